@@ -0,0 +1,13 @@
+// Imported by test_import_inline.gs.
+@noinline
+def factor() -> int {
+    return 3;
+}
+
+def offset() -> int {
+    return 1;
+}
+
+def apply(x: int) -> int {
+    return factor() * x + offset();
+}
@@ -0,0 +1,28 @@
+// new [n]T is an array that knows its length: every index is checked
+// (data[10] would stop the program with status 1), and -O drops the checks
+// range analysis proves redundant (-g keeps them all).
+def histogram(data: []int, bins: []int) -> int {
+    for i in 0..data.len {
+        let b = data[i] % 4;
+        bins[b] = bins[b] + 1;
+    }
+    return 0;
+}
+
+def main() -> int {
+    let data = new [10]int;
+    for i in 0..10 {
+        data[i] = i * 7;
+    }
+    let bins = new [4]int;
+    for i in 0..4 {
+        bins[i] = 0;
+    }
+    histogram(data, bins);
+    for b in bins {
+        println(b);
+    }
+    delete data;
+    delete bins;
+    return 0;
+}
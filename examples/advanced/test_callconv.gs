@@ -0,0 +1,38 @@
+// Calls with -m64 on Linux: nine int and ten float arguments spill past the
+// registers to the stack, structs come back by value, and ldiv from C
+// returns its two-word ldiv_t in rax:rdx.
+struct LDiv { quot: int; rem: int; }
+struct Vec3 { x: float; y: float; z: float; }
+
+extern "C" def ldiv(num: int, den: int) -> LDiv;
+
+def weigh(a: int, b: int, c: int, d: int, e: int, f: int, g: int, h: int, i: int) -> int {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i;
+}
+
+def total(a: float, b: float, c: float, d: float, e: float, f: float, g: float, h: float, i: float, j: float) -> float {
+    return a + b + c + d + e + f + g + h + i + j;
+}
+
+def scale(v: Vec3, k: float) -> Vec3 {
+    var r: Vec3;
+    r.x = v.x * k;
+    r.y = v.y * k;
+    r.z = v.z * k;
+    return r;
+}
+
+def main() -> int {
+    println(weigh(1, 2, 3, 4, 5, 6, 7, 8, 9));  // 285
+    println_float(total(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0));  // 55.0
+    var v: Vec3;
+    v.x = 1.0;
+    v.y = 2.0;
+    v.z = 3.0;
+    var w: Vec3 = scale(scale(v, 2.0), 0.5);
+    println_float(w.z);  // 3.0
+    var d: LDiv = ldiv(47, 5);
+    println(d.quot);  // 9
+    println(d.rem);   // 2
+    return 0;
+}
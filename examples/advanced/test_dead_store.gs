@@ -0,0 +1,14 @@
+// Under -O, v's stores are dead once side(v) becomes side(33), so the let
+// goes away; the call in the second store still runs, as a statement of its
+// own. Builds with -O and with -O --emit-ir, printing 33.
+@noinline
+def side(x: int) -> int {
+    println(x);
+    return x;
+}
+
+def main() -> int {
+    let v = 33;
+    v = side(v) + 1;
+    return 0;
+}
@@ -0,0 +1,8 @@
+// Under -O scale.apply is inlined into main: its calls of factor and offset
+// still mean the functions of scale, though main's module has neither.
+import scale;
+
+def main() -> int {
+    println(scale.apply(4));  // 13
+    return 0;
+}
@@ -0,0 +1,55 @@
+struct Vec2 {
+    x: float;
+    y: float;
+}
+
+class Box<T> {
+    value: T;
+}
+
+def get<T>(b: *Box<T>) -> T {
+    return b.value;
+}
+
+def dot(a: *Vec2, b: *Vec2) -> float {
+    return a.x * b.x + a.y * b.y;
+}
+
+def square(x: int) -> int {
+    return x * x;
+}
+
+@inline
+def poly(x: int) -> int {
+    return x * x * x * x + 3 * x * x * x + 2 * x * x + 7 * x + 1;
+}
+
+@noinline
+def cube(x: int) -> int {
+    return x * x * x;
+}
+
+// gsc test_inline.gs -m64 -O -Rpass=inline -Rpass-missed=inline
+def main() -> int {
+    let b = new Box<int>;
+    b.value = 42;
+    println(get<int>(b));
+
+    let v = new Vec2;
+    v.x = 1.5;
+    v.y = 2.0;
+    println_float(dot(v, v));
+
+    let sum = 0;
+    let i = 0;
+    while (i < 10) {
+        sum = square(i) + sum;
+        i = i + 1;
+    }
+    println(sum);
+    println(poly(2));
+    println(cube(3));
+    delete b;
+    delete v;
+    return 0;
+}
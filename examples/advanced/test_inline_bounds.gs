@@ -0,0 +1,26 @@
+// An argument whose check may fail keeps its check when the call is
+// inlined under -O: first(s[1], s[2]) is inlined, but pick uses y only when
+// c holds and five ignores x, so they are called instead, and five(s[10])
+// stops the program with status 1 as it does without -O.
+def five(x: int) -> int {
+    return 5;
+}
+
+def first(x: int, y: int) -> int {
+    return x + y;
+}
+
+def pick(c: bool, y: int) -> bool {
+    return c and y > 0;
+}
+
+def main() -> int {
+    let s = new [3]int;
+    s[1] = 4;
+    println(first(s[1], s[2]));  // 4
+    if (pick(false, s[10])) {
+        return 2;
+    }
+    println(five(s[10]));  // index 10 out of bounds for length 3
+    return 0;
+}
@@ -0,0 +1,22 @@
+// An argument that may trap is evaluated even when its call is inlined and
+// the parameter unused: k ignores x, yet let a = k(10 / z) divides by zero
+// under -O as without it (SIGFPE). Under -O 10 / z goes to a temporary set
+// before the let; *p + 1 is used once, first, and stays in place.
+def k(x: int) -> int {
+    return 5;
+}
+
+def inc(x: int) -> int {
+    return x + 1;
+}
+
+def main() -> int {
+    let p: *int = new int[1];
+    *p = 41;
+    println(inc(*p + 1));
+    delete p;
+    let z = 0;
+    let a = k(10 / z);
+    println(a);
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Dot product four lanes at a time, with a scalar tail.
+def dot(a: *float, b: *float, n: int) -> float {
+    let acc = f64x4(0.0);
+    let i = 0;
+    while (i + 4 <= n) {
+        acc = acc + vload(a + i) * vload(b + i);
+        i = i + 4;
+    }
+    let s = reduce_add(acc);
+    while (i < n) {
+        s = s + a[i] * b[i];
+        i = i + 1;
+    }
+    return s;
+}
+
+def main() -> int {
+    let n = 10;
+    let a: *float = new float[n];
+    let b: *float = new float[n];
+    let i = 0;
+    while (i < n) {
+        a[i] = 1.5;
+        b[i] = 2.0;
+        i = i + 1;
+    }
+    println_float(dot(a, b, n));  // 30.0
+
+    let v = i32x8(1, -2, 3, -4, 5, -6, 7, -8);
+    let w = v * i32x8(3) - i32x8(1);
+    println(extract(w, 7));       // -25
+    println(reduce_min(v));       // -8
+    println(reduce_add(insert(w, 0, 100)));  // 100 - 7 + 8 - 13 + 14 - 19 + 20 - 25 = 78
+
+    delete a;
+    delete b;
+    return 0;
+}
@@ -0,0 +1,30 @@
+// A slice []T is a pointer and a length. Indexing one is bounds-checked;
+// for-in walks it, or a range lo..hi, without checks.
+def sum(s: []int) -> int {
+    let t = 0;
+    for x in s {
+        t = t + x;
+    }
+    return t;
+}
+
+def dot(a: []int, b: []int) -> int {
+    let t = 0;
+    for i in 0..a.len {
+        t = t + a[i] * b[i];
+    }
+    return t;
+}
+
+def main() -> int {
+    let p = new int[8];
+    for i in 0..8 {
+        p[i] = i + 1;
+    }
+    let all = p[0..8];
+    println(sum(all));
+    println(sum(all[2..5]));
+    println(dot(all, all));
+    delete p;
+    return 0;
+}
@@ -0,0 +1,36 @@
+// @soa keeps each member of new T[n] in an array of its own, so a loop
+// over one member reads contiguous memory. ps.mass is ps[0].mass, as for
+// the single element of new Particle.
+@soa class Particle {
+    pos: float;
+    vel: float;
+    mass: int;
+}
+
+def main() -> int {
+    let n = 4;
+    let ps: *Particle = new Particle[n];
+    let i = 0;
+    while (i < n) {
+        ps[i].mass = i + 1;
+        i = i + 1;
+    }
+
+    let total = 0;
+    i = 0;
+    while (i < n) {
+        total = total + ps[i].mass;
+        i = i + 1;
+    }
+    println(total);
+    println(ps.mass);  // 1
+
+    let one: *Particle = new Particle;
+    one.mass = 3;
+    one.vel = 0.5;
+    println(one.mass);
+
+    delete ps;
+    delete one;
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Tail calls under -O: gcd and sum return a call of themselves and run as
+// loops, so sum(50000, 0) runs in one frame; even returns a call of odd,
+// which on x86-64 jumps to it instead of calling it.
+def gcd(a: int, b: int) -> int {
+    if (b == 0) {
+        return a;
+    } else {
+        return gcd(b, a % b);
+    }
+}
+
+def sum(n: int, acc: int) -> int {
+    if (n == 0) {
+        return acc;
+    }
+    return sum(n - 1, acc + n % 7);
+}
+
+@noinline
+def odd(n: int) -> int {
+    return n % 2;
+}
+
+@noinline
+def even(n: int) -> int {
+    return odd(n + 1);
+}
+
+def main() -> int {
+    println(gcd(1071, 462));
+    println(gcd(17, 5));
+    println(even(10));
+    if (sum(1000, 0) != 3003) {
+        return 1;
+    }
+    println(sum(50000, 0));
+    return 0;
+}
@@ -0,0 +1,33 @@
+// gsc test_vectorize.gs -m64 -O -Rpass=vectorize -Rpass-missed=vectorize
+// vectorizes the loop in triple, and reports the one in hash as not
+// vectorized because its body stores to h rather than an element, though
+// -O has turned its p[i] into a pointer stepped next to i.
+def triple(a: *int, b: *int, n: int) -> int {
+    for i in 0..n {
+        a[i] = b[i] * 3;
+    }
+    return 0;
+}
+
+def hash(p: *int, n: int) -> int {
+    let h = 0;
+    let i = 0;
+    while (i < n) {
+        h = h * 31 + p[i];
+        i = i + 1;
+    }
+    return h;
+}
+
+def main() -> int {
+    let a: *int = new int[3];
+    let b: *int = new int[3];
+    b[0] = 1;
+    b[1] = 2;
+    b[2] = 3;
+    triple(a, b, 3);
+    println(hash(a, 3));  // 3078
+    delete a;
+    delete b;
+    return 0;
+}
@@ -4,7 +4,21 @@ class Point {
     y: int;
 }
 
+// Structs are values: p is a copy of the caller's point.
+def manhattan(p: Point) -> int {
+    return p.x + p.y;
+}
+
 def main() -> int {
-    println(42);
+    var p: Point;          // lives on the stack
+    p.x = 40;
+    p.y = 2;
+    println(manhattan(p));
+
+    // Contiguous array of points, no per-element allocation
+    let pts: *Point = new Point[3];
+    (pts + 1).x = 7;
+    println((pts + 1).x);
+    delete pts;
     return 0;
 }
@@ -0,0 +1,62 @@
+#include "arena.h"
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+
+namespace gspp {
+
+Arena::Arena(size_t blockSize) : blockSize_(blockSize) {}
+
+Arena::~Arena() {
+    reset();
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size >= sizeof(void*) && align <= alignof(std::max_align_t)) {
+        auto it = freeLists_.find(size);
+        if (it != freeLists_.end() && it->second) {
+            void* p = it->second;
+            it->second = *static_cast<void**>(p);
+            return p;
+        }
+    }
+    uintptr_t p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+    if (!cur_ || p + size > (uintptr_t)end_) {
+        // Oversized requests get a block of their own.
+        size_t n = std::max(blockSize_, size + align);
+        char* block = static_cast<char*>(std::malloc(n));
+        if (!block) throw std::bad_alloc();
+        blocks_.push_back(block);
+        cur_ = block;
+        end_ = block + n;
+        p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    used_ += size;
+    return reinterpret_cast<void*>(p);
+}
+
+void Arena::recycle(void* p, size_t size) {
+    if (!p || size < sizeof(void*)) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    void*& head = freeLists_[size];
+    *static_cast<void**>(p) = head;
+    head = p;
+}
+
+void Arena::reset() {
+    for (char* b : blocks_) std::free(b);
+    blocks_.clear();
+    cur_ = end_ = nullptr;
+    used_ = 0;
+    freeLists_.clear();
+}
+
+Arena& Arena::ast() {
+    static Arena arena;
+    return arena;
+}
+
+} // namespace gspp
@@ -0,0 +1,53 @@
+#ifndef GSPP_ARENA_H
+#define GSPP_ARENA_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace gspp {
+
+// Bump allocator: memory is carved sequentially out of large blocks and only
+// released all at once when the arena is reset or destroyed. Pointers stay
+// valid for the arena's lifetime. allocate() and recycle() may be called
+// from several threads.
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 256 * 1024);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    // Makes a node-sized chunk available to later allocate() calls of the
+    // same size, so short-lived temporaries do not grow the arena.
+    void recycle(void* p, size_t size);
+    void reset();
+    size_t bytesUsed() const { return used_; }
+    size_t blockCount() const { return blocks_.size(); }
+
+    // Arena holding AST and Type nodes for the whole compilation.
+    static Arena& ast();
+
+private:
+    size_t blockSize_;
+    std::vector<char*> blocks_;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    size_t used_ = 0;
+    std::unordered_map<size_t, void*> freeLists_;  // size -> intrusive singly linked list
+    std::mutex mutex_;
+};
+
+// Base for node types that live in Arena::ast(). Destructors still run (so
+// owned strings and vectors are freed); the node storage is recycled for
+// nodes of the same size and returned to the system in bulk with the arena.
+struct ArenaNode {
+    static void* operator new(size_t size) { return Arena::ast().allocate(size); }
+    static void operator delete(void* p, size_t size) { Arena::ast().recycle(p, size); }
+};
+
+} // namespace gspp
+
+#endif
@@ -0,0 +1,1146 @@
+#include "assembler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace gspp {
+
+struct Assembler::Operand {
+    enum class Kind { Reg, Imm, Mem } kind = Kind::Imm;
+    int reg = -1;
+    int size = 0;  // Reg: 1, 2, 4, 8, or 16 for %xmm
+    bool xmm = false;
+    bool highByte = false;  // %ah..%bh
+    int64_t value = 0;      // Imm value or Mem displacement
+    std::string symbol;     // Imm/Mem symbolic part
+    int base = -1;
+    int index = -1;
+    int scale = 1;
+    bool rip = false;
+    bool indirect = false;  // '*' prefix on call/jmp operands
+
+    bool isReg() const { return kind == Kind::Reg; }
+    bool isGpr() const { return kind == Kind::Reg && !xmm; }
+    bool isImm() const { return kind == Kind::Imm; }
+    bool isMem() const { return kind == Kind::Mem; }
+    // A bare symbol, which call/jmp/jcc treat as a branch target.
+    bool isLabel() const { return isMem() && !indirect && base < 0 && index < 0 && !rip && !symbol.empty() && value == 0; }
+};
+
+namespace {
+
+const char* const kReg64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                              "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+const char* const kReg32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                              "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char* const kReg16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+                              "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+const char* const kReg8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                             "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char* const kRegHigh[] = {"ah", "ch", "dh", "bh"};
+
+struct ZeroOperandOp { const char* name; std::vector<uint8_t> bytes; };
+const ZeroOperandOp kZeroOperand[] = {
+    {"ret", {0xC3}}, {"retq", {0xC3}}, {"leave", {0xC9}}, {"leaveq", {0xC9}}, {"nop", {0x90}},
+    {"cqto", {0x48, 0x99}}, {"cqo", {0x48, 0x99}}, {"cltq", {0x48, 0x98}}, {"cdqe", {0x48, 0x98}},
+    {"cltd", {0x99}}, {"cdq", {0x99}}, {"int3", {0xCC}}, {"hlt", {0xF4}}, {"pause", {0xF3, 0x90}},
+    {"syscall", {0x0F, 0x05}}, {"ud2", {0x0F, 0x0B}},
+};
+
+// SSE instructions of the form "op xmm/m, xmm" (and "op xmm, m" when a store
+// opcode exists). prefix is the mandatory 66/F2/F3 byte or 0.
+struct SseOp { const char* name; uint8_t prefix; std::vector<uint8_t> opcode; uint8_t store; };
+const SseOp kSse[] = {
+    {"movsd", 0xF2, {0x10}, 0x11}, {"movss", 0xF3, {0x10}, 0x11},
+    {"movapd", 0x66, {0x28}, 0x29}, {"movaps", 0, {0x28}, 0x29},
+    {"movupd", 0x66, {0x10}, 0x11}, {"movups", 0, {0x10}, 0x11},
+    {"movdqa", 0x66, {0x6F}, 0x7F}, {"movdqu", 0xF3, {0x6F}, 0x7F},
+    {"addsd", 0xF2, {0x58}, 0}, {"mulsd", 0xF2, {0x59}, 0}, {"subsd", 0xF2, {0x5C}, 0},
+    {"divsd", 0xF2, {0x5E}, 0}, {"sqrtsd", 0xF2, {0x51}, 0}, {"minsd", 0xF2, {0x5D}, 0}, {"maxsd", 0xF2, {0x5F}, 0},
+    {"addss", 0xF3, {0x58}, 0}, {"mulss", 0xF3, {0x59}, 0}, {"subss", 0xF3, {0x5C}, 0}, {"divss", 0xF3, {0x5E}, 0},
+    {"addpd", 0x66, {0x58}, 0}, {"mulpd", 0x66, {0x59}, 0}, {"subpd", 0x66, {0x5C}, 0}, {"divpd", 0x66, {0x5E}, 0},
+    {"addps", 0, {0x58}, 0}, {"mulps", 0, {0x59}, 0}, {"subps", 0, {0x5C}, 0}, {"divps", 0, {0x5E}, 0},
+    {"ucomisd", 0x66, {0x2E}, 0}, {"comisd", 0x66, {0x2F}, 0}, {"ucomiss", 0, {0x2E}, 0}, {"comiss", 0, {0x2F}, 0},
+    {"andpd", 0x66, {0x54}, 0}, {"andps", 0, {0x54}, 0}, {"andnpd", 0x66, {0x55}, 0},
+    {"orpd", 0x66, {0x56}, 0}, {"orps", 0, {0x56}, 0}, {"xorpd", 0x66, {0x57}, 0}, {"xorps", 0, {0x57}, 0},
+    {"cvtsd2ss", 0xF2, {0x5A}, 0}, {"cvtss2sd", 0xF3, {0x5A}, 0},
+    {"unpcklpd", 0x66, {0x14}, 0}, {"unpckhpd", 0x66, {0x15}, 0},
+    {"pxor", 0x66, {0xEF}, 0}, {"pand", 0x66, {0xDB}, 0}, {"pandn", 0x66, {0xDF}, 0}, {"por", 0x66, {0xEB}, 0},
+    {"minpd", 0x66, {0x5D}, 0}, {"maxpd", 0x66, {0x5F}, 0}, {"pcmpgtd", 0x66, {0x66}, 0},
+    {"punpckldq", 0x66, {0x62}, 0}, {"punpckhdq", 0x66, {0x6A}, 0},
+    {"paddd", 0x66, {0xFE}, 0}, {"paddq", 0x66, {0xD4}, 0}, {"psubd", 0x66, {0xFA}, 0}, {"psubq", 0x66, {0xFB}, 0},
+    {"pmulld", 0x66, {0x38, 0x40}, 0}, {"pmuludq", 0x66, {0xF4}, 0},
+    {"punpcklqdq", 0x66, {0x6C}, 0}, {"punpckhqdq", 0x66, {0x6D}, 0},
+};
+
+// SSE2 shifts by an immediate count, "op $imm, xmm": 66 0F opcode /digit ib.
+struct SseShiftOp { const char* name; uint8_t opcode; int digit; };
+const SseShiftOp kSseShift[] = {
+    {"psrld", 0x72, 2}, {"psrad", 0x72, 4}, {"pslld", 0x72, 6},
+    {"psrlq", 0x73, 2}, {"psrldq", 0x73, 3}, {"psllq", 0x73, 6}, {"pslldq", 0x73, 7},
+};
+
+const SseOp* findSse(const std::string& name) {
+    for (const auto& op : kSse)
+        if (name == op.name) return &op;
+    return nullptr;
+}
+
+// Shuffles with an immediate selector, "op $imm, xmm/m, xmm".
+struct SseShuffleOp { const char* name; uint8_t prefix; uint8_t opcode; };
+const SseShuffleOp kSseShuffle[] = {{"pshufd", 0x66, 0x70}, {"shufps", 0, 0xC6}, {"shufpd", 0x66, 0xC6}};
+
+const SseShuffleOp* findSseShuffle(const std::string& name) {
+    for (const auto& op : kSseShuffle)
+        if (name == op.name) return &op;
+    return nullptr;
+}
+
+const SseShiftOp* findSseShift(const std::string& name) {
+    for (const auto& op : kSseShift)
+        if (name == op.name) return &op;
+    return nullptr;
+}
+
+// Two-operand extensions: opcode after 0F, source and destination sizes.
+struct ExtendOp { const char* name; uint8_t opcode; int srcSize; int dstSize; };
+const ExtendOp kExtend[] = {
+    {"movzbw", 0xB6, 1, 2}, {"movzbl", 0xB6, 1, 4}, {"movzbq", 0xB6, 1, 8},
+    {"movzwl", 0xB7, 2, 4}, {"movzwq", 0xB7, 2, 8},
+    {"movsbw", 0xBE, 1, 2}, {"movsbl", 0xBE, 1, 4}, {"movsbq", 0xBE, 1, 8},
+    {"movswl", 0xBF, 2, 4}, {"movswq", 0xBF, 2, 8},
+};
+
+int conditionCode(const std::string& cc) {
+    static const std::unordered_map<std::string, int> codes = {
+        {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+        {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+        {"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+        {"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15}};
+    auto it = codes.find(cc);
+    return it == codes.end() ? -1 : it->second;
+}
+
+// Mnemonics taking an operand-size suffix, with their ModRM /digit where one applies.
+const std::unordered_map<std::string, int> kAluDigit = {
+    {"add", 0}, {"or", 1}, {"adc", 2}, {"sbb", 3}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7}};
+const std::unordered_map<std::string, int> kUnaryDigit = {
+    {"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7}};
+const std::unordered_map<std::string, int> kShiftDigit = {
+    {"rol", 0}, {"ror", 1}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7}};
+
+bool isSizedBase(const std::string& m) {
+    return kAluDigit.count(m) || kUnaryDigit.count(m) || kShiftDigit.count(m) || m == "mov" || m == "test" ||
+           m == "lea" || m == "imul" || m == "inc" || m == "dec" || m == "push" || m == "pop";
+}
+
+int suffixSize(char c) {
+    switch (c) {
+        case 'b': return 1;
+        case 'w': return 2;
+        case 'l': return 4;
+        case 'q': return 8;
+    }
+    return 0;
+}
+
+std::string trim(const std::string& s) {
+    size_t a = 0, b = s.size();
+    while (a < b && std::isspace((unsigned char)s[a])) a++;
+    while (b > a && std::isspace((unsigned char)s[b - 1])) b--;
+    return s.substr(a, b - a);
+}
+
+std::string lower(std::string s) {
+    for (char& c : s) c = (char)std::tolower((unsigned char)c);
+    return s;
+}
+
+bool isSymbolChar(char c) {
+    return std::isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+// Splits on top-level commas (outside parentheses and quotes).
+std::vector<std::string> splitOperands(const std::string& s) {
+    std::vector<std::string> parts;
+    std::string cur;
+    int depth = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (quoted) {
+            cur += c;
+            if (c == '\\' && i + 1 < s.size()) cur += s[++i];
+            else if (c == '"') quoted = false;
+            continue;
+        }
+        if (c == '"') quoted = true;
+        else if (c == '(') depth++;
+        else if (c == ')') depth--;
+        else if (c == ',' && depth == 0) {
+            parts.push_back(trim(cur));
+            cur.clear();
+            continue;
+        }
+        cur += c;
+    }
+    if (!trim(cur).empty() || !parts.empty()) parts.push_back(trim(cur));
+    return parts;
+}
+
+bool fitsInt8(int64_t v) { return v >= -128 && v <= 127; }
+bool fitsInt32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+// Interprets the low `size` bytes of v as a signed value.
+int64_t truncateSigned(int64_t v, int size) {
+    if (size >= 8) return v;
+    int shift = 64 - size * 8;
+    return (int64_t)((uint64_t)v << shift) >> shift;
+}
+
+bool fitsSize(int64_t v, int size) {
+    if (size >= 8) return true;
+    int64_t lo = -((int64_t)1 << (size * 8 - 1));
+    int64_t hi = ((int64_t)1 << (size * 8)) - 1;
+    return v >= lo && v <= hi;
+}
+
+// Pads code with the recommended multi-byte NOP forms (at most 9 bytes each).
+void appendNops(std::vector<uint8_t>& out, size_t n) {
+    static const std::vector<uint8_t> kNops[] = {
+        {0x90}, {0x66, 0x90}, {0x0F, 0x1F, 0x00}, {0x0F, 0x1F, 0x40, 0x00}, {0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00}, {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}};
+    while (n > 0) {
+        size_t k = std::min<size_t>(n, 9);
+        out.insert(out.end(), kNops[k - 1].begin(), kNops[k - 1].end());
+        n -= k;
+    }
+}
+
+} // namespace
+
+uint64_t Assembler::Fragment::size() const {
+    if (branch) return longForm ? (cond < 0 ? 5 : 6) : 2;
+    return bytes.size();
+}
+
+Assembler::Assembler() {
+    switchSection(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR);
+    switchSection(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE);
+    switchSection(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE);
+    // Marks the stack non-executable, as GNU as does on Linux.
+    switchSection(".note.GNU-stack", SHT_PROGBITS, 0);
+    cur_ = 0;
+}
+
+bool Assembler::error(const std::string& msg) {
+    errors_.push_back("assembler: " + msg + (line_.empty() ? "" : " in '" + line_ + "'"));
+    return false;
+}
+
+void Assembler::switchSection(const std::string& name, uint32_t type, uint64_t flags, const std::string& group) {
+    for (size_t i = 0; i < obj_.sections.size(); i++) {
+        if (obj_.sections[i].name == name) {
+            cur_ = (int)i;
+            return;
+        }
+    }
+    ObjSection sec;
+    sec.name = name;
+    sec.type = type;
+    sec.flags = flags;
+    sec.group = group;
+    obj_.sections.push_back(sec);
+    frags_.emplace_back();
+    cur_ = (int)obj_.sections.size() - 1;
+}
+
+Assembler::Fragment& Assembler::frag() {
+    auto& fs = frags_[cur_];
+    if (fs.empty() || fs.back().branch || fs.back().align) fs.emplace_back();
+    return fs.back();
+}
+
+bool Assembler::assemble(const std::string& source) {
+    // Split into statements: newlines and ';' separate them, '#' starts a comment.
+    std::vector<std::string> statements;
+    std::string cur;
+    bool quoted = false, comment = false;
+    for (size_t i = 0; i <= source.size(); i++) {
+        char c = i < source.size() ? source[i] : '\n';
+        if (c == '\n') {
+            statements.push_back(cur);
+            cur.clear();
+            quoted = comment = false;
+            continue;
+        }
+        if (comment) continue;
+        if (quoted) {
+            cur += c;
+            if (c == '\\' && i + 1 < source.size() && source[i + 1] != '\n') cur += source[++i];
+            else if (c == '"') quoted = false;
+            continue;
+        }
+        if (c == '"') quoted = true;
+        else if (c == '#') { comment = true; continue; }
+        else if (c == ';') { statements.push_back(cur); cur.clear(); continue; }
+        cur += c;
+    }
+    for (const auto& s : statements) {
+        line_ = trim(s);
+        if (!statement(line_)) return false;
+    }
+    line_.clear();
+
+    for (size_t s = 0; s < obj_.sections.size(); s++) layout((int)s);
+    for (size_t s = 0; s < obj_.sections.size(); s++) finish((int)s);
+    if (!errors_.empty()) return false;
+
+    // Symbols: named labels (".L" labels stay assembler-local), then
+    // globals declared or referenced without a definition.
+    for (const auto& name : labelOrder_) {
+        if (name.compare(0, 2, ".L") == 0 && !globals_.count(name)) continue;
+        const Label& l = labels_.at(name);
+        obj_.symbols.push_back({name, l.section, labelOffset(l), globals_.count(name) > 0, functions_.count(name) > 0,
+                                weak_.count(name) > 0});
+    }
+    std::unordered_set<std::string> undefined;
+    for (const auto& name : referenced_) {
+        if (labels_.count(name) || !undefined.insert(name).second) continue;
+        obj_.symbols.push_back({name, -1, 0, true, false, weak_.count(name) > 0});
+    }
+    return true;
+}
+
+bool Assembler::statement(const std::string& line) {
+    std::string s = line;
+    while (true) {
+        if (s.empty()) return true;
+        size_t i = 0;
+        while (i < s.size() && isSymbolChar(s[i])) i++;
+        if (i == 0 || i >= s.size() || s[i] != ':') break;
+        std::string name = s.substr(0, i);
+        if (labels_.count(name)) return error("symbol '" + name + "' is already defined");
+        Fragment& f = frag();
+        labels_[name] = {cur_, frags_[cur_].size() - 1, f.bytes.size()};
+        labelOrder_.push_back(name);
+        s = trim(s.substr(i + 1));
+    }
+    size_t sp = 0;
+    while (sp < s.size() && !std::isspace((unsigned char)s[sp])) sp++;
+    std::string name = s.substr(0, sp);
+    std::string args = trim(s.substr(sp));
+    if (name[0] == '.') return directive(name, args);
+    return instruction(lower(name), args);
+}
+
+bool Assembler::directive(const std::string& name, const std::string& args) {
+    if (name == ".text") { switchSection(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR); return true; }
+    if (name == ".data") { switchSection(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE); return true; }
+    if (name == ".bss") { switchSection(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE); return true; }
+    if (name == ".section") {
+        std::vector<std::string> parts = splitOperands(args);
+        if (parts.empty() || parts[0].empty()) return error("missing section name");
+        const std::string& sec = parts[0];
+        uint32_t type = SHT_PROGBITS;
+        uint64_t flags = 0;
+        if (sec.compare(0, 5, ".text") == 0) flags = SHF_ALLOC | SHF_EXECINSTR;
+        else if (sec.compare(0, 5, ".data") == 0) flags = SHF_ALLOC | SHF_WRITE;
+        else if (sec.compare(0, 4, ".bss") == 0) { flags = SHF_ALLOC | SHF_WRITE; type = SHT_NOBITS; }
+        else if (sec.compare(0, 7, ".rodata") == 0) flags = SHF_ALLOC;
+        std::string group;
+        if (parts.size() > 1) {
+            std::string f = parts[1];
+            if (f.size() < 2 || f.front() != '"' || f.back() != '"') return error("malformed section flags");
+            flags = 0;
+            for (char c : f.substr(1, f.size() - 2)) {
+                if (c == 'a') flags |= SHF_ALLOC;
+                else if (c == 'w') flags |= SHF_WRITE;
+                else if (c == 'x') flags |= SHF_EXECINSTR;
+                else if (c == 'G') flags |= SHF_GROUP;
+                else return error(std::string("unsupported section flag '") + c + "'");
+            }
+        }
+        if (parts.size() > 2) {
+            if (parts[2] == "@nobits") type = SHT_NOBITS;
+            else if (parts[2] != "@progbits") return error("unsupported section type");
+        }
+        if (flags & SHF_GROUP) {
+            // Only COMDAT groups: ".section name,"axG",@progbits,signature,comdat".
+            if (parts.size() != 5 || parts[3].empty() || parts[4] != "comdat")
+                return error("unsupported section group");
+            group = parts[3];
+        }
+        switchSection(sec, type, flags, group);
+        return true;
+    }
+    if (name == ".globl" || name == ".global") {
+        for (const auto& sym : splitOperands(args)) globals_.insert(sym);
+        return true;
+    }
+    if (name == ".weak") {
+        for (const auto& sym : splitOperands(args)) {
+            globals_.insert(sym);
+            weak_.insert(sym);
+        }
+        return true;
+    }
+    if (name == ".type") {
+        std::vector<std::string> parts = splitOperands(args);
+        if (parts.size() == 2 && (parts[1] == "@function" || parts[1] == "%function")) functions_.insert(parts[0]);
+        return true;
+    }
+    if (name == ".extern" || name == ".file" || name == ".ident" || name == ".size" || name == ".local" ||
+        name == ".code64")
+        return true;
+    if (name == ".string" || name == ".asciz") return emitString(args, true);
+    if (name == ".ascii") return emitString(args, false);
+    if (name == ".byte") return emitData(args, 1);
+    if (name == ".short" || name == ".word" || name == ".value") return emitData(args, 2);
+    if (name == ".long" || name == ".int") return emitData(args, 4);
+    if (name == ".quad") return emitData(args, 8);
+    if (name == ".zero" || name == ".skip" || name == ".space") {
+        std::vector<std::string> parts = splitOperands(args);
+        int64_t n = 0, fill = 0;
+        std::string sym;
+        if (parts.empty() || !parseExpr(parts[0], n, sym) || !sym.empty() || n < 0) return error("bad size");
+        if (parts.size() > 1 && (!parseExpr(parts[1], fill, sym) || !sym.empty())) return error("bad fill value");
+        Fragment& f = frag();
+        f.bytes.insert(f.bytes.end(), (size_t)n, (uint8_t)fill);
+        return true;
+    }
+    if (name == ".align" || name == ".balign" || name == ".p2align") {
+        std::vector<std::string> parts = splitOperands(args);
+        int64_t n = 0, fill = -1;
+        std::string sym;
+        if (parts.empty() || !parseExpr(parts[0], n, sym) || !sym.empty() || n < 0 || n > 4096)
+            return error("bad alignment");
+        if (parts.size() > 1 && !parts[1].empty() && (!parseExpr(parts[1], fill, sym) || !sym.empty()))
+            return error("bad fill value");
+        uint64_t align = name == ".p2align" ? (uint64_t)1 << n : (uint64_t)n;
+        if (align == 0 || (align & (align - 1))) return error("alignment is not a power of two");
+        Fragment f;
+        f.align = align;
+        f.fill = (uint8_t)(fill >= 0 ? fill : 0);
+        f.nops = fill < 0 && (obj_.sections[cur_].flags & SHF_EXECINSTR);
+        frags_[cur_].push_back(f);
+        obj_.sections[cur_].align = std::max(obj_.sections[cur_].align, align);
+        return true;
+    }
+    return error("unsupported directive '" + name + "'");
+}
+
+bool Assembler::emitString(const std::string& args, bool terminate) {
+    for (const auto& part : splitOperands(args)) {
+        if (part.size() < 2 || part.front() != '"' || part.back() != '"') return error("expected string literal");
+        Fragment& f = frag();
+        for (size_t i = 1; i + 1 < part.size(); i++) {
+            char c = part[i];
+            if (c != '\\') { f.bytes.push_back((uint8_t)c); continue; }
+            c = part[++i];
+            switch (c) {
+                case 'n': f.bytes.push_back('\n'); break;
+                case 't': f.bytes.push_back('\t'); break;
+                case 'r': f.bytes.push_back('\r'); break;
+                case 'b': f.bytes.push_back('\b'); break;
+                case 'f': f.bytes.push_back('\f'); break;
+                case 'v': f.bytes.push_back('\v'); break;
+                case 'a': f.bytes.push_back('\a'); break;
+                case 'x': {
+                    int v = 0;
+                    while (i + 1 < part.size() - 1 && std::isxdigit((unsigned char)part[i + 1]))
+                        v = v * 16 + std::stoi(std::string(1, part[++i]), nullptr, 16);
+                    f.bytes.push_back((uint8_t)v);
+                    break;
+                }
+                default:
+                    if (c >= '0' && c <= '7') {
+                        int v = c - '0';
+                        for (int k = 0; k < 2 && i + 1 < part.size() - 1 && part[i + 1] >= '0' && part[i + 1] <= '7'; k++)
+                            v = v * 8 + (part[++i] - '0');
+                        f.bytes.push_back((uint8_t)v);
+                    } else {
+                        f.bytes.push_back((uint8_t)c);  // \\, \", and unknown escapes
+                    }
+                    break;
+            }
+        }
+        if (terminate) f.bytes.push_back(0);
+    }
+    return true;
+}
+
+bool Assembler::emitData(const std::string& args, int size) {
+    for (const auto& part : splitOperands(args)) {
+        int64_t v = 0;
+        std::string sym;
+        if (!parseExpr(part, v, sym)) return error("bad data value '" + part + "'");
+        if (!sym.empty() && size < 4) return error("symbol in a data directive narrower than 4 bytes");
+        if (sym.empty() && !fitsSize(v, size)) return error("value does not fit in " + std::to_string(size) + " bytes");
+        emitImm(v, sym, size, size == 8 ? R_X86_64_64 : R_X86_64_32);
+    }
+    return true;
+}
+
+bool Assembler::parseExpr(const std::string& text, int64_t& value, std::string& symbol) {
+    value = 0;
+    symbol.clear();
+    std::string t = trim(text);
+    size_t i = 0;
+    bool expectTerm = true;
+    int sign = 1;
+    while (i < t.size()) {
+        char c = t[i];
+        if (std::isspace((unsigned char)c)) { i++; continue; }
+        if (c == '+' || c == '-') {
+            if (c == '-') sign = -sign;
+            expectTerm = true;
+            i++;
+            continue;
+        }
+        if (!expectTerm) return false;
+        if (std::isdigit((unsigned char)c)) {
+            size_t j = i;
+            while (j < t.size() && std::isalnum((unsigned char)t[j])) j++;
+            std::string num = lower(t.substr(i, j - i));
+            int base = 10;
+            size_t start = 0;
+            if (num.size() > 2 && num[0] == '0' && num[1] == 'x') { base = 16; start = 2; }
+            else if (num.size() > 2 && num[0] == '0' && num[1] == 'b') { base = 2; start = 2; }
+            else if (num.size() > 1 && num[0] == '0') { base = 8; start = 1; }
+            char* end = nullptr;
+            uint64_t v = std::strtoull(num.c_str() + start, &end, base);
+            if (*end) return false;
+            value += sign * (int64_t)v;
+            i = j;
+        } else if (c == '\'' && i + 1 < t.size()) {
+            value += sign * (int64_t)(unsigned char)t[i + 1];
+            i += 2;
+            if (i < t.size() && t[i] == '\'') i++;
+        } else if (isSymbolChar(c)) {
+            size_t j = i;
+            while (j < t.size() && isSymbolChar(t[j])) j++;
+            if (!symbol.empty() || sign < 0) return false;
+            symbol = t.substr(i, j - i);
+            i = j;
+            if (t.compare(i, 4, "@PLT") == 0) i += 4;
+        } else {
+            return false;
+        }
+        expectTerm = false;
+        sign = 1;
+    }
+    return !expectTerm;
+}
+
+bool Assembler::parseOperand(const std::string& text, Operand& op) {
+    std::string t = trim(text);
+    if (t.empty()) return error("missing operand");
+    if (t[0] == '*') {
+        op.indirect = true;
+        t = trim(t.substr(1));
+    }
+    auto parseReg = [&](const std::string& name, Operand& r) {
+        std::string n = lower(name);
+        for (int i = 0; i < 16; i++) {
+            if (n == kReg64[i]) { r.reg = i; r.size = 8; return true; }
+            if (n == kReg32[i]) { r.reg = i; r.size = 4; return true; }
+            if (n == kReg16[i]) { r.reg = i; r.size = 2; return true; }
+            if (n == kReg8[i]) { r.reg = i; r.size = 1; return true; }
+        }
+        for (int i = 0; i < 4; i++)
+            if (n == kRegHigh[i]) { r.reg = i + 4; r.size = 1; r.highByte = true; return true; }
+        if (n.compare(0, 3, "xmm") == 0 && n.size() > 3 && n.size() <= 5 &&
+            std::all_of(n.begin() + 3, n.end(), [](char c) { return std::isdigit((unsigned char)c); })) {
+            r.reg = std::atoi(n.c_str() + 3);
+            r.size = 16;
+            r.xmm = true;
+            return r.reg < 16;
+        }
+        return false;
+    };
+    if (t[0] == '$') {
+        op.kind = Operand::Kind::Imm;
+        if (!parseExpr(t.substr(1), op.value, op.symbol)) return error("bad immediate '" + t + "'");
+        return true;
+    }
+    size_t lp = t.find('(');
+    if (t[0] == '%' && lp == std::string::npos) {
+        op.kind = Operand::Kind::Reg;
+        if (!parseReg(t.substr(1), op)) return error("unknown register '" + t + "'");
+        return true;
+    }
+    op.kind = Operand::Kind::Mem;
+    std::string disp = trim(t.substr(0, lp));
+    if (!disp.empty() && !parseExpr(disp, op.value, op.symbol)) return error("bad displacement '" + disp + "'");
+    if (lp == std::string::npos) return true;
+    if (t.back() != ')') return error("malformed memory operand '" + t + "'");
+    std::vector<std::string> parts = splitOperands(t.substr(lp + 1, t.size() - lp - 2));
+    if (parts.empty() || parts.size() > 3) return error("malformed memory operand '" + t + "'");
+    auto addrReg = [&](const std::string& s, int& out) {
+        if (s.empty()) return true;
+        Operand r;
+        if (s[0] != '%' || !parseReg(s.substr(1), r) || r.size != 8 || r.xmm) return false;
+        out = r.reg;
+        return true;
+    };
+    if (lower(parts[0]) == "%rip") {
+        if (parts.size() != 1) return error("%rip cannot be used with an index");
+        op.rip = true;
+        return true;
+    }
+    if (!addrReg(parts[0], op.base)) return error("bad base register in '" + t + "'");
+    if (parts.size() > 1 && !addrReg(parts[1], op.index)) return error("bad index register in '" + t + "'");
+    if (op.index == 4) return error("%rsp cannot be an index register");
+    if (parts.size() > 2) {
+        op.scale = std::atoi(parts[2].c_str());
+        if (op.scale != 1 && op.scale != 2 && op.scale != 4 && op.scale != 8) return error("bad scale in '" + t + "'");
+    }
+    return true;
+}
+
+void Assembler::emitPlain(const std::vector<uint8_t>& prefixes, uint8_t rex, const std::vector<uint8_t>& opcode) {
+    Fragment& f = frag();
+    f.bytes.insert(f.bytes.end(), prefixes.begin(), prefixes.end());
+    if (rex) f.bytes.push_back(rex);
+    f.bytes.insert(f.bytes.end(), opcode.begin(), opcode.end());
+}
+
+void Assembler::emitImm(int64_t value, const std::string& symbol, int size, uint32_t relocType) {
+    Fragment& f = frag();
+    if (!symbol.empty()) {
+        Fixup fx;
+        fx.offset = f.bytes.size();
+        fx.size = size;
+        fx.type = relocType;
+        fx.symbol = symbol;
+        fx.addend = value;
+        f.fixups.push_back(fx);
+        value = 0;
+    }
+    for (int i = 0; i < size; i++) f.bytes.push_back((uint8_t)((uint64_t)value >> (8 * i)));
+}
+
+bool Assembler::encodeRM(const std::vector<uint8_t>& prefixes, bool rexW, const std::vector<uint8_t>& opcode,
+                         int regField, const Operand* regOp, const Operand& rm, int immSize) {
+    uint8_t rex = rexW ? 0x48 : 0;
+    bool needRex = false, high = false;
+    auto checkByteReg = [&](const Operand* o) {
+        if (!o || !o->isReg() || o->size != 1) return;
+        if (o->highByte) high = true;
+        else if (o->reg >= 4 && o->reg < 8) needRex = true;
+    };
+    checkByteReg(regOp);
+    checkByteReg(&rm);
+    int reg = regOp ? regOp->reg : regField;
+    if (reg & 8) rex |= 0x44;
+
+    std::vector<uint8_t> tail;
+    Fixup fx;
+    bool hasFixup = false;
+    int dispSize = 0;
+    int64_t disp = rm.value;
+    if (rm.isReg()) {
+        if (rm.reg & 8) rex |= 0x41;
+        tail.push_back((uint8_t)(0xC0 | (reg & 7) << 3 | (rm.reg & 7)));
+    } else if (rm.isMem()) {
+        int scaleBits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        if (rm.index >= 0 && (rm.index & 8)) rex |= 0x42;
+        if (rm.base >= 0 && (rm.base & 8)) rex |= 0x41;
+        if (rm.rip) {
+            tail.push_back((uint8_t)(0x05 | (reg & 7) << 3));
+            dispSize = 4;
+            if (!rm.symbol.empty()) {
+                hasFixup = true;
+                fx.type = R_X86_64_PC32;
+                fx.addend = rm.value - 4 - immSize;
+            }
+        } else if (rm.base < 0) {
+            tail.push_back((uint8_t)(0x04 | (reg & 7) << 3));
+            int idx = rm.index < 0 ? 4 : (rm.index & 7);
+            tail.push_back((uint8_t)(scaleBits << 6 | idx << 3 | 5));
+            dispSize = 4;
+            if (!rm.symbol.empty()) {
+                hasFixup = true;
+                fx.type = R_X86_64_32S;
+                fx.addend = rm.value;
+            }
+        } else {
+            int mod;
+            if (!rm.symbol.empty()) mod = 2;
+            else if (disp == 0 && (rm.base & 7) != 5) mod = 0;
+            else if (fitsInt8(disp)) mod = 1;
+            else mod = 2;
+            if (rm.index < 0 && (rm.base & 7) != 4) {
+                tail.push_back((uint8_t)(mod << 6 | (reg & 7) << 3 | (rm.base & 7)));
+            } else {
+                tail.push_back((uint8_t)(mod << 6 | (reg & 7) << 3 | 4));
+                int idx = rm.index < 0 ? 4 : (rm.index & 7);
+                tail.push_back((uint8_t)(scaleBits << 6 | idx << 3 | (rm.base & 7)));
+            }
+            dispSize = mod == 1 ? 1 : mod == 2 ? 4 : 0;
+            if (!rm.symbol.empty()) {
+                hasFixup = true;
+                fx.type = R_X86_64_32S;
+                fx.addend = rm.value;
+            }
+        }
+        if (!hasFixup && dispSize == 4 && !fitsInt32(disp)) return error("displacement out of range");
+    } else {
+        return error("operand must be a register or memory reference");
+    }
+    if (needRex && !rex) rex = 0x40;
+    if (high && rex) return error("%ah..%bh cannot be encoded with a REX prefix");
+
+    emitPlain(prefixes, rex, opcode);
+    Fragment& f = frag();
+    f.bytes.insert(f.bytes.end(), tail.begin(), tail.end());
+    if (hasFixup) {
+        fx.offset = f.bytes.size();
+        fx.size = 4;
+        fx.symbol = rm.symbol;
+        f.fixups.push_back(fx);
+        disp = 0;
+    }
+    for (int i = 0; i < dispSize; i++) f.bytes.push_back((uint8_t)((uint64_t)disp >> (8 * i)));
+    return true;
+}
+
+void Assembler::emitBranch(int cond, const std::string& target) {
+    Fragment f;
+    f.branch = true;
+    f.cond = cond;
+    f.target = target;
+    frags_[cur_].push_back(f);
+    referenced_.push_back(target);
+}
+
+bool Assembler::encodeAlu(int digit, int size, const Operand& src, const Operand& dst) {
+    std::vector<uint8_t> pfx;
+    if (size == 2) pfx.push_back(0x66);
+    bool w = size == 8;
+    if (src.isImm()) {
+        if (src.symbol.empty() && !fitsSize(src.value, size == 8 ? 4 : size) && !(size == 8 && fitsInt32(src.value)))
+            return error("immediate out of range");
+        int64_t v = truncateSigned(src.value, size);
+        uint32_t reloc = size == 8 ? R_X86_64_32S : R_X86_64_32;
+        if (size == 1) {
+            if (dst.isReg() && dst.reg == 0 && !dst.highByte) emitPlain(pfx, 0, {(uint8_t)(0x04 + digit * 8)});
+            else if (!encodeRM(pfx, false, {0x80}, digit, nullptr, dst, 1)) return false;
+            emitImm(v, src.symbol, 1, reloc);
+        } else if (src.symbol.empty() && fitsInt8(v)) {
+            if (!encodeRM(pfx, w, {0x83}, digit, nullptr, dst, 1)) return false;
+            emitImm(v, "", 1, reloc);
+        } else {
+            int immSize = size == 2 ? 2 : 4;
+            if (dst.isReg() && dst.reg == 0) emitPlain(pfx, w ? 0x48 : 0, {(uint8_t)(0x05 + digit * 8)});
+            else if (!encodeRM(pfx, w, {0x81}, digit, nullptr, dst, immSize)) return false;
+            emitImm(v, src.symbol, immSize, reloc);
+        }
+        return true;
+    }
+    if (src.isGpr()) return encodeRM(pfx, w, {(uint8_t)(digit * 8 + (size == 1 ? 0 : 1))}, 0, &src, dst, 0);
+    if (src.isMem() && dst.isGpr()) return encodeRM(pfx, w, {(uint8_t)(digit * 8 + (size == 1 ? 2 : 3))}, 0, &dst, src, 0);
+    return error("invalid operands");
+}
+
+bool Assembler::encodeMov(int size, const Operand& src, const Operand& dst) {
+    std::vector<uint8_t> pfx;
+    if (size == 2) pfx.push_back(0x66);
+    bool w = size == 8;
+    if (src.isImm()) {
+        if (src.symbol.empty() && !fitsSize(src.value, size)) return error("immediate out of range");
+        if (dst.isGpr()) {
+            if (size == 8) {
+                if (src.symbol.empty() && !fitsInt32(src.value)) {
+                    // Like GNU as, promote to movabs when the value needs 64 bits.
+                    emitPlain({}, (uint8_t)(0x48 | (dst.reg >> 3)), {(uint8_t)(0xB8 + (dst.reg & 7))});
+                    emitImm(src.value, "", 8, R_X86_64_64);
+                    return true;
+                }
+                if (!encodeRM({}, true, {0xC7}, 0, nullptr, dst, 4)) return false;
+                emitImm(src.value, src.symbol, 4, R_X86_64_32S);
+                return true;
+            }
+            uint8_t rex = (dst.reg & 8) ? 0x41 : 0;
+            if (size == 1 && !dst.highByte && dst.reg >= 4 && dst.reg < 8) rex = 0x40;
+            emitPlain(pfx, rex, {(uint8_t)((size == 1 ? 0xB0 : 0xB8) + (dst.reg & 7))});
+            emitImm(truncateSigned(src.value, size), src.symbol, size, R_X86_64_32);
+            return true;
+        }
+        int immSize = std::min(size, 4);
+        if (!encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xC6 : 0xC7)}, 0, nullptr, dst, immSize)) return false;
+        emitImm(truncateSigned(src.value, immSize), src.symbol, immSize, size == 8 ? R_X86_64_32S : R_X86_64_32);
+        return true;
+    }
+    if (src.isGpr()) return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0x88 : 0x89)}, 0, &src, dst, 0);
+    if (src.isMem() && dst.isGpr()) return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0x8A : 0x8B)}, 0, &dst, src, 0);
+    return error("invalid operands");
+}
+
+bool Assembler::encodeSse(const std::string& mnem, const std::vector<Operand>& ops) {
+    if (const SseShuffleOp* op = findSseShuffle(mnem)) {
+        if (ops.size() != 3 || !ops[0].isImm() || !ops[2].xmm || !(ops[1].xmm || ops[1].isMem()))
+            return error("invalid operands");
+        std::vector<uint8_t> pfx;
+        if (op->prefix) pfx.push_back(op->prefix);
+        if (!encodeRM(pfx, false, {0x0F, op->opcode}, 0, &ops[2], ops[1], 1)) return false;
+        emitImm(ops[0].value & 0xFF, "", 1, 0);
+        return true;
+    }
+    if (ops.size() != 2) return error("expected two operands");
+    const Operand& src = ops[0];
+    const Operand& dst = ops[1];
+    if (mnem == "movq" || mnem == "movd") {
+        bool q = mnem == "movq";
+        if (src.xmm && dst.xmm) return encodeRM({0xF3}, false, {0x0F, 0x7E}, 0, &dst, src, 0);
+        if (dst.xmm) {
+            if (src.isGpr()) return encodeRM({0x66}, src.size == 8, {0x0F, 0x6E}, 0, &dst, src, 0);
+            if (src.isMem()) return q ? encodeRM({0xF3}, false, {0x0F, 0x7E}, 0, &dst, src, 0)
+                                      : encodeRM({0x66}, false, {0x0F, 0x6E}, 0, &dst, src, 0);
+        } else if (src.xmm) {
+            if (dst.isGpr()) return encodeRM({0x66}, dst.size == 8, {0x0F, 0x7E}, 0, &src, dst, 0);
+            if (dst.isMem()) return q ? encodeRM({0x66}, false, {0x0F, 0xD6}, 0, &src, dst, 0)
+                                      : encodeRM({0x66}, false, {0x0F, 0x7E}, 0, &src, dst, 0);
+        }
+        return error("invalid operands");
+    }
+    if (const SseShiftOp* op = findSseShift(mnem)) {
+        if (!src.isImm() || !dst.xmm) return error("invalid operands");
+        if (!encodeRM({0x66}, false, {0x0F, op->opcode}, op->digit, nullptr, dst, 1)) return false;
+        emitImm(src.value & 0xFF, "", 1, 0);
+        return true;
+    }
+    if (const SseOp* op = findSse(mnem)) {
+        std::vector<uint8_t> pfx;
+        if (op->prefix) pfx.push_back(op->prefix);
+        std::vector<uint8_t> opcode = {0x0F};
+        if (dst.xmm && (src.xmm || src.isMem())) {
+            opcode.insert(opcode.end(), op->opcode.begin(), op->opcode.end());
+            return encodeRM(pfx, false, opcode, 0, &dst, src, 0);
+        }
+        if (op->store && src.xmm && dst.isMem()) {
+            opcode.push_back(op->store);
+            return encodeRM(pfx, false, opcode, 0, &src, dst, 0);
+        }
+        return error("invalid operands");
+    }
+    if (mnem.compare(0, 7, "cvtsi2s") == 0) {
+        // cvtsi2sd[lq] / cvtsi2ss[lq]: integer register or memory to xmm.
+        uint8_t prefix = mnem[7] == 'd' ? 0xF2 : 0xF3;
+        char suffix = mnem.size() > 8 ? mnem[8] : 0;
+        bool w = suffix == 'q' || (suffix == 0 && src.isGpr() && src.size == 8);
+        if (!dst.xmm || src.xmm) return error("invalid operands");
+        return encodeRM({prefix}, w, {0x0F, 0x2A}, 0, &dst, src, 0);
+    }
+    if (mnem.compare(0, 3, "cvt") == 0) {
+        // cvt[t]sd2si[lq] / cvt[t]ss2si[lq]: xmm or memory to integer register.
+        bool truncate = mnem[3] == 't';
+        std::string rest = mnem.substr(truncate ? 4 : 3);
+        uint8_t prefix;
+        if (rest.compare(0, 5, "sd2si") == 0) prefix = 0xF2;
+        else if (rest.compare(0, 5, "ss2si") == 0) prefix = 0xF3;
+        else return error("unsupported instruction '" + mnem + "'");
+        if (!dst.isGpr() || dst.size < 4) return error("invalid operands");
+        return encodeRM({prefix}, dst.size == 8, {0x0F, (uint8_t)(truncate ? 0x2C : 0x2D)}, 0, &dst, src, 0);
+    }
+    return error("unsupported instruction '" + mnem + "'");
+}
+
+bool Assembler::instruction(std::string mnem, const std::string& args) {
+    for (const auto& z : kZeroOperand) {
+        if (mnem != z.name) continue;
+        if (!args.empty()) return error("unexpected operands");
+        emitPlain({}, 0, z.bytes);
+        return true;
+    }
+
+    std::vector<Operand> ops;
+    for (const auto& part : splitOperands(args)) {
+        ops.emplace_back();
+        if (!parseOperand(part, ops.back())) return false;
+        if (!ops.back().symbol.empty()) referenced_.push_back(ops.back().symbol);
+    }
+
+    // Control transfers.
+    if (mnem == "call" || mnem == "callq" || mnem == "jmp" || mnem == "jmpq") {
+        bool call = mnem[0] == 'c';
+        if (ops.size() != 1) return error("expected one operand");
+        if (ops[0].indirect) {
+            if (ops[0].isReg() && (ops[0].xmm || ops[0].size != 8)) return error("indirect target must be a 64-bit register");
+            Operand target = ops[0];
+            return encodeRM({}, false, {0xFF}, call ? 2 : 4, nullptr, target, 0);
+        }
+        if (!ops[0].isLabel()) return error("unsupported branch target");
+        if (!call) {
+            emitBranch(-1, ops[0].symbol);
+            return true;
+        }
+        emitPlain({}, 0, {0xE8});
+        emitImm(-4, ops[0].symbol, 4, R_X86_64_PLT32);
+        return true;
+    }
+    if (mnem.size() > 1 && mnem[0] == 'j') {
+        int cc = conditionCode(mnem.substr(1));
+        if (cc < 0) return error("unsupported instruction '" + mnem + "'");
+        if (ops.size() != 1 || !ops[0].isLabel()) return error("expected a label");
+        emitBranch(cc, ops[0].symbol);
+        return true;
+    }
+    if (mnem.compare(0, 3, "set") == 0 && conditionCode(mnem.substr(3)) >= 0) {
+        if (ops.size() != 1 || (ops[0].isReg() && (ops[0].size != 1 || ops[0].xmm))) return error("expected a byte operand");
+        return encodeRM({}, false, {0x0F, (uint8_t)(0x90 + conditionCode(mnem.substr(3)))}, 0, nullptr, ops[0], 0);
+    }
+    if (mnem.compare(0, 4, "cmov") == 0) {
+        std::string cc = mnem.substr(4);
+        if (conditionCode(cc) < 0 && !cc.empty() && suffixSize(cc.back())) cc.pop_back();
+        int code = conditionCode(cc);
+        if (code < 0) return error("unsupported instruction '" + mnem + "'");
+        if (ops.size() != 2 || !ops[1].isGpr() || ops[1].size < 2) return error("invalid operands");
+        std::vector<uint8_t> pfx;
+        if (ops[1].size == 2) pfx.push_back(0x66);
+        return encodeRM(pfx, ops[1].size == 8, {0x0F, (uint8_t)(0x40 + code)}, 0, &ops[1], ops[0], 0);
+    }
+
+    // SSE, including movq/movd between general-purpose and xmm registers.
+    bool anyXmm = std::any_of(ops.begin(), ops.end(), [](const Operand& o) { return o.xmm; });
+    if (findSse(mnem) || findSseShift(mnem) || findSseShuffle(mnem) || mnem.compare(0, 3, "cvt") == 0 || ((mnem == "movq" || mnem == "movd") && anyXmm))
+        return encodeSse(mnem, ops);
+
+    if (mnem == "movabsq" || mnem == "movabs") {
+        if (ops.size() != 2 || !ops[0].isImm() || !ops[1].isGpr() || ops[1].size != 8) return error("invalid operands");
+        emitPlain({}, (uint8_t)(0x48 | (ops[1].reg >> 3)), {(uint8_t)(0xB8 + (ops[1].reg & 7))});
+        emitImm(ops[0].value, ops[0].symbol, 8, R_X86_64_64);
+        return true;
+    }
+    for (const auto& e : kExtend) {
+        if (mnem != e.name) continue;
+        if (ops.size() != 2 || !ops[1].isGpr() || ops[1].size != e.dstSize ||
+            (ops[0].isReg() && (ops[0].xmm || ops[0].size != e.srcSize)) || ops[0].isImm())
+            return error("invalid operands");
+        std::vector<uint8_t> pfx;
+        if (e.dstSize == 2) pfx.push_back(0x66);
+        return encodeRM(pfx, e.dstSize == 8, {0x0F, e.opcode}, 0, &ops[1], ops[0], 0);
+    }
+    if (mnem == "movslq") {
+        if (ops.size() != 2 || !ops[1].isGpr() || ops[1].size != 8 || ops[0].isImm() ||
+            (ops[0].isReg() && (ops[0].xmm || ops[0].size != 4)))
+            return error("invalid operands");
+        return encodeRM({}, true, {0x63}, 0, &ops[1], ops[0], 0);
+    }
+
+    // Integer instructions with an optional b/w/l/q size suffix.
+    std::string base = mnem;
+    int size = 0;
+    if (!isSizedBase(base)) {
+        if (base.size() > 1 && suffixSize(base.back()) && isSizedBase(base.substr(0, base.size() - 1))) {
+            size = suffixSize(base.back());
+            base.pop_back();
+        } else {
+            return error("unsupported instruction '" + mnem + "'");
+        }
+    }
+    bool shift = kShiftDigit.count(base) > 0;
+    if (size == 0) {
+        for (size_t i = ops.size(); i-- > 0;) {
+            if (shift && i == 0 && ops.size() == 2) continue;  // count register
+            if (ops[i].isGpr()) { size = ops[i].size; break; }
+        }
+        if (size == 0 && (base == "push" || base == "pop")) size = 8;
+        if (size == 0) return error("ambiguous operand size for '" + mnem + "'");
+    }
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].xmm) return error("invalid operands");
+        if (!ops[i].isReg() || (shift && i == 0 && ops.size() == 2)) continue;
+        if (ops[i].size != size) return error("operand size mismatch");
+    }
+    std::vector<uint8_t> pfx;
+    if (size == 2) pfx.push_back(0x66);
+    bool w = size == 8;
+
+    auto alu = kAluDigit.find(base);
+    if (alu != kAluDigit.end()) {
+        if (ops.size() != 2) return error("expected two operands");
+        return encodeAlu(alu->second, size, ops[0], ops[1]);
+    }
+    if (base == "mov") {
+        if (ops.size() != 2) return error("expected two operands");
+        return encodeMov(size, ops[0], ops[1]);
+    }
+    if (base == "test") {
+        if (ops.size() != 2) return error("expected two operands");
+        const Operand& src = ops[0];
+        const Operand& dst = ops[1];
+        if (src.isImm()) {
+            int immSize = std::min(size, 4);
+            if (src.symbol.empty() && !fitsSize(src.value, immSize)) return error("immediate out of range");
+            if (dst.isReg() && dst.reg == 0 && !dst.highByte)
+                emitPlain(pfx, w ? 0x48 : 0, {(uint8_t)(size == 1 ? 0xA8 : 0xA9)});
+            else if (!encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xF6 : 0xF7)}, 0, nullptr, dst, immSize)) return false;
+            emitImm(truncateSigned(src.value, immSize), src.symbol, immSize, R_X86_64_32);
+            return true;
+        }
+        if (src.isGpr()) return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0x84 : 0x85)}, 0, &src, dst, 0);
+        if (src.isMem() && dst.isGpr()) return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0x84 : 0x85)}, 0, &dst, src, 0);
+        return error("invalid operands");
+    }
+    if (base == "lea") {
+        if (ops.size() != 2 || !ops[0].isMem() || !ops[1].isGpr() || size == 1) return error("invalid operands");
+        return encodeRM(pfx, w, {0x8D}, 0, &ops[1], ops[0], 0);
+    }
+    if (base == "imul") {
+        if (size == 1 && ops.size() != 1) return error("invalid operands");
+        if (ops.size() == 1) return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xF6 : 0xF7)}, 5, nullptr, ops[0], 0);
+        const Operand* imm = ops[0].isImm() ? &ops[0] : nullptr;
+        const Operand& rm = ops.size() == 3 ? ops[1] : (imm ? ops[1] : ops[0]);
+        const Operand& dst = ops.back();
+        if (!dst.isGpr() || (ops.size() == 3 && !imm)) return error("invalid operands");
+        if (!imm) return encodeRM(pfx, w, {0x0F, 0xAF}, 0, &dst, rm, 0);
+        int immSize = size == 2 ? 2 : 4;
+        if (imm->symbol.empty() && !fitsSize(imm->value, immSize)) return error("immediate out of range");
+        int64_t v = truncateSigned(imm->value, immSize);
+        bool short8 = imm->symbol.empty() && fitsInt8(v);
+        if (!encodeRM(pfx, w, {(uint8_t)(short8 ? 0x6B : 0x69)}, 0, &dst, rm, short8 ? 1 : immSize)) return false;
+        emitImm(v, imm->symbol, short8 ? 1 : immSize, R_X86_64_32S);
+        return true;
+    }
+    auto unary = kUnaryDigit.find(base);
+    if (unary != kUnaryDigit.end()) {
+        if (ops.size() != 1) return error("expected one operand");
+        return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xF6 : 0xF7)}, unary->second, nullptr, ops[0], 0);
+    }
+    if (base == "inc" || base == "dec") {
+        if (ops.size() != 1) return error("expected one operand");
+        return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xFE : 0xFF)}, base == "inc" ? 0 : 1, nullptr, ops[0], 0);
+    }
+    auto sh = kShiftDigit.find(base);
+    if (sh != kShiftDigit.end()) {
+        if (ops.empty() || ops.size() > 2) return error("invalid operands");
+        const Operand& dst = ops.back();
+        if (ops.size() == 1 || (ops[0].isImm() && ops[0].symbol.empty() && ops[0].value == 1))
+            return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xD0 : 0xD1)}, sh->second, nullptr, dst, 0);
+        if (ops[0].isImm()) {
+            if (!ops[0].symbol.empty() || ops[0].value < 0 || ops[0].value > 255) return error("bad shift count");
+            if (!encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xC0 : 0xC1)}, sh->second, nullptr, dst, 1)) return false;
+            emitImm(ops[0].value, "", 1, 0);
+            return true;
+        }
+        if (ops[0].isGpr() && ops[0].reg == 1 && ops[0].size == 1 && !ops[0].highByte)
+            return encodeRM(pfx, w, {(uint8_t)(size == 1 ? 0xD2 : 0xD3)}, sh->second, nullptr, dst, 0);
+        return error("shift count must be an immediate or %cl");
+    }
+    if (base == "push" || base == "pop") {
+        if (ops.size() != 1 || size != 8) return error("invalid operands");
+        const Operand& op = ops[0];
+        bool push = base == "push";
+        if (op.isGpr()) {
+            emitPlain({}, (op.reg & 8) ? 0x41 : 0, {(uint8_t)((push ? 0x50 : 0x58) + (op.reg & 7))});
+            return true;
+        }
+        if (op.isImm() && push) {
+            bool short8 = op.symbol.empty() && fitsInt8(op.value);
+            if (op.symbol.empty() && !fitsInt32(op.value)) return error("immediate out of range");
+            emitPlain({}, 0, {(uint8_t)(short8 ? 0x6A : 0x68)});
+            emitImm(op.value, op.symbol, short8 ? 1 : 4, R_X86_64_32S);
+            return true;
+        }
+        if (op.isMem()) return encodeRM({}, false, {(uint8_t)(push ? 0xFF : 0x8F)}, push ? 6 : 0, nullptr, op, 0);
+        return error("invalid operands");
+    }
+    return error("unsupported instruction '" + mnem + "'");
+}
+
+uint64_t Assembler::labelOffset(const Label& l) const {
+    return frags_[l.section][l.fragment].offset + l.offset;
+}
+
+void Assembler::layout(int section) {
+    auto& fs = frags_[section];
+    // Branches to anything but a local label of this section keep the rel32
+    // form and get a relocation; the rest start short and grow as needed.
+    for (auto& f : fs) {
+        if (!f.branch) continue;
+        auto it = labels_.find(f.target);
+        if (it == labels_.end() || it->second.section != section || globals_.count(f.target)) f.longForm = true;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        uint64_t off = 0;
+        for (auto& f : fs) {
+            f.offset = off;
+            if (f.align) {
+                size_t pad = (size_t)((f.align - off % f.align) % f.align);
+                f.bytes.clear();
+                if (f.nops) appendNops(f.bytes, pad);
+                else f.bytes.assign(pad, f.fill);
+            }
+            off += f.size();
+        }
+        for (auto& f : fs) {
+            if (!f.branch || f.longForm) continue;
+            int64_t disp = (int64_t)labelOffset(labels_.at(f.target)) - (int64_t)(f.offset + 2);
+            if (!fitsInt8(disp)) {
+                f.longForm = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+void Assembler::finish(int section) {
+    ObjSection& sec = obj_.sections[section];
+    std::vector<uint8_t>& out = sec.data;
+    auto put = [&](uint64_t pos, int64_t v, int size) {
+        for (int i = 0; i < size; i++) out[pos + i] = (uint8_t)((uint64_t)v >> (8 * i));
+    };
+    auto resolve = [&](uint64_t pos, const Fixup& fx) {
+        auto it = labels_.find(fx.symbol);
+        bool pcrel = fx.type == R_X86_64_PC32 || fx.type == R_X86_64_PLT32;
+        if (it == labels_.end() || globals_.count(fx.symbol)) {
+            sec.relocs.push_back({pos, fx.type, fx.addend, fx.symbol, -1});
+            return;
+        }
+        int64_t target = (int64_t)labelOffset(it->second);
+        if (pcrel && it->second.section == section) {
+            int64_t v = target + fx.addend - (int64_t)pos;
+            if (!fitsInt32(v)) error("relative reference to '" + fx.symbol + "' out of range");
+            put(pos, v, fx.size);
+            return;
+        }
+        sec.relocs.push_back({pos, pcrel ? R_X86_64_PC32 : fx.type, fx.addend + target, "", it->second.section});
+    };
+    for (const auto& f : frags_[section]) {
+        uint64_t start = out.size();
+        if (f.branch) {
+            auto it = labels_.find(f.target);
+            int64_t disp = 0;
+            if (f.longForm) {
+                if (f.cond < 0) out.push_back(0xE9);
+                else { out.push_back(0x0F); out.push_back((uint8_t)(0x80 + f.cond)); }
+                out.resize(out.size() + 4);
+                Fixup fx;
+                fx.type = R_X86_64_PLT32;
+                fx.symbol = f.target;
+                fx.addend = -4;
+                resolve(out.size() - 4, fx);
+            } else {
+                disp = (int64_t)labelOffset(it->second) - (int64_t)(start + 2);
+                out.push_back(f.cond < 0 ? 0xEB : (uint8_t)(0x70 + f.cond));
+                out.push_back((uint8_t)disp);
+            }
+            continue;
+        }
+        out.insert(out.end(), f.bytes.begin(), f.bytes.end());
+        for (const auto& fx : f.fixups) resolve(start + fx.offset, fx);
+    }
+    if (sec.type == SHT_NOBITS) {
+        if (std::any_of(out.begin(), out.end(), [](uint8_t b) { return b != 0; }))
+            error("non-zero data in " + sec.name);
+        sec.size = out.size();
+        out.clear();
+    }
+}
+
+} // namespace gspp
@@ -0,0 +1,96 @@
+#ifndef GSPP_ASSEMBLER_H
+#define GSPP_ASSEMBLER_H
+
+#include "elfwriter.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gspp {
+
+// Built-in x86-64 assembler for the AT&T syntax emitted by the code
+// generator. It covers the instructions and directives the backend produces
+// (plus the common scalar SSE forms), relaxes local branches to their short
+// encodings like GNU as does, and produces an ObjectFile for writeElfObject.
+// Anything outside that subset (e.g. unusual inline asm) makes assemble()
+// fail, and the driver falls back to an external assembler.
+class Assembler {
+public:
+    Assembler();
+    bool assemble(const std::string& source);
+    const ObjectFile& object() const { return obj_; }
+    const std::vector<std::string>& errors() const { return errors_; }
+
+private:
+    struct Operand;
+    struct Fixup {
+        size_t offset = 0;  // within the fragment
+        int size = 4;
+        uint32_t type = 0;
+        std::string symbol;
+        int64_t addend = 0;
+    };
+    // A run of bytes, a relaxable branch or an alignment gap. Only branches
+    // and alignment change size during layout, so labels are recorded as
+    // (fragment, offset within fragment).
+    struct Fragment {
+        std::vector<uint8_t> bytes;
+        std::vector<Fixup> fixups;
+        bool branch = false;
+        int cond = -1;  // -1: jmp
+        std::string target;
+        bool longForm = false;
+        uint64_t align = 0;
+        uint8_t fill = 0;
+        bool nops = false;  // pad code with NOP instructions instead of fill
+        uint64_t offset = 0;
+        uint64_t size() const;
+    };
+    struct Label {
+        int section = 0;
+        size_t fragment = 0;
+        size_t offset = 0;
+    };
+
+    bool statement(const std::string& line);
+    bool directive(const std::string& name, const std::string& args);
+    bool instruction(std::string mnem, const std::string& args);
+    bool parseOperand(const std::string& text, Operand& op);
+    bool parseExpr(const std::string& text, int64_t& value, std::string& symbol);
+    bool emitData(const std::string& args, int size);
+    bool emitString(const std::string& args, bool terminate);
+
+    bool encodeAlu(int digit, int size, const Operand& src, const Operand& dst);
+    bool encodeMov(int size, const Operand& src, const Operand& dst);
+    bool encodeSse(const std::string& mnem, const std::vector<Operand>& ops);
+    bool encodeRM(const std::vector<uint8_t>& prefixes, bool rexW, const std::vector<uint8_t>& opcode, int regField,
+                  const Operand* regOp, const Operand& rm, int immSize);
+    void emitPlain(const std::vector<uint8_t>& prefixes, uint8_t rex, const std::vector<uint8_t>& opcode);
+    void emitImm(int64_t value, const std::string& symbol, int size, uint32_t relocType);
+    void emitBranch(int cond, const std::string& target);
+
+    Fragment& frag();
+    void switchSection(const std::string& name, uint32_t type, uint64_t flags, const std::string& group = "");
+    void layout(int section);
+    void finish(int section);
+    uint64_t labelOffset(const Label& l) const;
+    bool error(const std::string& msg);
+
+    ObjectFile obj_;
+    std::vector<std::vector<Fragment>> frags_;  // per section
+    int cur_ = 0;
+    std::unordered_map<std::string, Label> labels_;
+    std::vector<std::string> labelOrder_;
+    std::vector<std::string> referenced_;
+    std::unordered_set<std::string> globals_;
+    std::unordered_set<std::string> weak_;
+    std::unordered_set<std::string> functions_;
+    std::vector<std::string> errors_;
+    std::string line_;
+};
+
+} // namespace gspp
+
+#endif
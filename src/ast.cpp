@@ -2,32 +2,78 @@
 
 namespace gspp {
 
-Type::Type(const Type& other) {
-    kind = other.kind;
-    structName = other.structName;
-    ns = other.ns;
-    typeArgs = other.typeArgs;
-    loc = other.loc;
-    if (other.ptrTo) ptrTo = std::make_unique<Type>(*other.ptrTo);
+TypeTable& TypeTable::instance() {
+    static TypeTable inst;
+    return inst;
 }
 
-Type& Type::operator=(const Type& other) {
-    if (this == &other) return *this;
-    kind = other.kind;
-    structName = other.structName;
-    ns = other.ns;
-    typeArgs = other.typeArgs;
-    loc = other.loc;
-    if (other.ptrTo) ptrTo = std::make_unique<Type>(*other.ptrTo);
-    else ptrTo.reset();
-    return *this;
+TypeTable::TypeTable() {
+    static const char* const names[] = {"int",    "float", "bool", nullptr, nullptr, "void",
+                                        "string", "char",  nullptr, "f64x4", "i32x8"};
+    for (int k = 0; k < 11; k++) {
+        if (!names[k]) continue;
+        Type* t = new Type;
+        t->kind = (Type::Kind)k;
+        t->mangledName = names[k];
+        primitives_[k] = t;
+    }
+}
+
+const Type* TypeTable::pointerTo(const Type* pointee) {
+    return intern(Type::Kind::Pointer, Symbol(), Symbol(), {}, pointee);
+}
+
+const Type* TypeTable::structRef(Symbol name, Symbol ns, const std::vector<const Type*>& typeArgs) {
+    return intern(Type::Kind::StructRef, name, ns, typeArgs, nullptr);
+}
+
+const Type* TypeTable::typeParam(Symbol name) {
+    return intern(Type::Kind::TypeParam, name, Symbol(), {}, nullptr);
+}
+
+const Type* TypeTable::intern(Type::Kind kind, Symbol name, Symbol ns,
+                              const std::vector<const Type*>& typeArgs, const Type* ptrTo) {
+    // Components are already canonical, so hashing their IDs and addresses is enough.
+    size_t h = (size_t)name.id() * 31 + ns.id();
+    h = h * 31 + (size_t)kind;
+    h = h * 31 + std::hash<const Type*>()(ptrTo);
+    for (const Type* a : typeArgs) h = h * 31 + std::hash<const Type*>()(a);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto range = types_.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Type* t = it->second;
+        if (t->kind == kind && t->ptrTo == ptrTo && t->structName == name && t->ns == ns && t->typeArgs == typeArgs)
+            return t;
+    }
+
+    Type* t = new Type;
+    t->kind = kind;
+    t->structName = name;
+    t->ns = ns;
+    t->typeArgs = typeArgs;
+    t->ptrTo = ptrTo;
+    switch (kind) {
+        case Type::Kind::Pointer:
+            t->mangledName = "ptr_" + ptrTo->mangledName;
+            break;
+        case Type::Kind::StructRef:
+            t->mangledName = ns.empty() ? name.str() : ns + "_" + name;
+            for (const Type* a : typeArgs) t->mangledName += "_" + a->mangledName;
+            break;
+        default:
+            t->mangledName = name.str();
+            break;
+    }
+    types_.emplace(h, t);
+    return t;
 }
 
 std::unique_ptr<Expr> Expr::makeIntLit(int64_t v, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::IntLit;
     e->intVal = v;
-    e->exprType.kind = Type::Kind::Int;
+    e->exprType = TypeTable::instance().get(Type::Kind::Int);
     e->loc = loc;
     return e;
 }
@@ -36,7 +82,7 @@ std::unique_ptr<Expr> Expr::makeFloatLit(double v, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::FloatLit;
     e->floatVal = v;
-    e->exprType.kind = Type::Kind::Float;
+    e->exprType = TypeTable::instance().get(Type::Kind::Float);
     e->loc = loc;
     return e;
 }
@@ -45,12 +91,12 @@ std::unique_ptr<Expr> Expr::makeBoolLit(bool v, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::BoolLit;
     e->boolVal = v;
-    e->exprType.kind = Type::Kind::Bool;
+    e->exprType = TypeTable::instance().get(Type::Kind::Bool);
     e->loc = loc;
     return e;
 }
 
-std::unique_ptr<Expr> Expr::makeVar(const std::string& id, SourceLoc loc) {
+std::unique_ptr<Expr> Expr::makeVar(Symbol id, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::Var;
     e->ident = id;
@@ -58,7 +104,7 @@ std::unique_ptr<Expr> Expr::makeVar(const std::string& id, SourceLoc loc) {
     return e;
 }
 
-std::unique_ptr<Expr> Expr::makeBinary(std::unique_ptr<Expr> l, const std::string& op,
+std::unique_ptr<Expr> Expr::makeBinary(std::unique_ptr<Expr> l, Op op,
                                         std::unique_ptr<Expr> r, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::Binary;
@@ -69,7 +115,7 @@ std::unique_ptr<Expr> Expr::makeBinary(std::unique_ptr<Expr> l, const std::strin
     return e;
 }
 
-std::unique_ptr<Expr> Expr::makeUnary(const std::string& op, std::unique_ptr<Expr> operand, SourceLoc loc) {
+std::unique_ptr<Expr> Expr::makeUnary(Op op, std::unique_ptr<Expr> operand, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::Unary;
     e->op = op;
@@ -78,7 +124,7 @@ std::unique_ptr<Expr> Expr::makeUnary(const std::string& op, std::unique_ptr<Exp
     return e;
 }
 
-std::unique_ptr<Expr> Expr::makeCall(const std::string& id, std::vector<std::unique_ptr<Expr>> args, SourceLoc loc) {
+std::unique_ptr<Expr> Expr::makeCall(Symbol id, std::vector<std::unique_ptr<Expr>> args, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::Call;
     e->ident = id;
@@ -87,7 +133,7 @@ std::unique_ptr<Expr> Expr::makeCall(const std::string& id, std::vector<std::uni
     return e;
 }
 
-std::unique_ptr<Expr> Expr::makeMember(std::unique_ptr<Expr> base, const std::string& member, SourceLoc loc) {
+std::unique_ptr<Expr> Expr::makeMember(std::unique_ptr<Expr> base, Symbol member, SourceLoc loc) {
     auto e = std::make_unique<Expr>();
     e->kind = Kind::Member;
     e->left = std::move(base);
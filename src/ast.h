@@ -2,9 +2,13 @@
 #define GSPP_AST_H
 
 #include "common.h"
+#include "arena.h"
+#include "symbol.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <cstdint>
 
 namespace gspp {
@@ -14,55 +18,90 @@ struct Type;
 struct Expr;
 struct Stmt;
 
-struct Type {
-    enum class Kind { Int, Float, Bool, StructRef, Pointer, Void, String, Char, TypeParam };
+// Types are interned: every distinct type exists exactly once in the
+// TypeTable and is referred to by a canonical const pointer, so two types are
+// equal iff their pointers are equal. Nodes are immutable once created.
+struct Type : ArenaNode {
+    // F64x4 and I32x8 are SIMD vectors of four floats and eight 32-bit ints.
+    enum class Kind { Int, Float, Bool, StructRef, Pointer, Void, String, Char, TypeParam, F64x4, I32x8 };
     Kind kind = Kind::Int;
-    std::string structName;  // for StructRef or TypeParam name
-    std::string ns;          // for StructRef
-    std::vector<Type> typeArgs; // for generics
-    std::unique_ptr<Type> ptrTo; // for Pointer
-    SourceLoc loc;
+    Symbol structName;       // for StructRef or TypeParam name
+    Symbol ns;               // for StructRef
+    std::vector<const Type*> typeArgs; // for generics
+    const Type* ptrTo = nullptr; // for Pointer
+    std::string mangledName; // e.g. "ptr_Vec_int", used for generic instance names
+};
 
-    Type() = default;
-    Type(Kind k) : kind(k) {}
-    Type(const Type& other);
-    Type& operator=(const Type& other);
+// SIMD vectors are 32-byte values: four floats (f64x4) or eight 32-bit ints (i32x8).
+inline bool isVector(const Type* t) { return t->kind == Type::Kind::F64x4 || t->kind == Type::Kind::I32x8; }
+inline int vectorLanes(const Type* t) { return t->kind == Type::Kind::F64x4 ? 4 : 8; }
+
+class TypeTable {
+public:
+    static TypeTable& instance();
+
+    // Int, Float, Bool, Void, String, Char, F64x4 or I32x8.
+    const Type* get(Type::Kind kind) const { return primitives_[(int)kind]; }
+    const Type* pointerTo(const Type* pointee);
+    const Type* structRef(Symbol name, Symbol ns, const std::vector<const Type*>& typeArgs = {});
+    const Type* typeParam(Symbol name);
+    size_t size() const { std::lock_guard<std::mutex> lock(mutex_); return types_.size(); }
+
+private:
+    TypeTable();
+    const Type* intern(Type::Kind kind, Symbol name, Symbol ns,
+                       const std::vector<const Type*>& typeArgs, const Type* ptrTo);
+
+    const Type* primitives_[11] = {};
+    std::unordered_multimap<size_t, const Type*> types_;  // structural hash -> type
+    mutable std::mutex mutex_;  // parsers on several threads intern concurrently
 };
 
-struct Expr {
+struct Expr : ArenaNode {
     enum class Kind {
         IntLit, FloatLit, BoolLit, StringLit,
         Var, Binary, Unary, Call, Member, Cast,
-        Deref, AddressOf, New, Delete
+        Deref, AddressOf, New, Delete, Index,
+        Slice,     // left[args[0]..args[1]], built in the frame slot named by ident
+        NewArray   // new [left]targetType: a slice over fresh memory, built like Slice
+    };
+    enum class Op {
+        None,
+        Add, Sub, Mul, Div, Mod,
+        Eq, Ne, Lt, Gt, Le, Ge,
+        And, Or,
+        Neg, Not  // unary
     };
     Kind kind = Kind::IntLit;
-    Type exprType;
+    const Type* exprType = TypeTable::instance().get(Type::Kind::Int);
     SourceLoc loc;
 
     int64_t intVal = 0;
     double floatVal = 0.0;
     bool boolVal = false;
-    std::string ident;
-    std::string ns; // namespace
-    std::unique_ptr<Expr> left;
-    std::unique_ptr<Expr> right;
-    std::string op;  // binary op or unary op
+    std::string strVal;  // StringLit contents
+    Symbol ident;
+    Symbol ns; // namespace
+    std::unique_ptr<Expr> left;   // also the base of Index
+    std::unique_ptr<Expr> right;  // also the subscript of Index
+    Op op = Op::None;  // binary op or unary op
     std::vector<std::unique_ptr<Expr>> args;
-    std::string member;
-    std::unique_ptr<Type> targetType;  // for Cast
+    Symbol member;  // also the frame slot receiving a struct result of Call
+    const Type* targetType = nullptr;  // for Cast and New
+    std::vector<const Type*> typeArgs; // explicit generic arguments of a Call
 
     static std::unique_ptr<Expr> makeIntLit(int64_t v, SourceLoc loc);
     static std::unique_ptr<Expr> makeFloatLit(double v, SourceLoc loc);
     static std::unique_ptr<Expr> makeBoolLit(bool v, SourceLoc loc);
-    static std::unique_ptr<Expr> makeVar(const std::string& id, SourceLoc loc);
-    static std::unique_ptr<Expr> makeBinary(std::unique_ptr<Expr> l, const std::string& op,
+    static std::unique_ptr<Expr> makeVar(Symbol id, SourceLoc loc);
+    static std::unique_ptr<Expr> makeBinary(std::unique_ptr<Expr> l, Op op,
                                             std::unique_ptr<Expr> r, SourceLoc loc);
-    static std::unique_ptr<Expr> makeUnary(const std::string& op, std::unique_ptr<Expr> operand, SourceLoc loc);
-    static std::unique_ptr<Expr> makeCall(const std::string& id, std::vector<std::unique_ptr<Expr>> args, SourceLoc loc);
-    static std::unique_ptr<Expr> makeMember(std::unique_ptr<Expr> base, const std::string& member, SourceLoc loc);
+    static std::unique_ptr<Expr> makeUnary(Op op, std::unique_ptr<Expr> operand, SourceLoc loc);
+    static std::unique_ptr<Expr> makeCall(Symbol id, std::vector<std::unique_ptr<Expr>> args, SourceLoc loc);
+    static std::unique_ptr<Expr> makeMember(std::unique_ptr<Expr> base, Symbol member, SourceLoc loc);
 };
 
-struct Stmt {
+struct Stmt : ArenaNode {
     enum class Kind {
         Block, VarDecl, Assign, If, While, For, Return, ExprStmt,
         Unsafe, Asm
@@ -71,8 +110,8 @@ struct Stmt {
     SourceLoc loc;
 
     std::vector<std::unique_ptr<Stmt>> blockStmts;
-    std::string varName;
-    Type varType;
+    Symbol varName;
+    const Type* varType = TypeTable::instance().get(Type::Kind::Int);
     std::unique_ptr<Expr> varInit;
     std::unique_ptr<Expr> assignTarget;  // or for expr in For
     std::unique_ptr<Expr> assignValue;
@@ -84,41 +123,46 @@ struct Stmt {
     std::unique_ptr<Stmt> stepStmt;
     std::unique_ptr<Expr> returnExpr;
     std::unique_ptr<Expr> expr;
-    std::string asmCode; // for Asm
+    std::string asmCode; // for Asm; for a loop -O rewrote, why it could not be vectorized
 };
 
 struct StructMember {
-    std::string name;
-    Type type;
+    Symbol name;
+    const Type* type = nullptr;
     SourceLoc loc;
 };
 
 struct StructDecl {
-    std::string name;
-    std::vector<std::string> typeParams;
+    Symbol name;
+    std::vector<Symbol> typeParams;
     std::vector<StructMember> members;
     SourceLoc loc;
+    bool packed = false;   // @packed: no padding, alignment 1
+    bool reorder = false;  // @reorder: lay members out by decreasing alignment
+    bool soa = false;      // @soa: new T[n] keeps each member in an array of its own
 };
 
 struct FuncParam {
-    std::string name;
-    Type type;
+    Symbol name;
+    const Type* type = nullptr;
     SourceLoc loc;
 };
 
 struct FuncDecl {
-    std::string name;
-    std::vector<std::string> typeParams;
+    Symbol name;
+    std::vector<Symbol> typeParams;
     std::vector<FuncParam> params;
-    Type returnType;
+    const Type* returnType = TypeTable::instance().get(Type::Kind::Int);
     std::unique_ptr<Stmt> body;
     SourceLoc loc;
     bool isExtern = false;
     std::string externLib; // e.g. "C"
+    bool forceInline = false;  // @inline: inline every call the optimizer can
+    bool noInline = false;     // @noinline: never inline
 };
 
 struct Import {
-    std::string name; // namespace name
+    Symbol name;      // namespace name
     std::string path; // file path
     SourceLoc loc;
 };
@@ -1,13 +1,16 @@
 #include "codegen.h"
+#include "regalloc.h"
 #include <sstream>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 namespace gspp {
 
-CodeGenerator::CodeGenerator(Program* program, SemanticAnalyzer* semantic, std::ostream& out, bool use32Bit)
-    : program_(program), semantic_(semantic), out_(&out), use32Bit_(use32Bit) {
+CodeGenerator::CodeGenerator(Program* program, SemanticAnalyzer* semantic, std::ostream& out, bool use32Bit,
+                             bool optimize)
+    : program_(program), semantic_(semantic), out_(&out), use32Bit_(use32Bit), optimize_(optimize && !use32Bit) {
 #ifndef _WIN32
     isLinux_ = true;
 #endif
@@ -25,7 +28,7 @@ int CodeGenerator::getFrameSize() {
     int slot = use32Bit_ ? 4 : 8;
     int n = 0;
     for (const auto& p : currentVars_)
-        if (p.second.frameOffset < 0) n += slot;
+        if (p.second.frameOffset < 0) n = std::max(n, -p.second.frameOffset / 8 * slot);
     if (use32Bit_) {
         n = (n + 15) & ~15;  // align to 16 for cdecl
     } else {
@@ -35,7 +38,9 @@ int CodeGenerator::getFrameSize() {
     return n;
 }
 
-std::string CodeGenerator::getVarLocation(const std::string& name) {
+std::string CodeGenerator::getVarLocation(Symbol name) {
+    auto reg = varRegs_.find(name);
+    if (reg != varRegs_.end()) return reg->second;
     auto it = currentVars_.find(name);
     if (it == currentVars_.end()) return "";
     int off = it->second.frameOffset;
@@ -47,25 +52,27 @@ std::string CodeGenerator::getVarLocation(const std::string& name) {
     return std::to_string(off) + "(%rbp)";
 }
 
-int CodeGenerator::getTypeSize(const Type& t) {
-    if (t.kind == Type::Kind::Int || t.kind == Type::Kind::Float || t.kind == Type::Kind::Pointer || t.kind == Type::Kind::String)
+int CodeGenerator::getTypeSize(const Type* t) {
+    if (t->kind == Type::Kind::Int || t->kind == Type::Kind::Float || t->kind == Type::Kind::Pointer || t->kind == Type::Kind::String)
         return use32Bit_ ? 4 : 8;
-    if (t.kind == Type::Kind::Bool || t.kind == Type::Kind::Char)
+    if (t->kind == Type::Kind::Bool || t->kind == Type::Kind::Char)
         return 1;
-    if (t.kind == Type::Kind::StructRef) {
-        StructDef* sd = resolveStruct(t.structName, t.ns);
+    if (isVector(t))
+        return 32;
+    if (t->kind == Type::Kind::StructRef) {
+        StructDef* sd = resolveStruct(t->structName, t->ns);
         return sd ? (int)sd->sizeBytes : (use32Bit_ ? 4 : 8);
     }
     return 0;
 }
 
-StructDef* CodeGenerator::resolveStruct(const std::string& name, const std::string& ns) {
+StructDef* CodeGenerator::resolveStruct(Symbol name, Symbol ns) {
     auto sd = semantic_->getStruct(name, ns);
     if (!sd && ns.empty()) sd = semantic_->getStruct(name, currentNamespace_);
     return sd;
 }
 
-FuncSymbol* CodeGenerator::resolveFunc(const std::string& name, const std::string& ns) {
+FuncSymbol* CodeGenerator::resolveFunc(Symbol name, Symbol ns) {
     auto fs = semantic_->getFunc(name, ns);
     if (!fs && ns.empty()) fs = semantic_->getFunc(name, currentNamespace_);
     return fs;
@@ -79,6 +86,301 @@ void CodeGenerator::emitExprToXmm0(Expr* expr) {
     emitExpr(expr, "xmm0", true);
 }
 
+bool CodeGenerator::isLeaf(const Expr* expr) const {
+    return expr->kind == Expr::Kind::IntLit || expr->kind == Expr::Kind::BoolLit || expr->kind == Expr::Kind::Var;
+}
+
+bool CodeGenerator::hasCall(const Expr* expr) const {
+    if (!expr) return false;
+    if (expr->kind == Expr::Kind::Call || expr->kind == Expr::Kind::New || expr->kind == Expr::Kind::NewArray ||
+        expr->kind == Expr::Kind::Delete)
+        return true;
+    if (expr->kind == Expr::Kind::Binary && expr->left->exprType->kind == Type::Kind::String) return true;
+    if (hasCall(expr->left.get()) || hasCall(expr->right.get())) return true;
+    for (const auto& a : expr->args)
+        if (hasCall(a.get())) return true;
+    return false;
+}
+
+// Evaluates left into rax and right into rcx. Under -O the left value is kept
+// in a scratch register instead of the stack when the right side cannot clobber it.
+void CodeGenerator::emitOperands(Expr* left, Expr* right) {
+    if (optimize_) {
+        if (isLeaf(right)) {
+            emitExprToRax(left);
+            emitExpr(right, "rcx", false);
+            return;
+        }
+        if (!scratchFree_.empty() && !hasCall(right)) {
+            std::string tmp = scratchFree_.back();
+            scratchFree_.pop_back();
+            emitExprToRax(left);
+            *out_ << "\tmovq\t%rax, %" << tmp << "\n";
+            emitExprToRax(right);
+            *out_ << "\tmovq\t%rax, %rcx\n\tmovq\t%" << tmp << ", %rax\n";
+            scratchFree_.push_back(tmp);
+            return;
+        }
+    }
+    emitExprToRax(left);
+    *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
+    emitExprToRax(right);
+    *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tpopl\t%eax\n" : "\tmovq\t%rax, %rcx\n\tpopq\t%rax\n");
+}
+
+// Jumps to label when cond is true (or false). Under -O integer comparisons
+// branch on the flags directly instead of materializing a boolean.
+void CodeGenerator::emitBranch(Expr* cond, const std::string& label, bool whenTrue) {
+    if (optimize_ && cond->kind == Expr::Kind::Binary) {
+        static const struct { Expr::Op op; const char* cc; const char* inv; } ops[] = {
+            {Expr::Op::Eq, "e", "ne"}, {Expr::Op::Ne, "ne", "e"}, {Expr::Op::Lt, "l", "ge"},
+            {Expr::Op::Gt, "g", "le"}, {Expr::Op::Le, "le", "g"}, {Expr::Op::Ge, "ge", "l"},
+        };
+        for (const auto& o : ops) {
+            if (cond->op != o.op) continue;
+            emitOperands(cond->left.get(), cond->right.get());
+            *out_ << "\tcmpq\t%rcx, %rax\n";
+            *out_ << "\tj" << (whenTrue ? o.cc : o.inv) << "\t" << label << "\n";
+            return;
+        }
+    }
+    emitExprToRax(cond);
+    *out_ << (use32Bit_ ? "\ttestl\t%eax, %eax\n" : "\ttestq\t%rax, %rax\n");
+    *out_ << "\t" << (whenTrue ? "jne" : "je") << "\t" << label << "\n";
+}
+
+void CodeGenerator::emitStoreVar(Symbol name, Expr* value) {
+    std::string loc = getVarLocation(name);
+    auto vec = currentVars_.find(name);
+    if (vec != currentVars_.end() && isVector(vec->second.type)) {
+        emitExpr(value, "xmm0", true);
+        int off = std::stoi(loc);
+        *out_ << "\tmovdqu\t%xmm0, " << off << "(%rbp)\n\tmovdqu\t%xmm1, " << off + 16 << "(%rbp)\n";
+        return;
+    }
+    if (loc.size() > 1 && loc[0] == '%' && loc.compare(1, 3, "xmm") != 0) {
+        // Register-allocated GPR local: evaluate straight into it.
+        emitExpr(value, loc.substr(1), false);
+        return;
+    }
+    emitExprToRax(value);
+    if (loc.empty()) return;
+    auto var = currentVars_.find(name);
+    if (var != currentVars_.end() && var->second.type->kind == Type::Kind::StructRef) {
+        *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tleal\t" : "\tmovq\t%rax, %rcx\n\tleaq\t") << loc
+              << (use32Bit_ ? ", %eax\n" : ", %rax\n");
+        emitStoreAt(var->second.type, 0);
+        return;
+    }
+    *out_ << "\t" << (use32Bit_ ? "movl\t%eax, " : "movq\t%rax, ") << loc << "\n";
+}
+
+// With tailCallee, the frame is dropped and the callee returns straight to
+// this function's caller.
+void CodeGenerator::emitEpilogue(const std::string& tailCallee) {
+    for (const auto& r : savedRegs_)
+        *out_ << "\tmovq\t" << r.second << "(%rbp), " << r.first << "\n";
+    if (tailCallee.empty()) *out_ << "\tleave\n\tret\n";
+    else *out_ << "\tleave\n\tjmp\t" << tailCallee << "\n";
+}
+
+// Whether any address taken in s may point into the frame.
+static bool takesLocalAddress(const Expr* e) {
+    if (!e) return false;
+    if (e->kind == Expr::Kind::AddressOf) {
+        const Expr* root = e->right.get();
+        while (root->kind == Expr::Kind::Member && root->left->exprType->kind == Type::Kind::StructRef)
+            root = root->left.get();
+        if (root->kind == Expr::Kind::Var) return true;
+    }
+    if (takesLocalAddress(e->left.get()) || takesLocalAddress(e->right.get())) return true;
+    for (const auto& a : e->args)
+        if (takesLocalAddress(a.get())) return true;
+    return false;
+}
+
+static bool takesLocalAddress(const Stmt* s) {
+    if (!s) return false;
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        if (takesLocalAddress(e)) return true;
+    for (const auto& b : s->blockStmts)
+        if (takesLocalAddress(b.get())) return true;
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        if (takesLocalAddress(c)) return true;
+    return false;
+}
+
+// A call whose value is returned as is can reuse the frame when its
+// arguments all go in registers and none can point into the frame: struct
+// arguments are passed by address.
+bool CodeGenerator::isTailCall(const Expr* call) {
+    if (!optimize_ || frameEscapes_ || call->kind != Expr::Kind::Call) return false;
+    FuncSymbol* fs = resolveFunc(call->ident, call->ns);
+    if (!fs || isVector(fs->returnType) || fs->returnType->kind == Type::Kind::StructRef) return false;
+    size_t ints = 0, floats = 0;
+    for (const auto& a : call->args) {
+        const Type* t = a->exprType;
+        if (t->kind == Type::Kind::StructRef || isVector(t)) return false;
+        (t->kind == Type::Kind::Float ? floats : ints)++;
+    }
+    return isLinux_ ? ints <= 6 && floats <= 8 : call->args.size() <= 4;
+}
+
+// The System V classes of the eightbytes of a struct passed to or returned
+// from C: sse[k] when eightbyte k holds only floats and goes in an xmm
+// register, otherwise in a general one. False when the struct goes in
+// memory instead: it is larger than 16 bytes or has a misaligned member.
+bool CodeGenerator::sysvClasses(const Type* t, std::vector<bool>& sse) {
+    int size = getTypeSize(t);
+    if (size == 0 || size > 16) return false;
+    std::vector<int> classes((size + 7) / 8, 0);
+    if (!classifyAt(t, 0, classes)) return false;
+    sse.clear();
+    for (int c : classes) sse.push_back(c == 1);
+    return true;
+}
+
+// Merges the members of t at off into classes: 1 for float, 2 for integer.
+bool CodeGenerator::classifyAt(const Type* t, int off, std::vector<int>& classes) {
+    if (t->kind == Type::Kind::StructRef) {
+        StructDef* sd = resolveStruct(t->structName, t->ns);
+        if (!sd) return false;
+        for (size_t i = 0; i < sd->members.size(); i++)
+            if (!classifyAt(sd->members[i].second, off + (int)sd->offsets[i], classes)) return false;
+        return true;
+    }
+    int size = getTypeSize(t);
+    if (isVector(t) || off % size != 0) return false;
+    int& c = classes[off / 8];
+    c = t->kind == Type::Kind::Float && c != 2 ? 1 : 2;
+    return true;
+}
+
+// A call on 64-bit Linux. The first six integer and eight float arguments
+// go in registers and the rest in order in an argument area at rsp. A GS++
+// function takes a struct by address and copies it, and returns one
+// through the slot whose address it gets in rax. C (an extern function)
+// takes and returns a struct of up to 16 bytes in registers, one per
+// eightbyte, and a larger one in memory: copied to the argument area, or
+// written to the slot whose address it gets in rdi.
+void CodeGenerator::emitCallSysV(Expr* call, FuncSymbol* fs, const std::string& dest) {
+    static const char* const regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+    static const char* const fregs[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
+    bool toC = fs->decl && fs->decl->isExtern;
+    const Type* ret = fs->returnType;
+    bool structResult = ret->kind == Type::Kind::StructRef;
+    std::vector<bool> resultSse;
+    bool resultInRegs = structResult && toC && sysvClasses(ret, resultSse);
+    int ireg = structResult && toC && !resultInRegs ? 1 : 0;  // rdi is the result slot
+    int freg = 0;
+
+    // Where each argument goes: registers, or an offset in the argument area.
+    struct Place { std::vector<const char*> regs; int stack = -1; int save = -1; };
+    size_t n = call->args.size();
+    std::vector<Place> places(n);
+    int areaBytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Type* t = call->args[i]->exprType;
+        Place& p = places[i];
+        if (toC && t->kind == Type::Kind::StructRef) {
+            std::vector<bool> sse;
+            int floats = 0;
+            bool small = sysvClasses(t, sse);
+            for (bool s : sse) floats += s;
+            if (small && ireg + (int)sse.size() - floats <= 6 && freg + floats <= 8) {
+                for (bool s : sse) p.regs.push_back(s ? fregs[freg++] : regs[ireg++]);
+            } else {
+                p.stack = areaBytes;
+                areaBytes += (getTypeSize(t) + 7) & ~7;
+            }
+        } else if (t->kind == Type::Kind::Float ? freg < 8 : ireg < 6) {
+            p.regs.push_back(t->kind == Type::Kind::Float ? fregs[freg++] : regs[ireg++]);
+        } else {
+            p.stack = areaBytes;
+            areaBytes += 8;
+        }
+    }
+    // An argument whose register a later one would overwrite waits in the
+    // area until all are evaluated. Besides calls, expressions only touch
+    // rax, rcx, rdx, r10, r11, xmm0 and xmm1.
+    auto clobbers = [&](const Expr* e, const std::string& reg) {
+        if (hasCall(e)) return true;
+        if (isLeaf(e) || e->kind == Expr::Kind::StringLit) return false;
+        return reg == "rcx" || reg == "rdx" || reg == "xmm0" || reg == "xmm1";
+    };
+    for (size_t i = 0; i < n; i++) {
+        Place& p = places[i];
+        bool wait = false;
+        for (size_t j = i + 1; j < n && !wait; j++)
+            for (const char* r : p.regs) wait |= clobbers(call->args[j].get(), r);
+        if (wait) {
+            p.save = areaBytes;
+            areaBytes += 8 * (int)p.regs.size();
+        }
+    }
+    areaBytes = (areaBytes + 15) & ~15;
+    if (areaBytes) *out_ << "\tsubq\t$" << areaBytes << ", %rsp\n";
+
+    for (size_t i = 0; i < n; i++) {
+        Expr* a = call->args[i].get();
+        const Place& p = places[i];
+        bool byValue = toC && a->exprType->kind == Type::Kind::StructRef;
+        if (p.stack >= 0) {
+            emitExprToRax(a);
+            if (byValue) emitCopyToFrame(a->exprType, p.stack, true);
+            else *out_ << "\tmovq\t%rax, " << p.stack << "(%rsp)\n";
+        } else if (byValue) {
+            emitExprToRax(a);
+            for (size_t k = 0; k < p.regs.size(); k++) {
+                if (p.save < 0) {
+                    *out_ << "\tmovq\t" << 8 * k << "(%rax), %" << p.regs[k] << "\n";
+                } else {
+                    *out_ << "\tmovq\t" << 8 * k << "(%rax), %r11\n";
+                    *out_ << "\tmovq\t%r11, " << p.save + 8 * (int)k << "(%rsp)\n";
+                }
+            }
+        } else if (p.save >= 0) {
+            emitExprToRax(a);
+            *out_ << "\tmovq\t%rax, " << p.save << "(%rsp)\n";
+        } else {
+            emitExpr(a, p.regs[0], a->exprType->kind == Type::Kind::Float);
+        }
+    }
+    for (const Place& p : places)
+        for (size_t k = 0; p.save >= 0 && k < p.regs.size(); k++)
+            *out_ << "\tmovq\t" << p.save + 8 * (int)k << "(%rsp), %" << p.regs[k] << "\n";
+    if (structResult && !resultInRegs)
+        *out_ << "\tleaq\t" << getVarLocation(call->member) << ", %" << (toC ? "rdi" : "rax") << "\n";
+    if (toC) *out_ << "\tmovl\t$" << freg << ", %eax\n";  // xmm registers used, for varargs
+    if (call == tailCall_) {
+        tailCall_ = nullptr;
+        emitEpilogue(fs->mangledName);
+        return;
+    }
+    *out_ << "\tcall\t" << fs->mangledName << "\n";
+    if (areaBytes) *out_ << "\taddq\t$" << areaBytes << ", %rsp\n";
+
+    if (resultInRegs) {
+        std::string slot = getVarLocation(call->member);
+        int off = std::stoi(slot);
+        const char* ints[] = {"rax", "rdx"};
+        const char* floats[] = {"xmm0", "xmm1"};
+        int ni = 0, nf = 0;
+        for (size_t k = 0; k < resultSse.size(); k++)
+            *out_ << "\tmovq\t%" << (resultSse[k] ? floats[nf++] : ints[ni++]) << ", " << off + 8 * (int)k
+                  << "(%rbp)\n";
+        *out_ << "\tleaq\t" << slot << ", %" << dest << "\n";
+    } else if (ret->kind == Type::Kind::Float) {
+        if (dest != "xmm0") *out_ << "\tmovq\t%xmm0, %" << dest << "\n";
+    } else if (isVector(ret)) {
+        // already in xmm0:xmm1
+    } else if (dest != "rax") {
+        *out_ << "\tmovq\t%rax, %" << dest << "\n";
+    }
+}
+
 void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFloat) {
     if (!expr) return;
     std::string dest = destReg;
@@ -91,6 +393,10 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
     }
     const char* mov = use32Bit_ ? "movl" : "movq";
     const char* rax = use32Bit_ ? "eax" : "rax";
+    if (isVector(expr->exprType) && expr->kind != Expr::Kind::Call) {
+        emitVectorExpr(expr);
+        return;
+    }
     switch (expr->kind) {
         case Expr::Kind::IntLit:
             if (use32Bit_)
@@ -127,10 +433,10 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
             break;
         case Expr::Kind::StringLit: {
             std::string label;
-            if (stringPool_.count(expr->ident)) label = stringPool_[expr->ident];
+            if (stringPool_.count(expr->strVal)) label = stringPool_[expr->strVal];
             else {
                 label = ".LS" + std::to_string(stringPool_.size());
-                stringPool_[expr->ident] = label;
+                stringPool_[expr->strVal] = label;
             }
             if (use32Bit_) *out_ << "\tmovl\t$" << label << ", %" << dest << "\n";
             else *out_ << "\tleaq\t" << label << "(%rip), %" << dest << "\n";
@@ -139,18 +445,21 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
         case Expr::Kind::Var: {
             std::string loc = getVarLocation(expr->ident);
             if (loc.empty()) { error("unknown variable " + expr->ident, expr->loc); return; }
-            *out_ << "\t" << mov << "\t" << loc << ", %" << dest << "\n";
+            if (expr->exprType->kind == Type::Kind::StructRef)  // a struct local is used through its address
+                *out_ << "\t" << (use32Bit_ ? "leal" : "leaq") << "\t" << loc << ", %" << dest << "\n";
+            else
+                *out_ << "\t" << mov << "\t" << loc << ", %" << dest << "\n";
             break;
         }
         case Expr::Kind::Binary: {
-            if (expr->op == "and" || expr->op == "or") {
+            if (expr->op == Expr::Op::And || expr->op == Expr::Op::Or) {
                 std::string endLabel = nextLabel();
                 emitExprToRax(expr->left.get());
                 if (use32Bit_) {
-                    if (expr->op == "and") { *out_ << "\ttestl\t%eax, %eax\n"; *out_ << "\tje\t" << endLabel << "\n"; }
+                    if (expr->op == Expr::Op::And) { *out_ << "\ttestl\t%eax, %eax\n"; *out_ << "\tje\t" << endLabel << "\n"; }
                     else { *out_ << "\ttestl\t%eax, %eax\n"; *out_ << "\tjne\t" << endLabel << "\n"; }
                 } else {
-                    if (expr->op == "and") { *out_ << "\ttestq\t%rax, %rax\n"; *out_ << "\tje\t" << endLabel << "\n"; }
+                    if (expr->op == Expr::Op::And) { *out_ << "\ttestq\t%rax, %rax\n"; *out_ << "\tje\t" << endLabel << "\n"; }
                     else { *out_ << "\ttestq\t%rax, %rax\n"; *out_ << "\tjne\t" << endLabel << "\n"; }
                 }
                 emitExprToRax(expr->right.get());
@@ -158,47 +467,66 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
                 if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
                 return;
             }
-            if (expr->op == "==" || expr->op == "!=" || expr->op == "<" || expr->op == ">" || expr->op == "<=" || expr->op == ">=") {
-                emitExprToRax(expr->left.get());
-                *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
-                emitExprToRax(expr->right.get());
-                *out_ << (use32Bit_ ? "\tpopl\t%ecx\n" : "\tpopq\t%rcx\n");
-                *out_ << (use32Bit_ ? "\tcmpl\t%eax, %ecx\n" : "\tcmpq\t%rax, %rcx\n");
-                if (expr->op == "==") *out_ << "\tsete\t%al\n";
-                else if (expr->op == "!=") *out_ << "\tsetne\t%al\n";
-                else if (expr->op == "<") *out_ << "\tsetl\t%al\n";
-                else if (expr->op == ">") *out_ << "\tsetg\t%al\n";
-                else if (expr->op == "<=") *out_ << "\tsetle\t%al\n";
+            if (expr->op == Expr::Op::Eq || expr->op == Expr::Op::Ne || expr->op == Expr::Op::Lt || expr->op == Expr::Op::Gt || expr->op == Expr::Op::Le || expr->op == Expr::Op::Ge) {
+                if (optimize_) {
+                    emitOperands(expr->left.get(), expr->right.get());
+                    *out_ << "\tcmpq\t%rcx, %rax\n";
+                } else {
+                    emitExprToRax(expr->left.get());
+                    *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
+                    emitExprToRax(expr->right.get());
+                    *out_ << (use32Bit_ ? "\tpopl\t%ecx\n" : "\tpopq\t%rcx\n");
+                    *out_ << (use32Bit_ ? "\tcmpl\t%eax, %ecx\n" : "\tcmpq\t%rax, %rcx\n");
+                }
+                if (expr->op == Expr::Op::Eq) *out_ << "\tsete\t%al\n";
+                else if (expr->op == Expr::Op::Ne) *out_ << "\tsetne\t%al\n";
+                else if (expr->op == Expr::Op::Lt) *out_ << "\tsetl\t%al\n";
+                else if (expr->op == Expr::Op::Gt) *out_ << "\tsetg\t%al\n";
+                else if (expr->op == Expr::Op::Le) *out_ << "\tsetle\t%al\n";
                 else *out_ << "\tsetge\t%al\n";
                 *out_ << (use32Bit_ ? "\tmovzbl\t%al, %eax\n" : "\tmovzbq\t%al, %rax\n");
                 if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
                 return;
             }
-            if (expr->left->exprType.kind == Type::Kind::Float) {
-                emitExprToXmm0(expr->left.get());
-                *out_ << "\tsubq\t$8, %rsp\n\tmovq\t%xmm0, (%rsp)\n";
-                emitExprToXmm0(expr->right.get());
-                *out_ << "\tmovq\t%xmm0, %xmm1\n\tmovq\t(%rsp), %xmm0\n\taddq\t$8, %rsp\n";
-                if (expr->op == "+") *out_ << "\taddsd\t%xmm1, %xmm0\n";
-                else if (expr->op == "-") *out_ << "\tsubsd\t%xmm1, %xmm0\n";
-                else if (expr->op == "*") *out_ << "\tmulsd\t%xmm1, %xmm0\n";
-                else if (expr->op == "/") *out_ << "\tdivsd\t%xmm1, %xmm0\n";
+            if (expr->left->exprType->kind == Type::Kind::Float) {
+                if (optimize_ && expr->right->kind == Expr::Kind::Var) {
+                    emitExprToXmm0(expr->left.get());
+                    emitExpr(expr->right.get(), "xmm1", true);
+                } else {
+                    emitExprToXmm0(expr->left.get());
+                    *out_ << "\tsubq\t$8, %rsp\n\tmovq\t%xmm0, (%rsp)\n";
+                    emitExprToXmm0(expr->right.get());
+                    *out_ << "\tmovq\t%xmm0, %xmm1\n\tmovq\t(%rsp), %xmm0\n\taddq\t$8, %rsp\n";
+                }
+                if (expr->op == Expr::Op::Add) *out_ << "\taddsd\t%xmm1, %xmm0\n";
+                else if (expr->op == Expr::Op::Sub) *out_ << "\tsubsd\t%xmm1, %xmm0\n";
+                else if (expr->op == Expr::Op::Mul) *out_ << "\tmulsd\t%xmm1, %xmm0\n";
+                else if (expr->op == Expr::Op::Div) *out_ << "\tdivsd\t%xmm1, %xmm0\n";
                 if (dest != "xmm0") *out_ << "\tmovq\t%xmm0, %" << dest << "\n";
                 return;
             }
-            emitExprToRax(expr->left.get());
-            *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
-            emitExprToRax(expr->right.get());
-            *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tpopl\t%eax\n" : "\tmovq\t%rax, %rcx\n\tpopq\t%rax\n");
-            if (expr->op == "+") {
-                if (expr->left->exprType.kind == Type::Kind::Pointer) {
-                    int size = getTypeSize(*expr->left->exprType.ptrTo);
+            if ((expr->op == Expr::Op::Add || expr->op == Expr::Op::Sub) &&
+                expr->left->exprType->kind == Type::Kind::Pointer && expr->right->kind == Expr::Kind::IntLit) {
+                // A constant step, as strength reduction leaves in loops.
+                int64_t offset = expr->right->intVal * getTypeSize(expr->left->exprType->ptrTo);
+                if (expr->op == Expr::Op::Sub) offset = -offset;
+                if (offset >= INT32_MIN && offset <= INT32_MAX) {
+                    emitExprToRax(expr->left.get());
+                    if (offset != 0) *out_ << (use32Bit_ ? "\taddl\t$" : "\taddq\t$") << offset << ", %" << rax << "\n";
+                    if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
+                    return;
+                }
+            }
+            emitOperands(expr->left.get(), expr->right.get());
+            if (expr->op == Expr::Op::Add) {
+                if (expr->left->exprType->kind == Type::Kind::Pointer) {
+                    int size = getTypeSize(expr->left->exprType->ptrTo);
                     if (use32Bit_) *out_ << "\timull\t$" << size << ", %ecx\n\taddl\t%ecx, %eax\n";
                     else *out_ << "\timulq\t$" << size << ", %rcx\n\taddq\t%rcx, %rax\n";
                     if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
                     return;
                 }
-                if (expr->left->exprType.kind == Type::Kind::String) {
+                if (expr->left->exprType->kind == Type::Kind::String) {
                     if (use32Bit_) {
                         *out_ << "\tpushl\t%ecx\n\tpushl\t%eax\n\tcall\t_gspp_strcat\n\taddl\t$8, %esp\n";
                     } else {
@@ -211,9 +539,9 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
                 } else {
                     *out_ << (use32Bit_ ? "\taddl\t%ecx, %eax\n" : "\taddq\t%rcx, %rax\n");
                 }
-            } else if (expr->op == "-") {
-                if (expr->left->exprType.kind == Type::Kind::Pointer) {
-                    int size = getTypeSize(*expr->left->exprType.ptrTo);
+            } else if (expr->op == Expr::Op::Sub) {
+                if (expr->left->exprType->kind == Type::Kind::Pointer) {
+                    int size = getTypeSize(expr->left->exprType->ptrTo);
                     if (use32Bit_) *out_ << "\timull\t$" << size << ", %ecx\n\tsubl\t%ecx, %eax\n";
                     else *out_ << "\timulq\t$" << size << ", %rcx\n\tsubq\t%rcx, %rax\n";
                     if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
@@ -221,11 +549,11 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
                 }
                 *out_ << (use32Bit_ ? "\tsubl\t%ecx, %eax\n" : "\tsubq\t%rcx, %rax\n");
             }
-            else if (expr->op == "*") *out_ << (use32Bit_ ? "\timull\t%ecx, %eax\n" : "\timulq\t%rcx, %rax\n");
-            else if (expr->op == "/") {
+            else if (expr->op == Expr::Op::Mul) *out_ << (use32Bit_ ? "\timull\t%ecx, %eax\n" : "\timulq\t%rcx, %rax\n");
+            else if (expr->op == Expr::Op::Div) {
                 if (use32Bit_) { *out_ << "\tcdq\n\tidivl\t%ecx\n"; }
                 else { *out_ << "\tcqto\n\tidivq\t%rcx\n"; }
-            } else if (expr->op == "%") {
+            } else if (expr->op == Expr::Op::Mod) {
                 if (use32Bit_) { *out_ << "\tcdq\n\tidivl\t%ecx\n\tmovl\t%edx, %eax\n"; }
                 else { *out_ << "\tcqto\n\tidivq\t%rcx\n\tmovq\t%rdx, %rax\n"; }
             }
@@ -233,10 +561,10 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
             break;
         }
         case Expr::Kind::Unary:
-            if (expr->op == "-") {
+            if (expr->op == Expr::Op::Neg) {
                 emitExprToRax(expr->right.get());
                 *out_ << (use32Bit_ ? "\tnegl\t%eax\n" : "\tnegq\t%rax\n");
-            } else if (expr->op == "not") {
+            } else if (expr->op == Expr::Op::Not) {
                 emitExprToRax(expr->right.get());
                 *out_ << (use32Bit_ ? "\ttestl\t%eax, %eax\n" : "\ttestq\t%rax, %rax\n");
                 *out_ << "\tsete\t%al\n";
@@ -245,93 +573,121 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
             if (dest != "rax" && dest != "eax") *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
             break;
         case Expr::Kind::Call: {
-            std::string funcName = expr->ident;
+            static const Symbol printSym("print"), printlnSym("println");
+            static const Symbol printStringSym("print_string"), printlnStringSym("println_string");
+            static const Symbol printFloatSym("print_float"), printlnFloatSym("println_float");
+            Symbol funcName = expr->ident;
             if (expr->ns.empty()) {
-                if (funcName == "print" && !expr->args.empty()) {
-                    if (expr->args[0]->exprType.kind == Type::Kind::String) funcName = "print_string";
+                if (funcName == printSym && !expr->args.empty()) {
+                    if (expr->args[0]->exprType->kind == Type::Kind::String) funcName = printStringSym;
                 }
-                if (funcName == "println" && !expr->args.empty()) {
-                    if (expr->args[0]->exprType.kind == Type::Kind::String) funcName = "println_string";
+                if (funcName == printlnSym && !expr->args.empty()) {
+                    if (expr->args[0]->exprType->kind == Type::Kind::String) funcName = printlnStringSym;
                 }
             }
             FuncSymbol* fs = resolveFunc(funcName, expr->ns);
+            if (!fs && expr->ns.empty() && isVectorBuiltin(expr->ident)) {
+                emitVectorBuiltin(expr, dest);
+                return;
+            }
             if (!fs) { error("unknown function " + expr->ident, expr->loc); return; }
+            if (fs->decl && fs->decl->isExtern && (use32Bit_ || !isLinux_)) {
+                bool byValue = fs->returnType->kind == Type::Kind::StructRef;
+                for (const auto& a : expr->args) byValue |= a->exprType->kind == Type::Kind::StructRef;
+                if (byValue) error("structs are passed to and from C by value only on 64-bit Linux", expr->loc);
+            }
+            if (!use32Bit_ && isLinux_) {
+                emitCallSysV(expr, fs, dest);
+                break;
+            }
+            // A struct result is copied to the slot whose address is in rax.
+            std::string resultAt;
+            if (fs->returnType->kind == Type::Kind::StructRef) resultAt = getVarLocation(expr->member);
             if (use32Bit_) {
                 // cdecl: push args right to left
                 for (int i = (int)expr->args.size() - 1; i >= 0; i--)
                     emitExprToRax(expr->args[i].get()), *out_ << "\tpushl\t%eax\n";
+                if (!resultAt.empty()) *out_ << "\tleal\t" << resultAt << ", %eax\n";
                 *out_ << "\tcall\t" << fs->mangledName << "\n";
                 *out_ << "\taddl\t$" << (4 * (int)expr->args.size()) << ", %esp\n";
                 if (dest != "rax" && dest != "eax") *out_ << "\tmovl\t%eax, %" << dest << "\n";
-            } else {
-                if (isLinux_) {
-                    const char* regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
-                    const char* fregs[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
-                    int ireg = 0, freg = 0;
-                    for (size_t i = 0; i < expr->args.size(); i++) {
-                        if (expr->args[i]->exprType.kind == Type::Kind::Float) {
-                            if (freg < 8) emitExpr(expr->args[i].get(), fregs[freg++], true);
-                            else { emitExprToRax(expr->args[i].get()); *out_ << "\tpushq\t%rax\n"; }
-                        } else {
-                            if (ireg < 6) emitExpr(expr->args[i].get(), regs[ireg++], false);
-                            else { emitExprToRax(expr->args[i].get()); *out_ << "\tpushq\t%rax\n"; }
-                        }
-                    }
-                    *out_ << "\tmovl\t$" << freg << ", %eax\n"; // for varargs
-                    *out_ << "\tcall\t" << fs->mangledName << "\n";
-                    int totalPushed = (ireg > 6 ? ireg - 6 : 0) + (freg > 8 ? freg - 8 : 0);
-                    if (totalPushed > 0) *out_ << "\taddq\t$" << (totalPushed * 8) << ", %rsp\n";
-                } else {
-                    bool floatFirst = (expr->ident == "print_float" || expr->ident == "println_float") && !expr->args.empty();
-                    for (size_t i = 0; i < expr->args.size(); i++) {
-                        if (i < 4) {
-                            if (i == 0 && floatFirst) emitExpr(expr->args[i].get(), "xmm0", true);
-                            else emitExpr(expr->args[i].get(), i == 0 ? "rcx" : i == 1 ? "rdx" : i == 2 ? "r8" : "r9", false);
-                        } else {
-                            *out_ << "\tsubq\t$8, %rsp\n";
-                            emitExprToRax(expr->args[i].get());
-                            *out_ << "\tpushq\t%rax\n";
-                        }
+            } else {  // Windows x64
+                bool floatFirst = (expr->ident == printFloatSym || expr->ident == printlnFloatSym) && !expr->args.empty();
+                for (size_t i = 0; i < expr->args.size(); i++) {
+                    if (i < 4) {
+                        if (i == 0 && floatFirst) emitExpr(expr->args[i].get(), "xmm0", true);
+                        else emitExpr(expr->args[i].get(), i == 0 ? "rcx" : i == 1 ? "rdx" : i == 2 ? "r8" : "r9", false);
+                    } else {
+                        *out_ << "\tsubq\t$8, %rsp\n";
+                        emitExprToRax(expr->args[i].get());
+                        *out_ << "\tpushq\t%rax\n";
                     }
-                    *out_ << "\tsubq\t$32, %rsp\n";
-                    *out_ << "\tcall\t" << fs->mangledName << "\n";
-                    *out_ << "\taddq\t$32, %rsp\n";
-                    for (size_t i = 4; i < expr->args.size(); i++) *out_ << "\taddq\t$8, %rsp\n";
                 }
-                if (dest != "rax") *out_ << "\tmovq\t%rax, %" << dest << "\n";
+                if (!resultAt.empty()) *out_ << "\tleaq\t" << resultAt << ", %rax\n";
+                if (expr == tailCall_) {  // the caller's shadow space serves
+                    tailCall_ = nullptr;
+                    emitEpilogue(fs->mangledName);
+                    break;
+                }
+                *out_ << "\tsubq\t$32, %rsp\n";
+                *out_ << "\tcall\t" << fs->mangledName << "\n";
+                *out_ << "\taddq\t$32, %rsp\n";
+                for (size_t i = 4; i < expr->args.size(); i++) *out_ << "\taddq\t$8, %rsp\n";
+                if (fs->returnType->kind == Type::Kind::Float) {
+                    if (dest != "xmm0") *out_ << "\tmovq\t%xmm0, %" << dest << "\n";
+                } else if (isVector(fs->returnType)) {
+                    // already in xmm0:xmm1
+                } else if (dest != "rax") *out_ << "\tmovq\t%rax, %" << dest << "\n";
             }
             break;
         }
         case Expr::Kind::Member: {
+            if (isSoaMember(expr)) {
+                emitSoaMemberAddress(expr);
+                emitLoad(expr->exprType, 0, dest);
+                break;
+            }
             emitExprToRax(expr->left.get());
-            Type baseType = expr->left->exprType;
-            if (baseType.kind == Type::Kind::Pointer) baseType = *baseType.ptrTo;
-            StructDef* sd = resolveStruct(baseType.structName, baseType.ns);
+            const Type* baseType = expr->left->exprType;
+            if (baseType->kind == Type::Kind::Pointer) baseType = baseType->ptrTo;
+            StructDef* sd = resolveStruct(baseType->structName, baseType->ns);
             if (!sd) { error("unknown struct", expr->loc); return; }
             auto it = sd->memberIndex.find(expr->member);
             if (it == sd->memberIndex.end()) { error("no member " + expr->member, expr->loc); return; }
-            int offset = (int)(it->second * (use32Bit_ ? 4 : 8));
-            *out_ << "\t" << mov << "\t" << offset << "(%" << rax << "), %" << dest << "\n";
+            emitLoad(sd->members[it->second].second, (int)sd->offsets[it->second], dest);
             break;
         }
-        case Expr::Kind::Deref: {
+        case Expr::Kind::Deref:
             emitExprToRax(expr->right.get());
-            *out_ << "\t" << mov << "\t(%" << rax << "), %" << dest << "\n";
+            emitLoad(expr->exprType, 0, dest);
+            break;
+        case Expr::Kind::Index:
+            emitIndexAddress(expr);
+            emitLoad(expr->exprType, 0, dest);
+            break;
+        case Expr::Kind::Slice:
+            emitSlice(expr, dest);
+            break;
+        case Expr::Kind::NewArray:
+            emitNewArray(expr, dest);
             break;
-        }
         case Expr::Kind::AddressOf: {
             if (expr->right->kind == Expr::Kind::Var) {
                 std::string loc = getVarLocation(expr->right->ident);
                 *out_ << "\t" << (use32Bit_ ? "leal" : "leaq") << "\t" << loc << ", %" << dest << "\n";
+            } else if (expr->right->kind == Expr::Kind::Index || isSoaMember(expr->right.get())) {
+                if (expr->right->kind == Expr::Kind::Index) emitIndexAddress(expr->right.get());
+                else emitSoaMemberAddress(expr->right.get());
+                if (dest != rax) *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
             } else if (expr->right->kind == Expr::Kind::Member) {
                 emitExprToRax(expr->right->left.get());
-                Type baseType = expr->right->left->exprType;
-                if (baseType.kind == Type::Kind::Pointer) baseType = *baseType.ptrTo;
-                StructDef* sd = resolveStruct(baseType.structName, baseType.ns);
+                const Type* baseType = expr->right->left->exprType;
+                if (baseType->kind == Type::Kind::Pointer) baseType = baseType->ptrTo;
+                StructDef* sd = resolveStruct(baseType->structName, baseType->ns);
                 if (sd) {
                     auto it = sd->memberIndex.find(expr->right->member);
                     if (it != sd->memberIndex.end()) {
-                        int off = (int)(it->second * (use32Bit_ ? 4 : 8));
+                        int off = (int)sd->offsets[it->second];
                         *out_ << "\t" << (use32Bit_ ? "addl" : "addq") << "\t$" << off << ", %" << rax << "\n";
                         if (dest != rax) *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
                     }
@@ -340,22 +696,17 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
             break;
         }
         case Expr::Kind::New: {
-            int size = getTypeSize(*expr->targetType);
+            int size = getTypeSize(expr->targetType);
+            if (isSoa(expr->targetType)) {
+                emitNewSoa(expr);
+                if (dest != rax) *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
+                break;
+            }
             if (expr->left) {
                 emitExprToRax(expr->left.get());
-                if (use32Bit_) {
-                    *out_ << "\timull\t$" << size << ", %eax\n";
-                    *out_ << "\tpushl\t%eax\n";
-                    *out_ << "\tcall\tmalloc\n\taddl\t$4, %esp\n";
-                    if (dest != "eax") *out_ << "\tmovl\t%eax, %" << dest << "\n";
-                } else {
-                    *out_ << "\timulq\t$" << size << ", %rax\n";
-                    if (isLinux_) *out_ << "\tmovq\t%rax, %rdi\n";
-                    else { *out_ << "\tmovq\t%rax, %rcx\n\tsubq\t$32, %rsp\n"; }
-                    *out_ << "\tcall\tmalloc\n";
-                    if (!isLinux_) *out_ << "\taddq\t$32, %rsp\n";
-                    if (dest != "rax") *out_ << "\tmovq\t%rax, %" << dest << "\n";
-                }
+                *out_ << (use32Bit_ ? "\timull\t$" : "\timulq\t$") << size << (use32Bit_ ? ", %eax\n" : ", %rax\n");
+                emitMalloc();
+                if (dest != rax) *out_ << "\t" << mov << "\t%" << rax << ", %" << dest << "\n";
             } else {
                 if (use32Bit_) {
                     *out_ << "\tpushl\t$" << size << "\n";
@@ -373,6 +724,11 @@ void CodeGenerator::emitExpr(Expr* expr, const std::string& destReg, bool wantFl
         }
         case Expr::Kind::Delete: {
             emitExprToRax(expr->right.get());
+            const Type* target = expr->right->exprType;
+            if (isSlice(target))  // the memory of new [n]T
+                *out_ << (use32Bit_ ? "\tmovl\t(%eax), %eax\n" : "\tmovq\t(%rax), %rax\n");
+            if (target->kind == Type::Kind::Pointer && isSoa(target->ptrTo))  // free from the length word
+                *out_ << (use32Bit_ ? "\tsubl\t$4, %eax\n" : "\tsubq\t$8, %rax\n");
             if (use32Bit_) {
                 *out_ << "\tpushl\t%eax\n";
                 *out_ << "\tcall\tfree\n";
@@ -401,48 +757,44 @@ void CodeGenerator::emitStmt(Stmt* stmt) {
             for (auto& s : stmt->blockStmts) emitStmt(s.get());
             break;
         case Stmt::Kind::VarDecl: {
-            if (stmt->varInit) {
-                emitExprToRax(stmt->varInit.get());
-                std::string loc = getVarLocation(stmt->varName);
-                if (!loc.empty()) *out_ << "\t" << (use32Bit_ ? "movl\t%eax, " : "movq\t%rax, ") << loc << "\n";
-            }
+            if (stmt->varInit) emitStoreVar(stmt->varName, stmt->varInit.get());
             break;
         }
         case Stmt::Kind::Assign: {
             if (stmt->assignTarget->kind == Expr::Kind::Var) {
-                emitExprToRax(stmt->assignValue.get());
-                std::string loc = getVarLocation(stmt->assignTarget->ident);
-                if (!loc.empty()) *out_ << "\t" << (use32Bit_ ? "movl\t%eax, " : "movq\t%rax, ") << loc << "\n";
-            } else if (stmt->assignTarget->kind == Expr::Kind::Member) {
-                emitExprToRax(stmt->assignTarget->left.get());
+                emitStoreVar(stmt->assignTarget->ident, stmt->assignValue.get());
+            } else if (isVector(stmt->assignTarget->exprType)) {
+                emitVectorAddress(stmt->assignTarget.get());
+                *out_ << "\tpushq\t%rax\n";
+                emitExpr(stmt->assignValue.get(), "xmm0", true);
+                *out_ << "\tpopq\t%rax\n\tmovdqu\t%xmm0, (%rax)\n\tmovdqu\t%xmm1, 16(%rax)\n";
+            } else if (stmt->assignTarget->kind == Expr::Kind::Index || isSoaMember(stmt->assignTarget.get())) {
+                if (stmt->assignTarget->kind == Expr::Kind::Index) emitIndexAddress(stmt->assignTarget.get());
+                else emitSoaMemberAddress(stmt->assignTarget.get());
                 *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
                 emitExprToRax(stmt->assignValue.get());
                 *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tpopl\t%eax\n" : "\tmovq\t%rax, %rcx\n\tpopq\t%rax\n");
-                Type baseType = stmt->assignTarget->left->exprType;
-                if (baseType.kind == Type::Kind::Pointer) baseType = *baseType.ptrTo;
-                StructDef* sd = resolveStruct(baseType.structName, baseType.ns);
+                emitStoreAt(stmt->assignTarget->exprType, 0);
+            } else if (stmt->assignTarget->kind == Expr::Kind::Member) {
+                emitOperands(stmt->assignTarget->left.get(), stmt->assignValue.get());
+                const Type* baseType = stmt->assignTarget->left->exprType;
+                if (baseType->kind == Type::Kind::Pointer) baseType = baseType->ptrTo;
+                StructDef* sd = resolveStruct(baseType->structName, baseType->ns);
                 if (sd) {
                     auto it = sd->memberIndex.find(stmt->assignTarget->member);
-                    if (it != sd->memberIndex.end()) {
-                        int off = (int)(it->second * (use32Bit_ ? 4 : 8));
-                        *out_ << "\t" << (use32Bit_ ? "movl\t%ecx, " : "movq\t%rcx, ") << off << "(%" << (use32Bit_ ? "eax" : "rax") << ")\n";
-                    }
+                    if (it != sd->memberIndex.end())
+                        emitStoreAt(sd->members[it->second].second, (int)sd->offsets[it->second]);
                 }
             } else if (stmt->assignTarget->kind == Expr::Kind::Deref) {
-                emitExprToRax(stmt->assignTarget->right.get());
-                *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
-                emitExprToRax(stmt->assignValue.get());
-                *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tpopl\t%eax\n" : "\tmovq\t%rax, %rcx\n\tpopq\t%rax\n");
-                *out_ << "\t" << (use32Bit_ ? "movl\t%ecx, (%eax)" : "movq\t%rcx, (%rax)") << "\n";
+                emitOperands(stmt->assignTarget->right.get(), stmt->assignValue.get());
+                emitStoreAt(stmt->assignTarget->exprType, 0);
             }
             break;
         }
         case Stmt::Kind::If: {
             std::string elseLabel = nextLabel();
             std::string endLabel = nextLabel();
-            emitExprToRax(stmt->condition.get());
-            *out_ << (use32Bit_ ? "\ttestl\t%eax, %eax\n" : "\ttestq\t%rax, %rax\n");
-            *out_ << "\tje\t" << elseLabel << "\n";
+            emitBranch(stmt->condition.get(), elseLabel, false);
             emitStmt(stmt->thenBranch.get());
             *out_ << "\tjmp\t" << endLabel << "\n";
             *out_ << elseLabel << ":\n";
@@ -453,13 +805,12 @@ void CodeGenerator::emitStmt(Stmt* stmt) {
         case Stmt::Kind::While: {
             std::string condLabel = nextLabel();
             std::string bodyLabel = nextLabel();
+            emitVectorLoop(stmt);
             *out_ << "\tjmp\t" << condLabel << "\n";
             *out_ << bodyLabel << ":\n";
             emitStmt(stmt->body.get());
             *out_ << condLabel << ":\n";
-            emitExprToRax(stmt->condition.get());
-            *out_ << (use32Bit_ ? "\ttestl\t%eax, %eax\n" : "\ttestq\t%rax, %rax\n");
-            *out_ << "\tjne\t" << bodyLabel << "\n";
+            emitBranch(stmt->condition.get(), bodyLabel, true);
             break;
         }
         case Stmt::Kind::For: {
@@ -467,28 +818,39 @@ void CodeGenerator::emitStmt(Stmt* stmt) {
             std::string bodyLabel = nextLabel();
             std::string stepLabel = nextLabel();
             emitStmt(stmt->initStmt.get());
+            emitVectorLoop(stmt);
             *out_ << "\tjmp\t" << condLabel << "\n";
             *out_ << bodyLabel << ":\n";
             emitStmt(stmt->body.get());
             *out_ << stepLabel << ":\n";
             emitStmt(stmt->stepStmt.get());
             *out_ << condLabel << ":\n";
-            emitExprToRax(stmt->condition.get());
-            *out_ << (use32Bit_ ? "\ttestl\t%eax, %eax\n" : "\ttestq\t%rax, %rax\n");
-            *out_ << "\tjne\t" << bodyLabel << "\n";
+            emitBranch(stmt->condition.get(), bodyLabel, true);
             break;
         }
-        case Stmt::Kind::Return:
-            if (stmt->returnExpr) {
-                if (stmt->returnExpr->exprType.kind == Type::Kind::Float)
+        case Stmt::Kind::Return: {
+            // return f(x) under -O jumps to f, which returns to our caller.
+            bool tail = stmt->returnExpr && isTailCall(stmt->returnExpr.get());
+            if (tail) tailCall_ = stmt->returnExpr.get();
+            if (stmt->returnExpr && stmt->returnExpr->exprType->kind == Type::Kind::StructRef) {
+                // Copy the struct to where the caller wants it, and return that address.
+                emitExprToRax(stmt->returnExpr.get());
+                *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tmovl\t" : "\tmovq\t%rax, %rcx\n\tmovq\t")
+                      << getVarLocation(resultSlot()) << (use32Bit_ ? ", %eax\n" : ", %rax\n");
+                emitStoreAt(stmt->returnExpr->exprType, 0);
+            } else if (stmt->returnExpr) {
+                if (stmt->returnExpr->exprType->kind == Type::Kind::Float || isVector(stmt->returnExpr->exprType))
                     emitExprToXmm0(stmt->returnExpr.get());
                 else
                     emitExprToRax(stmt->returnExpr.get());
             } else {
                 *out_ << (use32Bit_ ? "\tmovl\t$0, %eax\n" : "\tmovq\t$0, %rax\n");
             }
-            *out_ << "\tleave\n\tret\n";
+            bool jumped = tail && !tailCall_;
+            tailCall_ = nullptr;
+            if (!jumped) emitEpilogue();
             break;
+        }
         case Stmt::Kind::ExprStmt:
             emitExprToRax(stmt->expr.get());
             break;
@@ -501,52 +863,717 @@ void CodeGenerator::emitStmt(Stmt* stmt) {
     }
 }
 
+// Loads the value of type at off(rax) into dest. A struct value is its
+// address.
+void CodeGenerator::emitLoad(const Type* type, int off, const std::string& dest) {
+    const char* rax = use32Bit_ ? "eax" : "rax";
+    if (type->kind == Type::Kind::StructRef)
+        *out_ << "\t" << (use32Bit_ ? "leal" : "leaq") << "\t" << off << "(%" << rax << "), %" << dest << "\n";
+    else if (type->kind == Type::Kind::Bool || type->kind == Type::Kind::Char)
+        *out_ << "\t" << (use32Bit_ ? "movzbl" : "movzbq") << "\t" << off << "(%" << rax << "), %" << dest << "\n";
+    else
+        *out_ << "\t" << (use32Bit_ ? "movl" : "movq") << "\t" << off << "(%" << rax << "), %" << dest << "\n";
+}
+
+bool CodeGenerator::isSoa(const Type* t) {
+    if (t->kind != Type::Kind::StructRef) return false;
+    StructDef* sd = resolveStruct(t->structName, t->ns);
+    return sd && sd->soa;
+}
+
+bool CodeGenerator::isSlice(const Type* t) {
+    if (t->kind != Type::Kind::StructRef) return false;
+    StructDef* sd = resolveStruct(t->structName, t->ns);
+    return sd && sd->slice;
+}
+
+// Calls _gspp_bounds_fail(index, length) unless index < length (or <= for
+// an inclusive bound), comparing unsigned so a negative index fails too.
+// The operands are memory or registers other than the argument registers.
+void CodeGenerator::emitBoundsCheck(const std::string& index, const std::string& length, bool inclusive) {
+    std::string ok = nextLabel();
+    *out_ << "\t" << (use32Bit_ ? "cmpl" : "cmpq") << "\t" << length << ", " << index << "\n";
+    *out_ << "\t" << (inclusive ? "jbe" : "jb") << "\t" << ok << "\n";
+    if (use32Bit_)
+        *out_ << "\tmovl\t" << length << ", %edx\n\tmovl\t" << index << ", %eax\n\tpushl\t%edx\n\tpushl\t%eax\n";
+    else if (isLinux_)
+        *out_ << "\tmovq\t" << length << ", %rsi\n\tmovq\t" << index << ", %rdi\n";
+    else
+        *out_ << "\tmovq\t" << length << ", %rdx\n\tmovq\t" << index << ", %rcx\n";
+    *out_ << "\tcall\t_gspp_bounds_fail\n" << ok << ":\n";
+}
+
+// Builds base[lo..hi] in the expression's frame slot and leaves the slot's
+// address in dest. Slicing a slice checks lo <= hi <= len; slicing a raw
+// pointer checks nothing.
+void CodeGenerator::emitSlice(Expr* expr, const std::string& dest) {
+    const char* mov = use32Bit_ ? "movl" : "movq";
+    const char* sp = use32Bit_ ? "%esp" : "%rsp";
+    const char* rax = use32Bit_ ? "%eax" : "%rax";
+    const char* rcx = use32Bit_ ? "%ecx" : "%rcx";
+    int word = use32Bit_ ? 4 : 8;
+    StructDef* sd = resolveStruct(expr->exprType->structName, expr->exprType->ns);
+    int size = getTypeSize(sd->members[0].second->ptrTo);
+    std::string slot = getVarLocation(expr->ident);
+    std::string frame = slot.substr(slot.find('('));
+    int off = std::stoi(slot);
+
+    // base and lo on the stack, hi in rcx, then base back in rax.
+    emitExprToRax(expr->left.get());
+    *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
+    emitExprToRax(expr->args[0].get());
+    *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
+    emitExprToRax(expr->args[1].get());
+    *out_ << "\t" << mov << "\t" << rax << ", " << rcx << "\n";
+    *out_ << "\t" << mov << "\t" << word << "(" << sp << "), " << rax << "\n";
+    if (isSlice(expr->left->exprType)) {
+        emitBoundsCheck(rcx, std::to_string(word) + "(" + rax + ")", true);
+        emitBoundsCheck(std::string("(") + sp + ")", rcx, true);
+        *out_ << "\t" << mov << "\t(" << rax << "), " << rax << "\n";
+    }
+    *out_ << "\t" << (use32Bit_ ? "subl" : "subq") << "\t(" << sp << "), " << rcx << "\n";
+    *out_ << "\t" << mov << "\t" << rcx << ", " << off + word << frame << "\n";
+    *out_ << (use32Bit_ ? "\tpopl\t%ecx\n" : "\tpopq\t%rcx\n");
+    if (size != 1) *out_ << "\t" << (use32Bit_ ? "imull" : "imulq") << "\t$" << size << ", " << rcx << "\n";
+    *out_ << "\t" << (use32Bit_ ? "addl" : "addq") << "\t" << rcx << ", " << rax << "\n";
+    *out_ << "\t" << mov << "\t" << rax << ", " << slot << "\n";
+    *out_ << (use32Bit_ ? "\taddl\t$4, %esp\n" : "\taddq\t$8, %rsp\n");
+    *out_ << "\t" << (use32Bit_ ? "leal" : "leaq") << "\t" << slot << ", %" << dest << "\n";
+}
+
+// new [n]T: malloc(n * size) as the pointer of a slice of length n.
+void CodeGenerator::emitNewArray(Expr* expr, const std::string& dest) {
+    const char* mov = use32Bit_ ? "movl" : "movq";
+    const char* rax = use32Bit_ ? "%eax" : "%rax";
+    int word = use32Bit_ ? 4 : 8;
+    std::string slot = getVarLocation(expr->ident);
+    std::string frame = slot.substr(slot.find('('));
+    int off = std::stoi(slot);
+
+    emitExprToRax(expr->left.get());
+    *out_ << "\t" << mov << "\t" << rax << ", " << off + word << frame << "\n";
+    *out_ << "\t" << (use32Bit_ ? "imull" : "imulq") << "\t$" << getTypeSize(expr->targetType) << ", " << rax << "\n";
+    emitMalloc();
+    *out_ << "\t" << mov << "\t" << rax << ", " << slot << "\n";
+    *out_ << "\t" << (use32Bit_ ? "leal" : "leaq") << "\t" << slot << ", %" << dest << "\n";
+}
+
+// malloc of the byte count in rax; the memory comes back in rax.
+void CodeGenerator::emitMalloc() {
+    if (use32Bit_) {
+        *out_ << "\tpushl\t%eax\n";
+        *out_ << "\tcall\tmalloc\n\taddl\t$4, %esp\n";
+        return;
+    }
+    if (isLinux_) *out_ << "\tmovq\t%rax, %rdi\n";
+    else *out_ << "\tmovq\t%rax, %rcx\n\tsubq\t$32, %rsp\n";
+    *out_ << "\tcall\tmalloc\n";
+    if (!isLinux_) *out_ << "\taddq\t$32, %rsp\n";
+}
+
+// base[i].m, or p.m on a pointer, which is p[0].m.
+bool CodeGenerator::isSoaMember(const Expr* expr) {
+    if (expr->kind != Expr::Kind::Member) return false;
+    const Type* t = expr->left->exprType;
+    if (expr->left->kind == Expr::Kind::Index) return isSoa(t);
+    return t->kind == Type::Kind::Pointer && isSoa(t->ptrTo);
+}
+
+// Leaves the address of base[i] in rax.
+void CodeGenerator::emitIndexAddress(Expr* index) {
+    int size = getTypeSize(index->exprType);
+    if (isSlice(index->left->exprType)) {
+        emitOperands(index->left.get(), index->right.get());
+        emitBoundsCheck(use32Bit_ ? "%ecx" : "%rcx", use32Bit_ ? "4(%eax)" : "8(%rax)", false);
+        *out_ << (use32Bit_ ? "\tmovl\t(%eax), %eax\n" : "\tmovq\t(%rax), %rax\n");
+        if (size != 1) *out_ << "\t" << (use32Bit_ ? "imull" : "imulq") << "\t$" << size << (use32Bit_ ? ", %ecx\n" : ", %rcx\n");
+        *out_ << (use32Bit_ ? "\taddl\t%ecx, %eax\n" : "\taddq\t%rcx, %rax\n");
+        return;
+    }
+    if (index->right->kind == Expr::Kind::IntLit && index->right->intVal >= INT32_MIN / size &&
+        index->right->intVal <= INT32_MAX / size) {
+        emitExprToRax(index->left.get());
+        if (index->right->intVal != 0)
+            *out_ << (use32Bit_ ? "\taddl\t$" : "\taddq\t$") << index->right->intVal * size
+                  << (use32Bit_ ? ", %eax\n" : ", %rax\n");
+        return;
+    }
+    emitOperands(index->left.get(), index->right.get());
+    if (size != 1) *out_ << "\t" << (use32Bit_ ? "imull" : "imulq") << "\t$" << size << (use32Bit_ ? ", %ecx\n" : ", %rcx\n");
+    *out_ << (use32Bit_ ? "\taddl\t%ecx, %eax\n" : "\taddq\t%rcx, %rax\n");
+}
+
+// Leaves the address of base[i].member (or p.member, element 0) in rax for
+// an @soa array: the member's values start at n * offset, n being the word
+// before base.
+void CodeGenerator::emitSoaMemberAddress(Expr* member) {
+    Expr* index = member->left.get();
+    bool indexed = index->kind == Expr::Kind::Index;
+    const Type* t = indexed ? index->exprType : index->exprType->ptrTo;
+    StructDef* sd = resolveStruct(t->structName, t->ns);
+    size_t m = sd->memberIndex.at(member->member);
+    int off = (int)sd->offsets[m];
+    int size = getTypeSize(sd->members[m].second);
+    emitExprToRax(indexed ? index->left.get() : index);
+    if (off != 0) {
+        *out_ << (use32Bit_ ? "\tmovl\t-4(%eax), %ecx\n\timull\t$" : "\tmovq\t-8(%rax), %rcx\n\timulq\t$") << off
+              << (use32Bit_ ? ", %ecx\n\taddl\t%ecx, %eax\n" : ", %rcx\n\taddq\t%rcx, %rax\n");
+    }
+    if (!indexed) return;  // element 0
+    if (isLeaf(index->right.get())) {
+        emitExpr(index->right.get(), "rcx", false);
+    } else {
+        *out_ << (use32Bit_ ? "\tpushl\t%eax\n" : "\tpushq\t%rax\n");
+        emitExprToRax(index->right.get());
+        *out_ << (use32Bit_ ? "\tmovl\t%eax, %ecx\n\tpopl\t%eax\n" : "\tmovq\t%rax, %rcx\n\tpopq\t%rax\n");
+    }
+    if (size != 1) *out_ << "\t" << (use32Bit_ ? "imull" : "imulq") << "\t$" << size << (use32Bit_ ? ", %ecx\n" : ", %rcx\n");
+    *out_ << (use32Bit_ ? "\taddl\t%ecx, %eax\n" : "\taddq\t%rcx, %rax\n");
+}
+
+// new T[n] for an @soa T: n elements' worth of bytes after a word holding
+// n; the result points past that word. new T is the n == 1 case.
+void CodeGenerator::emitNewSoa(Expr* expr) {
+    int size = getTypeSize(expr->targetType);
+    int word = use32Bit_ ? 4 : 8;
+    if (expr->left) emitExprToRax(expr->left.get());
+    else *out_ << "\t" << (use32Bit_ ? "movl" : "movq") << "\t$1, %" << (use32Bit_ ? "eax" : "rax") << "\n";
+    if (use32Bit_) {
+        *out_ << "\tpushl\t%eax\n";
+        *out_ << "\timull\t$" << size << ", %eax\n\taddl\t$4, %eax\n";
+        *out_ << "\tpushl\t%eax\n\tcall\tmalloc\n\taddl\t$4, %esp\n";
+        *out_ << "\tpopl\t%ecx\n";
+    } else {
+        *out_ << "\tpushq\t%rax\n\tsubq\t$8, %rsp\n";  // keep rsp 16-byte aligned at the call
+        *out_ << "\timulq\t$" << size << ", %rax\n\taddq\t$8, %rax\n";
+        if (isLinux_) *out_ << "\tmovq\t%rax, %rdi\n";
+        else *out_ << "\tmovq\t%rax, %rcx\n\tsubq\t$32, %rsp\n";
+        *out_ << "\tcall\tmalloc\n";
+        if (!isLinux_) *out_ << "\taddq\t$32, %rsp\n";
+        *out_ << "\taddq\t$8, %rsp\n\tpopq\t%rcx\n";
+    }
+    *out_ << (use32Bit_ ? "\tmovl\t%ecx, (%eax)\n" : "\tmovq\t%rcx, (%rax)\n");
+    *out_ << "\t" << (use32Bit_ ? "addl" : "addq") << "\t$" << word << ", %" << (use32Bit_ ? "eax" : "rax") << "\n";
+}
+
+// Stores the value in rcx to off(rax) with the width of type. A struct
+// value is copied from the address in rcx.
+void CodeGenerator::emitStoreAt(const Type* type, int off) {
+    const char* base = use32Bit_ ? "eax" : "rax";
+    if (type->kind == Type::Kind::Bool || type->kind == Type::Kind::Char) {
+        *out_ << "\tmovb\t%cl, " << off << "(%" << base << ")\n";
+        return;
+    }
+    if (type->kind != Type::Kind::StructRef) {
+        *out_ << "\t" << (use32Bit_ ? "movl\t%ecx, " : "movq\t%rcx, ") << off << "(%" << base << ")\n";
+        return;
+    }
+    int size = getTypeSize(type);
+    int word = use32Bit_ ? 4 : 8;
+    int i = 0;
+    for (; i + word <= size; i += word) {
+        *out_ << "\t" << (use32Bit_ ? "movl\t" : "movq\t") << i << (use32Bit_ ? "(%ecx), %edx\n" : "(%rcx), %rdx\n");
+        *out_ << "\t" << (use32Bit_ ? "movl\t%edx, " : "movq\t%rdx, ") << off + i << "(%" << base << ")\n";
+    }
+    for (; i < size; i++) {
+        *out_ << "\tmovb\t" << i << (use32Bit_ ? "(%ecx), %dl\n" : "(%rcx), %dl\n");
+        *out_ << "\tmovb\t%dl, " << off + i << "(%" << base << ")\n";
+    }
+}
+
+// Copies a struct from the address in rax to off(rbp), or to off(rsp) in
+// the argument area of a call. Only rax and r11 (edx on 32-bit) are
+// touched, so argument registers survive.
+void CodeGenerator::emitCopyToFrame(const Type* type, int off, bool toArgs) {
+    int size = getTypeSize(type);
+    int word = use32Bit_ ? 4 : 8;
+    const char* base = use32Bit_ ? "ebp" : toArgs ? "rsp" : "rbp";
+    int i = 0;
+    for (; i + word <= size; i += word) {
+        *out_ << "\t" << (use32Bit_ ? "movl\t" : "movq\t") << i << (use32Bit_ ? "(%eax), %edx\n" : "(%rax), %r11\n");
+        *out_ << "\t" << (use32Bit_ ? "movl\t%edx, " : "movq\t%r11, ") << off + i << "(%" << base << ")\n";
+    }
+    for (; i < size; i++) {
+        *out_ << "\tmovb\t" << i << (use32Bit_ ? "(%eax), %dl\n" : "(%rax), %r11b\n");
+        *out_ << "\tmovb\t" << (use32Bit_ ? "%dl, " : "%r11b, ") << off + i << "(%" << base << ")\n";
+    }
+}
+
+// Vector values live in xmm0 (lanes 0-1 of an f64x4, 0-3 of an i32x8) and
+// xmm1 (the rest); xmm2-xmm4 are scratch.
+void CodeGenerator::emitVectorExpr(Expr* expr) {
+    if (use32Bit_) {
+        error("vector type " + expr->exprType->mangledName + " needs -m64", expr->loc);
+        return;
+    }
+    bool fl = expr->exprType->kind == Type::Kind::F64x4;
+    switch (expr->kind) {
+        case Expr::Kind::Var: {
+            int off = std::stoi(getVarLocation(expr->ident));
+            *out_ << "\tmovdqu\t" << off << "(%rbp), %xmm0\n\tmovdqu\t" << off + 16 << "(%rbp), %xmm1\n";
+            break;
+        }
+        case Expr::Kind::Call:
+            emitExpr(expr, "xmm0", true);  // a builtin or a function returning a vector
+            break;
+        case Expr::Kind::Deref:
+        case Expr::Kind::Index:
+        case Expr::Kind::Member:
+            emitVectorAddress(expr);
+            *out_ << "\tmovdqu\t(%rax), %xmm0\n\tmovdqu\t16(%rax), %xmm1\n";
+            break;
+        case Expr::Kind::Binary: {
+            emitVectorExpr(expr->left.get());
+            *out_ << "\tsubq\t$32, %rsp\n\tmovdqu\t%xmm0, (%rsp)\n\tmovdqu\t%xmm1, 16(%rsp)\n";
+            emitVectorExpr(expr->right.get());
+            *out_ << "\tmovdqa\t%xmm0, %xmm2\n\tmovdqa\t%xmm1, %xmm3\n";
+            *out_ << "\tmovdqu\t(%rsp), %xmm0\n\tmovdqu\t16(%rsp), %xmm1\n\taddq\t$32, %rsp\n";
+            if (!fl && expr->op == Expr::Op::Mul) {
+                // SSE2 multiplies the even lanes to 64 bits; shift the odd
+                // lanes down, multiply those, and interleave the low halves.
+                for (const char* half : {"0", "1"}) {
+                    std::string a = std::string("%xmm") + half, b = half[0] == '0' ? "%xmm2" : "%xmm3";
+                    *out_ << "\tmovdqa\t" << a << ", %xmm4\n\tpmuludq\t" << b << ", %xmm4\n";
+                    *out_ << "\tpsrlq\t$32, " << a << "\n\tpsrlq\t$32, " << b << "\n\tpmuludq\t" << b << ", " << a << "\n";
+                    *out_ << "\tpshufd\t$8, %xmm4, %xmm4\n\tpshufd\t$8, " << a << ", " << a << "\n";
+                    *out_ << "\tpunpckldq\t" << a << ", %xmm4\n\tmovdqa\t%xmm4, " << a << "\n";
+                }
+                break;
+            }
+            const char* op = nullptr;
+            switch (expr->op) {
+                case Expr::Op::Add: op = fl ? "addpd" : "paddd"; break;
+                case Expr::Op::Sub: op = fl ? "subpd" : "psubd"; break;
+                case Expr::Op::Mul: op = "mulpd"; break;
+                default: op = "divpd"; break;
+            }
+            *out_ << "\t" << op << "\t%xmm2, %xmm0\n\t" << op << "\t%xmm3, %xmm1\n";
+            break;
+        }
+        default:
+            error("unsupported vector expression", expr->loc);
+            break;
+    }
+}
+
+// Leaves the address of a vector lvalue in rax.
+void CodeGenerator::emitVectorAddress(Expr* lvalue) {
+    switch (lvalue->kind) {
+        case Expr::Kind::Var:
+            *out_ << "\tleaq\t" << getVarLocation(lvalue->ident) << ", %rax\n";
+            break;
+        case Expr::Kind::Deref:
+            emitExprToRax(lvalue->right.get());
+            break;
+        case Expr::Kind::Index:
+            emitIndexAddress(lvalue);
+            break;
+        case Expr::Kind::Member: {
+            if (isSoaMember(lvalue)) {
+                emitSoaMemberAddress(lvalue);
+                break;
+            }
+            emitExprToRax(lvalue->left.get());
+            const Type* baseType = lvalue->left->exprType;
+            if (baseType->kind == Type::Kind::Pointer) baseType = baseType->ptrTo;
+            StructDef* sd = resolveStruct(baseType->structName, baseType->ns);
+            if (!sd) break;
+            auto it = sd->memberIndex.find(lvalue->member);
+            if (it != sd->memberIndex.end()) *out_ << "\taddq\t$" << sd->offsets[it->second] << ", %rax\n";
+            break;
+        }
+        default:
+            error("vector expression has no address", lvalue->loc);
+            break;
+    }
+}
+
+// Minimum (or maximum) of the i32x8 lanes in xmm0 and xmm1, into xmm0.
+// SSE2 has no pminsd, so select through a pcmpgtd mask.
+void CodeGenerator::emitVectorSelect(bool min) {
+    if (min) *out_ << "\tmovdqa\t%xmm0, %xmm2\n\tpcmpgtd\t%xmm1, %xmm2\n";  // a > b
+    else *out_ << "\tmovdqa\t%xmm1, %xmm2\n\tpcmpgtd\t%xmm0, %xmm2\n";      // b > a
+    *out_ << "\tmovdqa\t%xmm1, %xmm3\n\tpand\t%xmm2, %xmm3\n\tpandn\t%xmm0, %xmm2\n";
+    *out_ << "\tpor\t%xmm3, %xmm2\n\tmovdqa\t%xmm2, %xmm0\n";
+}
+
+void CodeGenerator::emitVectorBuiltin(Expr* call, const std::string& dest) {
+    if (use32Bit_) {
+        error(call->ident + " needs -m64", call->loc);
+        return;
+    }
+    const std::string& name = call->ident.str();
+    auto& args = call->args;
+    const Type* vt = name == "f64x4" || name == "i32x8" || name == "vload" ? call->exprType
+                   : name == "vstore" ? args[1]->exprType : args[0]->exprType;
+    bool fl = vt->kind == Type::Kind::F64x4;
+    const char* spill = "\tsubq\t$32, %rsp\n\tmovdqu\t%xmm0, (%rsp)\n\tmovdqu\t%xmm1, 16(%rsp)\n";
+    const char* reload = "\tmovdqu\t(%rsp), %xmm0\n\tmovdqu\t16(%rsp), %xmm1\n\taddq\t$32, %rsp\n";
+
+    if (name == "f64x4" || name == "i32x8") {
+        if (args.size() == 1) {
+            if (fl) {
+                emitExprToXmm0(args[0].get());
+                *out_ << "\tunpcklpd\t%xmm0, %xmm0\n\tmovapd\t%xmm0, %xmm1\n";
+            } else {
+                emitExprToRax(args[0].get());
+                *out_ << "\tmovd\t%eax, %xmm0\n\tpshufd\t$0, %xmm0, %xmm0\n\tmovdqa\t%xmm0, %xmm1\n";
+            }
+            return;
+        }
+        *out_ << "\tsubq\t$32, %rsp\n";
+        for (size_t k = 0; k < args.size(); k++) {
+            if (fl) {
+                emitExprToXmm0(args[k].get());
+                *out_ << "\tmovsd\t%xmm0, " << 8 * k << "(%rsp)\n";
+            } else {
+                emitExprToRax(args[k].get());
+                *out_ << "\tmovl\t%eax, " << 4 * k << "(%rsp)\n";
+            }
+        }
+        *out_ << reload;
+        return;
+    }
+    if (name == "vload") {
+        emitExprToRax(args[0].get());
+        if (fl) {
+            *out_ << "\tmovupd\t(%rax), %xmm0\n\tmovupd\t16(%rax), %xmm1\n";
+        } else {
+            // Eight ints: keep the low half of each.
+            *out_ << "\tmovdqu\t(%rax), %xmm0\n\tmovdqu\t16(%rax), %xmm2\n\tshufps\t$0x88, %xmm2, %xmm0\n";
+            *out_ << "\tmovdqu\t32(%rax), %xmm1\n\tmovdqu\t48(%rax), %xmm3\n\tshufps\t$0x88, %xmm3, %xmm1\n";
+        }
+        return;
+    }
+    if (name == "vstore") {
+        emitExprToRax(args[0].get());
+        *out_ << "\tpushq\t%rax\n";
+        emitVectorExpr(args[1].get());
+        *out_ << "\tpopq\t%rax\n";
+        if (fl) {
+            *out_ << "\tmovupd\t%xmm0, (%rax)\n\tmovupd\t%xmm1, 16(%rax)\n";
+            return;
+        }
+        // Sign-extend each lane back to a whole int.
+        for (int half = 0; half < 2; half++) {
+            std::string x = "%xmm" + std::to_string(half);
+            *out_ << "\tmovdqa\t" << x << ", %xmm2\n\tpsrad\t$31, %xmm2\n";
+            *out_ << "\tmovdqa\t" << x << ", %xmm3\n\tpunpckldq\t%xmm2, %xmm3\n\tpunpckhdq\t%xmm2, " << x << "\n";
+            *out_ << "\tmovdqu\t%xmm3, " << 32 * half << "(%rax)\n\tmovdqu\t" << x << ", " << 32 * half + 16 << "(%rax)\n";
+        }
+        return;
+    }
+    emitVectorExpr(args[0].get());
+    if (name == "extract" || name == "insert") {
+        int64_t lane = args[1]->intVal;
+        *out_ << spill;
+        if (name == "insert") {
+            if (fl) {
+                emitExprToXmm0(args[2].get());
+                *out_ << "\tmovsd\t%xmm0, " << 8 * lane << "(%rsp)\n";
+            } else {
+                emitExprToRax(args[2].get());
+                *out_ << "\tmovl\t%eax, " << 4 * lane << "(%rsp)\n";
+            }
+            *out_ << reload;
+            return;
+        }
+        if (fl) {
+            *out_ << "\tmovsd\t" << 8 * lane << "(%rsp), %xmm0\n\taddq\t$32, %rsp\n";
+            if (dest != "xmm0") *out_ << "\tmovq\t%xmm0, %" << dest << "\n";
+        } else {
+            *out_ << "\tmovslq\t" << 4 * lane << "(%rsp), %rax\n\taddq\t$32, %rsp\n";
+            if (dest != "rax") *out_ << "\tmovq\t%rax, %" << dest << "\n";
+        }
+        return;
+    }
+
+    // Horizontal reductions: combine the halves, then the lanes of xmm0.
+    if (fl) {
+        const char* pd = name == "reduce_add" ? "addpd" : name == "reduce_min" ? "minpd" : "maxpd";
+        const char* sd = name == "reduce_add" ? "addsd" : name == "reduce_min" ? "minsd" : "maxsd";
+        *out_ << "\t" << pd << "\t%xmm1, %xmm0\n\tmovapd\t%xmm0, %xmm1\n\tunpckhpd\t%xmm1, %xmm1\n";
+        *out_ << "\t" << sd << "\t%xmm1, %xmm0\n";
+        if (dest != "xmm0") *out_ << "\tmovq\t%xmm0, %" << dest << "\n";
+        return;
+    }
+    bool add = name == "reduce_add";
+    if (add) *out_ << "\tpaddd\t%xmm1, %xmm0\n";
+    else emitVectorSelect(name == "reduce_min");
+    for (const char* shuffle : {"$0x4E", "$0xB1"}) {
+        *out_ << "\tpshufd\t" << shuffle << ", %xmm0, %xmm1\n";
+        if (add) *out_ << "\tpaddd\t%xmm1, %xmm0\n";
+        else emitVectorSelect(name == "reduce_min");
+    }
+    *out_ << "\tmovd\t%xmm0, %eax\n\tmovslq\t%eax, %rax\n";
+    if (dest != "rax") *out_ << "\tmovq\t%rax, %" << dest << "\n";
+}
+
+// Under -O, a loop that analyzeVectorLoop accepts first runs two elements at
+// a time in SSE2 registers. The scalar loop emitted after it finishes the odd
+// element, and runs the whole loop when two of the pointers overlap.
+void CodeGenerator::emitVectorLoop(Stmt* loop) {
+    if (!optimize_ || !currentSym_) return;
+    VectorLoop plan;
+    std::string whyNot = loop->asmCode;  // found before strength reduction
+    if (whyNot.empty() && analyzeVectorLoop(loop, *currentSym_, plan, whyNot)) {
+        std::ostringstream code;
+        std::ostream* saved = out_;
+        out_ = &code;
+        bool ok = emitVectorCode(plan, whyNot);
+        out_ = saved;
+        if (ok) {
+            *out_ << code.str();
+            if (remarkVectorized_)
+                remarks_.push_back(SourceManager::instance().formatRemark(
+                    loop->loc, "vectorized loop (vectorization width: 2, interleaved count: 1)"));
+            return;
+        }
+    }
+    if (remarkMissed_)
+        remarks_.push_back(SourceManager::instance().formatRemark(loop->loc, "loop not vectorized: " + whyNot));
+}
+
+bool CodeGenerator::emitVectorCode(const VectorLoop& plan, std::string& whyNot) {
+    VectorRegs regs;
+    int n = (int)plan.invariants.size();
+    if (plan.usesCounter) {
+        regs.counter = n++;
+        regs.step = n++;
+    }
+    regs.firstTemp = n;
+    regs.limit = isLinux_ ? 8 : 6;  // xmm6 and up are callee-saved on Windows
+    std::string scalarLabel = nextLabel();
+    std::string loopLabel = nextLabel();
+    std::string counter = getVarLocation(plan.counter);
+
+    // Run the scalar loop when a store could reach an element that another
+    // pointer reads or writes in the same pair of iterations: the pointers
+    // differ by less than a vector but are not equal.
+    for (size_t a = 0; a < plan.pointers.size(); a++) {
+        for (size_t b = a + 1; b < plan.pointers.size(); b++) {
+            auto written = [&](Symbol p) {
+                return std::find(plan.written.begin(), plan.written.end(), p) != plan.written.end();
+            };
+            if (!written(plan.pointers[a]) && !written(plan.pointers[b])) continue;
+            std::string apart = nextLabel();
+            *out_ << "\tmovq\t" << getVarLocation(plan.pointers[a]) << ", %rax\n";
+            *out_ << "\tsubq\t" << getVarLocation(plan.pointers[b]) << ", %rax\n";
+            *out_ << "\tleaq\t15(%rax), %rcx\n\tcmpq\t$30, %rcx\n\tja\t" << apart << "\n";
+            *out_ << "\ttestq\t%rax, %rax\n\tjne\t" << scalarLabel << "\n";
+            *out_ << apart << ":\n";
+        }
+    }
+
+    // Broadcast the invariants, and start the counter vector at [i, i+1].
+    for (size_t k = 0; k < plan.invariants.size(); k++) {
+        const Expr* e = plan.invariants[k];
+        std::string x = "%xmm" + std::to_string(k);
+        bool fl = e->exprType->kind == Type::Kind::Float;
+        if (e->kind == Expr::Kind::Var) {
+            *out_ << "\tmovq\t" << getVarLocation(e->ident) << ", " << x << "\n";
+        } else {
+            int64_t bits = e->intVal;
+            if (fl) memcpy(&bits, &e->floatVal, 8);
+            if (bits == (int32_t)bits) *out_ << "\tmovq\t$" << bits << ", %rax\n";
+            else *out_ << "\tmovabsq\t$" << bits << ", %rax\n";
+            *out_ << "\tmovq\t%rax, " << x << "\n";
+        }
+        *out_ << "\t" << (fl ? "unpcklpd" : "punpcklqdq") << "\t" << x << ", " << x << "\n";
+    }
+    if (plan.usesCounter) {
+        std::string c = "%xmm" + std::to_string(regs.counter);
+        std::string st = "%xmm" + std::to_string(regs.step);
+        *out_ << "\tmovq\t" << counter << ", %rax\n\tmovq\t%rax, " << c << "\n\tpunpcklqdq\t" << c << ", " << c << "\n";
+        *out_ << "\tmovq\t$1, %rax\n\tmovq\t%rax, " << st << "\n\tpslldq\t$8, " << st << "\n";
+        *out_ << "\tpaddq\t" << st << ", " << c << "\n";
+        *out_ << "\tmovq\t$2, %rax\n\tmovq\t%rax, " << st << "\n\tpunpcklqdq\t" << st << ", " << st << "\n";
+    }
+
+    *out_ << loopLabel << ":\n";
+    *out_ << "\tmovq\t" << counter << ", %rax\n\tleaq\t2(%rax), %rcx\n";
+    if (plan.bound->kind == Expr::Kind::IntLit && plan.bound->intVal == (int32_t)plan.bound->intVal)
+        *out_ << "\tcmpq\t$" << plan.bound->intVal << ", %rcx\n";
+    else if (plan.bound->kind == Expr::Kind::IntLit)
+        *out_ << "\tmovabsq\t$" << plan.bound->intVal << ", %rdx\n\tcmpq\t%rdx, %rcx\n";
+    else
+        *out_ << "\tcmpq\t" << getVarLocation(plan.bound->ident) << ", %rcx\n";
+    *out_ << "\tjg\t" << scalarLabel << "\n";
+    for (const Stmt* s : plan.stores) {
+        if (!emitVectorValue(s->assignValue.get(), plan, regs, regs.firstTemp)) {
+            whyNot = "the loop needs more than " + std::to_string(regs.limit) + " vector registers";
+            return false;
+        }
+        bool fl = s->assignValue->exprType->kind == Type::Kind::Float;
+        *out_ << "\tmovq\t" << getVarLocation(elementPointer(s->assignTarget.get(), plan.counter)) << ", %rdx\n";
+        *out_ << "\t" << (fl ? "movupd" : "movdqu") << "\t%xmm" << regs.firstTemp << ", (%rdx,%rax,8)\n";
+    }
+    *out_ << "\taddq\t$2, " << counter << "\n";
+    if (plan.usesCounter) *out_ << "\tpaddq\t%xmm" << regs.step << ", %xmm" << regs.counter << "\n";
+    *out_ << "\tjmp\t" << loopLabel << "\n";
+    *out_ << scalarLabel << ":\n";
+    return true;
+}
+
+// The register already holding leaf e (an invariant or the counter), or -1.
+int CodeGenerator::vectorLeafReg(const Expr* e, const VectorLoop& plan, const VectorRegs& regs) const {
+    if (e->kind == Expr::Kind::Var && e->ident == plan.counter) return regs.counter;
+    return plan.invariantIndex(e);
+}
+
+// Evaluates e for elements i and i+1 into xmm t, using the registers above t
+// as scratch. The element index is in rax; rdx is clobbered.
+bool CodeGenerator::emitVectorValue(const Expr* e, const VectorLoop& plan, const VectorRegs& regs, int t) {
+    if (t >= regs.limit) return false;
+    bool fl = e->exprType->kind == Type::Kind::Float;
+    std::string x = "%xmm" + std::to_string(t);
+    Symbol p = elementPointer(e, plan.counter);
+    if (!p.empty()) {
+        *out_ << "\tmovq\t" << getVarLocation(p) << ", %rdx\n";
+        *out_ << "\t" << (fl ? "movupd" : "movdqu") << "\t(%rdx,%rax,8), " << x << "\n";
+        return true;
+    }
+    if (e->kind != Expr::Kind::Binary) {
+        *out_ << "\t" << (fl ? "movapd" : "movdqa") << "\t%xmm" << vectorLeafReg(e, plan, regs) << ", " << x << "\n";
+        return true;
+    }
+    if (!emitVectorValue(e->left.get(), plan, regs, t)) return false;
+    int r = vectorLeafReg(e->right.get(), plan, regs);
+    if (r < 0) {
+        if (!emitVectorValue(e->right.get(), plan, regs, t + 1)) return false;
+        r = t + 1;
+    }
+    std::string y = "%xmm" + std::to_string(r);
+    if (fl) {
+        const char* op = e->op == Expr::Op::Add ? "addpd" : e->op == Expr::Op::Sub ? "subpd"
+                       : e->op == Expr::Op::Mul ? "mulpd" : "divpd";
+        *out_ << "\t" << op << "\t" << y << ", " << x << "\n";
+    } else if (e->op == Expr::Op::Add) {
+        *out_ << "\tpaddq\t" << y << ", " << x << "\n";
+    } else if (e->op == Expr::Op::Sub) {
+        *out_ << "\tpsubq\t" << y << ", " << x << "\n";
+    } else {
+        // SSE2 has no 64-bit multiply: lo*lo + ((hi*lo + lo*hi) << 32).
+        if (t + 3 >= regs.limit) return false;
+        std::string s1 = "%xmm" + std::to_string(t + 2);
+        std::string s2 = "%xmm" + std::to_string(t + 3);
+        *out_ << "\tmovdqa\t" << x << ", " << s1 << "\n\tpsrlq\t$32, " << s1 << "\n\tpmuludq\t" << y << ", " << s1 << "\n";
+        *out_ << "\tmovdqa\t" << y << ", " << s2 << "\n\tpsrlq\t$32, " << s2 << "\n\tpmuludq\t" << x << ", " << s2 << "\n";
+        *out_ << "\tpaddq\t" << s2 << ", " << s1 << "\n\tpsllq\t$32, " << s1 << "\n";
+        *out_ << "\tpmuludq\t" << y << ", " << x << "\n\tpaddq\t" << s1 << ", " << x << "\n";
+    }
+    return true;
+}
+
 void CodeGenerator::emitFunc(const FuncSymbol& fs) {
-    if (fs.decl && fs.decl->isExtern) return;
+    if (fs.precompiled) return;
     if (fs.mangledName == "println" || fs.mangledName == "print" || fs.mangledName == "print_float" ||
         fs.mangledName == "println_float" || fs.mangledName == "print_string" || fs.mangledName == "println_string") return;
 
     currentFunc_ = fs.decl;
+    currentSym_ = &fs;
     currentVars_ = fs.locals;
     currentNamespace_ = fs.ns;
+    // Where each parameter arrives on x64: a register, or a stack slot
+    // above the return address. Windows callers leave a home slot for the
+    // four register arguments; System V does not, so those get one below
+    // the locals, and the stack arguments start at 16(%rbp).
+    std::vector<std::string> incoming;
+    if (!use32Bit_ && fs.decl) {
+        static const char* const regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+        static const char* const fregs[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
+        static const char* const winRegs[] = {"rcx", "rdx", "r8", "r9"};
+        int ireg = 0, freg = 0, stack = 16, deepest = 0;
+        for (const auto& p : currentVars_) deepest = std::max(deepest, -p.second.frameOffset);
+        for (size_t i = 0; i < fs.decl->params.size(); i++) {
+            VarSymbol& v = currentVars_.at(fs.decl->params[i].name);
+            bool isFloat = v.type->kind == Type::Kind::Float;
+            bool inFrame = v.type->kind == Type::Kind::StructRef;  // the copy, not the address
+            if (!isLinux_) {
+                incoming.push_back(i < 4 ? std::string("%") + winRegs[i] : std::to_string(16 + 8 * i) + "(%rbp)");
+            } else if (isFloat ? freg < 8 : ireg < 6) {
+                incoming.push_back(std::string("%") + (isFloat ? fregs[freg++] : regs[ireg++]));
+                if (!inFrame) v.frameOffset = -(deepest += 8);
+            } else {
+                incoming.push_back(std::to_string(stack) + "(%rbp)");
+                if (!inFrame) v.frameOffset = stack;
+                stack += 8;
+            }
+        }
+    }
     frameSize_ = getFrameSize();
+    varRegs_.clear();
+    savedRegs_.clear();
+    frameEscapes_ = fs.decl && takesLocalAddress(fs.decl->body.get());
+    if (optimize_ && fs.decl) {
+        RegisterAllocator ra(fs, isLinux_);
+        ra.run();
+        varRegs_ = ra.assignment();
+        int localBytes = 0;
+        for (const auto& p : currentVars_)
+            localBytes = std::max(localBytes, -p.second.frameOffset);
+        for (const auto& r : ra.usedCalleeSaved()) {
+            localBytes += 8;
+            savedRegs_.push_back({r, -localBytes});
+        }
+        frameSize_ = std::max(frameSize_, (localBytes + 15) & ~15);
+    }
+    scratchFree_ = {"r11", "r10"};
 
     std::string label = fs.mangledName;
-    if (use32Bit_ && fs.name == "main") label = "_main";
-    *out_ << "\t.globl\t" << label << "\n";
+    if (use32Bit_ && fs.name.str() == "main") label = "_main";
+    if (fs.instance) {
+        // Every object that uses a generic instance carries a copy; each goes
+        // in a section group of its own so the linker keeps just one.
+        if (isLinux_) {
+            *out_ << "\t.section\t.text." << label << ",\"axG\",@progbits," << label << ",comdat\n";
+            *out_ << "\t.weak\t" << label << "\n";
+        } else {
+            *out_ << "\t.section\t.text$" << label << ",\"x\"\n\t.linkonce\tdiscard\n";
+            *out_ << "\t.globl\t" << label << "\n";
+        }
+    } else {
+        *out_ << "\t.globl\t" << label << "\n";
+    }
     *out_ << label << ":\n";
+    // A function returning a struct gets the address of the result in rax.
+    bool structResult = currentVars_.count(resultSlot()) != 0;
     if (use32Bit_) {
         *out_ << "\tpushl\t%ebp\n";
         *out_ << "\tmovl\t%esp, %ebp\n";
         *out_ << "\tsubl\t$" << frameSize_ << ", %esp\n";
+        if (structResult) *out_ << "\tmovl\t%eax, " << getVarLocation(resultSlot()) << "\n";
+        for (size_t i = 0; fs.decl && i < fs.decl->params.size(); i++) {
+            const Type* pt = currentVars_.at(fs.decl->params[i].name).type;
+            if (pt->kind != Type::Kind::StructRef) continue;
+            *out_ << "\tmovl\t" << (8 + i * 4) << "(%ebp), %eax\n";
+            emitCopyToFrame(pt, std::stoi(getVarLocation(fs.decl->params[i].name)));
+        }
     } else {
         *out_ << "\tpushq\t%rbp\n";
         *out_ << "\tmovq\t%rsp, %rbp\n";
         *out_ << "\tsubq\t$" << frameSize_ << ", %rsp\n";
-        if (fs.decl) {
-            if (isLinux_) {
-                const char* regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
-                const char* fregs[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
-                int ireg = 0, freg = 0;
-                for (size_t i = 0; i < fs.decl->params.size(); i++) {
-                    if (fs.decl->params[i].type.kind == Type::Kind::Float) {
-                        if (freg < 8) *out_ << "\tmovq\t%" << fregs[freg++] << ", " << (16 + i * 8) << "(%rbp)\n";
-                    } else {
-                        if (ireg < 6) *out_ << "\tmovq\t%" << regs[ireg++] << ", " << (16 + i * 8) << "(%rbp)\n";
-                    }
-                }
-            } else {
-                if (fs.decl->params.size() > 0) *out_ << "\tmovq\t%rcx, 16(%rbp)\n";
-                if (fs.decl->params.size() > 1) *out_ << "\tmovq\t%rdx, 24(%rbp)\n";
-                if (fs.decl->params.size() > 2) *out_ << "\tmovq\t%r8, 32(%rbp)\n";
-                if (fs.decl->params.size() > 3) *out_ << "\tmovq\t%r9, 40(%rbp)\n";
+        for (const auto& r : savedRegs_)
+            *out_ << "\tmovq\t" << r.first << ", " << r.second << "(%rbp)\n";
+        if (structResult) *out_ << "\tmovq\t%rax, " << getVarLocation(resultSlot()) << "\n";
+        for (size_t i = 0; i < incoming.size(); i++) {
+            std::string loc = getVarLocation(fs.decl->params[i].name);
+            const Type* pt = currentVars_.at(fs.decl->params[i].name).type;
+            if (pt->kind == Type::Kind::StructRef) {
+                // Passed by address; copy it into the frame.
+                *out_ << "\tmovq\t" << incoming[i] << ", %rax\n";
+                emitCopyToFrame(pt, std::stoi(loc));
+            } else if (incoming[i] != loc) {
+                *out_ << "\tmovq\t" << incoming[i] << ", " << loc << "\n";
             }
         }
     }
     if (fs.decl && fs.decl->body) emitStmt(fs.decl->body.get());
-    *out_ << "\tleave\n";
-    *out_ << "\tret\n\n";
+    emitEpilogue();
+    if (fs.instance) *out_ << "\t.text\n";
+    *out_ << "\n";
     currentFunc_ = nullptr;
+    currentSym_ = nullptr;
 }
 
 void CodeGenerator::emitProgram() {
@@ -566,6 +1593,9 @@ void CodeGenerator::emitProgram() {
     *out_ << ".LC_fmt_f_nl:\n\t.string \"%f\\n\"\n";
     *out_ << ".LC_fmt_s:\n\t.string \"%s\"\n";
     *out_ << ".LC_fmt_s_nl:\n\t.string \"%s\\n\"\n";
+    // Index and length are words: long on Linux x64, but not on Windows.
+    const char* word = use32Bit_ ? "%d" : isLinux_ ? "%ld" : "%I64d";
+    *out_ << ".LC_bounds:\n\t.string \"index " << word << " out of bounds for length " << word << "\\n\"\n";
     for (auto& p : stringPool_) {
         *out_ << p.second << ":\n\t.string \"" << p.first << "\"\n";
     }
@@ -574,13 +1604,16 @@ void CodeGenerator::emitProgram() {
 }
 
 void CodeGenerator::emitProgramBody() {
-    if (use32Bit_) {
+    // Module objects call the runtime helpers emitted with the main program.
+    bool withRuntime = !splitUnits_ || unit_.empty();
+    if (withRuntime && use32Bit_) {
         *out_ << "\t.extern\t_printf\n";
         *out_ << "\t.extern\t_strlen\n";
         *out_ << "\t.extern\t_strcpy\n";
         *out_ << "\t.extern\t_strcat\n";
         *out_ << "\t.extern\tmalloc\n";
         *out_ << "\t.extern\tfree\n";
+        *out_ << "\t.extern\texit\n";
         *out_ << "\t.globl\tprintln\nprintln:\n";
         *out_ << "\tpushl\t%ebp\n\tmovl\t%esp, %ebp\n";
         *out_ << "\tpushl\t8(%ebp)\n\tpushl\t$.LC_fmt_d_nl\n\tcall\t_printf\n\taddl\t$8, %esp\n\tleave\n\tret\n";
@@ -590,14 +1623,20 @@ void CodeGenerator::emitProgramBody() {
         *out_ << "\t.globl\tprintln_float\nprintln_float:\n";
         *out_ << "\tpushl\t%ebp\n\tmovl\t%esp, %ebp\n\tsubl\t$8, %esp\n\tmovd\t8(%ebp), %xmm0\n\tmovd\t%xmm0, (%esp)\n\tpushl\t$.LC_fmt_f_nl\n\tcall\t_printf\n\taddl\t$12, %esp\n\tleave\n\tret\n";
         *out_ << "\t.globl\tprint_float\nprint_float:\n";
-        *out_ << "\tpushl\t%ebp\n\tmovl\t%esp, %ebp\n\tsubl\t$8, %esp\n\tmovd\t8(%ebp), %xmm0\n\tmovd\t%xmm0, (%esp)\n\tpushl\t$.LC_fmt_f\n\tcall\t_printf\n\taddl\t$12, %esp\n\tleave\n\tret\n\n";
-    } else {
+        *out_ << "\tpushl\t%ebp\n\tmovl\t%esp, %ebp\n\tsubl\t$8, %esp\n\tmovd\t8(%ebp), %xmm0\n\tmovd\t%xmm0, (%esp)\n\tpushl\t$.LC_fmt_f\n\tcall\t_printf\n\taddl\t$12, %esp\n\tleave\n\tret\n";
+        // _gspp_bounds_fail(index, length): report a failed bounds check and exit.
+        *out_ << "\t.globl\t_gspp_bounds_fail\n_gspp_bounds_fail:\n";
+        *out_ << "\tpushl\t%ebp\n\tmovl\t%esp, %ebp\n\tandl\t$-16, %esp\n\tsubl\t$4, %esp\n";
+        *out_ << "\tpushl\t12(%ebp)\n\tpushl\t8(%ebp)\n\tpushl\t$.LC_bounds\n\tcall\t_printf\n";
+        *out_ << "\tpushl\t$1\n\tcall\texit\n\n";
+    } else if (withRuntime) {
         *out_ << "\t.extern\tprintf\n";
         *out_ << "\t.extern\tstrlen\n";
         *out_ << "\t.extern\tstrcpy\n";
         *out_ << "\t.extern\tstrcat\n";
         *out_ << "\t.extern\tmalloc\n";
         *out_ << "\t.extern\tfree\n";
+        *out_ << "\t.extern\texit\n";
         if (isLinux_) {
             *out_ << "\t.globl\tprintln\nprintln:\n";
             *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n";
@@ -621,13 +1660,18 @@ void CodeGenerator::emitProgramBody() {
             *out_ << "\tmovq\t%rdi, %rsi\n\tleaq\t.LC_fmt_s(%rip), %rdi\n\tmovl\t$0, %eax\n\tcall\tprintf\n\tpopq\t%rbp\n\tret\n";
             *out_ << "\t.globl\t_gspp_strcat\n_gspp_strcat:\n";
             *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n\tsubq\t$32, %rsp\n";
-            *out_ << "\tmovq\t%rdi, 16(%rbp)\n\tmovq\t%rsi, 24(%rbp)\n";
-            *out_ << "\tcall\tstrlen\n\tmovq\t%rax, %rbx\n";
-            *out_ << "\tmovq\t24(%rbp), %rdi\n\tcall\tstrlen\n\taddq\t%rbx, %rax\n\tincq\t%rax\n";
-            *out_ << "\tmovq\t%rax, %rdi\n\tcall\tmalloc\n\tmovq\t%rax, %r10\n";
-            *out_ << "\tmovq\t%r10, %rdi\n\tmovq\t16(%rbp), %rsi\n\tcall\tstrcpy\n";
-            *out_ << "\tmovq\t%r10, %rdi\n\tmovq\t24(%rbp), %rsi\n\tcall\tstrcat\n";
-            *out_ << "\tmovq\t%r10, %rax\n\taddq\t$32, %rsp\n\tpopq\t%rbp\n\tret\n\n";
+            *out_ << "\tmovq\t%rdi, -8(%rbp)\n\tmovq\t%rsi, -16(%rbp)\n";
+            *out_ << "\tcall\tstrlen\n\tmovq\t%rax, -24(%rbp)\n";
+            *out_ << "\tmovq\t-16(%rbp), %rdi\n\tcall\tstrlen\n\taddq\t-24(%rbp), %rax\n\tincq\t%rax\n";
+            *out_ << "\tmovq\t%rax, %rdi\n\tcall\tmalloc\n\tmovq\t%rax, -32(%rbp)\n";
+            *out_ << "\tmovq\t%rax, %rdi\n\tmovq\t-8(%rbp), %rsi\n\tcall\tstrcpy\n";
+            *out_ << "\tmovq\t-32(%rbp), %rdi\n\tmovq\t-16(%rbp), %rsi\n\tcall\tstrcat\n";
+            *out_ << "\tmovq\t-32(%rbp), %rax\n\tleave\n\tret\n";
+            // _gspp_bounds_fail(index, length): report a failed bounds check and exit.
+            *out_ << "\t.globl\t_gspp_bounds_fail\n_gspp_bounds_fail:\n";
+            *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n\tandq\t$-16, %rsp\n";
+            *out_ << "\tmovq\t%rsi, %rdx\n\tmovq\t%rdi, %rsi\n\tleaq\t.LC_bounds(%rip), %rdi\n\tmovl\t$0, %eax\n\tcall\tprintf\n";
+            *out_ << "\tmovl\t$1, %edi\n\tcall\texit\n\n";
         } else {
             *out_ << "\t.globl\tprintln\nprintln:\n";
             *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n\tsubq\t$32, %rsp\n";
@@ -648,16 +1692,29 @@ void CodeGenerator::emitProgramBody() {
             *out_ << "\t.globl\tprint_string\nprint_string:\n";
             *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n\tsubq\t$32, %rsp\n";
             *out_ << "\tmovq\t%rcx, %rdx\n\tleaq\t.LC_fmt_s(%rip), %rcx\n\tcall\tprintf\n";
-            *out_ << "\taddq\t$32, %rsp\n\tpopq\t%rbp\n\tret\n\n";
+            *out_ << "\taddq\t$32, %rsp\n\tpopq\t%rbp\n\tret\n";
+            *out_ << "\t.globl\t_gspp_bounds_fail\n_gspp_bounds_fail:\n";
+            *out_ << "\tpushq\t%rbp\n\tmovq\t%rsp, %rbp\n\tandq\t$-16, %rsp\n\tsubq\t$32, %rsp\n";
+            *out_ << "\tmovq\t%rdx, %r8\n\tmovq\t%rcx, %rdx\n\tleaq\t.LC_bounds(%rip), %rcx\n\tcall\tprintf\n";
+            *out_ << "\tmovl\t$1, %ecx\n\tcall\texit\n\n";
         }
     }
-    for (const auto& pair : semantic_->functions())
-        emitFunc(pair.second);
+    // Emit in name order so the output does not depend on hash-map iteration.
+    std::vector<const FuncSymbol*> funcs;
+    for (const auto& pair : semantic_->functions()) {
+        if (splitUnits_ && pair.second.unit != unit_) continue;
+        funcs.push_back(&pair.second);
+    }
     for (const auto& modPair : semantic_->moduleFunctions()) {
         for (const auto& pair : modPair.second) {
-            emitFunc(pair.second);
+            if (splitUnits_ && pair.second.unit != unit_) continue;
+            funcs.push_back(&pair.second);
         }
     }
+    std::sort(funcs.begin(), funcs.end(),
+              [](const FuncSymbol* a, const FuncSymbol* b) { return a->mangledName < b->mangledName; });
+    for (const FuncSymbol* fs : funcs)
+        emitFunc(*fs);
 }
 
 bool CodeGenerator::generate() {
@@ -3,6 +3,7 @@
 
 #include "ast.h"
 #include "semantic.h"
+#include "vectorize.h"
 #include <ostream>
 #include <string>
 #include <unordered_map>
@@ -12,22 +13,66 @@ namespace gspp {
 
 class CodeGenerator {
 public:
-    CodeGenerator(Program* program, SemanticAnalyzer* semantic, std::ostream& out, bool use32Bit = true);
+    CodeGenerator(Program* program, SemanticAnalyzer* semantic, std::ostream& out, bool use32Bit = true,
+                  bool optimize = false);
     bool generate();
+    // Emit only the code of one unit: a module's own functions, or (for the
+    // empty symbol) the main program with the runtime helpers and all generic
+    // instances. By default everything goes into one assembly file.
+    void setUnit(Symbol unit) { unit_ = unit; splitUnits_ = true; }
     const std::vector<std::string>& errors() const { return errors_; }
+    // -Rpass=vectorize and -Rpass-missed=vectorize: report loops that were
+    // (or were not) vectorized.
+    void setRemarks(bool vectorized, bool missed) { remarkVectorized_ = vectorized; remarkMissed_ = missed; }
+    const std::vector<std::string>& remarks() const { return remarks_; }
 
 private:
+    // xmm registers of a vectorized loop: invariants take 0.., then the
+    // counter vector and its step, then temporaries up to limit.
+    struct VectorRegs { int counter = -1; int step = -1; int firstTemp = 0; int limit = 0; };
+
     void emitProgram();
     void emitFunc(const FuncSymbol& fs);
     void emitStmt(Stmt* stmt);
     void emitExpr(Expr* expr, const std::string& destReg, bool wantFloat = false);
     void emitExprToRax(Expr* expr);
     void emitExprToXmm0(Expr* expr);
+    void emitOperands(Expr* left, Expr* right);
+    void emitBranch(Expr* cond, const std::string& label, bool whenTrue);
+    void emitStoreVar(Symbol name, Expr* value);
+    void emitStoreAt(const Type* type, int off);
+    void emitCopyToFrame(const Type* type, int off, bool toArgs = false);
+    void emitLoad(const Type* type, int off, const std::string& dest);
+    void emitIndexAddress(Expr* index);
+    void emitSoaMemberAddress(Expr* member);
+    void emitNewSoa(Expr* expr);
+    bool isSoa(const Type* t);
+    bool isSoaMember(const Expr* expr);
+    bool isSlice(const Type* t);
+    void emitSlice(Expr* expr, const std::string& dest);
+    void emitNewArray(Expr* expr, const std::string& dest);
+    void emitMalloc();
+    void emitBoundsCheck(const std::string& index, const std::string& length, bool inclusive);
+    void emitVectorExpr(Expr* expr);
+    void emitVectorAddress(Expr* lvalue);
+    void emitVectorBuiltin(Expr* call, const std::string& dest);
+    void emitVectorSelect(bool min);
+    void emitVectorLoop(Stmt* loop);
+    bool emitVectorCode(const VectorLoop& plan, std::string& whyNot);
+    bool emitVectorValue(const Expr* e, const VectorLoop& plan, const VectorRegs& regs, int t);
+    int vectorLeafReg(const Expr* e, const VectorLoop& plan, const VectorRegs& regs) const;
+    void emitCallSysV(Expr* call, FuncSymbol* fs, const std::string& dest);
+    bool sysvClasses(const Type* t, std::vector<bool>& sse);
+    bool classifyAt(const Type* t, int off, std::vector<int>& classes);
+    void emitEpilogue(const std::string& tailCallee = "");
+    bool isTailCall(const Expr* call);
+    bool isLeaf(const Expr* expr) const;
+    bool hasCall(const Expr* expr) const;
     int getFrameSize();
-    std::string getVarLocation(const std::string& name);
-    int getTypeSize(const Type& t);
-    StructDef* resolveStruct(const std::string& name, const std::string& ns);
-    FuncSymbol* resolveFunc(const std::string& name, const std::string& ns);
+    std::string getVarLocation(Symbol name);
+    int getTypeSize(const Type* t);
+    StructDef* resolveStruct(Symbol name, Symbol ns);
+    FuncSymbol* resolveFunc(Symbol name, Symbol ns);
     void emitProgramBody();
     void error(const std::string& msg, SourceLoc loc);
 
@@ -35,15 +80,27 @@ private:
     SemanticAnalyzer* semantic_;
     std::ostream* out_;
     const FuncDecl* currentFunc_ = nullptr;
-    std::unordered_map<std::string, VarSymbol> currentVars_;
+    const FuncSymbol* currentSym_ = nullptr;
+    std::unordered_map<Symbol, VarSymbol> currentVars_;
     int frameSize_ = 0;
     std::vector<std::string> errors_;
     int labelCounter_ = 0;
     std::string nextLabel();
     bool use32Bit_ = true;  // if true, emit 32-bit x86 (cdecl); else x86-64 Windows
     bool isLinux_ = false;
-    std::string currentNamespace_;
+    Symbol currentNamespace_;
     std::unordered_map<std::string, std::string> stringPool_;
+    bool optimize_ = false;  // -O: register allocation and register temporaries (x86-64 only)
+    std::unordered_map<Symbol, std::string> varRegs_;
+    std::vector<std::pair<std::string, int>> savedRegs_;  // callee-saved reg -> frame offset
+    std::vector<std::string> scratchFree_;
+    const Expr* tailCall_ = nullptr;  // the call of a return statement, made as a jump (-O)
+    bool frameEscapes_ = false;       // the function takes the address of a local
+    Symbol unit_;
+    bool splitUnits_ = false;
+    bool remarkVectorized_ = false;
+    bool remarkMissed_ = false;
+    std::vector<std::string> remarks_;
 };
 
 } // namespace gspp
@@ -0,0 +1,209 @@
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gspp {
+
+SourceBuffer::SourceBuffer(std::string text) : owned_(std::move(text)) {
+    data_ = owned_.data();
+    size_ = owned_.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::map(const std::string& path) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            close(fd);
+            std::unique_ptr<SourceBuffer> buf(new SourceBuffer());
+            buf->data_ = static_cast<const char*>(p);
+            buf->size_ = (size_t)st.st_size;
+            buf->mapped_ = true;
+            return buf;
+        }
+    }
+    close(fd);
+#endif
+    // Empty files, pipes and platforms without mmap are read conventionally.
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return nullptr;
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    return std::make_unique<SourceBuffer>(ss.str());
+}
+
+std::string_view SourceManager::load(const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ids_.find(filename);
+        if (it != ids_.end()) return files_[it->second].buffer->text();
+    }
+    // Map and index outside the lock so several threads can read files at
+    // once; if another thread won the race, its copy is kept.
+    std::unique_ptr<SourceBuffer> buf = SourceBuffer::map(filename);
+    if (!buf) return {};
+    File f = makeFile(filename, std::move(buf));
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(filename);
+    uint32_t id = it != ids_.end() ? it->second : insert(std::move(f));
+    return files_[id].buffer->text();
+}
+
+uint32_t SourceManager::addSource(const std::string& filename, std::string source) {
+    File f = makeFile(filename, std::make_unique<SourceBuffer>(std::move(source)));
+    std::lock_guard<std::mutex> lock(mutex_);
+    return insert(std::move(f));
+}
+
+SourceManager::File SourceManager::makeFile(const std::string& filename, std::unique_ptr<SourceBuffer> buf) {
+    File f;
+    f.name = filename;
+    f.buffer = std::move(buf);
+    std::string_view src = f.buffer->text();
+    f.lineStarts.push_back(0);
+    for (const char* p = src.data(), *end = p + src.size();
+         (p = static_cast<const char*>(std::memchr(p, '\n', end - p))) != nullptr; )
+        f.lineStarts.push_back((uint32_t)(++p - src.data()));
+    return f;
+}
+
+uint32_t SourceManager::insert(File f) {
+    size_t size = f.buffer->text().size();
+    // One past the end is a valid location (Eof), hence the +1.
+    if (nextBase_ + size + 1 <= UINT32_MAX && ranged_ == files_.size()) {
+        f.base = (uint32_t)nextBase_;
+        nextBase_ += size + 1;
+        ranged_++;
+    }
+    uint32_t id = (uint32_t)files_.size();
+    ids_[f.name] = id;
+    files_.push_back(std::move(f));
+    return id;
+}
+
+uint32_t SourceManager::findFile(const std::string& filename) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(filename);
+    return it == ids_.end() ? NoFile : it->second;
+}
+
+std::string_view SourceManager::text(const std::string& filename) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(filename);
+    return it == ids_.end() ? std::string_view() : files_[it->second].buffer->text();
+}
+
+std::string_view SourceManager::text(uint32_t file) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return files_[file].buffer->text();
+}
+
+SourceLoc SourceManager::getLoc(uint32_t file, size_t offset) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const File& f = files_[file];
+    return SourceLoc{f.base ? f.base + (uint32_t)offset : 0};
+}
+
+const SourceManager::File* SourceManager::fileFor(SourceLoc loc) const {
+    if (!loc.valid()) return nullptr;
+    auto it = std::upper_bound(files_.begin(), files_.begin() + ranged_, loc.offset,
+                               [](uint32_t off, const File& f) { return off < f.base; });
+    return it == files_.begin() ? nullptr : &*(it - 1);
+}
+
+LineColumn SourceManager::decodeIn(const File& f, SourceLoc loc) const {
+    uint32_t off = loc.offset - f.base;
+    auto lit = std::upper_bound(f.lineStarts.begin(), f.lineStarts.end(), off);
+    LineColumn lc;
+    lc.filename = f.name;
+    lc.line = (int)(lit - f.lineStarts.begin());
+    lc.column = (int)(off - *(lit - 1)) + 1;
+    return lc;
+}
+
+LineColumn SourceManager::decode(SourceLoc loc) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const File* f = fileFor(loc);
+    return f ? decodeIn(*f, loc) : LineColumn();
+}
+
+std::string_view SourceManager::lineText(const File& f, int line) const {
+    if (line < 1 || line > (int)f.lineStarts.size()) return {};
+    std::string_view src = f.buffer->text().substr(f.lineStarts[line - 1]);
+    return src.substr(0, src.find_first_of("\r\n"));
+}
+
+std::string SourceManager::getLine(const std::string& filename, int line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(filename);
+    return it == ids_.end() ? "" : std::string(lineText(files_[it->second], line));
+}
+
+std::string SourceManager::formatError(const SourceLoc& loc, const std::string& msg) {
+    std::ostringstream os;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const File* f = fileFor(loc);
+    if (!f) {
+        os << "error: " << msg;
+        return os.str();
+    }
+    LineColumn lc = decodeIn(*f, loc);
+    os << lc.filename << ":" << lc.line << ":" << lc.column << ": error: " << msg << "\n";
+    std::string_view snippet = lineText(*f, lc.line);
+    if (!snippet.empty()) {
+        os << "    " << snippet << "\n";
+        os << "    ";
+        for (int i = 1; i < lc.column; i++) {
+            if (i-1 < (int)snippet.size() && snippet[i-1] == '\t') os << "\t";
+            else os << " ";
+        }
+        os << "^";
+    }
+    return os.str();
+}
+
+std::string SourceManager::formatRemark(const SourceLoc& loc, const std::string& msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const File* f = fileFor(loc);
+    if (!f) return "remark: " + msg;
+    LineColumn lc = decodeIn(*f, loc);
+    return std::string(lc.filename) + ":" + std::to_string(lc.line) + ":" + std::to_string(lc.column) + ": remark: " + msg;
+}
+
+void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& fn) {
+    size_t threads = std::min<size_t>(jobs, count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < count; ) fn(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(work);
+    work();
+    for (std::thread& t : pool) t.join();
+}
+
+} // namespace gspp
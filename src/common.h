@@ -1,19 +1,58 @@
 #ifndef GSPP_COMMON_H
 #define GSPP_COMMON_H
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
-#include <sstream>
+#include <memory>
 
 namespace gspp {
 
+// A position in a registered source file, packed into 32 bits. Each file
+// owns a contiguous range of offsets in one global space, so the file is
+// recovered by binary search over range starts and the line from that
+// file's line table. Offset 0 means "no location".
 struct SourceLoc {
-    std::string filename;
+    uint32_t offset = 0;
+    bool valid() const { return offset != 0; }
+};
+
+// A SourceLoc decoded for display.
+struct LineColumn {
+    std::string_view filename;
     int line = 0;
     int column = 0;
 };
 
+// Read-only contents of one source file. Files are memory-mapped where the
+// platform allows it, so the text is never copied; tokens and diagnostics
+// refer into it for the rest of the compilation.
+class SourceBuffer {
+public:
+    static std::unique_ptr<SourceBuffer> map(const std::string& path);
+    explicit SourceBuffer(std::string text);
+    ~SourceBuffer();
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    std::string_view text() const { return {data_, size_}; }
+
+private:
+    SourceBuffer() = default;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string owned_;  // backing store when the file could not be mapped
+};
+
+// Owns every source file of the compilation. All members may be called from
+// several threads; returned views stay valid until exit.
 class SourceManager {
 public:
     static SourceManager& instance() {
@@ -21,51 +60,52 @@ public:
         return inst;
     }
 
-    void addSource(const std::string& filename, const std::string& source) {
-        sources_[filename] = source;
-    }
+    static constexpr uint32_t NoFile = UINT32_MAX;
 
-    std::string getLine(const std::string& filename, int line) {
-        auto it = sources_.find(filename);
-        if (it == sources_.end()) return "";
-        const std::string& src = it->second;
-        size_t start = 0;
-        int l = 1;
-        for (size_t i = 0; i < src.size(); i++) {
-            if (l == line) {
-                start = i;
-                while (i < src.size() && src[i] != '\n' && src[i] != '\r') i++;
-                return src.substr(start, i - start);
-            }
-            if (src[i] == '\n') l++;
-            else if (src[i] == '\r') {
-                if (i+1 < src.size() && src[i+1] == '\n') i++;
-                l++;
-            }
-        }
-        return "";
-    }
+    // Maps the file and keeps it alive until exit. Returns an empty view if
+    // the file cannot be read.
+    std::string_view load(const std::string& filename);
+    uint32_t addSource(const std::string& filename, std::string source);
+    uint32_t findFile(const std::string& filename) const;
+    std::string_view text(const std::string& filename) const;
+    std::string_view text(uint32_t file) const;
 
-    std::string formatError(const SourceLoc& loc, const std::string& msg) {
-        std::ostringstream os;
-        os << loc.filename << ":" << loc.line << ":" << loc.column << ": error: " << msg << "\n";
-        std::string lineText = getLine(loc.filename, loc.line);
-        if (!lineText.empty()) {
-            os << "    " << lineText << "\n";
-            os << "    ";
-            for (int i = 1; i < loc.column; i++) {
-                if (i-1 < (int)lineText.size() && lineText[i-1] == '\t') os << "\t";
-                else os << " ";
-            }
-            os << "^";
-        }
-        return os.str();
-    }
+    // Location of byte `offset` within `file`.
+    SourceLoc getLoc(uint32_t file, size_t offset) const;
+    LineColumn decode(SourceLoc loc) const;
+
+    std::string getLine(const std::string& filename, int line);
+    std::string formatError(const SourceLoc& loc, const std::string& msg);
+    // "file:line:col: remark: msg", without the source snippet.
+    std::string formatRemark(const SourceLoc& loc, const std::string& msg);
 
 private:
-    std::unordered_map<std::string, std::string> sources_;
+    struct File {
+        std::string name;
+        std::unique_ptr<SourceBuffer> buffer;
+        uint32_t base = 0;                // 0 once the location space is exhausted
+        std::vector<uint32_t> lineStarts; // byte offset of each line, built once
+    };
+
+    static File makeFile(const std::string& filename, std::unique_ptr<SourceBuffer> buf);
+
+    // Callers hold mutex_.
+    uint32_t insert(File f);
+    const File* fileFor(SourceLoc loc) const;
+    std::string_view lineText(const File& f, int line) const;
+    LineColumn decodeIn(const File& f, SourceLoc loc) const;
+
+    mutable std::mutex mutex_;
+    std::deque<File> files_;                        // indexed by file ID; never moves
+    std::unordered_map<std::string, uint32_t> ids_; // latest ID for each name
+    size_t ranged_ = 0;                             // leading files_ that own a range
+    uint64_t nextBase_ = 1;
 };
 
+// Calls fn(0) .. fn(count - 1) on up to `jobs` threads, the caller's
+// included, and returns once every call has finished.
+void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& fn);
+
 }
 
 #endif
@@ -0,0 +1,232 @@
+#include "elfwriter.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace gspp {
+
+namespace {
+
+struct ByteWriter {
+    std::vector<uint8_t> buf;
+    void u8(uint8_t v) { buf.push_back(v); }
+    void u16(uint16_t v) { for (int i = 0; i < 2; i++) buf.push_back((uint8_t)(v >> (8 * i))); }
+    void u32(uint32_t v) { for (int i = 0; i < 4; i++) buf.push_back((uint8_t)(v >> (8 * i))); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; i++) buf.push_back((uint8_t)(v >> (8 * i))); }
+    void pad(uint64_t align) { while (buf.size() % align) buf.push_back(0); }
+};
+
+struct StringTable {
+    std::vector<uint8_t> data = {0};
+    std::unordered_map<std::string, uint32_t> offsets;
+    uint32_t add(const std::string& s) {
+        if (s.empty()) return 0;
+        auto it = offsets.find(s);
+        if (it != offsets.end()) return it->second;
+        uint32_t off = (uint32_t)data.size();
+        data.insert(data.end(), s.begin(), s.end());
+        data.push_back(0);
+        offsets[s] = off;
+        return off;
+    }
+};
+
+struct SectionHeader {
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint64_t flags = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t link = 0;
+    uint32_t info = 0;
+    uint64_t align = 1;
+    uint64_t entsize = 0;
+    const std::vector<uint8_t>* contents = nullptr;
+};
+
+} // namespace
+
+void writeElfObject(const ObjectFile& obj, std::ostream& out) {
+    const uint16_t kShnUndef = 0;
+    StringTable strtab, shstrtab;
+
+    // COMDAT group sections must precede their members in the section header
+    // table, so they take the indices right after the null header and the
+    // object's own sections start at secBase.
+    std::vector<std::string> groups;
+    std::unordered_map<std::string, size_t> groupIndex;
+    for (const auto& sec : obj.sections)
+        if (!sec.group.empty() && groupIndex.emplace(sec.group, groups.size()).second) groups.push_back(sec.group);
+    const uint32_t secBase = 1 + (uint32_t)groups.size();
+
+    // Symbol table: null, one STT_SECTION symbol per section, named locals,
+    // then globals (the gABI requires all locals to precede globals).
+    ByteWriter symtab;
+    uint32_t symCount = 0;
+    auto addSym = [&](uint32_t name, uint8_t info, uint16_t shndx, uint64_t value) {
+        symtab.u32(name);
+        symtab.u8(info);
+        symtab.u8(0);
+        symtab.u16(shndx);
+        symtab.u64(value);
+        symtab.u64(0);
+        return symCount++;
+    };
+    addSym(0, 0, kShnUndef, 0);
+    std::vector<uint32_t> sectionSym(obj.sections.size());
+    for (size_t i = 0; i < obj.sections.size(); i++)
+        sectionSym[i] = addSym(0, 3 /* STB_LOCAL, STT_SECTION */, (uint16_t)(i + secBase), 0);
+    std::unordered_map<std::string, uint32_t> symIndex;
+    for (const auto& s : obj.symbols) {
+        if (s.global) continue;
+        symIndex[s.name] = addSym(strtab.add(s.name), s.function ? 2 : 0, (uint16_t)(s.section + secBase), s.value);
+    }
+    uint32_t firstGlobal = symCount;
+    for (const auto& s : obj.symbols) {
+        if (!s.global) continue;
+        uint8_t info = (uint8_t)((s.weak ? 2 : 1) << 4 | (s.function ? 2 : 0));
+        uint16_t shndx = s.section < 0 ? kShnUndef : (uint16_t)(s.section + secBase);
+        symIndex[s.name] = addSym(strtab.add(s.name), info, shndx, s.value);
+    }
+
+    std::vector<SectionHeader> headers(secBase);  // groups are filled in below
+    std::vector<std::vector<uint32_t>> groupMembers(groups.size());
+    for (const auto& sec : obj.sections) {
+        SectionHeader h;
+        h.name = shstrtab.add(sec.name);
+        h.type = sec.type;
+        h.flags = sec.flags;
+        if (!sec.group.empty()) {
+            h.flags |= SHF_GROUP;
+            groupMembers[groupIndex.at(sec.group)].push_back((uint32_t)headers.size());
+        }
+        h.align = sec.align;
+        h.size = sec.type == SHT_NOBITS ? sec.size : sec.data.size();
+        if (sec.type != SHT_NOBITS) h.contents = &sec.data;
+        headers.push_back(h);
+    }
+    uint32_t symtabIndex = (uint32_t)(headers.size());
+    for (const auto& sec : obj.sections)
+        if (!sec.relocs.empty()) symtabIndex++;
+
+    std::vector<std::vector<uint8_t>> relaData;
+    relaData.reserve(obj.sections.size());
+    for (size_t i = 0; i < obj.sections.size(); i++) {
+        const ObjSection& sec = obj.sections[i];
+        if (sec.relocs.empty()) continue;
+        ByteWriter rela;
+        for (const auto& r : sec.relocs) {
+            uint64_t sym = r.symbol.empty() ? sectionSym[r.section] : symIndex.at(r.symbol);
+            rela.u64(r.offset);
+            rela.u64(sym << 32 | r.type);
+            rela.u64((uint64_t)r.addend);
+        }
+        relaData.push_back(std::move(rela.buf));
+        SectionHeader h;
+        h.name = shstrtab.add(".rela" + sec.name);
+        h.type = SHT_RELA;
+        h.flags = SHF_INFO_LINK;
+        if (!sec.group.empty()) {
+            h.flags |= SHF_GROUP;
+            groupMembers[groupIndex.at(sec.group)].push_back((uint32_t)headers.size());
+        }
+        h.size = relaData.back().size();
+        h.link = symtabIndex;
+        h.info = (uint32_t)(i + secBase);
+        h.align = 8;
+        h.entsize = 24;
+        h.contents = &relaData.back();
+        headers.push_back(h);
+    }
+
+    // Each group is named by its signature symbol (the instance's own weak
+    // definition) and lists its member sections after the GRP_COMDAT flag.
+    std::vector<std::vector<uint8_t>> groupData;
+    groupData.reserve(groups.size());
+    for (size_t g = 0; g < groups.size(); g++) {
+        ByteWriter members;
+        members.u32(1);  // GRP_COMDAT
+        for (uint32_t m : groupMembers[g]) members.u32(m);
+        groupData.push_back(std::move(members.buf));
+        SectionHeader& h = headers[1 + g];
+        h.name = shstrtab.add(".group");
+        h.type = SHT_GROUP;
+        h.size = groupData.back().size();
+        h.link = symtabIndex;
+        auto sig = symIndex.find(groups[g]);
+        h.info = sig != symIndex.end() ? sig->second : sectionSym[groupMembers[g][0] - secBase];
+        h.align = 4;
+        h.entsize = 4;
+        h.contents = &groupData.back();
+    }
+
+    SectionHeader symHdr;
+    symHdr.name = shstrtab.add(".symtab");
+    symHdr.type = SHT_SYMTAB;
+    symHdr.size = symtab.buf.size();
+    symHdr.link = symtabIndex + 1;
+    symHdr.info = firstGlobal;
+    symHdr.align = 8;
+    symHdr.entsize = 24;
+    symHdr.contents = &symtab.buf;
+    headers.push_back(symHdr);
+
+    SectionHeader strHdr;
+    strHdr.name = shstrtab.add(".strtab");
+    strHdr.type = SHT_STRTAB;
+    strHdr.size = strtab.data.size();
+    strHdr.contents = &strtab.data;
+    headers.push_back(strHdr);
+
+    SectionHeader shstrHdr;
+    shstrHdr.name = shstrtab.add(".shstrtab");
+    shstrHdr.type = SHT_STRTAB;
+    shstrHdr.size = shstrtab.data.size();
+    shstrHdr.contents = &shstrtab.data;
+    headers.push_back(shstrHdr);
+
+    // Layout: ELF header, section contents, section header table.
+    ByteWriter file;
+    file.buf.resize(64);
+    for (auto& h : headers) {
+        if (h.type == 0) continue;
+        file.pad(h.align ? h.align : 1);
+        h.offset = file.buf.size();
+        if (h.contents) file.buf.insert(file.buf.end(), h.contents->begin(), h.contents->end());
+    }
+    file.pad(8);
+    uint64_t shoff = file.buf.size();
+    for (const auto& h : headers) {
+        file.u32(h.name);
+        file.u32(h.type);
+        file.u64(h.flags);
+        file.u64(0);  // sh_addr
+        file.u64(h.offset);
+        file.u64(h.size);
+        file.u32(h.link);
+        file.u32(h.info);
+        file.u64(h.type == 0 ? 0 : h.align);
+        file.u64(h.entsize);
+    }
+
+    ByteWriter ehdr;
+    const uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 2 /* ELFCLASS64 */, 1 /* ELFDATA2LSB */, 1 /* EV_CURRENT */};
+    for (uint8_t b : ident) ehdr.u8(b);
+    ehdr.u16(1);   // ET_REL
+    ehdr.u16(62);  // EM_X86_64
+    ehdr.u32(1);   // EV_CURRENT
+    ehdr.u64(0);   // e_entry
+    ehdr.u64(0);   // e_phoff
+    ehdr.u64(shoff);
+    ehdr.u32(0);   // e_flags
+    ehdr.u16(64);  // e_ehsize
+    ehdr.u16(0);   // e_phentsize
+    ehdr.u16(0);   // e_phnum
+    ehdr.u16(64);  // e_shentsize
+    ehdr.u16((uint16_t)headers.size());
+    ehdr.u16((uint16_t)(headers.size() - 1));  // .shstrtab is last
+    std::copy(ehdr.buf.begin(), ehdr.buf.end(), file.buf.begin());
+
+    out.write(reinterpret_cast<const char*>(file.buf.data()), (std::streamsize)file.buf.size());
+}
+
+} // namespace gspp
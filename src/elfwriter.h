@@ -0,0 +1,64 @@
+#ifndef GSPP_ELFWRITER_H
+#define GSPP_ELFWRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gspp {
+
+// ELF constants used by the object writer (see the System V gABI and the
+// x86-64 psABI for the full tables).
+enum : uint32_t {
+    SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_RELA = 4, SHT_NOBITS = 8, SHT_GROUP = 17
+};
+enum : uint64_t {
+    SHF_WRITE = 0x1, SHF_ALLOC = 0x2, SHF_EXECINSTR = 0x4, SHF_INFO_LINK = 0x40, SHF_GROUP = 0x200
+};
+enum : uint32_t {
+    R_X86_64_64 = 1, R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4, R_X86_64_32 = 10, R_X86_64_32S = 11
+};
+
+// Relocation against either a named symbol or (for local labels) the start
+// of a section, in which case the label's offset is folded into the addend.
+struct ObjReloc {
+    uint64_t offset = 0;
+    uint32_t type = 0;
+    int64_t addend = 0;
+    std::string symbol;   // global or undefined symbol; empty for section-relative
+    int section = -1;     // section index when symbol is empty
+};
+
+struct ObjSection {
+    std::string name;
+    uint32_t type = SHT_PROGBITS;
+    uint64_t flags = 0;
+    uint64_t align = 1;
+    std::vector<uint8_t> data;
+    uint64_t size = 0;  // SHT_NOBITS only
+    std::vector<ObjReloc> relocs;
+    std::string group;  // COMDAT group signature; the linker keeps one section per signature
+};
+
+struct ObjSymbol {
+    std::string name;
+    int section = -1;  // -1: undefined
+    uint64_t value = 0;
+    bool global = false;
+    bool function = false;
+    bool weak = false;  // global that another object's definition may override
+};
+
+// Contents of one relocatable object, independent of the file format.
+struct ObjectFile {
+    std::vector<ObjSection> sections;
+    std::vector<ObjSymbol> symbols;
+};
+
+// Serializes obj as an ELF64 little-endian x86-64 relocatable (ET_REL) file.
+void writeElfObject(const ObjectFile& obj, std::ostream& out);
+
+} // namespace gspp
+
+#endif
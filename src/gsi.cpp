@@ -0,0 +1,491 @@
+#include "gsi.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace gspp {
+
+namespace {
+
+// Layout: a header of kHeaderWords words (magic, version, build key, then
+// the start word and record count of each section), followed by the
+// sections in Section order. Variable-length data (member lists, type
+// arguments, template ASTs) lives in the pool; records refer to it by word
+// index. Type records keep their arguments apart, in TypeArgs, because types
+// are interned while pool entries are still being written. Strings are
+// (byte offset, length) pairs into the blob.
+const uint32_t kGsiMagic = 0x31495347;  // "GSI1"
+const uint32_t kGsiVersion = 3;
+const uint32_t kNone = 0xFFFFFFFF;
+
+enum Section {
+    Strings, Blob, Types, TypeArgs, Imports, Structs, Funcs, StructTemplates, FuncTemplates, Instances, Pool,
+    SectionCount
+};
+const uint32_t kRecordWords[SectionCount] = {2, 0, 5, 1, 2, 6, 4, 2, 2, 4, 1};
+const size_t kHeaderWords = 3 + 2 * SectionCount;
+
+size_t sectionStart(int s) { return 3 + 2 * s; }
+size_t sectionCount(int s) { return 4 + 2 * s; }
+
+class GsiWriter {
+public:
+    explicit GsiWriter(uint32_t file) {
+        SourceManager& sm = SourceManager::instance();
+        base_ = sm.getLoc(file, 0).offset;
+        size_ = (uint32_t)sm.text(file).size();
+    }
+
+    uint32_t str(std::string_view s) {
+        auto it = stringIds_.find(std::string(s));
+        if (it != stringIds_.end()) return it->second;
+        uint32_t id = (uint32_t)(strings_.size() / 2);
+        strings_.push_back((uint32_t)blob_.size());
+        strings_.push_back((uint32_t)s.size());
+        blob_.append(s.data(), s.size());
+        stringIds_.emplace(std::string(s), id);
+        return id;
+    }
+    uint32_t sym(Symbol s) { return str(s.str()); }
+
+    // Children are written before their parents, so a reader can reject any
+    // reference that does not point backwards.
+    uint32_t type(const Type* t) {
+        if (!t) return kNone;
+        auto it = typeIds_.find(t);
+        if (it != typeIds_.end()) return it->second;
+        uint32_t ptrTo = type(t->ptrTo);
+        std::vector<uint32_t> args;
+        for (const Type* a : t->typeArgs) args.push_back(type(a));
+        uint32_t argsPos = (uint32_t)typeArgs_.size();
+        typeArgs_.push_back((uint32_t)args.size());
+        typeArgs_.insert(typeArgs_.end(), args.begin(), args.end());
+        uint32_t id = (uint32_t)(types_.size() / kRecordWords[Types]);
+        types_.insert(types_.end(), {(uint32_t)t->kind, sym(t->structName), sym(t->ns), ptrTo, argsPos});
+        typeIds_[t] = id;
+        return id;
+    }
+
+    // Locations are stored relative to the module's file (0 means none).
+    uint32_t loc(SourceLoc l) const {
+        if (!base_ || !l.valid() || l.offset < base_ || l.offset - base_ > size_) return 0;
+        return l.offset - base_ + 1;
+    }
+
+    void types(const std::vector<const Type*>& ts) {
+        std::vector<uint32_t> ids;
+        for (const Type* t : ts) ids.push_back(type(t));
+        pool.push_back((uint32_t)ids.size());
+        pool.insert(pool.end(), ids.begin(), ids.end());
+    }
+
+    void expr(const Expr* e) {
+        if (!e) {
+            pool.push_back(0);
+            return;
+        }
+        uint64_t floatBits;
+        std::memcpy(&floatBits, &e->floatVal, sizeof floatBits);
+        uint32_t exprType = type(e->exprType), targetType = type(e->targetType);
+        pool.insert(pool.end(), {1u, (uint32_t)e->kind, (uint32_t)e->op, loc(e->loc),
+                                 (uint32_t)(uint64_t)e->intVal, (uint32_t)((uint64_t)e->intVal >> 32),
+                                 (uint32_t)floatBits, (uint32_t)(floatBits >> 32), (uint32_t)e->boolVal,
+                                 str(e->strVal), sym(e->ident), sym(e->ns), sym(e->member),
+                                 exprType, targetType});
+        types(e->typeArgs);
+        expr(e->left.get());
+        expr(e->right.get());
+        pool.push_back((uint32_t)e->args.size());
+        for (const auto& a : e->args) expr(a.get());
+    }
+
+    void stmt(const Stmt* s) {
+        if (!s) {
+            pool.push_back(0);
+            return;
+        }
+        uint32_t varType = type(s->varType);
+        pool.insert(pool.end(), {1u, (uint32_t)s->kind, loc(s->loc), sym(s->varName), varType, str(s->asmCode)});
+        expr(s->varInit.get());
+        expr(s->assignTarget.get());
+        expr(s->assignValue.get());
+        expr(s->condition.get());
+        stmt(s->thenBranch.get());
+        stmt(s->elseBranch.get());
+        stmt(s->body.get());
+        stmt(s->initStmt.get());
+        stmt(s->stepStmt.get());
+        expr(s->returnExpr.get());
+        expr(s->expr.get());
+        pool.push_back((uint32_t)s->blockStmts.size());
+        for (const auto& b : s->blockStmts) stmt(b.get());
+    }
+
+    void symbols(const std::vector<Symbol>& syms) {
+        pool.push_back((uint32_t)syms.size());
+        for (Symbol s : syms) pool.push_back(sym(s));
+    }
+
+    std::vector<uint32_t> pool;
+    std::vector<uint32_t> strings_;
+    std::string blob_;
+    std::vector<uint32_t> types_;
+    std::vector<uint32_t> typeArgs_;
+
+private:
+    uint32_t base_ = 0;
+    uint32_t size_ = 0;
+    std::unordered_map<std::string, uint32_t> stringIds_;
+    std::unordered_map<const Type*, uint32_t> typeIds_;
+};
+
+// Records of a name-sorted section, keyed by spelling while they are built.
+using SortedRecords = std::vector<std::pair<std::string, std::vector<uint32_t>>>;
+
+void flatten(SortedRecords& recs, std::vector<uint32_t>& out) {
+    std::sort(recs.begin(), recs.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& r : recs) out.insert(out.end(), r.second.begin(), r.second.end());
+}
+
+} // namespace
+
+std::string writeGsi(const ModuleInterface& iface, std::string_view buildKey, uint32_t file) {
+    GsiWriter w(file);
+    std::vector<uint32_t> sections[SectionCount];
+    uint32_t keyId = w.str(buildKey);
+
+    for (const Import& imp : iface.imports)
+        sections[Imports].insert(sections[Imports].end(), {w.sym(imp.name), w.str(imp.path)});
+
+    SortedRecords structs, funcs, structTemplates, funcTemplates;
+    for (const StructDef& sd : iface.structs) {
+        uint32_t pos = (uint32_t)w.pool.size();
+        w.pool.push_back((uint32_t)sd.members.size());
+        for (size_t i = 0; i < sd.members.size(); i++) {
+            uint32_t name = w.sym(sd.members[i].first);
+            uint32_t ty = w.type(sd.members[i].second);
+            w.pool.insert(w.pool.end(), {name, ty, (uint32_t)sd.offsets[i]});
+        }
+        structs.push_back({sd.name.str(), {w.sym(sd.name), w.str(sd.mangledName), (uint32_t)sd.sizeBytes,
+                                           (uint32_t)sd.alignBytes, (uint32_t)sd.soa, pos}});
+    }
+    for (const FuncSymbol& fs : iface.functions) {
+        uint32_t ret = w.type(fs.returnType);
+        uint32_t pos = (uint32_t)w.pool.size();
+        w.types(fs.paramTypes);
+        funcs.push_back({fs.name.str(), {w.sym(fs.name), w.str(fs.mangledName), ret, pos}});
+    }
+    for (const StructDecl* s : iface.structTemplates) {
+        uint32_t pos = (uint32_t)w.pool.size();
+        w.pool.insert(w.pool.end(), {w.sym(s->name), w.loc(s->loc),
+                                       (uint32_t)s->packed | (uint32_t)s->reorder << 1 | (uint32_t)s->soa << 2});
+        w.symbols(s->typeParams);
+        w.pool.push_back((uint32_t)s->members.size());
+        for (const StructMember& m : s->members) {
+            uint32_t name = w.sym(m.name);
+            uint32_t ty = w.type(m.type);
+            w.pool.insert(w.pool.end(), {name, ty, w.loc(m.loc)});
+        }
+        structTemplates.push_back({s->name.str(), {w.sym(s->name), pos}});
+    }
+    for (const FuncDecl* f : iface.funcTemplates) {
+        uint32_t ret = w.type(f->returnType);
+        uint32_t pos = (uint32_t)w.pool.size();
+        w.pool.insert(w.pool.end(), {w.sym(f->name), w.loc(f->loc), (uint32_t)f->isExtern, w.str(f->externLib), ret});
+        w.symbols(f->typeParams);
+        w.pool.push_back((uint32_t)f->params.size());
+        for (const FuncParam& p : f->params) {
+            uint32_t name = w.sym(p.name);
+            uint32_t ty = w.type(p.type);
+            w.pool.insert(w.pool.end(), {name, ty, w.loc(p.loc)});
+        }
+        w.stmt(f->body.get());
+        funcTemplates.push_back({f->name.str(), {w.sym(f->name), pos}});
+    }
+    for (const GenericInstance& gi : iface.instances) {
+        uint32_t pos = (uint32_t)w.pool.size();
+        w.types(gi.args);
+        sections[Instances].insert(sections[Instances].end(), {(uint32_t)gi.isFunc, w.sym(gi.name), w.sym(gi.ns), pos});
+    }
+    flatten(structs, sections[Structs]);
+    flatten(funcs, sections[Funcs]);
+    flatten(structTemplates, sections[StructTemplates]);
+    flatten(funcTemplates, sections[FuncTemplates]);
+    sections[Strings] = std::move(w.strings_);
+    sections[Types] = std::move(w.types_);
+    sections[TypeArgs] = std::move(w.typeArgs_);
+    sections[Pool] = std::move(w.pool);
+
+    std::vector<uint32_t> image(kHeaderWords);
+    image[0] = kGsiMagic;
+    image[1] = kGsiVersion;
+    image[2] = keyId;
+    for (int s = 0; s < SectionCount; s++) {
+        image[sectionStart(s)] = (uint32_t)image.size();
+        if (s == Blob) {
+            image[sectionCount(s)] = (uint32_t)w.blob_.size();
+            size_t at = image.size();
+            image.resize(at + (w.blob_.size() + 3) / 4);
+            std::copy(w.blob_.begin(), w.blob_.end(), reinterpret_cast<char*>(image.data() + at));
+            continue;
+        }
+        image[sectionCount(s)] = (uint32_t)(sections[s].size() / kRecordWords[s]);
+        image.insert(image.end(), sections[s].begin(), sections[s].end());
+    }
+    return std::string(reinterpret_cast<const char*>(image.data()), image.size() * sizeof(uint32_t));
+}
+
+std::unique_ptr<GsiModule> GsiModule::open(const std::string& path, uint32_t file) {
+    std::unique_ptr<SourceBuffer> buf = SourceBuffer::map(path);
+    if (!buf || buf->text().size() % 4 != 0 || buf->text().size() < kHeaderWords * 4) return nullptr;
+    std::unique_ptr<GsiModule> m(new GsiModule());
+    m->buf_ = std::move(buf);
+    m->words_ = m->buf_->text().size() / 4;
+    m->file_ = file;
+    if (m->word(0) != kGsiMagic || m->word(1) != kGsiVersion) return nullptr;
+    // Every section must lie inside the file; records are not checked until
+    // they are decoded, and out-of-range reads yield zeros.
+    for (int s = 0; s < SectionCount; s++) {
+        uint64_t words = s == Blob ? (m->word(sectionCount(s)) + 3ull) / 4
+                                   : (uint64_t)m->word(sectionCount(s)) * kRecordWords[s];
+        if (m->word(sectionStart(s)) + words > m->words_) return nullptr;
+    }
+    m->types_.assign(m->word(sectionCount(Types)), nullptr);
+
+    size_t base = m->word(sectionStart(Imports));
+    for (uint32_t i = 0; i < m->word(sectionCount(Imports)); i++) {
+        Import imp;
+        imp.name = m->symbol(m->word(base + 2 * i));
+        imp.path = std::string(m->string(m->word(base + 2 * i + 1)));
+        m->imports_.push_back(std::move(imp));
+    }
+    return m;
+}
+
+uint32_t GsiModule::word(size_t i) const {
+    if (i >= words_) return 0;
+    uint32_t w;
+    std::memcpy(&w, buf_->text().data() + i * 4, sizeof w);
+    return w;
+}
+
+std::string_view GsiModule::string(uint32_t index) const {
+    if (index >= word(sectionCount(Strings))) return {};
+    size_t rec = word(sectionStart(Strings)) + 2 * (size_t)index;
+    uint64_t off = word(rec), len = word(rec + 1);
+    if (off + len > word(sectionCount(Blob))) return {};
+    return buf_->text().substr(word(sectionStart(Blob)) * 4 + off, len);
+}
+
+std::string_view GsiModule::buildKey() const { return string(word(2)); }
+
+const Type* GsiModule::type(uint32_t index) const {
+    TypeTable& types = TypeTable::instance();
+    if (index >= types_.size()) return index == kNone ? nullptr : types.get(Type::Kind::Int);
+    if (types_[index]) return types_[index];
+    size_t rec = word(sectionStart(Types)) + kRecordWords[Types] * (size_t)index;
+    auto child = [&](uint32_t i) { return i < index ? type(i) : types.get(Type::Kind::Int); };
+    const Type* t = nullptr;
+    switch ((Type::Kind)word(rec)) {
+        case Type::Kind::Pointer:
+            t = types.pointerTo(child(word(rec + 3)));
+            break;
+        case Type::Kind::TypeParam:
+            t = types.typeParam(symbol(word(rec + 1)));
+            break;
+        case Type::Kind::StructRef: {
+            size_t pos = word(rec + 4);
+            std::vector<const Type*> args;
+            size_t argsBase = word(sectionStart(TypeArgs));
+            for (uint32_t n = std::min<size_t>(word(argsBase + pos), words_), i = 0; i < n; i++)
+                args.push_back(child(word(argsBase + pos + 1 + i)));
+            t = types.structRef(symbol(word(rec + 1)), symbol(word(rec + 2)), args);
+            break;
+        }
+        case Type::Kind::Int: case Type::Kind::Float: case Type::Kind::Bool:
+        case Type::Kind::Void: case Type::Kind::String: case Type::Kind::Char:
+        case Type::Kind::F64x4: case Type::Kind::I32x8:
+            t = types.get((Type::Kind)word(rec));
+            break;
+        default:
+            t = types.get(Type::Kind::Int);
+            break;
+    }
+    return types_[index] = t;
+}
+
+SourceLoc GsiModule::loc(uint32_t rel) const {
+    return rel ? SourceManager::instance().getLoc(file_, rel - 1) : SourceLoc();
+}
+
+size_t GsiModule::find(int section, Symbol name) const {
+    const std::string& key = name.str();
+    size_t lo = 0, hi = word(sectionCount(section));
+    size_t base = word(sectionStart(section)), width = kRecordWords[section];
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        std::string_view s = string(word(base + mid * width));
+        if (s == key) return mid;
+        if (s < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return std::string::npos;
+}
+
+std::vector<const Type*> GsiModule::typeList(size_t& pos) const {
+    size_t pool = word(sectionStart(Pool));
+    std::vector<const Type*> ts;
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), i = 0; i < n; i++)
+        ts.push_back(type(word(pool + pos++)));
+    return ts;
+}
+
+bool GsiModule::findStruct(Symbol name, StructDef& out) const {
+    size_t i = find(Structs, name);
+    if (i == std::string::npos) return false;
+    size_t rec = word(sectionStart(Structs)) + kRecordWords[Structs] * i;
+    size_t pool = word(sectionStart(Pool)), pos = word(rec + 5);
+    out.name = name;
+    out.mangledName = std::string(string(word(rec + 1)));
+    out.sizeBytes = word(rec + 2);
+    out.alignBytes = std::max<uint32_t>(word(rec + 3), 1);
+    out.soa = word(rec + 4) != 0;
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), m = 0; m < n; m++) {
+        Symbol member = symbol(word(pool + pos++));
+        out.memberIndex[member] = m;
+        out.members.push_back({member, type(word(pool + pos++))});
+        out.offsets.push_back(word(pool + pos++));
+    }
+    return true;
+}
+
+bool GsiModule::findFunc(Symbol name, FuncSymbol& out) const {
+    size_t i = find(Funcs, name);
+    if (i == std::string::npos) return false;
+    size_t rec = word(sectionStart(Funcs)) + kRecordWords[Funcs] * i;
+    size_t pos = word(rec + 3);
+    out.name = name;
+    out.mangledName = std::string(string(word(rec + 1)));
+    out.returnType = type(word(rec + 2));
+    out.paramTypes = typeList(pos);
+    return true;
+}
+
+std::unique_ptr<Expr> GsiModule::readExpr(size_t& pos) const {
+    size_t pool = word(sectionStart(Pool));
+    if (!word(pool + pos++)) return nullptr;
+    auto e = std::make_unique<Expr>();
+    e->kind = (Expr::Kind)word(pool + pos++);
+    e->op = (Expr::Op)word(pool + pos++);
+    e->loc = loc(word(pool + pos++));
+    uint64_t intBits = word(pool + pos) | (uint64_t)word(pool + pos + 1) << 32;
+    uint64_t floatBits = word(pool + pos + 2) | (uint64_t)word(pool + pos + 3) << 32;
+    pos += 4;
+    e->intVal = (int64_t)intBits;
+    std::memcpy(&e->floatVal, &floatBits, sizeof floatBits);
+    e->boolVal = word(pool + pos++) != 0;
+    e->strVal = std::string(string(word(pool + pos++)));
+    e->ident = symbol(word(pool + pos++));
+    e->ns = symbol(word(pool + pos++));
+    e->member = symbol(word(pool + pos++));
+    e->exprType = type(word(pool + pos++));
+    e->targetType = type(word(pool + pos++));
+    e->typeArgs = typeList(pos);
+    e->left = readExpr(pos);
+    e->right = readExpr(pos);
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), i = 0; i < n; i++)
+        e->args.push_back(readExpr(pos));
+    return e;
+}
+
+std::unique_ptr<Stmt> GsiModule::readStmt(size_t& pos) const {
+    size_t pool = word(sectionStart(Pool));
+    if (!word(pool + pos++)) return nullptr;
+    auto s = std::make_unique<Stmt>();
+    s->kind = (Stmt::Kind)word(pool + pos++);
+    s->loc = loc(word(pool + pos++));
+    s->varName = symbol(word(pool + pos++));
+    s->varType = type(word(pool + pos++));
+    s->asmCode = std::string(string(word(pool + pos++)));
+    s->varInit = readExpr(pos);
+    s->assignTarget = readExpr(pos);
+    s->assignValue = readExpr(pos);
+    s->condition = readExpr(pos);
+    s->thenBranch = readStmt(pos);
+    s->elseBranch = readStmt(pos);
+    s->body = readStmt(pos);
+    s->initStmt = readStmt(pos);
+    s->stepStmt = readStmt(pos);
+    s->returnExpr = readExpr(pos);
+    s->expr = readExpr(pos);
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), i = 0; i < n; i++)
+        s->blockStmts.push_back(readStmt(pos));
+    return s;
+}
+
+std::unique_ptr<StructDecl> GsiModule::structTemplate(Symbol name) const {
+    size_t i = find(StructTemplates, name);
+    if (i == std::string::npos) return nullptr;
+    size_t pool = word(sectionStart(Pool));
+    size_t pos = word(word(sectionStart(StructTemplates)) + kRecordWords[StructTemplates] * i + 1);
+    auto s = std::make_unique<StructDecl>();
+    s->name = symbol(word(pool + pos++));
+    s->loc = loc(word(pool + pos++));
+    uint32_t flags = word(pool + pos++);
+    s->packed = (flags & 1) != 0;
+    s->reorder = (flags & 2) != 0;
+    s->soa = (flags & 4) != 0;
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), k = 0; k < n; k++)
+        s->typeParams.push_back(symbol(word(pool + pos++)));
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), k = 0; k < n; k++) {
+        StructMember m;
+        m.name = symbol(word(pool + pos++));
+        m.type = type(word(pool + pos++));
+        m.loc = loc(word(pool + pos++));
+        s->members.push_back(m);
+    }
+    return s;
+}
+
+std::unique_ptr<FuncDecl> GsiModule::funcTemplate(Symbol name) const {
+    size_t i = find(FuncTemplates, name);
+    if (i == std::string::npos) return nullptr;
+    size_t pool = word(sectionStart(Pool));
+    size_t pos = word(word(sectionStart(FuncTemplates)) + kRecordWords[FuncTemplates] * i + 1);
+    auto f = std::make_unique<FuncDecl>();
+    f->name = symbol(word(pool + pos++));
+    f->loc = loc(word(pool + pos++));
+    f->isExtern = word(pool + pos++) != 0;
+    f->externLib = std::string(string(word(pool + pos++)));
+    f->returnType = type(word(pool + pos++));
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), k = 0; k < n; k++)
+        f->typeParams.push_back(symbol(word(pool + pos++)));
+    for (size_t n = std::min<size_t>(word(pool + pos++), words_), k = 0; k < n; k++) {
+        FuncParam p;
+        p.name = symbol(word(pool + pos++));
+        p.type = type(word(pool + pos++));
+        p.loc = loc(word(pool + pos++));
+        f->params.push_back(p);
+    }
+    f->body = readStmt(pos);
+    return f;
+}
+
+std::vector<GenericInstance> GsiModule::instances() const {
+    std::vector<GenericInstance> out;
+    size_t base = word(sectionStart(Instances));
+    for (uint32_t i = 0; i < word(sectionCount(Instances)); i++) {
+        size_t rec = base + kRecordWords[Instances] * i;
+        size_t pos = word(rec + 3);
+        GenericInstance gi;
+        gi.isFunc = word(rec) != 0;
+        gi.name = symbol(word(rec + 1));
+        gi.ns = symbol(word(rec + 2));
+        gi.args = typeList(pos);
+        out.push_back(std::move(gi));
+    }
+    return out;
+}
+
+} // namespace gspp
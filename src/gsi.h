@@ -0,0 +1,70 @@
+#ifndef GSPP_GSI_H
+#define GSPP_GSI_H
+
+#include "semantic.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gspp {
+
+// What an importer needs from a compiled module: the modules it imports,
+// its own struct layouts and function signatures, its generic templates
+// (instantiated by importers) and the generic instances it requested (those
+// are compiled with the main program, so importers replay them).
+struct ModuleInterface {
+    std::vector<Import> imports;
+    std::vector<StructDef> structs;
+    std::vector<FuncSymbol> functions;  // decl and locals are not kept
+    std::vector<const StructDecl*> structTemplates;
+    std::vector<const FuncDecl*> funcTemplates;
+    std::vector<GenericInstance> instances;
+};
+
+// Encodes iface as a .gsi image. `file` is the module's source file, against
+// which template locations are stored; `buildKey` names the object code the
+// interface describes.
+std::string writeGsi(const ModuleInterface& iface, std::string_view buildKey, uint32_t file);
+
+// A memory-mapped .gsi file. The image is a flat array of 32-bit words whose
+// tables are sorted by name, so entries are found by binary search and
+// decoded only when the analyzer first asks for them: importing a module
+// costs in proportion to what the importer uses, not to the module's size.
+class GsiModule {
+public:
+    // Null if the file is missing or not a .gsi of this version. Template
+    // locations are rebased onto `file`, which must already be loaded.
+    static std::unique_ptr<GsiModule> open(const std::string& path, uint32_t file);
+
+    std::string_view buildKey() const;
+    const std::vector<Import>& imports() const { return imports_; }
+    bool findStruct(Symbol name, StructDef& out) const;
+    bool findFunc(Symbol name, FuncSymbol& out) const;
+    std::unique_ptr<StructDecl> structTemplate(Symbol name) const;
+    std::unique_ptr<FuncDecl> funcTemplate(Symbol name) const;
+    std::vector<GenericInstance> instances() const;
+
+private:
+    GsiModule() = default;
+
+    uint32_t word(size_t i) const;
+    std::string_view string(uint32_t index) const;
+    Symbol symbol(uint32_t index) const { return Symbol(string(index)); }
+    const Type* type(uint32_t index) const;
+    SourceLoc loc(uint32_t rel) const;
+    size_t find(int section, Symbol name) const;  // record index, or npos
+    std::vector<const Type*> typeList(size_t& pos) const;
+    std::unique_ptr<Expr> readExpr(size_t& pos) const;
+    std::unique_ptr<Stmt> readStmt(size_t& pos) const;
+
+    std::unique_ptr<SourceBuffer> buf_;
+    size_t words_ = 0;
+    uint32_t file_ = 0;
+    std::vector<Import> imports_;
+    mutable std::vector<const Type*> types_;  // decoded on first use
+};
+
+} // namespace gspp
+
+#endif
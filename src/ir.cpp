@@ -0,0 +1,334 @@
+#include "ir.h"
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+#include <sstream>
+
+namespace gspp {
+
+const char* irTypeName(IRType t) {
+    switch (t) {
+        case IRType::Void: return "void";
+        case IRType::I1: return "i1";
+        case IRType::I8: return "i8";
+        case IRType::I64: return "i64";
+        case IRType::F64: return "f64";
+        case IRType::Ptr: return "ptr";
+    }
+    return "?";
+}
+
+IRBlock* IRFunction::createBlock() {
+    auto b = std::make_unique<IRBlock>();
+    b->id = (int)blocks.size();
+    b->parent = this;
+    blocks.push_back(std::move(b));
+    return blocks.back().get();
+}
+
+IRValue* IRFunction::constInt(IRType t, int64_t v) {
+    for (const auto& c : constants)
+        if (c->kind == IRValue::Kind::Const && c->type == t && c->intVal == v) return c.get();
+    auto c = std::make_unique<IRValue>();
+    c->kind = IRValue::Kind::Const;
+    c->type = t;
+    c->intVal = v;
+    constants.push_back(std::move(c));
+    return constants.back().get();
+}
+
+IRValue* IRFunction::constFloat(double v) {
+    for (const auto& c : constants)
+        if (c->kind == IRValue::Kind::Const && c->type == IRType::F64 && c->floatVal == v) return c.get();
+    auto c = std::make_unique<IRValue>();
+    c->kind = IRValue::Kind::Const;
+    c->type = IRType::F64;
+    c->floatVal = v;
+    constants.push_back(std::move(c));
+    return constants.back().get();
+}
+
+IRValue* IRFunction::undef(IRType t) {
+    for (const auto& c : constants)
+        if (c->kind == IRValue::Kind::Undef && c->type == t) return c.get();
+    auto c = std::make_unique<IRValue>();
+    c->kind = IRValue::Kind::Undef;
+    c->type = t;
+    constants.push_back(std::move(c));
+    return constants.back().get();
+}
+
+void IRFunction::replaceAllUses(IRValue* from, IRValue* to) {
+    for (auto& b : blocks)
+        for (auto& i : b->insts)
+            for (auto& op : i->operands)
+                if (op == from) op = to;
+}
+
+void IRFunction::removeUnreachableBlocks() {
+    if (blocks.empty()) return;
+    std::unordered_set<IRBlock*> reachable;
+    std::vector<IRBlock*> work = {blocks.front().get()};
+    while (!work.empty()) {
+        IRBlock* b = work.back();
+        work.pop_back();
+        if (!reachable.insert(b).second) continue;
+        for (IRBlock* s : b->succs) work.push_back(s);
+    }
+    for (auto& b : blocks) {
+        if (!reachable.count(b.get())) continue;
+        for (auto& i : b->insts) {
+            if (i->op != IROp::Phi) continue;
+            for (size_t k = i->blocks.size(); k-- > 0;) {
+                if (reachable.count(i->blocks[k])) continue;
+                i->blocks.erase(i->blocks.begin() + k);
+                i->operands.erase(i->operands.begin() + k);
+            }
+        }
+        auto& preds = b->preds;
+        preds.erase(std::remove_if(preds.begin(), preds.end(), [&](IRBlock* p) { return !reachable.count(p); }),
+                    preds.end());
+    }
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [&](const std::unique_ptr<IRBlock>& b) { return !reachable.count(b.get()); }),
+                 blocks.end());
+}
+
+void IRFunction::orderBlocks() {
+    if (blocks.empty()) return;
+    std::vector<IRBlock*> post;
+    std::unordered_set<IRBlock*> visited;
+    std::vector<std::pair<IRBlock*, size_t>> stack = {{blocks.front().get(), 0}};
+    visited.insert(blocks.front().get());
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.second < top.first->succs.size()) {
+            IRBlock* s = top.first->succs[top.second++];
+            if (visited.insert(s).second) stack.push_back({s, 0});
+        } else {
+            post.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::unordered_map<IRBlock*, size_t> rank;
+    for (size_t i = 0; i < post.size(); i++) rank[post[i]] = post.size() - i;
+    std::stable_sort(blocks.begin(), blocks.end(), [&](const std::unique_ptr<IRBlock>& a, const std::unique_ptr<IRBlock>& b) {
+        return rank[a.get()] < rank[b.get()];
+    });
+}
+
+void IRFunction::renumber() {
+    int next = 0;
+    for (auto& a : args) a->id = next++;
+    int bid = 0;
+    for (auto& b : blocks) {
+        b->id = bid++;
+        for (auto& i : b->insts)
+            if (i->type != IRType::Void) i->id = next++;
+    }
+}
+
+IRValue* IRModule::stringConst(const std::string& s) {
+    for (size_t i = 0; i < strings.size(); i++)
+        if (strings[i] == s) return globals[i].get();
+    auto g = std::make_unique<IRValue>();
+    g->kind = IRValue::Kind::Global;
+    g->type = IRType::Ptr;
+    g->name = ".str" + std::to_string(strings.size());
+    strings.push_back(s);
+    globals.push_back(std::move(g));
+    return globals.back().get();
+}
+
+static std::string valueRef(const IRValue* v) {
+    switch (v->kind) {
+        case IRValue::Kind::Const:
+            if (v->type == IRType::F64) {
+                std::ostringstream os;
+                os << v->floatVal;
+                std::string s = os.str();
+                if (s.find_first_of(".eni") == std::string::npos) s += ".0";
+                return s;
+            }
+            if (v->type == IRType::I1) return v->intVal ? "true" : "false";
+            if (v->type == IRType::Ptr && v->intVal == 0) return "null";
+            return std::to_string(v->intVal);
+        case IRValue::Kind::Undef: return "undef";
+        case IRValue::Kind::Global: return "@" + v->name;
+        case IRValue::Kind::Arg:
+        case IRValue::Kind::Inst: return "%" + std::to_string(v->id);
+    }
+    return "?";
+}
+
+static std::string typedRef(const IRValue* v) {
+    return std::string(irTypeName(v->type)) + " " + valueRef(v);
+}
+
+static const char* opName(IROp op) {
+    switch (op) {
+        case IROp::Add: return "add";
+        case IROp::Sub: return "sub";
+        case IROp::Mul: return "mul";
+        case IROp::SDiv: return "sdiv";
+        case IROp::SRem: return "srem";
+        case IROp::FAdd: return "fadd";
+        case IROp::FSub: return "fsub";
+        case IROp::FMul: return "fmul";
+        case IROp::FDiv: return "fdiv";
+        case IROp::Neg: return "neg";
+        case IROp::FNeg: return "fneg";
+        case IROp::Not: return "not";
+        case IROp::ICmp: return "icmp";
+        case IROp::FCmp: return "fcmp";
+        case IROp::Alloca: return "alloca";
+        case IROp::Load: return "load";
+        case IROp::Store: return "store";
+        case IROp::FieldPtr: return "fieldptr";
+        case IROp::ElemPtr: return "elemptr";
+        case IROp::Call: return "call";
+        case IROp::Asm: return "asm";
+        case IROp::Phi: return "phi";
+        case IROp::Br: return "br";
+        case IROp::CondBr: return "condbr";
+        case IROp::Ret: return "ret";
+    }
+    return "?";
+}
+
+static const char* cmpName(IRCmp p) {
+    switch (p) {
+        case IRCmp::Eq: return "eq";
+        case IRCmp::Ne: return "ne";
+        case IRCmp::Lt: return "lt";
+        case IRCmp::Gt: return "gt";
+        case IRCmp::Le: return "le";
+        case IRCmp::Ge: return "ge";
+    }
+    return "?";
+}
+
+static std::string escape(const std::string& s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '\n') r += "\\n";
+        else if (c == '\t') r += "\\t";
+        else if (c == '"' || c == '\\') { r += '\\'; r += c; }
+        else r += c;
+    }
+    return r;
+}
+
+static void dumpInst(const IRInst& i, std::ostream& out) {
+    out << "  ";
+    if (i.type != IRType::Void) out << "%" << i.id << " = ";
+    out << opName(i.op);
+    switch (i.op) {
+        case IROp::ICmp:
+        case IROp::FCmp:
+            out << " " << cmpName(i.pred) << " " << typedRef(i.operands[0]) << ", " << valueRef(i.operands[1]);
+            break;
+        case IROp::Alloca:
+            out << " " << i.imm;
+            if (!i.varName.empty()) out << "  ; " << i.varName;
+            break;
+        case IROp::Load:
+            out << " " << irTypeName(i.type) << ", " << typedRef(i.operands[0]);
+            break;
+        case IROp::FieldPtr:
+            out << " " << typedRef(i.operands[0]) << ", " << i.imm;
+            break;
+        case IROp::ElemPtr:
+            out << " " << typedRef(i.operands[0]) << ", " << typedRef(i.operands[1]) << ", " << i.imm;
+            break;
+        case IROp::Call:
+            out << " " << irTypeName(i.type) << " @" << i.callee << "(";
+            for (size_t k = 0; k < i.operands.size(); k++) out << (k ? ", " : "") << typedRef(i.operands[k]);
+            out << ")";
+            break;
+        case IROp::Asm:
+            out << " \"" << escape(i.callee) << "\"";
+            break;
+        case IROp::Phi:
+            out << " " << irTypeName(i.type) << " ";
+            for (size_t k = 0; k < i.operands.size(); k++)
+                out << (k ? ", " : "") << "[" << valueRef(i.operands[k]) << ", bb" << i.blocks[k]->id << "]";
+            if (!i.varName.empty()) out << "  ; " << i.varName;
+            break;
+        case IROp::Br:
+            out << " bb" << i.blocks[0]->id;
+            break;
+        case IROp::CondBr:
+            out << " " << typedRef(i.operands[0]) << ", bb" << i.blocks[0]->id << ", bb" << i.blocks[1]->id;
+            break;
+        case IROp::Ret:
+            if (!i.operands.empty()) out << " " << typedRef(i.operands[0]);
+            break;
+        default:
+            if (i.operands.size() == 1) out << " " << typedRef(i.operands[0]);
+            else if (i.operands.size() == 2) out << " " << typedRef(i.operands[0]) << ", " << valueRef(i.operands[1]);
+            else
+                for (size_t k = 0; k < i.operands.size(); k++) out << (k ? ", " : " ") << typedRef(i.operands[k]);
+            break;
+    }
+    out << "\n";
+}
+
+void dumpIR(const IRFunction& func, std::ostream& out) {
+    out << "func @" << func.name << "(";
+    for (size_t k = 0; k < func.args.size(); k++)
+        out << (k ? ", " : "") << irTypeName(func.args[k]->type) << " %" << func.args[k]->id;
+    out << ") -> " << irTypeName(func.returnType) << " {\n";
+    for (const auto& b : func.blocks) {
+        out << "bb" << b->id << ":";
+        if (!b->preds.empty()) {
+            out << "  ; preds:";
+            for (const IRBlock* p : b->preds) out << " bb" << p->id;
+        }
+        out << "\n";
+        for (const auto& i : b->insts) dumpInst(*i, out);
+    }
+    out << "}\n";
+}
+
+void dumpIR(const IRModule& module, std::ostream& out) {
+    for (size_t i = 0; i < module.globals.size(); i++)
+        out << "@" << module.globals[i]->name << " = string \"" << escape(module.strings[i]) << "\"\n";
+    if (!module.globals.empty()) out << "\n";
+    for (size_t i = 0; i < module.functions.size(); i++) {
+        if (i) out << "\n";
+        dumpIR(*module.functions[i], out);
+    }
+}
+
+std::vector<std::string> verifyIR(const IRFunction& func) {
+    std::vector<std::string> problems;
+    auto report = [&](const IRBlock* b, const std::string& msg) {
+        problems.push_back(func.name + ": bb" + std::to_string(b->id) + ": " + msg);
+    };
+    for (const auto& b : func.blocks) {
+        if (!b->terminator()) report(b.get(), "missing terminator");
+        bool seenNonPhi = false;
+        for (size_t k = 0; k < b->insts.size(); k++) {
+            const IRInst& i = *b->insts[k];
+            if (i.isTerminator() && k + 1 != b->insts.size()) report(b.get(), "terminator in middle of block");
+            if (i.op == IROp::Phi) {
+                if (seenNonPhi) report(b.get(), "phi after non-phi instruction");
+                if (i.operands.size() != b->preds.size()) report(b.get(), "phi arity does not match predecessors");
+                for (const IRBlock* in : i.blocks)
+                    if (std::find(b->preds.begin(), b->preds.end(), in) == b->preds.end())
+                        report(b.get(), "phi incoming block is not a predecessor");
+            } else {
+                seenNonPhi = true;
+            }
+            for (const IRValue* op : i.operands)
+                if (!op) report(b.get(), std::string("null operand in ") + opName(i.op));
+        }
+        for (const IRBlock* s : b->succs)
+            if (std::find(s->preds.begin(), s->preds.end(), b.get()) == s->preds.end())
+                report(b.get(), "successor bb" + std::to_string(s->id) + " does not list it as predecessor");
+    }
+    return problems;
+}
+
+} // namespace gspp
@@ -0,0 +1,115 @@
+#ifndef GSPP_IR_H
+#define GSPP_IR_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+namespace gspp {
+
+// Typed SSA intermediate representation. Functions are lists of basic blocks;
+// every value is defined exactly once and merges at join points go through phi
+// instructions. Struct values never appear directly: aggregates are reached
+// through ptr values and explicit field/element address arithmetic.
+
+enum class IRType { Void, I1, I8, I64, F64, Ptr };
+
+const char* irTypeName(IRType t);
+
+struct IRBlock;
+struct IRFunction;
+
+struct IRValue {
+    enum class Kind { Const, Undef, Arg, Global, Inst };
+    Kind kind = Kind::Const;
+    IRType type = IRType::I64;
+    int id = -1;           // SSA number (Arg/Inst), assigned by renumber()
+    int64_t intVal = 0;    // Const (integer, bool, ptr null)
+    double floatVal = 0.0; // Const (f64)
+    std::string name;      // Arg name, Global label
+
+    virtual ~IRValue() = default;
+};
+
+enum class IROp {
+    Add, Sub, Mul, SDiv, SRem,
+    FAdd, FSub, FMul, FDiv,
+    Neg, FNeg, Not,
+    ICmp, FCmp,
+    Alloca, Load, Store,
+    FieldPtr,   // ptr + imm (byte offset)
+    ElemPtr,    // ptr + index * imm (element size)
+    Call, Asm,
+    Phi,
+    Br, CondBr, Ret
+};
+
+enum class IRCmp { Eq, Ne, Lt, Gt, Le, Ge };
+
+struct IRInst : IRValue {
+    IROp op = IROp::Add;
+    IRBlock* parent = nullptr;
+    std::vector<IRValue*> operands;
+    // Br/CondBr: targets. Phi: incoming block for each operand (parallel arrays).
+    std::vector<IRBlock*> blocks;
+    IRCmp pred = IRCmp::Eq;
+    int64_t imm = 0;      // FieldPtr offset, ElemPtr element size, Alloca size
+    std::string callee;   // Call target, Asm text
+    std::string varName;  // Phi/Alloca: source variable, for readability
+
+    bool isTerminator() const { return op == IROp::Br || op == IROp::CondBr || op == IROp::Ret; }
+    bool hasSideEffects() const {
+        return op == IROp::Store || op == IROp::Call || op == IROp::Asm || isTerminator();
+    }
+};
+
+struct IRBlock {
+    int id = 0;
+    IRFunction* parent = nullptr;
+    std::vector<std::unique_ptr<IRInst>> insts;
+    std::vector<IRBlock*> preds;
+    std::vector<IRBlock*> succs;
+
+    IRInst* terminator() const {
+        return insts.empty() || !insts.back()->isTerminator() ? nullptr : insts.back().get();
+    }
+};
+
+struct IRFunction {
+    std::string name;
+    IRType returnType = IRType::I64;
+    std::vector<std::unique_ptr<IRValue>> args;
+    std::vector<std::unique_ptr<IRBlock>> blocks;
+    std::vector<std::unique_ptr<IRValue>> constants;
+
+    IRBlock* createBlock();
+    IRValue* constInt(IRType t, int64_t v);
+    IRValue* constFloat(double v);
+    IRValue* undef(IRType t);
+    // Replaces every use of `from` (operands only) with `to`.
+    void replaceAllUses(IRValue* from, IRValue* to);
+    // Drops blocks not reachable from the entry and fixes up phis.
+    void removeUnreachableBlocks();
+    // Reorders blocks into reverse postorder (entry first, defs before uses in acyclic code).
+    void orderBlocks();
+    void renumber();
+};
+
+struct IRModule {
+    std::vector<std::unique_ptr<IRFunction>> functions;
+    std::vector<std::unique_ptr<IRValue>> globals;  // string literals
+    std::vector<std::string> strings;               // contents, parallel to globals
+
+    IRValue* stringConst(const std::string& s);
+};
+
+void dumpIR(const IRModule& module, std::ostream& out);
+void dumpIR(const IRFunction& func, std::ostream& out);
+// Structural checks (terminators, phi arity, CFG symmetry); returns problems found.
+std::vector<std::string> verifyIR(const IRFunction& func);
+
+} // namespace gspp
+
+#endif
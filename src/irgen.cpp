@@ -0,0 +1,697 @@
+#include "irgen.h"
+#include <algorithm>
+
+namespace gspp {
+
+IRGenerator::IRGenerator(SemanticAnalyzer* semantic) : semantic_(semantic) {}
+
+void IRGenerator::error(const std::string& msg, SourceLoc loc) {
+    errors_.push_back(SourceManager::instance().formatError(loc, msg));
+}
+
+StructDef* IRGenerator::resolveStruct(Symbol name, Symbol ns) {
+    auto sd = semantic_->getStruct(name, ns);
+    if (!sd && ns.empty()) sd = semantic_->getStruct(name, currentNamespace_);
+    return sd;
+}
+
+FuncSymbol* IRGenerator::resolveFunc(Symbol name, Symbol ns) {
+    auto fs = semantic_->getFunc(name, ns);
+    if (!fs && ns.empty()) fs = semantic_->getFunc(name, currentNamespace_);
+    return fs;
+}
+
+IRType IRGenerator::irType(const Type* t) const {
+    switch (t->kind) {
+        case Type::Kind::Int: return IRType::I64;
+        case Type::Kind::Float: return IRType::F64;
+        case Type::Kind::Bool: return IRType::I1;
+        case Type::Kind::Char: return IRType::I8;
+        case Type::Kind::Void: return IRType::Void;
+        case Type::Kind::Pointer:
+        case Type::Kind::String:
+        case Type::Kind::StructRef: return IRType::Ptr;
+        case Type::Kind::TypeParam: return IRType::I64;
+        case Type::Kind::F64x4:
+        case Type::Kind::I32x8: return IRType::Ptr;  // not lowered; see lowerExpr
+    }
+    return IRType::I64;
+}
+
+int64_t IRGenerator::typeSize(const Type* t) {
+    if (t->kind == Type::Kind::Bool || t->kind == Type::Kind::Char) return 1;
+    if (t->kind == Type::Kind::StructRef) {
+        StructDef* sd = resolveStruct(t->structName, t->ns);
+        return sd ? (int64_t)sd->sizeBytes : 8;
+    }
+    return 8;
+}
+
+bool IRGenerator::isSoa(const Type* t) {
+    if (t->kind != Type::Kind::StructRef) return false;
+    StructDef* sd = resolveStruct(t->structName, t->ns);
+    return sd && sd->soa;
+}
+
+int64_t IRGenerator::fieldOffset(const Type* baseType, Symbol member) {
+    const Type* t = baseType->kind == Type::Kind::Pointer ? baseType->ptrTo : baseType;
+    StructDef* sd = resolveStruct(t->structName, t->ns);
+    if (!sd) return 0;
+    auto it = sd->memberIndex.find(member);
+    return it == sd->memberIndex.end() ? 0 : (int64_t)sd->offsets[it->second];
+}
+
+// --- instruction helpers ---------------------------------------------------
+
+IRInst* IRGenerator::emit(IROp op, IRType type, std::vector<IRValue*> operands) {
+    auto inst = std::make_unique<IRInst>();
+    inst->kind = IRValue::Kind::Inst;
+    inst->op = op;
+    inst->type = type;
+    inst->operands = std::move(operands);
+    inst->parent = cur_;
+    cur_->insts.push_back(std::move(inst));
+    return cur_->insts.back().get();
+}
+
+void IRGenerator::addEdge(IRBlock* from, IRBlock* to) {
+    from->succs.push_back(to);
+    to->preds.push_back(from);
+}
+
+void IRGenerator::branch(IRBlock* target) {
+    IRInst* br = emit(IROp::Br, IRType::Void);
+    br->blocks.push_back(target);
+    addEdge(cur_, target);
+}
+
+void IRGenerator::condBranch(IRValue* cond, IRBlock* ifTrue, IRBlock* ifFalse) {
+    IRInst* br = emit(IROp::CondBr, IRType::Void, {cond});
+    br->blocks = {ifTrue, ifFalse};
+    addEdge(cur_, ifTrue);
+    addEdge(cur_, ifFalse);
+}
+
+void IRGenerator::startBlock(IRBlock* b) {
+    cur_ = b;
+}
+
+bool IRGenerator::terminated() const {
+    if (cur_->terminator()) return true;
+    return cur_ != func_->blocks.front().get() && cur_->preds.empty();
+}
+
+IRValue* IRGenerator::toBool(IRValue* v) {
+    if (v->type == IRType::I1) return v;
+    IRInst* c = nullptr;
+    if (v->type == IRType::F64) {
+        c = emit(IROp::FCmp, IRType::I1, {v, func_->constFloat(0.0)});
+    } else {
+        c = emit(IROp::ICmp, IRType::I1, {v, func_->constInt(v->type, 0)});
+    }
+    c->pred = IRCmp::Ne;
+    return c;
+}
+
+IRValue* IRGenerator::convert(IRValue* v, IRType to) {
+    if (to == IRType::I1 && v->type != IRType::I1) return toBool(v);
+    return v;
+}
+
+// --- SSA construction --------------------------------------------------------
+
+int IRGenerator::declareVar(Symbol name, const Type* type) {
+    LocalVar lv;
+    lv.name = name.str();
+    lv.type = irType(type);
+    if (allInMemory_ || memoryVars_.count(name) || type->kind == Type::Kind::StructRef) {
+        IRBlock* saved = cur_;
+        // Allocas live at the top of the entry block.
+        cur_ = func_->blocks.front().get();
+        auto slot = std::make_unique<IRInst>();
+        slot->kind = IRValue::Kind::Inst;
+        slot->op = IROp::Alloca;
+        slot->type = IRType::Ptr;
+        slot->imm = typeSize(type);
+        slot->varName = name.str();
+        slot->parent = cur_;
+        auto& insts = cur_->insts;
+        auto pos = std::find_if(insts.begin(), insts.end(),
+                                [](const std::unique_ptr<IRInst>& i) { return i->op != IROp::Alloca; });
+        lv.slot = insts.insert(pos, std::move(slot))->get();
+        cur_ = saved;
+    }
+    vars_.push_back(lv);
+    int id = (int)vars_.size() - 1;
+    scopes_.back()[name] = id;
+    return id;
+}
+
+int IRGenerator::lookupVar(Symbol name) {
+    for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+        auto i = it->find(name);
+        if (i != it->end()) return i->second;
+    }
+    return -1;
+}
+
+void IRGenerator::writeVariable(int var, IRBlock* block, IRValue* value) {
+    currentDef_[block][var] = value;
+}
+
+IRValue* IRGenerator::readVariable(int var, IRBlock* block) {
+    auto bi = currentDef_.find(block);
+    if (bi != currentDef_.end()) {
+        auto vi = bi->second.find(var);
+        if (vi != bi->second.end()) return vi->second;
+    }
+    return readVariableRecursive(var, block);
+}
+
+static IRInst* insertPhi(IRBlock* block, IRType type, const std::string& name) {
+    auto phi = std::make_unique<IRInst>();
+    phi->kind = IRValue::Kind::Inst;
+    phi->op = IROp::Phi;
+    phi->type = type;
+    phi->varName = name;
+    phi->parent = block;
+    auto& insts = block->insts;
+    auto pos = std::find_if(insts.begin(), insts.end(),
+                            [](const std::unique_ptr<IRInst>& i) { return i->op != IROp::Phi; });
+    return insts.insert(pos, std::move(phi))->get();
+}
+
+IRValue* IRGenerator::readVariableRecursive(int var, IRBlock* block) {
+    IRValue* val = nullptr;
+    if (!sealed_.count(block)) {
+        IRInst* phi = insertPhi(block, vars_[var].type, vars_[var].name);
+        incompletePhis_[block].push_back({var, phi});
+        val = phi;
+    } else if (block->preds.empty()) {
+        val = func_->undef(vars_[var].type);
+    } else if (block->preds.size() == 1) {
+        val = readVariable(var, block->preds[0]);
+    } else {
+        IRInst* phi = insertPhi(block, vars_[var].type, vars_[var].name);
+        writeVariable(var, block, phi);
+        val = addPhiOperands(var, phi);
+    }
+    writeVariable(var, block, val);
+    return val;
+}
+
+IRValue* IRGenerator::addPhiOperands(int var, IRInst* phi) {
+    for (IRBlock* pred : phi->parent->preds) {
+        phi->operands.push_back(readVariable(var, pred));
+        phi->blocks.push_back(pred);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+IRValue* IRGenerator::tryRemoveTrivialPhi(IRInst* phi) {
+    IRValue* same = nullptr;
+    for (IRValue* op : phi->operands) {
+        if (op == same || op == phi) continue;
+        if (same) return phi;  // merges at least two values: not trivial
+        same = op;
+    }
+    if (!same) same = func_->undef(phi->type);
+
+    std::vector<IRInst*> phiUsers;
+    for (auto& b : func_->blocks)
+        for (auto& i : b->insts)
+            if (i.get() != phi && i->op == IROp::Phi &&
+                std::find(i->operands.begin(), i->operands.end(), phi) != i->operands.end())
+                phiUsers.push_back(i.get());
+    func_->replaceAllUses(phi, same);
+    for (auto& defs : currentDef_)
+        for (auto& d : defs.second)
+            if (d.second == phi) d.second = same;
+
+    auto& insts = phi->parent->insts;
+    auto it = std::find_if(insts.begin(), insts.end(),
+                           [phi](const std::unique_ptr<IRInst>& i) { return i.get() == phi; });
+    std::unique_ptr<IRInst> dead = std::move(*it);
+    insts.erase(it);
+    dead->parent = nullptr;
+
+    for (IRInst* user : phiUsers)
+        if (user->parent) tryRemoveTrivialPhi(user);
+    return same;
+}
+
+void IRGenerator::sealBlock(IRBlock* block) {
+    auto it = incompletePhis_.find(block);
+    if (it != incompletePhis_.end()) {
+        auto pending = std::move(it->second);
+        incompletePhis_.erase(it);
+        for (auto& p : pending) addPhiOperands(p.first, p.second);
+    }
+    sealed_.insert(block);
+}
+
+// --- expressions -------------------------------------------------------------
+
+IRValue* IRGenerator::lowerMemberAddress(Expr* expr) {
+    Expr* left = expr->left.get();
+    if (left->kind == Expr::Kind::Index && isSoa(left->exprType)) {
+        // base[i].m of an @soa array: m's values start at n * offset(m).
+        IRValue* base = lowerExpr(left->left.get());
+        IRInst* lenAddr = emit(IROp::FieldPtr, IRType::Ptr, {base});
+        lenAddr->imm = -8;
+        IRInst* column = emit(IROp::ElemPtr, IRType::Ptr, {base, emit(IROp::Load, IRType::I64, {lenAddr})});
+        column->imm = fieldOffset(left->exprType, expr->member);
+        IRInst* addr = emit(IROp::ElemPtr, IRType::Ptr, {column, lowerExpr(left->right.get())});
+        addr->imm = typeSize(expr->exprType);
+        return addr;
+    }
+    if (left->exprType->kind == Type::Kind::Pointer && isSoa(left->exprType->ptrTo)) {
+        // p.m is p[0].m, at the start of m's values.
+        IRValue* base = lowerExpr(left);
+        IRInst* lenAddr = emit(IROp::FieldPtr, IRType::Ptr, {base});
+        lenAddr->imm = -8;
+        IRInst* column = emit(IROp::ElemPtr, IRType::Ptr, {base, emit(IROp::Load, IRType::I64, {lenAddr})});
+        column->imm = fieldOffset(left->exprType, expr->member);
+        return column;
+    }
+    IRValue* base = lowerExpr(expr->left.get());
+    IRInst* addr = emit(IROp::FieldPtr, IRType::Ptr, {base});
+    addr->imm = fieldOffset(expr->left->exprType, expr->member);
+    return addr;
+}
+
+IRValue* IRGenerator::lowerIndexAddress(Expr* expr) {
+    // Only a slice can be indexed as a struct.
+    if (expr->left->exprType->kind == Type::Kind::StructRef) {
+        error("slices cannot be lowered to IR yet", expr->loc);
+        return func_->undef(IRType::Ptr);
+    }
+    IRInst* addr = emit(IROp::ElemPtr, IRType::Ptr, {lowerExpr(expr->left.get()), lowerExpr(expr->right.get())});
+    addr->imm = typeSize(expr->exprType);
+    return addr;
+}
+
+// Struct values are copied a word at a time, then byte by byte.
+void IRGenerator::copyBytes(IRValue* dst, IRValue* src, int64_t size) {
+    for (int64_t off = 0; off < size;) {
+        int64_t width = size - off >= 8 ? 8 : 1;
+        IRType type = width == 8 ? IRType::I64 : IRType::I8;
+        IRInst* from = emit(IROp::FieldPtr, IRType::Ptr, {src});
+        from->imm = off;
+        IRInst* to = emit(IROp::FieldPtr, IRType::Ptr, {dst});
+        to->imm = off;
+        emit(IROp::Store, IRType::Void, {emit(IROp::Load, type, {from}), to});
+        off += width;
+    }
+}
+
+IRValue* IRGenerator::lowerAddress(Expr* expr) {
+    switch (expr->kind) {
+        case Expr::Kind::Var: {
+            int v = lookupVar(expr->ident);
+            if (v >= 0 && vars_[v].slot) return vars_[v].slot;
+            error("cannot take address of '" + expr->ident + "'", expr->loc);
+            return func_->undef(IRType::Ptr);
+        }
+        case Expr::Kind::Member:
+            return lowerMemberAddress(expr);
+        case Expr::Kind::Deref:
+            return lowerExpr(expr->right.get());
+        case Expr::Kind::Index:
+            return lowerIndexAddress(expr);
+        default:
+            error("expression is not addressable", expr->loc);
+            return func_->undef(IRType::Ptr);
+    }
+}
+
+IRValue* IRGenerator::lowerShortCircuit(Expr* expr) {
+    bool isAnd = expr->op == Expr::Op::And;
+    IRValue* l = toBool(lowerExpr(expr->left.get()));
+    IRBlock* lhsEnd = cur_;
+    IRBlock* rhs = func_->createBlock();
+    IRBlock* join = func_->createBlock();
+    if (isAnd) condBranch(l, rhs, join);
+    else condBranch(l, join, rhs);
+    sealBlock(rhs);
+    startBlock(rhs);
+    IRValue* r = toBool(lowerExpr(expr->right.get()));
+    IRBlock* rhsEnd = cur_;
+    branch(join);
+    sealBlock(join);
+    startBlock(join);
+    IRInst* phi = insertPhi(join, IRType::I1, "");
+    phi->operands = {func_->constInt(IRType::I1, isAnd ? 0 : 1), r};
+    phi->blocks = {lhsEnd, rhsEnd};
+    return phi;
+}
+
+IRValue* IRGenerator::lowerExpr(Expr* expr) {
+    if (!expr) return func_->undef(IRType::I64);
+    if (isVector(expr->exprType) || (expr->kind == Expr::Kind::Call && isVectorBuiltin(expr->ident) &&
+                                     !resolveFunc(expr->ident, expr->ns))) {
+        error("SIMD vectors cannot be lowered to IR yet", expr->loc);
+        return func_->undef(IRType::I64);
+    }
+    if (expr->kind == Expr::Kind::Slice || expr->kind == Expr::Kind::NewArray) {
+        error("slices cannot be lowered to IR yet", expr->loc);
+        return func_->undef(IRType::I64);
+    }
+    switch (expr->kind) {
+        case Expr::Kind::IntLit:
+            return func_->constInt(IRType::I64, expr->intVal);
+        case Expr::Kind::FloatLit:
+            return func_->constFloat(expr->floatVal);
+        case Expr::Kind::BoolLit:
+            return func_->constInt(IRType::I1, expr->boolVal ? 1 : 0);
+        case Expr::Kind::StringLit:
+            return module_->stringConst(expr->strVal);
+        case Expr::Kind::Var: {
+            int v = lookupVar(expr->ident);
+            if (v < 0) {
+                error("unknown variable " + expr->ident, expr->loc);
+                return func_->undef(irType(expr->exprType));
+            }
+            if (expr->exprType->kind == Type::Kind::StructRef) return vars_[v].slot;  // used through its address
+            if (vars_[v].slot) return emit(IROp::Load, vars_[v].type, {vars_[v].slot});
+            return readVariable(v, cur_);
+        }
+        case Expr::Kind::Binary: {
+            if (expr->op == Expr::Op::And || expr->op == Expr::Op::Or) return lowerShortCircuit(expr);
+            IRValue* l = lowerExpr(expr->left.get());
+            IRValue* r = lowerExpr(expr->right.get());
+            static const std::pair<Expr::Op, IRCmp> cmps[] = {
+                {Expr::Op::Eq, IRCmp::Eq}, {Expr::Op::Ne, IRCmp::Ne}, {Expr::Op::Lt, IRCmp::Lt},
+                {Expr::Op::Gt, IRCmp::Gt}, {Expr::Op::Le, IRCmp::Le}, {Expr::Op::Ge, IRCmp::Ge},
+            };
+            for (const auto& c : cmps) {
+                if (expr->op != c.first) continue;
+                IRInst* i = emit(l->type == IRType::F64 ? IROp::FCmp : IROp::ICmp, IRType::I1, {l, r});
+                i->pred = c.second;
+                return i;
+            }
+            const Type* lt = expr->left->exprType;
+            if (lt->kind == Type::Kind::Pointer && (expr->op == Expr::Op::Add || expr->op == Expr::Op::Sub)) {
+                if (expr->op == Expr::Op::Sub) r = emit(IROp::Neg, r->type, {r});
+                IRInst* i = emit(IROp::ElemPtr, IRType::Ptr, {l, r});
+                i->imm = typeSize(lt->ptrTo);
+                return i;
+            }
+            if (lt->kind == Type::Kind::String && expr->op == Expr::Op::Add) {
+                IRInst* i = emit(IROp::Call, IRType::Ptr, {l, r});
+                i->callee = "_gspp_strcat";
+                return i;
+            }
+            bool f = l->type == IRType::F64;
+            IROp op = IROp::Add;
+            if (expr->op == Expr::Op::Add) op = f ? IROp::FAdd : IROp::Add;
+            else if (expr->op == Expr::Op::Sub) op = f ? IROp::FSub : IROp::Sub;
+            else if (expr->op == Expr::Op::Mul) op = f ? IROp::FMul : IROp::Mul;
+            else if (expr->op == Expr::Op::Div) op = f ? IROp::FDiv : IROp::SDiv;
+            else if (expr->op == Expr::Op::Mod) op = IROp::SRem;
+            return emit(op, l->type, {l, r});
+        }
+        case Expr::Kind::Unary: {
+            IRValue* o = lowerExpr(expr->right.get());
+            if (expr->op == Expr::Op::Not) return emit(IROp::Not, IRType::I1, {toBool(o)});
+            return emit(o->type == IRType::F64 ? IROp::FNeg : IROp::Neg, o->type, {o});
+        }
+        case Expr::Kind::Call: {
+            static const Symbol printSym("print"), printlnSym("println");
+            static const Symbol printStringSym("print_string"), printlnStringSym("println_string");
+            Symbol funcName = expr->ident;
+            if (expr->ns.empty() && !expr->args.empty() && expr->args[0]->exprType->kind == Type::Kind::String) {
+                if (funcName == printSym) funcName = printStringSym;
+                else if (funcName == printlnSym) funcName = printlnStringSym;
+            }
+            FuncSymbol* fs = resolveFunc(funcName, expr->ns);
+            if (!fs) {
+                error("unknown function " + expr->ident, expr->loc);
+                return func_->undef(IRType::I64);
+            }
+            if (fs->returnType->kind == Type::Kind::StructRef) {
+                error("struct results cannot be lowered to IR yet", expr->loc);
+                return func_->undef(IRType::Ptr);
+            }
+            std::vector<IRValue*> args;
+            for (size_t i = 0; i < expr->args.size(); i++) {
+                IRValue* a = lowerExpr(expr->args[i].get());
+                if (i < fs->paramTypes.size()) a = convert(a, irType(fs->paramTypes[i]));
+                args.push_back(a);
+            }
+            IRInst* call = emit(IROp::Call, irType(fs->returnType), std::move(args));
+            call->callee = fs->mangledName;
+            return call;
+        }
+        case Expr::Kind::Member:
+            // A struct stored inline is used through its address.
+            if (expr->exprType->kind == Type::Kind::StructRef) return lowerMemberAddress(expr);
+            return emit(IROp::Load, irType(expr->exprType), {lowerMemberAddress(expr)});
+        case Expr::Kind::Deref:
+            if (expr->exprType->kind == Type::Kind::StructRef) return lowerExpr(expr->right.get());
+            return emit(IROp::Load, irType(expr->exprType), {lowerExpr(expr->right.get())});
+        case Expr::Kind::Index:
+            if (expr->exprType->kind == Type::Kind::StructRef) return lowerIndexAddress(expr);
+            return emit(IROp::Load, irType(expr->exprType), {lowerIndexAddress(expr)});
+        case Expr::Kind::AddressOf:
+            return lowerAddress(expr->right.get());
+        case Expr::Kind::New: {
+            IRValue* bytes = func_->constInt(IRType::I64, typeSize(expr->targetType));
+            IRValue* count = expr->left ? lowerExpr(expr->left.get()) : nullptr;
+            if (count) bytes = emit(IROp::Mul, IRType::I64, {count, bytes});
+            if (!isSoa(expr->targetType)) {
+                IRInst* call = emit(IROp::Call, IRType::Ptr, {bytes});
+                call->callee = "malloc";
+                return call;
+            }
+            // @soa: a word holding the element count precedes the columns.
+            bytes = emit(IROp::Add, IRType::I64, {bytes, func_->constInt(IRType::I64, 8)});
+            IRInst* call = emit(IROp::Call, IRType::Ptr, {bytes});
+            call->callee = "malloc";
+            emit(IROp::Store, IRType::Void, {count ? count : func_->constInt(IRType::I64, 1), call});
+            IRInst* first = emit(IROp::FieldPtr, IRType::Ptr, {call});
+            first->imm = 8;
+            return first;
+        }
+        case Expr::Kind::Delete: {
+            IRValue* ptr = lowerExpr(expr->right.get());
+            const Type* target = expr->right->exprType;
+            if (target->kind == Type::Kind::Pointer && isSoa(target->ptrTo)) {
+                IRInst* block = emit(IROp::FieldPtr, IRType::Ptr, {ptr});
+                block->imm = -8;
+                ptr = block;
+            }
+            IRInst* call = emit(IROp::Call, IRType::Void, {ptr});
+            call->callee = "free";
+            return call;
+        }
+        default:
+            error("expression cannot be lowered to IR", expr->loc);
+            return func_->undef(irType(expr->exprType));
+    }
+}
+
+// --- statements --------------------------------------------------------------
+
+void IRGenerator::lowerStmt(Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->kind) {
+        case Stmt::Kind::Block:
+            scopes_.emplace_back();
+            for (auto& s : stmt->blockStmts) {
+                if (terminated()) break;  // statements after return are unreachable
+                lowerStmt(s.get());
+            }
+            scopes_.pop_back();
+            break;
+        case Stmt::Kind::VarDecl: {
+            IRValue* init = stmt->varInit ? lowerExpr(stmt->varInit.get()) : nullptr;
+            int v = declareVar(stmt->varName, stmt->varType);
+            if (stmt->varType->kind == Type::Kind::StructRef) {
+                if (init) copyBytes(vars_[v].slot, init, typeSize(stmt->varType));
+                break;
+            }
+            if (!init) {
+                if (!vars_[v].slot) writeVariable(v, cur_, func_->undef(vars_[v].type));
+                break;
+            }
+            init = convert(init, vars_[v].type);
+            if (vars_[v].slot) emit(IROp::Store, IRType::Void, {init, vars_[v].slot});
+            else writeVariable(v, cur_, init);
+            break;
+        }
+        case Stmt::Kind::Assign: {
+            Expr* target = stmt->assignTarget.get();
+            if (target->exprType->kind == Type::Kind::StructRef) {
+                IRValue* addr = lowerAddress(target);
+                copyBytes(addr, lowerExpr(stmt->assignValue.get()), typeSize(target->exprType));
+            } else if (target->kind == Expr::Kind::Var) {
+                IRValue* val = lowerExpr(stmt->assignValue.get());
+                int v = lookupVar(target->ident);
+                if (v < 0) { error("unknown variable " + target->ident, target->loc); break; }
+                val = convert(val, vars_[v].type);
+                if (vars_[v].slot) emit(IROp::Store, IRType::Void, {val, vars_[v].slot});
+                else writeVariable(v, cur_, val);
+            } else {
+                IRValue* addr = lowerAddress(target);
+                IRValue* val = convert(lowerExpr(stmt->assignValue.get()), irType(target->exprType));
+                emit(IROp::Store, IRType::Void, {val, addr});
+            }
+            break;
+        }
+        case Stmt::Kind::If: {
+            IRValue* c = toBool(lowerExpr(stmt->condition.get()));
+            IRBlock* thenB = func_->createBlock();
+            IRBlock* elseB = stmt->elseBranch ? func_->createBlock() : nullptr;
+            IRBlock* join = func_->createBlock();
+            condBranch(c, thenB, elseB ? elseB : join);
+            sealBlock(thenB);
+            startBlock(thenB);
+            lowerStmt(stmt->thenBranch.get());
+            if (!terminated()) branch(join);
+            if (elseB) {
+                sealBlock(elseB);
+                startBlock(elseB);
+                lowerStmt(stmt->elseBranch.get());
+                if (!terminated()) branch(join);
+            }
+            sealBlock(join);
+            startBlock(join);
+            break;
+        }
+        case Stmt::Kind::While:
+        case Stmt::Kind::For: {
+            bool isFor = stmt->kind == Stmt::Kind::For;
+            if (isFor) {
+                scopes_.emplace_back();
+                lowerStmt(stmt->initStmt.get());
+            }
+            IRBlock* header = func_->createBlock();
+            IRBlock* body = func_->createBlock();
+            IRBlock* exit = func_->createBlock();
+            branch(header);
+            startBlock(header);  // sealed once the back edge is known
+            condBranch(toBool(lowerExpr(stmt->condition.get())), body, exit);
+            sealBlock(body);
+            startBlock(body);
+            lowerStmt(stmt->body.get());
+            if (isFor && !terminated()) lowerStmt(stmt->stepStmt.get());
+            if (!terminated()) branch(header);
+            sealBlock(header);
+            sealBlock(exit);
+            startBlock(exit);
+            if (isFor) scopes_.pop_back();
+            break;
+        }
+        case Stmt::Kind::Return: {
+            if (stmt->returnExpr) {
+                IRValue* v = convert(lowerExpr(stmt->returnExpr.get()), func_->returnType);
+                emit(IROp::Ret, IRType::Void, {v});
+            } else if (func_->returnType == IRType::Void) {
+                emit(IROp::Ret, IRType::Void);
+            } else {
+                emit(IROp::Ret, IRType::Void, {func_->constInt(func_->returnType, 0)});
+            }
+            break;
+        }
+        case Stmt::Kind::ExprStmt:
+            lowerExpr(stmt->expr.get());
+            break;
+        case Stmt::Kind::Unsafe:
+            lowerStmt(stmt->body.get());
+            break;
+        case Stmt::Kind::Asm: {
+            IRInst* a = emit(IROp::Asm, IRType::Void);
+            a->callee = stmt->asmCode;
+            break;
+        }
+    }
+}
+
+static void collectAddressTaken(const Stmt* s, std::unordered_set<Symbol>& out, bool& hasAsm);
+
+static void collectAddressTaken(const Expr* e, std::unordered_set<Symbol>& out) {
+    if (!e) return;
+    if (e->kind == Expr::Kind::AddressOf && e->right && e->right->kind == Expr::Kind::Var)
+        out.insert(e->right->ident);
+    collectAddressTaken(e->left.get(), out);
+    collectAddressTaken(e->right.get(), out);
+    for (const auto& a : e->args) collectAddressTaken(a.get(), out);
+}
+
+static void collectAddressTaken(const Stmt* s, std::unordered_set<Symbol>& out, bool& hasAsm) {
+    if (!s) return;
+    if (s->kind == Stmt::Kind::Asm) hasAsm = true;
+    for (const auto& b : s->blockStmts) collectAddressTaken(b.get(), out, hasAsm);
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        collectAddressTaken(e, out);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        collectAddressTaken(c, out, hasAsm);
+}
+
+void IRGenerator::lowerFunc(const FuncSymbol& fs) {
+    const FuncDecl* decl = fs.decl;
+    auto fn = std::make_unique<IRFunction>();
+    fn->name = fs.mangledName;
+    fn->returnType = irType(fs.returnType);
+    func_ = fn.get();
+    currentNamespace_ = fs.ns;
+    vars_.clear();
+    scopes_.clear();
+    currentDef_.clear();
+    incompletePhis_.clear();
+    sealed_.clear();
+    memoryVars_.clear();
+    allInMemory_ = false;
+    collectAddressTaken(decl->body.get(), memoryVars_, allInMemory_);
+
+    IRBlock* entry = func_->createBlock();
+    sealBlock(entry);
+    startBlock(entry);
+    scopes_.emplace_back();
+    for (size_t i = 0; i < decl->params.size(); i++) {
+        const Type* pt = i < fs.paramTypes.size() ? fs.paramTypes[i] : decl->params[i].type;
+        auto arg = std::make_unique<IRValue>();
+        arg->kind = IRValue::Kind::Arg;
+        arg->type = irType(pt);
+        arg->name = decl->params[i].name.str();
+        IRValue* a = arg.get();
+        func_->args.push_back(std::move(arg));
+        int v = declareVar(decl->params[i].name, pt);
+        if (pt->kind == Type::Kind::StructRef) copyBytes(vars_[v].slot, a, typeSize(pt));  // passed by address
+        else if (vars_[v].slot) emit(IROp::Store, IRType::Void, {a, vars_[v].slot});
+        else writeVariable(v, entry, a);
+    }
+    lowerStmt(decl->body.get());
+    if (!cur_->terminator()) {
+        if (func_->returnType == IRType::Void) emit(IROp::Ret, IRType::Void);
+        else emit(IROp::Ret, IRType::Void, {func_->constInt(func_->returnType, 0)});
+    }
+    func_->removeUnreachableBlocks();
+    func_->orderBlocks();
+    func_->renumber();
+    for (const auto& p : verifyIR(*func_)) errors_.push_back("IR verification failed: " + p);
+    module_->functions.push_back(std::move(fn));
+    func_ = nullptr;
+}
+
+std::unique_ptr<IRModule> IRGenerator::generate() {
+    auto module = std::make_unique<IRModule>();
+    module_ = module.get();
+    std::vector<const FuncSymbol*> funcs;
+    for (const auto& p : semantic_->functions()) funcs.push_back(&p.second);
+    for (const auto& m : semantic_->moduleFunctions())
+        for (const auto& p : m.second) funcs.push_back(&p.second);
+    std::sort(funcs.begin(), funcs.end(),
+              [](const FuncSymbol* a, const FuncSymbol* b) { return a->mangledName < b->mangledName; });
+    for (const FuncSymbol* fs : funcs) {
+        if (!fs->decl || fs->decl->isExtern || !fs->decl->body) continue;
+        lowerFunc(*fs);
+    }
+    module_ = nullptr;
+    return module;
+}
+
+} // namespace gspp
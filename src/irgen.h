@@ -0,0 +1,85 @@
+#ifndef GSPP_IRGEN_H
+#define GSPP_IRGEN_H
+
+#include "ast.h"
+#include "semantic.h"
+#include "ir.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gspp {
+
+// Lowers analyzed functions into SSA form using the on-the-fly construction of
+// Braun et al. ("Simple and Efficient Construction of Static Single Assignment
+// Form"): locals are tracked per block, phis are created lazily on reads and
+// trivial phis are removed as blocks are sealed. Locals whose address is taken
+// (or every local, in functions with inline asm) stay in memory via alloca.
+class IRGenerator {
+public:
+    explicit IRGenerator(SemanticAnalyzer* semantic);
+    std::unique_ptr<IRModule> generate();
+    const std::vector<std::string>& errors() const { return errors_; }
+
+private:
+    struct LocalVar {
+        std::string name;
+        IRType type = IRType::I64;
+        IRInst* slot = nullptr;  // alloca for memory-resident locals
+    };
+
+    void lowerFunc(const FuncSymbol& fs);
+    void lowerStmt(Stmt* stmt);
+    IRValue* lowerExpr(Expr* expr);
+    IRValue* lowerAddress(Expr* expr);
+    IRValue* lowerMemberAddress(Expr* expr);
+    IRValue* lowerIndexAddress(Expr* expr);
+    void copyBytes(IRValue* dst, IRValue* src, int64_t size);
+    IRValue* lowerShortCircuit(Expr* expr);
+    IRValue* toBool(IRValue* v);
+    IRValue* convert(IRValue* v, IRType to);
+
+    IRInst* emit(IROp op, IRType type, std::vector<IRValue*> operands = {});
+    void branch(IRBlock* target);
+    void condBranch(IRValue* cond, IRBlock* ifTrue, IRBlock* ifFalse);
+    void addEdge(IRBlock* from, IRBlock* to);
+    void startBlock(IRBlock* b);
+    bool terminated() const;
+
+    int declareVar(Symbol name, const Type* type);
+    int lookupVar(Symbol name);
+    void writeVariable(int var, IRBlock* block, IRValue* value);
+    IRValue* readVariable(int var, IRBlock* block);
+    IRValue* readVariableRecursive(int var, IRBlock* block);
+    IRValue* addPhiOperands(int var, IRInst* phi);
+    IRValue* tryRemoveTrivialPhi(IRInst* phi);
+    void sealBlock(IRBlock* block);
+
+    IRType irType(const Type* t) const;
+    int64_t typeSize(const Type* t);
+    int64_t fieldOffset(const Type* baseType, Symbol member);
+    bool isSoa(const Type* t);
+    StructDef* resolveStruct(Symbol name, Symbol ns);
+    FuncSymbol* resolveFunc(Symbol name, Symbol ns);
+    void error(const std::string& msg, SourceLoc loc);
+
+    SemanticAnalyzer* semantic_;
+    IRModule* module_ = nullptr;
+    IRFunction* func_ = nullptr;
+    IRBlock* cur_ = nullptr;
+    Symbol currentNamespace_;
+    std::vector<LocalVar> vars_;
+    std::vector<std::unordered_map<Symbol, int>> scopes_;
+    std::unordered_set<Symbol> memoryVars_;
+    bool allInMemory_ = false;
+    std::unordered_map<IRBlock*, std::unordered_map<int, IRValue*>> currentDef_;
+    std::unordered_map<IRBlock*, std::vector<std::pair<int, IRInst*>>> incompletePhis_;
+    std::unordered_set<IRBlock*> sealed_;
+    std::vector<std::string> errors_;
+};
+
+} // namespace gspp
+
+#endif
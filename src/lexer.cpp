@@ -1,11 +1,172 @@
 #include "lexer.h"
 #include <cctype>
+#include <charconv>
+#include <cstring>
 #include <stdexcept>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GSPP_LEXER_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace gspp {
 
-Lexer::Lexer(const std::string& source, const std::string& filename)
-    : source_(source), filename_(filename.empty() ? "<input>" : filename) {}
+namespace {
+
+// Character classes for the scanning loops, one table lookup per byte.
+enum : uint8_t { CSpace = 1, CAlpha = 2, CDigit = 4, CIdent = CAlpha | CDigit };
+
+struct CharTable {
+    uint8_t cls[256] = {};
+    constexpr CharTable() {
+        cls[(unsigned char)' '] = cls[(unsigned char)'\t'] = CSpace;
+        cls[(unsigned char)'\r'] = cls[(unsigned char)'\n'] = CSpace;
+        for (int c = 'a'; c <= 'z'; c++) cls[c] = cls[c - 'a' + 'A'] = CAlpha;
+        cls[(unsigned char)'_'] = CAlpha;
+        for (int c = '0'; c <= '9'; c++) cls[c] = CDigit;
+    }
+};
+constexpr CharTable kChars;
+
+inline bool isClass(char c, uint8_t mask) { return kChars.cls[(unsigned char)c] & mask; }
+
+#ifdef GSPP_LEXER_SSE2
+inline unsigned firstSetBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// Lanes of v whose byte lies in [lo, hi]. The compare is signed, so bytes
+// >= 0x80 never match an ASCII range.
+inline __m128i inRange(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8((char)(hi + 1))));
+}
+#endif
+
+// Index of the first byte at or after i that is not whitespace.
+size_t scanSpace(std::string_view s, size_t i) {
+#ifdef GSPP_LEXER_SSE2
+    while (i + 16 <= s.size()) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+        __m128i sp = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        unsigned rest = ~(unsigned)_mm_movemask_epi8(sp) & 0xFFFF;
+        if (rest) return i + firstSetBit(rest);
+        i += 16;
+    }
+#endif
+    while (i < s.size() && isClass(s[i], CSpace)) i++;
+    return i;
+}
+
+// Index of the first byte at or after i that cannot continue an identifier.
+size_t scanIdent(std::string_view s, size_t i) {
+#ifdef GSPP_LEXER_SSE2
+    while (i + 16 <= s.size()) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));  // 'A'..'Z' -> 'a'..'z'
+        __m128i id = _mm_or_si128(
+            _mm_or_si128(inRange(folded, 'a', 'z'), inRange(v, '0', '9')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        unsigned rest = ~(unsigned)_mm_movemask_epi8(id) & 0xFFFF;
+        if (rest) return i + firstSetBit(rest);
+        i += 16;
+    }
+#endif
+    while (i < s.size() && isClass(s[i], CIdent)) i++;
+    return i;
+}
+
+size_t scanDigits(std::string_view s, size_t i) {
+    while (i < s.size() && isClass(s[i], CDigit)) i++;
+    return i;
+}
+
+// Keywords live in a perfect hash on (first char, last char, length); the
+// static_assert below rejects a keyword set the hash no longer separates.
+struct Keyword {
+    const char* spelling;
+    TokenKind kind;
+};
+
+constexpr Keyword kKeywords[] = {
+    {"var", TokenKind::Var}, {"let", TokenKind::Let},
+    {"func", TokenKind::Func}, {"def", TokenKind::Func},
+    {"class", TokenKind::Class}, {"struct", TokenKind::Struct},
+    {"if", TokenKind::If}, {"else", TokenKind::Else},
+    {"while", TokenKind::While}, {"for", TokenKind::For},
+    {"in", TokenKind::In}, {"return", TokenKind::Return},
+    {"int", TokenKind::Int}, {"float", TokenKind::Float},
+    {"bool", TokenKind::Bool}, {"string", TokenKind::String},
+    {"char", TokenKind::Char}, {"true", TokenKind::True},
+    {"f64x4", TokenKind::F64x4}, {"i32x8", TokenKind::I32x8},
+    {"false", TokenKind::False}, {"and", TokenKind::And},
+    {"or", TokenKind::Or}, {"not", TokenKind::Not},
+    {"import", TokenKind::Import}, {"asm", TokenKind::Asm},
+    {"unsafe", TokenKind::Unsafe}, {"new", TokenKind::New},
+    {"delete", TokenKind::Delete}, {"extern", TokenKind::Extern},
+};
+
+constexpr size_t kKeywordSlots = 128;
+
+constexpr size_t keywordHash(char first, char last, size_t len) {
+    return ((unsigned char)first * 3u + (unsigned char)last * 9u + len) & (kKeywordSlots - 1);
+}
+
+constexpr size_t cstrLen(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+struct KeywordTable {
+    const Keyword* slot[kKeywordSlots] = {};
+    bool perfect = true;
+    constexpr KeywordTable() {
+        for (const Keyword& k : kKeywords) {
+            size_t len = cstrLen(k.spelling);
+            size_t h = keywordHash(k.spelling[0], k.spelling[len - 1], len);
+            if (slot[h]) perfect = false;
+            slot[h] = &k;
+        }
+    }
+};
+constexpr KeywordTable kKeywordTable;
+static_assert(kKeywordTable.perfect, "keyword hash has collisions; pick new multipliers");
+
+TokenKind keywordKind(std::string_view word) {
+    const Keyword* k = kKeywordTable.slot[keywordHash(word.front(), word.back(), word.size())];
+    if (k && std::strncmp(k->spelling, word.data(), word.size()) == 0 && k->spelling[word.size()] == '\0')
+        return k->kind;
+    return TokenKind::Ident;
+}
+
+} // namespace
+
+Lexer::Lexer(std::string_view source, const std::string& filename)
+    : source_(source), filename_(filename.empty() ? "<input>" : filename) {
+    SourceManager& sm = SourceManager::instance();
+    file_ = sm.findFile(filename_);
+    if (file_ == SourceManager::NoFile || sm.text(file_).data() != source.data()) {
+        file_ = sm.addSource(filename_, std::string(source));
+        source_ = sm.text(file_);
+    }
+    locBase_ = sm.getLoc(file_, 0).offset;
+}
+
+SourceLoc Lexer::here() const {
+    return SourceLoc{locBase_ ? locBase_ + (uint32_t)pos_ : 0};
+}
 
 char Lexer::cur() const {
     if (pos_ >= source_.size()) return '\0';
@@ -18,11 +179,7 @@ char Lexer::peekChar() const {
 }
 
 void Lexer::advance() {
-    if (pos_ < source_.size()) {
-        if (source_[pos_] == '\n') { line_++; col_ = 1; }
-        else col_++;
-        pos_++;
-    }
+    if (pos_ < source_.size()) pos_++;
 }
 
 bool Lexer::match(char c) {
@@ -32,16 +189,25 @@ bool Lexer::match(char c) {
 }
 
 void Lexer::skipWhitespaceAndComments() {
+    const char* base = source_.data();
+    size_t n = source_.size();
     for (;;) {
-        while (cur() == ' ' || cur() == '\t' || cur() == '\r' || cur() == '\n') advance();
-        if (cur() == '/' && peekChar() == '/') {
-            while (cur() != '\0' && cur() != '\n') advance();
+        if (pos_ < n && isClass(base[pos_], CSpace)) pos_ = scanSpace(source_, pos_ + 1);
+        if (cur() != '/') break;
+        if (peekChar() == '/') {
+            const void* nl = std::memchr(base + pos_, '\n', n - pos_);
+            pos_ = nl ? static_cast<const char*>(nl) - base : n;
             continue;
         }
-        if (cur() == '/' && peekChar() == '*') {
-            advance(); advance();
-            while (cur() != '\0' && !(cur() == '*' && peekChar() == '/')) advance();
-            if (cur() == '*') { advance(); advance(); }
+        if (peekChar() == '*') {
+            size_t i = pos_ + 2;
+            for (;;) {
+                const void* star = i < n ? std::memchr(base + i, '*', n - i) : nullptr;
+                if (!star) { i = n; break; }
+                i = static_cast<const char*>(star) - base + 1;
+                if (i < n && base[i] == '/') { i++; break; }
+            }
+            pos_ = i;
             continue;
         }
         break;
@@ -51,36 +217,49 @@ void Lexer::skipWhitespaceAndComments() {
 Token Lexer::makeToken(TokenKind k) {
     Token t;
     t.kind = k;
-    t.loc = { filename_, line_, col_ };
+    t.loc = here();
     return t;
 }
 
 Token Lexer::lexNumber() {
-    SourceLoc loc = { filename_, line_, col_ };
-    std::string num;
+    SourceLoc loc = here();
+    size_t start = pos_;
     bool isFloat = false;
-    while (std::isdigit(static_cast<unsigned char>(cur()))) { num += cur(); advance(); }
-    if (cur() == '.' && std::isdigit(static_cast<unsigned char>(peekChar()))) {
+    pos_ = scanDigits(source_, pos_);
+    if (cur() == '.' && isClass(peekChar(), CDigit)) {
         isFloat = true;
-        num += cur(); advance();
-        while (std::isdigit(static_cast<unsigned char>(cur()))) { num += cur(); advance(); }
+        pos_ = scanDigits(source_, pos_ + 1);
     }
     Token t;
     t.loc = loc;
+    t.text = source_.substr(start, pos_ - start);
+    const char* first = t.text.data();
+    const char* last = first + t.text.size();
     if (isFloat) {
         t.kind = TokenKind::FloatLit;
-        t.floatVal = std::stod(num);
+        std::from_chars(first, last, t.floatVal);
     } else {
         t.kind = TokenKind::IntLit;
-        t.intVal = std::stoll(num);
+        std::from_chars(first, last, t.intVal);
     }
     return t;
 }
 
 Token Lexer::lexString() {
-    SourceLoc loc = { filename_, line_, col_ };
+    SourceLoc loc = here();
     advance(); // skip opening "
-    std::string s;
+    size_t start = pos_;
+    while (cur() != '"' && cur() != '\0' && cur() != '\\') advance();
+    Token t;
+    t.kind = TokenKind::StringLit;
+    t.loc = loc;
+    if (cur() != '\\') {
+        // No escapes: the token refers straight into the source.
+        t.text = source_.substr(start, pos_ - start);
+        if (cur() == '"') advance();
+        return t;
+    }
+    std::string s(source_.substr(start, pos_ - start));
     while (cur() != '"' && cur() != '\0') {
         if (cur() == '\\') {
             advance();
@@ -91,62 +270,31 @@ Token Lexer::lexString() {
         } else { s += cur(); advance(); }
     }
     if (cur() == '"') advance();
-    Token t;
-    t.kind = TokenKind::StringLit;
-    t.text = s;
-    t.loc = loc;
+    decoded_.push_back(std::move(s));
+    t.text = decoded_.back();
     return t;
 }
 
 Token Lexer::lexIdentOrKeyword() {
-    SourceLoc loc = { filename_, line_, col_ };
-    std::string id;
-    if (std::isalpha(static_cast<unsigned char>(cur())) || cur() == '_') {
-        id += cur(); advance();
-        while (std::isalnum(static_cast<unsigned char>(cur())) || cur() == '_') { id += cur(); advance(); }
-    }
+    SourceLoc loc = here();
+    size_t start = pos_;
+    pos_ = scanIdent(source_, pos_ + 1);
     Token t;
     t.loc = loc;
-    t.text = id;
-    if (id == "var") t.kind = TokenKind::Var;
-    else if (id == "let") t.kind = TokenKind::Let;
-    else if (id == "func" || id == "def") t.kind = TokenKind::Func;
-    else if (id == "class") t.kind = TokenKind::Class;
-    else if (id == "struct") t.kind = TokenKind::Struct;
-    else if (id == "if") t.kind = TokenKind::If;
-    else if (id == "else") t.kind = TokenKind::Else;
-    else if (id == "while") t.kind = TokenKind::While;
-    else if (id == "for") t.kind = TokenKind::For;
-    else if (id == "in") t.kind = TokenKind::In;
-    else if (id == "return") t.kind = TokenKind::Return;
-    else if (id == "int") t.kind = TokenKind::Int;
-    else if (id == "float") t.kind = TokenKind::Float;
-    else if (id == "bool") t.kind = TokenKind::Bool;
-    else if (id == "string") t.kind = TokenKind::String;
-    else if (id == "char") t.kind = TokenKind::Char;
-    else if (id == "true") t.kind = TokenKind::True;
-    else if (id == "false") t.kind = TokenKind::False;
-    else if (id == "and") t.kind = TokenKind::And;
-    else if (id == "or") t.kind = TokenKind::Or;
-    else if (id == "not") t.kind = TokenKind::Not;
-    else if (id == "import") t.kind = TokenKind::Import;
-    else if (id == "asm") t.kind = TokenKind::Asm;
-    else if (id == "unsafe") t.kind = TokenKind::Unsafe;
-    else if (id == "new") t.kind = TokenKind::New;
-    else if (id == "delete") t.kind = TokenKind::Delete;
-    else if (id == "extern") t.kind = TokenKind::Extern;
-    else t.kind = TokenKind::Ident;
+    t.text = source_.substr(start, pos_ - start);
+    t.kind = keywordKind(t.text);
+    if (t.kind == TokenKind::Ident) t.sym = Symbol(t.text);
     return t;
 }
 
 Token Lexer::lex() {
     skipWhitespaceAndComments();
-    SourceLoc loc = { filename_, line_, col_ };
+    SourceLoc loc = here();
     if (cur() == '\0') return makeToken(TokenKind::Eof);
 
     if (cur() == '"') return lexString();
-    if (std::isdigit(static_cast<unsigned char>(cur()))) return lexNumber();
-    if (std::isalpha(static_cast<unsigned char>(cur())) || cur() == '_') return lexIdentOrKeyword();
+    if (isClass(cur(), CDigit)) return lexNumber();
+    if (isClass(cur(), CAlpha)) return lexIdentOrKeyword();
 
     char c = cur();
     advance();
@@ -162,8 +310,12 @@ Token Lexer::lex() {
         case ';': t.kind = TokenKind::Semicolon; break;
         case ',': t.kind = TokenKind::Comma; break;
         case ':': t.kind = TokenKind::Colon; break;
+        case '@': t.kind = TokenKind::At; break;
         case '&': t.kind = TokenKind::Amp; break;
-        case '.': t.kind = TokenKind::Dot; break;
+        case '.':
+            if (cur() == '.') { advance(); t.kind = TokenKind::DotDot; }
+            else t.kind = TokenKind::Dot;
+            break;
         case '+': t.kind = TokenKind::Plus; break;
         case '-':
             if (cur() == '>') { advance(); t.kind = TokenKind::Arrow; }
@@ -178,7 +330,7 @@ Token Lexer::lex() {
             break;
         case '!':
             if (cur() == '=') { advance(); t.kind = TokenKind::Ne; }
-            else { t.kind = TokenKind::Invalid; t.text = "!"; }
+            else { t.kind = TokenKind::Invalid; t.text = source_.substr(pos_ - 1, 1); }
             break;
         case '<':
             if (cur() == '=') { advance(); t.kind = TokenKind::Le; }
@@ -190,7 +342,7 @@ Token Lexer::lex() {
             break;
         default:
             t.kind = TokenKind::Invalid;
-            t.text = std::string(1, c);
+            t.text = source_.substr(pos_ - 1, 1);
             break;
     }
     return t;
@@ -213,17 +365,7 @@ Token Lexer::peek() {
 }
 
 std::string Lexer::lineSnippet(int line) const {
-    size_t start = 0;
-    int l = 1;
-    for (size_t i = 0; i < source_.size(); i++) {
-        if (l == line) {
-            start = i;
-            while (i < source_.size() && source_[i] != '\n') i++;
-            return source_.substr(start, i - start);
-        }
-        if (source_[i] == '\n') l++;
-    }
-    return "";
+    return SourceManager::instance().getLine(filename_, line);
 }
 
 bool Lexer::peekForGenericEnd() {
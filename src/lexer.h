@@ -2,7 +2,10 @@
 #define GSPP_LEXER_H
 
 #include "common.h"
+#include "symbol.h"
 #include <string>
+#include <string_view>
+#include <deque>
 #include <vector>
 #include <cstdint>
 
@@ -18,20 +21,21 @@ enum class TokenKind {
     // Keywords — Python-style + C++ power
     Var, Let, Func, Def, Class, Struct, Return,
     If, Else, While, For, In,
-    Int, Float, Bool, String, Char, True, False, And, Or, Not,
+    Int, Float, Bool, String, Char, F64x4, I32x8, True, False, And, Or, Not,
     Import, Asm, Unsafe, New, Delete, Extern,
     // Punctuation
     LParen, RParen, LBrace, RBrace, LBracket, RBracket,
-    Semicolon, Comma, Colon, Arrow,
+    Semicolon, Comma, Colon, Arrow, At,
     Assign, Amp,
     Plus, Minus, Star, Slash, Percent,
     Eq, Ne, Lt, Gt, Le, Ge,
-    Dot
+    Dot, DotDot
 };
 
 struct Token {
     TokenKind kind = TokenKind::Eof;
-    std::string text;
+    std::string_view text;  // spelling, or decoded contents of a string literal
+    Symbol sym;        // interned spelling of an identifier
     SourceLoc loc;
     int64_t intVal = 0;
     double floatVal = 0.0;
@@ -39,7 +43,10 @@ struct Token {
 
 class Lexer {
 public:
-    explicit Lexer(const std::string& source, const std::string& filename = "");
+    // The source must outlive the lexer and every token it returns. Text not
+    // already registered with the SourceManager under `filename` is copied
+    // into it so token locations can be decoded.
+    explicit Lexer(std::string_view source, const std::string& filename = "");
     Token next();
     Token peek();
     const std::string& filename() const { return filename_; }
@@ -47,6 +54,7 @@ public:
     bool peekForGenericEnd();
 
 private:
+    SourceLoc here() const;
     char cur() const;
     char peekChar() const;
     void advance();
@@ -58,11 +66,12 @@ private:
     Token lexIdentOrKeyword();
     Token lex();
 
-    std::string source_;
+    std::string_view source_;
     std::string filename_;
+    std::deque<std::string> decoded_;  // string literals that contained escapes
+    uint32_t file_ = 0;
+    uint32_t locBase_ = 0;  // location of source_[0]; 0 when the file has none
     size_t pos_ = 0;
-    int line_ = 1;
-    int col_ = 1;
     Token peeked_;
     bool hasPeeked_ = false;
 };
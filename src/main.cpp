@@ -3,25 +3,25 @@
 #include "semantic.h"
 #include "optimizer.h"
 #include "codegen.h"
+#include "irgen.h"
+#include "assembler.h"
+#include "modcache.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
 #include <set>
+#include <thread>
+#include <unordered_map>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-static std::string readFile(const std::string& path) {
-    std::ifstream f(path);
-    if (!f) return "";
-    std::stringstream buf;
-    buf << f.rdbuf();
-    return buf.str();
-}
-
 static int runCommand(const std::string& cmd) {
     return system(cmd.c_str());
 }
@@ -32,25 +32,61 @@ int main(int argc, char* argv[]) {
         std::cerr << "Usage: gsc <source.gs> [options]\n";
         std::cerr << "  -o <exe>   Output executable (default: base name of source)\n";
         std::cerr << "  -S         Emit assembly only (do not link)\n";
-        std::cerr << "  -g         Debug mode (no optimizations)\n";
-        std::cerr << "  -O         Release mode (optimize)\n";
+        std::cerr << "  -c         Emit an object file only (do not link)\n";
+        std::cerr << "  --via-asm  Write a .s file and assemble it with gcc (x86-64 Linux uses the built-in assembler)\n";
+        std::cerr << "  --emit-ir  Emit the SSA intermediate representation only (.ir)\n";
+        std::cerr << "  --bench-lex  Report lexer throughput on the source and exit\n";
+        std::cerr << "  -g         Debug mode (no optimizations; keeps every bounds check)\n";
+        std::cerr << "  -O         Release mode (optimize, register allocation with -m64)\n";
         std::cerr << "  -m64       Generate 64-bit code (default: 32-bit for compatibility)\n";
+        std::cerr << "  -Rpass=vectorize         Report loops vectorized under -O -m64\n";
+        std::cerr << "  -Rpass-missed=vectorize  Report loops that were not, and why\n";
+        std::cerr << "  -Rpass=inline            Report calls inlined under -O\n";
+        std::cerr << "  -Rpass-missed=inline     Report calls that were not, and why\n";
+        std::cerr << "  -j <n>     Parse imported modules on n threads (default: one per core)\n";
+        std::cerr << "  --cache-dir <dir>  Reuse compiled imports from <dir> (also GSC_CACHE_DIR)\n";
+        std::cerr << "  --stats    Report generic instantiation counts and time\n";
         return 1;
     }
     std::string sourcePath = argv[1];
     std::string outPath;
     bool emitAsmOnly = false;
+    bool emitObjOnly = false;
+    bool viaAsm = false;
+    bool emitIR = false;
+    bool benchLex = false;
+    bool stats = false;
     bool use64Bit = false;
     bool debugMode = false;
     bool releaseMode = false;
+    bool remarkVectorized = false;
+    bool remarkMissed = false;
+    bool remarkInlined = false;
+    bool remarkNotInlined = false;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string cacheDir;
+    if (const char* env = std::getenv("GSC_CACHE_DIR")) cacheDir = env;
     for (int i = 2; i < argc; i++) {
         std::string a = argv[i];
         if (a == "-o" && i + 1 < argc) { outPath = argv[++i]; continue; }
         if (a == "-S") { emitAsmOnly = true; continue; }
+        if (a == "-c") { emitObjOnly = true; continue; }
+        if (a == "--via-asm") { viaAsm = true; continue; }
+        if (a == "--emit-ir") { emitIR = true; continue; }
+        if (a == "--bench-lex") { benchLex = true; continue; }
+        if (a == "--stats") { stats = true; continue; }
         if (a == "-g") { debugMode = true; continue; }
         if (a == "-O") { releaseMode = true; continue; }
         if (a == "-m64") { use64Bit = true; continue; }
+        if (a == "-Rpass=vectorize") { remarkVectorized = true; continue; }
+        if (a == "-Rpass-missed=vectorize") { remarkMissed = true; continue; }
+        if (a == "-Rpass=inline") { remarkInlined = true; continue; }
+        if (a == "-Rpass-missed=inline") { remarkNotInlined = true; continue; }
+        if (a == "-j" && i + 1 < argc) { jobs = (unsigned)std::max(1, std::atoi(argv[++i])); continue; }
+        if (a.size() > 2 && a.compare(0, 2, "-j") == 0) { jobs = (unsigned)std::max(1, std::atoi(a.c_str() + 2)); continue; }
+        if (a == "--cache-dir" && i + 1 < argc) { cacheDir = argv[++i]; continue; }
     }
+    bool outGiven = !outPath.empty();
     if (outPath.empty()) {
         size_t dot = sourcePath.find_last_of(".\\/");
         if (dot != std::string::npos && sourcePath[dot] == '.')
@@ -62,13 +98,29 @@ int main(int argc, char* argv[]) {
 #endif
     }
 
-    std::string source = readFile(sourcePath);
+    std::string_view source = gspp::SourceManager::instance().load(sourcePath);
     if (source.empty()) {
         std::cerr << "gsc: cannot open '" << sourcePath << "'\n";
         return 1;
     }
 
-    gspp::SourceManager::instance().addSource(sourcePath, source);
+    if (benchLex) {
+        // Lex the whole file repeatedly for at least a second.
+        using Clock = std::chrono::steady_clock;
+        size_t tokens = 0, passes = 0;
+        double secs = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            gspp::Lexer benchLexer(source, sourcePath);
+            while (benchLexer.next().kind != gspp::TokenKind::Eof) tokens++;
+            passes++;
+            secs = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (secs < 1.0);
+        double mb = (double)source.size() * passes / 1e6;
+        std::cout << sourcePath << ": " << tokens / passes << " tokens, "
+                  << mb / secs << " MB/s (" << passes << " passes)\n";
+        return 0;
+    }
 
     gspp::Lexer lexer(source, sourcePath);
     gspp::Parser parser(lexer);
@@ -78,79 +130,309 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    gspp::SemanticAnalyzer semantic(program.get());
+    // The IR models 64-bit words whatever the code generation target.
+    gspp::SemanticAnalyzer semantic(program.get(), use64Bit || emitIR ? 8 : 4);
+
+    // Imports whose interface and object code are cached skip analysis and
+    // code generation; the others are compiled into objects of their own so
+    // they can be stored. Caching needs separately linked objects, which only
+    // the built-in assembler path produces.
+    std::unique_ptr<gspp::ModuleCache> cache;
+#ifndef _WIN32
+    if (!cacheDir.empty() && use64Bit && !emitAsmOnly && !emitObjOnly && !emitIR && !viaAsm) {
+        // Every flag that changes the generated code is part of the key:
+        // -g keeps the bounds checks -O would otherwise remove.
+        std::string flags = "-m64";
+        if (releaseMode) flags += " -O";
+        if (debugMode) flags += " -g";
+        cache = std::make_unique<gspp::ModuleCache>(cacheDir, flags);
+    }
+#endif
+
+    // Read and parse the import graph breadth-first: every module found in
+    // one wave is read concurrently, and their imports form the next wave.
+    // A module with a cached interface is not parsed at all; its imports
+    // come from the interface. Analysis then walks the graph depth-first in
+    // source order, exactly as if modules had been loaded one by one, so
+    // diagnostics and symbol registration never depend on thread timing.
+    struct Module {
+        std::string path;
+        bool found = false;
+        std::unique_ptr<gspp::Program> program;
+        std::unique_ptr<gspp::GsiModule> image;  // cached interface, if any
+        std::string sourceKey;
+
+        const std::vector<gspp::Import>& imports() const { return program ? program->imports : image->imports(); }
+    };
+    std::vector<Module> modules;
+    std::unordered_map<std::string, size_t> moduleIndex;
+    std::vector<size_t> wave;
+
+    auto discover = [&](const std::vector<gspp::Import>& imports) {
+        for (const auto& imp : imports) {
+            if (!moduleIndex.emplace(imp.path, modules.size()).second) continue;
+            wave.push_back(modules.size());
+            modules.emplace_back();
+            modules.back().path = imp.path;
+        }
+    };
+    auto parseModule = [](Module& m) {
+        gspp::Lexer modLexer(gspp::SourceManager::instance().text(m.path), m.path);
+        gspp::Parser modParser(modLexer);
+        m.program = modParser.parseProgram();
+    };
+
+    discover(program->imports);
+    while (!wave.empty()) {
+        std::vector<size_t> current;
+        current.swap(wave);
+        gspp::parallelFor(current.size(), jobs, [&](size_t i) {
+            Module& m = modules[current[i]];
+            std::string_view modSource = gspp::SourceManager::instance().load(m.path);
+            if (modSource.empty()) return;
+            m.found = true;
+            if (cache) {
+                m.sourceKey = cache->sourceKey(modSource);
+                m.image = cache->openInterface(m.sourceKey, gspp::SourceManager::instance().findFile(m.path));
+                if (m.image) return;
+            }
+            parseModule(m);
+        });
+        for (size_t i : current)
+            if (modules[i].found) discover(modules[i].imports());
+    }
+
+    std::unordered_map<std::string, std::string> moduleKeys;  // path -> cache key, empty if uncacheable
+    struct FreshModule {
+        gspp::Symbol name;
+        const Module* module;
+        std::string key;
+    };
+    std::vector<FreshModule> freshModules;
+    std::vector<std::string> moduleObjects;
 
     std::set<std::string> loadedModules;
-    std::vector<std::unique_ptr<gspp::Program>> modulePrograms;
 
-    auto loadModuleRecursive = [&](auto self, gspp::Program* p) -> void {
-        for (const auto& imp : p->imports) {
+    auto addModuleRecursive = [&](auto self, const std::vector<gspp::Import>& imports) -> void {
+        for (const auto& imp : imports) {
             if (loadedModules.count(imp.path)) continue;
             loadedModules.insert(imp.path);
 
-            std::string modSource = readFile(imp.path);
-            if (modSource.empty()) {
+            Module& mod = modules[moduleIndex.at(imp.path)];
+            if (!mod.found) {
                 std::cerr << "error: cannot find module '" << imp.name << "' at '" << imp.path << "'\n";
+                moduleKeys[imp.path] = "";
                 continue;
             }
-            gspp::SourceManager::instance().addSource(imp.path, modSource);
-            gspp::Lexer modLexer(modSource, imp.path);
-            gspp::Parser modParser(modLexer);
-            auto modProg = modParser.parseProgram();
 
-            self(self, modProg.get());
+            self(self, mod.imports());
 
-            semantic.addModule(imp.name, modProg.get());
-            modulePrograms.push_back(std::move(modProg));
+            if (cache) {
+                // A module's code depends on the interfaces of its imports, so
+                // their keys are part of its own. Modules in an import cycle
+                // (whose keys are not known yet) are never cached.
+                std::vector<std::string> importKeys;
+                bool cacheable = true;
+                for (const auto& dep : mod.imports()) {
+                    auto k = moduleKeys.find(dep.path);
+                    if (k == moduleKeys.end() || k->second.empty()) cacheable = false;
+                    else importKeys.push_back(k->second);
+                }
+                std::string key;
+                if (cacheable)
+                    key = cache->key(imp.name, gspp::SourceManager::instance().text(imp.path), importKeys);
+                moduleKeys[imp.path] = key;
+                if (!key.empty() && mod.image && mod.image->buildKey() == key && cache->hasObject(key)) {
+                    if (debugMode) std::cerr << "gsc: note: using cached module '" << imp.name << "'\n";
+                    semantic.addCachedModule(imp.name, mod.image.get());
+                    moduleObjects.push_back(cache->objectPath(key));
+                    continue;
+                }
+                freshModules.push_back({imp.name, &mod, key});
+            }
+
+            // A module whose cached interface is stale (built against other
+            // imports or under another namespace) was not parsed yet.
+            if (!mod.program) parseModule(mod);
+            semantic.addModule(imp.name, mod.program.get());
         }
     };
 
-    loadModuleRecursive(loadModuleRecursive, program.get());
+    addModuleRecursive(addModuleRecursive, program->imports);
 
     if (!semantic.analyze()) {
         for (const auto& e : semantic.errors()) std::cerr << e << "\n";
         return 1;
     }
+    if (stats) {
+        const gspp::InstantiationStats& st = semantic.instantiationStats();
+        std::cerr << "gsc: stats: " << st.funcs << " function and " << st.structs << " struct instances from "
+                  << st.requests << " requests (" << st.reused << " reused), "
+                  << st.seconds * 1000 << " ms\n";
+    }
 
-    gspp::Optimizer optimizer(program.get());
+    gspp::Optimizer optimizer(program.get(), &semantic);
+    optimizer.setRemarks(remarkInlined, remarkNotInlined);
+    optimizer.setKeepChecks(debugMode);
     if (releaseMode) optimizer.optimize();
+    for (const auto& r : optimizer.remarks()) std::cerr << r << "\n";
+
+    if (emitIR) {
+        gspp::IRGenerator irgen(&semantic);
+        std::unique_ptr<gspp::IRModule> module = irgen.generate();
+        if (!irgen.errors().empty()) {
+            for (const auto& e : irgen.errors()) std::cerr << e << "\n";
+            return 1;
+        }
+        std::string irPath = outPath;
+        size_t dot = irPath.find_last_of(".\\/");
+        if (dot != std::string::npos && irPath[dot] == '.') irPath = irPath.substr(0, dot);
+        irPath += ".ir";
+        std::ofstream irFile(irPath);
+        if (!irFile) {
+            std::cerr << "gsc: cannot write '" << irPath << "'\n";
+            return 1;
+        }
+        gspp::dumpIR(*module, irFile);
+        std::cout << "IR written to " << irPath << "\n";
+        return 0;
+    }
 
+    std::string basePath = outPath;
+    {
+        size_t dot = basePath.find_last_of(".\\/");
+        if (dot != std::string::npos && basePath[dot] == '.') basePath = basePath.substr(0, dot);
+    }
     std::string asmPath = outPath;
-    if (!emitAsmOnly) {
-        size_t dot = asmPath.find_last_of(".\\/");
-        asmPath = (dot != std::string::npos && asmPath[dot] == '.') ? asmPath.substr(0, dot) : asmPath;
-        asmPath += ".s";
-    } else if (outPath.find('.') == std::string::npos)
+    if (!emitAsmOnly) asmPath = basePath + ".s";
+    else if (outPath.find('.') == std::string::npos)
         asmPath += ".s";
+    std::string objPath = emitObjOnly && outGiven ? outPath : basePath + ".o";
 
-    std::ofstream asmFile(asmPath);
-    if (!asmFile) {
-        std::cerr << "gsc: cannot write '" << asmPath << "'\n";
-        return 1;
-    }
-    gspp::CodeGenerator codegen(program.get(), &semantic, asmFile, !use64Bit);
-    if (!codegen.generate()) {
+    std::ostringstream asmText;
+    gspp::CodeGenerator codegen(program.get(), &semantic, asmText, !use64Bit, releaseMode);
+    if (cache) codegen.setUnit(gspp::Symbol());
+    codegen.setRemarks(remarkVectorized, remarkMissed);
+    bool generated = codegen.generate();
+    for (const auto& r : codegen.remarks()) std::cerr << r << "\n";
+    if (!generated) {
         for (const auto& e : codegen.errors()) std::cerr << e << "\n";
         return 1;
     }
-    asmFile.close();
 
-    if (emitAsmOnly) {
-        std::cout << "Assembly written to " << asmPath << "\n";
+    // Objects for imports compiled in this run; stored in the cache when
+    // possible, otherwise written next to the output and removed after linking.
+    std::vector<std::string> tempObjects;
+#ifndef _WIN32
+    for (const auto& fm : freshModules) {
+        std::ostringstream modAsm;
+        gspp::CodeGenerator modGen(program.get(), &semantic, modAsm, false, releaseMode);
+        modGen.setUnit(fm.name);
+        modGen.setRemarks(remarkVectorized, remarkMissed);
+        bool modGenerated = modGen.generate();
+        for (const auto& r : modGen.remarks()) std::cerr << r << "\n";
+        if (!modGenerated) {
+            for (const auto& e : modGen.errors()) std::cerr << e << "\n";
+            return 1;
+        }
+        gspp::Assembler modAssembler;
+        if (modAssembler.assemble(modAsm.str())) {
+            std::ostringstream obj;
+            gspp::writeElfObject(modAssembler.object(), obj);
+            if (!fm.key.empty() &&
+                cache->store(fm.key, fm.module->sourceKey, semantic.moduleInterface(fm.name),
+                             gspp::SourceManager::instance().findFile(fm.module->path), obj.str())) {
+                moduleObjects.push_back(cache->objectPath(fm.key));
+                continue;
+            }
+            std::string modObj = basePath + "." + fm.name.str() + ".o";
+            std::ofstream objFile(modObj, std::ios::binary);
+            if (!objFile || !(objFile << obj.str())) {
+                std::cerr << "gsc: cannot write '" << modObj << "'\n";
+                return 1;
+            }
+            tempObjects.push_back(modObj);
+            continue;
+        }
+        if (debugMode)
+            for (const auto& e : modAssembler.errors()) std::cerr << "gsc: note: " << e << "; using gcc instead\n";
+        std::string modBase = basePath + "." + fm.name.str();
+        {
+            std::ofstream modAsmFile(modBase + ".s");
+            modAsmFile << modAsm.str();
+        }
+        int rc = runCommand("gcc -m64 -c -o \"" + modBase + ".o\" \"" + modBase + ".s\"");
+        std::remove((modBase + ".s").c_str());
+        if (rc != 0) {
+            std::cerr << "gsc: assembling failed (is gcc/MinGW in PATH?)\n";
+            return 1;
+        }
+        tempObjects.push_back(modBase + ".o");
+    }
+#endif
+
+    // On x86-64 Linux the object file is produced in-process; the external
+    // assembler is only used on request or for code the encoder rejects.
+    bool linkObject = false;
+#ifndef _WIN32
+    if (use64Bit && !emitAsmOnly && !viaAsm) {
+        gspp::Assembler assembler;
+        if (assembler.assemble(asmText.str())) {
+            std::ofstream objFile(objPath, std::ios::binary);
+            if (!objFile) {
+                std::cerr << "gsc: cannot write '" << objPath << "'\n";
+                return 1;
+            }
+            gspp::writeElfObject(assembler.object(), objFile);
+            linkObject = true;
+        } else if (debugMode) {
+            for (const auto& e : assembler.errors()) std::cerr << "gsc: note: " << e << "; using gcc instead\n";
+        }
+    }
+#endif
+
+    if (!linkObject) {
+        std::ofstream asmFile(asmPath);
+        if (!asmFile) {
+            std::cerr << "gsc: cannot write '" << asmPath << "'\n";
+            return 1;
+        }
+        asmFile << asmText.str();
+        asmFile.close();
+
+        if (emitAsmOnly) {
+            std::cout << "Assembly written to " << asmPath << "\n";
+            return 0;
+        }
+        if (emitObjOnly) {
+            std::string asCmd = std::string(use64Bit ? "gcc -m64" : "gcc -m32") + " -c -o \"" + objPath + "\" \"" + asmPath + "\"";
+            if (runCommand(asCmd) != 0) {
+                std::cerr << "gsc: assembling failed (is gcc/MinGW in PATH?)\n";
+                return 1;
+            }
+        }
+    }
+    if (emitObjOnly) {
+        std::cout << "Object written to " << objPath << "\n";
         return 0;
     }
 
+    std::string input = linkObject ? objPath : asmPath;
 #ifdef _WIN32
     std::string linkCmd = use64Bit
-        ? "gcc -m64 -Wl,-subsystem,console -o \"" + outPath + "\" \"" + asmPath + "\" -lm"
-        : "gcc -m32 -Wl,-subsystem,console -Wl,-e,_main -o \"" + outPath + "\" \"" + asmPath + "\" -lmsvcrt -lm";
+        ? "gcc -m64 -Wl,-subsystem,console -o \"" + outPath + "\" \"" + input + "\" -lm"
+        : "gcc -m32 -Wl,-subsystem,console -Wl,-e,_main -o \"" + outPath + "\" \"" + input + "\" -lmsvcrt -lm";
 #else
     std::string linkCmd = use64Bit
-        ? "gcc -m64 -o \"" + outPath + "\" \"" + asmPath + "\" -lm"
-        : "gcc -m32 -o \"" + outPath + "\" \"" + asmPath + "\" -lm";
+        ? "gcc -m64 -o \"" + outPath + "\" \"" + input + "\" -lm"
+        : "gcc -m32 -o \"" + outPath + "\" \"" + input + "\" -lm";
 #endif
+    for (const auto& o : moduleObjects) linkCmd += " \"" + o + "\"";
+    for (const auto& o : tempObjects) linkCmd += " \"" + o + "\"";
     if (debugMode) linkCmd += " -g";
     int ret = runCommand(linkCmd);
+    if (linkObject) std::remove(objPath.c_str());
+    for (const auto& o : tempObjects) std::remove(o.c_str());
     if (ret != 0) {
         std::cerr << "gsc: linking failed (is gcc/MinGW in PATH?)\n";
         return 1;
@@ -0,0 +1,114 @@
+#include "modcache.h"
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gspp {
+
+namespace {
+
+const char* const kCacheMagic = "gsc-cache";
+const int kCacheVersion = 2;
+
+uint64_t fnv1a(std::string_view data, uint64_t h) {
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+const uint64_t kFnvBasis = 14695981039346656037ull;
+
+bool makeDirs(const std::string& path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+        std::string prefix = path.substr(0, i);
+#ifdef _WIN32
+        _mkdir(prefix.c_str());
+#else
+        mkdir(prefix.c_str(), 0777);
+#endif
+    }
+    std::ofstream probe(path + "/.probe");
+    bool ok = (bool)probe;
+    probe.close();
+    std::remove((path + "/.probe").c_str());
+    return ok;
+}
+
+bool writeFileAtomic(const std::string& path, const std::string& data) {
+#ifdef _WIN32
+    std::string tmp = path + ".tmp" + std::to_string(_getpid());
+#else
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+#endif
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f || !f.write(data.data(), data.size())) return false;
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+ModuleCache::ModuleCache(std::string dir, const std::string& flags) : dir_(std::move(dir)) {
+    salt_ = fnv1a(kCacheMagic, kFnvBasis);
+    salt_ = fnv1a(std::to_string(kCacheVersion) + " " + flags, salt_);
+#ifndef _WIN32
+    // Any rebuild of the compiler invalidates every entry.
+    if (std::unique_ptr<SourceBuffer> self = SourceBuffer::map("/proc/self/exe"))
+        salt_ = fnv1a(self->text(), salt_);
+#endif
+    if (!makeDirs(dir_)) dir_.clear();
+}
+
+std::string ModuleCache::key(Symbol module, std::string_view source, const std::vector<std::string>& importKeys) const {
+    uint64_t h = fnv1a(module.str(), salt_);
+    h = fnv1a(std::string_view("\0", 1), h);
+    h = fnv1a(source, h);
+    for (const std::string& k : importKeys) h = fnv1a(k, h);
+    char buf[17];
+    std::snprintf(buf, sizeof buf, "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+std::string ModuleCache::sourceKey(std::string_view source) const {
+    char buf[17];
+    std::snprintf(buf, sizeof buf, "%016llx", (unsigned long long)fnv1a(source, salt_));
+    return buf;
+}
+
+std::string ModuleCache::interfacePath(const std::string& sourceKey) const { return dir_ + "/" + sourceKey + ".gsi"; }
+std::string ModuleCache::objectPath(const std::string& key) const { return dir_ + "/" + key + ".o"; }
+
+std::unique_ptr<GsiModule> ModuleCache::openInterface(const std::string& sourceKey, uint32_t file) const {
+    if (dir_.empty()) return nullptr;
+    return GsiModule::open(interfacePath(sourceKey), file);
+}
+
+bool ModuleCache::hasObject(const std::string& key) const {
+    return !dir_.empty() && (bool)std::ifstream(objectPath(key), std::ios::binary);
+}
+
+bool ModuleCache::store(const std::string& key, const std::string& sourceKey, const ModuleInterface& iface,
+                        uint32_t file, const std::string& object) const {
+    if (dir_.empty()) return false;
+    // The interface goes last: it names the object it describes, so it must
+    // not be visible before that object is.
+    return writeFileAtomic(objectPath(key), object) &&
+           writeFileAtomic(interfacePath(sourceKey), writeGsi(iface, key, file));
+}
+
+} // namespace gspp
@@ -0,0 +1,42 @@
+#ifndef GSPP_MODCACHE_H
+#define GSPP_MODCACHE_H
+
+#include "gsi.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gspp {
+
+// On-disk cache of compiled modules. A module's object file is stored under
+// a key that hashes everything the compiled code depends on: the compiler
+// binary, code generation flags, the module's namespace and source text, and
+// the keys of the modules it imports. Its .gsi interface is stored under a
+// key of the source text alone, so an importer can find it (and the
+// module's imports) without parsing; the interface records the object key it
+// was built with, which tells whether that object is still current.
+class ModuleCache {
+public:
+    ModuleCache(std::string dir, const std::string& flags);
+
+    std::string key(Symbol module, std::string_view source, const std::vector<std::string>& importKeys) const;
+    std::string sourceKey(std::string_view source) const;
+    std::unique_ptr<GsiModule> openInterface(const std::string& sourceKey, uint32_t file) const;
+    bool hasObject(const std::string& key) const;
+    // Writes both files atomically, so concurrent builds sharing the cache
+    // never see a partial entry. `file` is the module's source file.
+    bool store(const std::string& key, const std::string& sourceKey, const ModuleInterface& iface,
+               uint32_t file, const std::string& object) const;
+    std::string objectPath(const std::string& key) const;
+
+private:
+    std::string interfacePath(const std::string& sourceKey) const;
+
+    std::string dir_;
+    uint64_t salt_ = 0;
+};
+
+} // namespace gspp
+
+#endif
@@ -1,39 +1,1601 @@
 #include "optimizer.h"
+#include "semantic.h"
+#include "vectorize.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
 
 namespace gspp {
 
+namespace {
+
+// Callees whose returned expression has at most this many nodes are inlined
+// without @inline.
+constexpr int kInlineCost = 12;
+// Calls in inlined code are inlined in turn, this many levels deep.
+constexpr size_t kMaxInlineDepth = 4;
+
+int countNodes(const Expr* e) {
+    if (!e) return 0;
+    int n = 1 + countNodes(e->left.get()) + countNodes(e->right.get());
+    for (const auto& a : e->args) n += countNodes(a.get());
+    return n;
+}
+
+bool hasSideEffects(const Expr* e) {
+    if (!e) return false;
+    if (e->kind == Expr::Kind::Call || e->kind == Expr::Kind::New || e->kind == Expr::Kind::NewArray ||
+        e->kind == Expr::Kind::Delete)
+        return true;
+    if (hasSideEffects(e->left.get()) || hasSideEffects(e->right.get())) return true;
+    for (const auto& a : e->args)
+        if (hasSideEffects(a.get())) return true;
+    return false;
+}
+
+// Whether evaluating e itself, its operands aside, may stop the program: a
+// checked slice index or a slice of a slice out of range, an integer / or %
+// by a divisor not known to be nonzero, or a load through a pointer.
+bool failsHere(const Expr* e) {
+    switch (e->kind) {
+        case Expr::Kind::Index:
+            return e->left->exprType->kind == Type::Kind::StructRef || e->left->exprType->kind == Type::Kind::Pointer;
+        case Expr::Kind::Slice:
+            return e->left->exprType->kind == Type::Kind::StructRef;
+        case Expr::Kind::Binary:
+            return (e->op == Expr::Op::Div || e->op == Expr::Op::Mod) && e->exprType->kind == Type::Kind::Int &&
+                   (e->right->kind != Expr::Kind::IntLit || e->right->intVal == 0);
+        case Expr::Kind::Deref:
+            return true;
+        case Expr::Kind::Member:
+            return e->left->exprType->kind == Type::Kind::Pointer;
+        default:
+            return false;
+    }
+}
+
+bool mayFail(const Expr* e) {
+    if (!e) return false;
+    if (failsHere(e)) return true;
+    if (mayFail(e->left.get()) || mayFail(e->right.get())) return true;
+    for (const auto& a : e->args)
+        if (mayFail(a.get())) return true;
+    return false;
+}
+
+// Cheap enough to evaluate once per use of its parameter.
+bool trivialArg(const Expr* e) {
+    switch (e->kind) {
+        case Expr::Kind::IntLit:
+        case Expr::Kind::FloatLit:
+        case Expr::Kind::BoolLit:
+        case Expr::Kind::Var:
+            return true;
+        case Expr::Kind::AddressOf:
+            return e->right->kind == Expr::Kind::Var;
+        case Expr::Kind::Member:
+            return (e->left->kind == Expr::Kind::Var || e->left->kind == Expr::Kind::Member) && trivialArg(e->left.get());
+        default:
+            return false;
+    }
+}
+
+void collectAddressTaken(const Expr* e, std::unordered_set<Symbol>& out) {
+    if (!e) return;
+    if (e->kind == Expr::Kind::AddressOf) {
+        // &s.m lets a store through the pointer change struct local s.
+        const Expr* root = e->right.get();
+        while (root->kind == Expr::Kind::Member && root->left->exprType->kind == Type::Kind::StructRef)
+            root = root->left.get();
+        if (root->kind == Expr::Kind::Var) out.insert(root->ident);
+    }
+    collectAddressTaken(e->left.get(), out);
+    collectAddressTaken(e->right.get(), out);
+    for (const auto& a : e->args) collectAddressTaken(a.get(), out);
+}
+
+void collectAddressTaken(const Stmt* s, std::unordered_set<Symbol>& out) {
+    if (!s) return;
+    for (const auto& b : s->blockStmts) collectAddressTaken(b.get(), out);
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        collectAddressTaken(e, out);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        collectAddressTaken(c, out);
+}
+
+// How a callee's returned expression uses its parameters.
+struct ParamUses {
+    const std::vector<FuncParam>& params;
+    std::vector<int> count;
+    std::vector<int> order;  // parameters in the order their uses are evaluated
+    std::vector<bool> late;  // some use is conditional or follows a check that may fail
+    Symbol ns;                          // the callee's module
+    std::vector<Symbol> moduleCalls;    // unqualified calls that resolve there only
+    bool escapes = false;  // a parameter's address is taken
+    bool foreign = false;  // a name other than a parameter is read
+    bool checked = false;  // a check that may fail has been evaluated
+
+    explicit ParamUses(const std::vector<FuncParam>& p) : params(p), count(p.size(), 0), late(p.size(), false) {}
+
+    int index(Symbol name) const {
+        for (size_t i = 0; i < params.size(); i++)
+            if (params[i].name == name) return (int)i;
+        return -1;
+    }
+
+    void scan(const Expr* e, bool underAddressOf = false, bool conditional = false) {
+        if (!e) return;
+        if (e->kind == Expr::Kind::Var) {
+            int i = index(e->ident);
+            if (i < 0) foreign = true;
+            else count[i]++, escapes |= underAddressOf, order.push_back(i), late[i] = late[i] || conditional || checked;
+            return;
+        }
+        if (e->kind == Expr::Kind::Slice || e->kind == Expr::Kind::NewArray ||
+            (e->kind == Expr::Kind::Call && !e->member.empty()))
+            foreign = true;  // built in a frame slot of the callee
+        underAddressOf |= e->kind == Expr::Kind::AddressOf;
+        scan(e->left.get(), underAddressOf, conditional);
+        scan(e->right.get(), underAddressOf,
+             conditional || (e->kind == Expr::Kind::Binary && (e->op == Expr::Op::And || e->op == Expr::Op::Or)));
+        for (const auto& a : e->args) scan(a.get(), underAddressOf, conditional);
+        checked |= failsHere(e);
+    }
+};
+
+// A module's signatures name its own structs without the module: caller
+// type a matches parameter type p of a function in namespace ns.
+bool sameType(const Type* a, const Type* p, Symbol ns) {
+    if (a == p) return true;
+    if (a->kind != p->kind) return false;
+    if (a->kind == Type::Kind::Pointer) return sameType(a->ptrTo, p->ptrTo, ns);
+    return a->kind == Type::Kind::StructRef && p->ns.empty() && a->ns == ns && a->structName == p->structName &&
+           a->typeArgs == p->typeArgs;
+}
+
+bool unqualifiedStruct(const Type* t) {
+    if (!t) return false;
+    if (t->kind == Type::Kind::Pointer) return unqualifiedStruct(t->ptrTo);
+    if (t->kind != Type::Kind::StructRef) return false;
+    if (t->ns.empty()) return true;
+    for (const Type* a : t->typeArgs)
+        if (unqualifiedStruct(a)) return true;
+    return false;
+}
+
+// Whether a node of e other than a parameter has a type that only means
+// the right struct inside the callee's module.
+bool needsCalleeNamespace(const Expr* e, const ParamUses& uses) {
+    if (!e || (e->kind == Expr::Kind::Var && uses.index(e->ident) >= 0)) return false;
+    if (unqualifiedStruct(e->exprType) || unqualifiedStruct(e->targetType)) return true;
+    if (needsCalleeNamespace(e->left.get(), uses) || needsCalleeNamespace(e->right.get(), uses)) return true;
+    for (const auto& a : e->args)
+        if (needsCalleeNamespace(a.get(), uses)) return true;
+    return false;
+}
+
+// Unqualified calls in e that resolve in uses.ns but not globally, as they
+// did when the callee was analyzed.
+void collectModuleCalls(const Expr* e, SemanticAnalyzer& semantic, ParamUses& uses) {
+    if (!e) return;
+    if (e->kind == Expr::Kind::Call && e->ns.empty() && !semantic.getFunc(e->ident, Symbol()) &&
+        semantic.getFunc(e->ident, uses.ns))
+        uses.moduleCalls.push_back(e->ident);
+    collectModuleCalls(e->left.get(), semantic, uses);
+    collectModuleCalls(e->right.get(), semantic, uses);
+    for (const auto& a : e->args) collectModuleCalls(a.get(), semantic, uses);
+}
+
+// A copy of e; with uses, parameter i is replaced by a copy of args[i] and
+// the callee's calls of functions of its module are qualified with it.
+std::unique_ptr<Expr> cloneExpr(const Expr* e, const ParamUses* uses = nullptr,
+                                const std::vector<std::unique_ptr<Expr>>* args = nullptr) {
+    if (uses && e->kind == Expr::Kind::Var) return cloneExpr((*args)[uses->index(e->ident)].get());
+    auto res = std::make_unique<Expr>();
+    res->kind = e->kind;
+    res->exprType = e->exprType;
+    res->loc = e->loc;
+    res->intVal = e->intVal;
+    res->floatVal = e->floatVal;
+    res->boolVal = e->boolVal;
+    res->strVal = e->strVal;
+    res->ident = e->ident;
+    res->ns = e->ns;
+    if (uses && e->kind == Expr::Kind::Call && e->ns.empty() &&
+        std::find(uses->moduleCalls.begin(), uses->moduleCalls.end(), e->ident) != uses->moduleCalls.end())
+        res->ns = uses->ns;  // the callee's own function, named from the caller's module
+    res->op = e->op;
+    res->member = e->member;
+    res->targetType = e->targetType;
+    res->typeArgs = e->typeArgs;
+    if (e->left) res->left = cloneExpr(e->left.get(), uses, args);
+    if (e->right) res->right = cloneExpr(e->right.get(), uses, args);
+    for (const auto& a : e->args) res->args.push_back(cloneExpr(a.get(), uses, args));
+    return res;
+}
+
+void setInt(Expr* e, int64_t v) {
+    e->kind = Expr::Kind::IntLit;
+    e->intVal = v;
+    e->left.reset();
+    e->right.reset();
+}
+
+void setFloat(Expr* e, double v) {
+    e->kind = Expr::Kind::FloatLit;
+    e->floatVal = v;
+    e->left.reset();
+    e->right.reset();
+}
+
+void setBool(Expr* e, bool v) {
+    e->kind = Expr::Kind::BoolLit;
+    e->boolVal = v;
+    e->left.reset();
+    e->right.reset();
+}
+
+template <typename T>
+bool compare(Expr::Op op, T l, T r, bool& result) {
+    switch (op) {
+        case Expr::Op::Eq: result = l == r; return true;
+        case Expr::Op::Ne: result = l != r; return true;
+        case Expr::Op::Lt: result = l < r; return true;
+        case Expr::Op::Gt: result = l > r; return true;
+        case Expr::Op::Le: result = l <= r; return true;
+        case Expr::Op::Ge: result = l >= r; return true;
+        default: return false;
+    }
+}
+
+// Binary e with folded operands. Integer arithmetic wraps; a division that
+// would trap is left for run time.
+void foldBinary(Expr* e) {
+    const Expr* l = e->left.get();
+    const Expr* r = e->right.get();
+    bool c;
+    if (l->kind == Expr::Kind::IntLit && r->kind == Expr::Kind::IntLit) {
+        int64_t x = l->intVal, y = r->intVal;
+        switch (e->op) {
+            case Expr::Op::Add: setInt(e, (int64_t)((uint64_t)x + (uint64_t)y)); break;
+            case Expr::Op::Sub: setInt(e, (int64_t)((uint64_t)x - (uint64_t)y)); break;
+            case Expr::Op::Mul: setInt(e, (int64_t)((uint64_t)x * (uint64_t)y)); break;
+            case Expr::Op::Div:
+            case Expr::Op::Mod:
+                if (y == 0 || (x == INT64_MIN && y == -1)) break;
+                setInt(e, e->op == Expr::Op::Div ? x / y : x % y);
+                break;
+            default:
+                if (compare(e->op, x, y, c)) setBool(e, c);
+                break;
+        }
+    } else if (l->kind == Expr::Kind::FloatLit && r->kind == Expr::Kind::FloatLit) {
+        double x = l->floatVal, y = r->floatVal;
+        switch (e->op) {
+            case Expr::Op::Add: setFloat(e, x + y); break;
+            case Expr::Op::Sub: setFloat(e, x - y); break;
+            case Expr::Op::Mul: setFloat(e, x * y); break;
+            case Expr::Op::Div: setFloat(e, x / y); break;
+            default:
+                if (compare(e->op, x, y, c)) setBool(e, c);
+                break;
+        }
+    } else if (l->kind == Expr::Kind::BoolLit && r->kind == Expr::Kind::BoolLit) {
+        bool x = l->boolVal, y = r->boolVal;
+        if (e->op == Expr::Op::And) setBool(e, x && y);
+        else if (e->op == Expr::Op::Or) setBool(e, x || y);
+        else if (compare(e->op, x, y, c)) setBool(e, c);
+    } else if (l->kind == Expr::Kind::BoolLit && (e->op == Expr::Op::And || e->op == Expr::Op::Or)) {
+        // false and x, true or x: the left side decides; otherwise x does.
+        if (l->boolVal == (e->op == Expr::Op::Or)) {
+            setBool(e, l->boolVal);
+        } else {
+            std::unique_ptr<Expr> rest = std::move(e->right);
+            *e = std::move(*rest);
+        }
+    }
+}
+
+void foldUnary(Expr* e) {
+    const Expr* o = e->right.get();
+    if (e->op == Expr::Op::Neg && o->kind == Expr::Kind::IntLit) setInt(e, (int64_t)(0 - (uint64_t)o->intVal));
+    else if (e->op == Expr::Op::Neg && o->kind == Expr::Kind::FloatLit) setFloat(e, -o->floatVal);
+    else if (e->op == Expr::Op::Not && o->kind == Expr::Kind::BoolLit) setBool(e, !o->boolVal);
+}
+
+bool mentions(const Expr* e, Symbol name) {
+    if (!e) return false;
+    if (e->kind == Expr::Kind::Var && e->ident == name) return true;
+    if (mentions(e->left.get(), name) || mentions(e->right.get(), name)) return true;
+    for (const auto& a : e->args)
+        if (mentions(a.get(), name)) return true;
+    return false;
+}
+
+bool mentions(const Stmt* s, Symbol name) {
+    if (!s) return false;
+    if (s->kind == Stmt::Kind::VarDecl && s->varName == name) return true;
+    for (const auto& b : s->blockStmts)
+        if (mentions(b.get(), name)) return true;
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        if (mentions(e, name)) return true;
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        if (mentions(c, name)) return true;
+    return false;
+}
+
+// Locals a statement may store to; asm is set when inline assembly could
+// store to any of them.
+void collectAssigned(const Stmt* s, std::unordered_set<Symbol>& out, bool& hasAsm) {
+    if (!s) return;
+    if (s->kind == Stmt::Kind::Asm) hasAsm = true;
+    if (s->kind == Stmt::Kind::VarDecl) out.insert(s->varName);
+    if (s->kind == Stmt::Kind::Assign && s->assignTarget->kind == Expr::Kind::Var) out.insert(s->assignTarget->ident);
+    for (const auto& b : s->blockStmts) collectAssigned(b.get(), out, hasAsm);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        collectAssigned(c, out, hasAsm);
+}
+
+void countReads(const Expr* e, std::unordered_map<Symbol, int>& reads) {
+    if (!e) return;
+    if (e->kind == Expr::Kind::Var) reads[e->ident]++;
+    countReads(e->left.get(), reads);
+    countReads(e->right.get(), reads);
+    for (const auto& a : e->args) countReads(a.get(), reads);
+}
+
+// Every mention of a local except as the target of a store.
+void countReads(const Stmt* s, std::unordered_map<Symbol, int>& reads, bool& hasAsm) {
+    if (!s) return;
+    if (s->kind == Stmt::Kind::Asm) hasAsm = true;
+    if (s->kind != Stmt::Kind::Assign || s->assignTarget->kind != Expr::Kind::Var)
+        countReads(s->assignTarget.get(), reads);
+    for (const auto& b : s->blockStmts) countReads(b.get(), reads, hasAsm);
+    for (const Expr* e : {s->varInit.get(), s->assignValue.get(), s->condition.get(), s->returnExpr.get(),
+                          s->expr.get()})
+        countReads(e, reads);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        countReads(c, reads, hasAsm);
+}
+
+// The store at list[i] to name is overwritten, or the function returns,
+// before anything reads name.
+bool overwrittenBeforeRead(const std::vector<std::unique_ptr<Stmt>>& list, size_t i, Symbol name) {
+    for (size_t j = i + 1; j < list.size(); j++) {
+        const Stmt* s = list[j].get();
+        if (s->kind == Stmt::Kind::Assign && s->assignTarget->kind == Expr::Kind::Var &&
+            s->assignTarget->ident == name)
+            return !mentions(s->assignValue.get(), name);
+        if (s->kind == Stmt::Kind::Return) return !mentions(s->returnExpr.get(), name);
+        if (mentions(s, name)) return false;
+    }
+    return false;
+}
+
+bool sameExpr(const Expr* a, const Expr* b) {
+    if (!a || !b) return a == b;
+    if (a->kind != b->kind || a->op != b->op || a->exprType != b->exprType || a->ident != b->ident ||
+        a->ns != b->ns || a->member != b->member || a->intVal != b->intVal || a->boolVal != b->boolVal ||
+        a->args.size() != b->args.size())
+        return false;
+    if (a->kind == Expr::Kind::FloatLit && !(a->floatVal == b->floatVal)) return false;
+    if (!sameExpr(a->left.get(), b->left.get()) || !sameExpr(a->right.get(), b->right.get())) return false;
+    for (size_t i = 0; i < a->args.size(); i++)
+        if (!sameExpr(a->args[i].get(), b->args[i].get())) return false;
+    return true;
+}
+
+bool containsReturn(const Stmt* s) {
+    if (!s) return false;
+    if (s->kind == Stmt::Kind::Return) return true;
+    for (const auto& b : s->blockStmts)
+        if (containsReturn(b.get())) return true;
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get()})
+        if (containsReturn(c)) return true;
+    return false;
+}
+
+int countStores(const Stmt* s, Symbol name) {
+    if (!s) return 0;
+    int n = (s->kind == Stmt::Kind::VarDecl && s->varName == name) ||
+            (s->kind == Stmt::Kind::Assign && s->assignTarget->kind == Expr::Kind::Var &&
+             s->assignTarget->ident == name);
+    for (const auto& b : s->blockStmts) n += countStores(b.get(), name);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        n += countStores(c, name);
+    return n;
+}
+
+// i = i + c or i = i - c for an int literal c.
+bool isStep(const Stmt* s, Symbol& iv, int64_t& delta) {
+    if (!s || s->kind != Stmt::Kind::Assign || s->assignTarget->kind != Expr::Kind::Var) return false;
+    const Expr* v = s->assignValue.get();
+    if (v->kind != Expr::Kind::Binary || (v->op != Expr::Op::Add && v->op != Expr::Op::Sub) ||
+        v->left->kind != Expr::Kind::Var || v->left->ident != s->assignTarget->ident ||
+        v->right->kind != Expr::Kind::IntLit)
+        return false;
+    iv = s->assignTarget->ident;
+    delta = v->op == Expr::Op::Add ? v->right->intVal : -v->right->intVal;
+    return true;
+}
+
+std::unique_ptr<Expr> makeLocal(Symbol name, const Type* type, SourceLoc loc) {
+    auto e = Expr::makeVar(name, loc);
+    e->exprType = type;
+    return e;
+}
+
+std::unique_ptr<Stmt> makeDecl(Symbol name, std::unique_ptr<Expr> init) {
+    auto s = std::make_unique<Stmt>();
+    s->kind = Stmt::Kind::VarDecl;
+    s->loc = init->loc;
+    s->varName = name;
+    s->varType = init->exprType;
+    s->varInit = std::move(init);
+    return s;
+}
+
+std::unique_ptr<Stmt> cloneStmt(const Stmt* s) {
+    if (!s) return nullptr;
+    auto res = std::make_unique<Stmt>();
+    res->kind = s->kind;
+    res->loc = s->loc;
+    res->varName = s->varName;
+    res->varType = s->varType;
+    res->asmCode = s->asmCode;
+    for (const auto& b : s->blockStmts) res->blockStmts.push_back(cloneStmt(b.get()));
+    for (auto slot : {&Stmt::varInit, &Stmt::assignTarget, &Stmt::assignValue, &Stmt::condition,
+                      &Stmt::returnExpr, &Stmt::expr})
+        if (s->*slot) (*res).*slot = cloneExpr((s->*slot).get());
+    for (auto slot : {&Stmt::thenBranch, &Stmt::elseBranch, &Stmt::body, &Stmt::initStmt, &Stmt::stepStmt})
+        (*res).*slot = cloneStmt((s->*slot).get());
+    return res;
+}
+
+// Calls visit on every expression slot of s and the statements in it.
+void forEachExpr(Stmt* s, const std::function<void(std::unique_ptr<Expr>&)>& visit) {
+    if (!s) return;
+    for (auto slot : {&Stmt::varInit, &Stmt::assignTarget, &Stmt::assignValue, &Stmt::condition,
+                      &Stmt::returnExpr, &Stmt::expr})
+        if (s->*slot) visit(s->*slot);
+    for (auto& b : s->blockStmts) forEachExpr(b.get(), visit);
+    for (auto slot : {&Stmt::thenBranch, &Stmt::elseBranch, &Stmt::body, &Stmt::initStmt, &Stmt::stepStmt})
+        forEachExpr((s->*slot).get(), visit);
+}
+
+// Whether s stores into a member of local name (name.m = x).
+bool storesInto(const Stmt* s, Symbol name) {
+    if (!s) return false;
+    if (s->kind == Stmt::Kind::Assign) {
+        const Expr* root = s->assignTarget.get();
+        while (root->kind == Expr::Kind::Member) root = root->left.get();
+        if (root != s->assignTarget.get() && root->kind == Expr::Kind::Var && root->ident == name) return true;
+    }
+    for (const auto& b : s->blockStmts)
+        if (storesInto(b.get(), name)) return true;
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        if (storesInto(c, name)) return true;
+    return false;
+}
+
+bool scalar(const Type* t) {
+    return t->kind == Type::Kind::Int || t->kind == Type::Kind::Float || t->kind == Type::Kind::Bool ||
+           t->kind == Type::Kind::Char || t->kind == Type::Kind::Pointer;
+}
+
+} // namespace
+
+// What a loop may change: the locals it stores to by name, and the kinds of
+// value it stores through pointers. A store of one kind is assumed not to
+// change memory read as another (an int store leaves a pointer member
+// alone); calls, struct and vector stores and inline assembly may change
+// anything.
+struct Optimizer::LoopFacts {
+    std::unordered_set<Symbol> assigned;
+    std::unordered_set<int> storedKinds;
+    bool clobbersAll = false;
+    bool hasAsm = false;
+    bool inBody = false;    // hoisting from the body rather than the condition
+    bool fromBody = false;  // something was; the loop needs a guard
+    std::vector<std::unique_ptr<Stmt>> preheader;
+    std::vector<std::pair<const Expr*, Symbol>> hoisted;  // preheader expression -> its temp
+};
+
+bool Optimizer::Known::operator==(const Known& o) const {
+    if (kind != o.kind) return false;
+    switch (kind) {
+        case Expr::Kind::IntLit: return intVal == o.intVal;
+        case Expr::Kind::FloatLit: return floatVal == o.floatVal;
+        case Expr::Kind::BoolLit: return boolVal == o.boolVal;
+        default: return var == o.var;
+    }
+}
+
+// Scalar locals of the current function whose address is never taken: only
+// stores to them by name change them.
+const Type* Optimizer::trackedType(Symbol name) const {
+    if (!current_ || addressTaken_.count(name)) return nullptr;
+    auto it = current_->locals.find(name);
+    if (it == current_->locals.end()) return nullptr;
+    switch (it->second.type->kind) {
+        case Type::Kind::Int:
+        case Type::Kind::Float:
+        case Type::Kind::Bool:
+        case Type::Kind::Char:
+        case Type::Kind::Pointer:
+            return it->second.type;
+        default:
+            return nullptr;
+    }
+}
+
+void Optimizer::forget(Symbol name) {
+    known_.erase(name);
+    for (auto it = known_.begin(); it != known_.end();) {
+        if (it->second.kind == Expr::Kind::Var && it->second.var == name) it = known_.erase(it);
+        else ++it;
+    }
+}
+
+void Optimizer::learn(Symbol name, const Expr* value) {
+    forget(name);
+    const Type* t = trackedType(name);
+    if (!t || !value) return;
+    Known k;
+    k.kind = value->kind;
+    switch (value->kind) {
+        case Expr::Kind::IntLit:
+            if (t->kind != Type::Kind::Int) return;
+            k.intVal = value->intVal;
+            break;
+        case Expr::Kind::FloatLit:
+            if (t->kind != Type::Kind::Float) return;
+            k.floatVal = value->floatVal;
+            break;
+        case Expr::Kind::BoolLit:
+            if (t->kind != Type::Kind::Bool) return;
+            k.boolVal = value->boolVal;
+            break;
+        case Expr::Kind::Var:
+            if (value->ident == name || trackedType(value->ident) != t) return;
+            k.var = value->ident;
+            break;
+        default:
+            return;
+    }
+    known_[name] = k;
+}
+
+// Before a loop: what the body stores may differ from one iteration to the
+// next.
+void Optimizer::forgetAssignedIn(const Stmt* loop) {
+    std::unordered_set<Symbol> assigned;
+    bool hasAsm = false;
+    collectAssigned(loop, assigned, hasAsm);
+    if (hasAsm) known_.clear();
+    for (Symbol name : assigned) forget(name);
+}
+
+// Where two paths join only what both agree on is still known.
+void Optimizer::keepAgreeing(const std::unordered_map<Symbol, Known>& other) {
+    for (auto it = known_.begin(); it != known_.end();) {
+        auto o = other.find(it->first);
+        if (o == other.end() || !(o->second == it->second)) it = known_.erase(it);
+        else ++it;
+    }
+}
+
+bool Optimizer::removeDeadStores(Stmt* stmt, const std::unordered_map<Symbol, int>& reads) {
+    if (!stmt) return false;
+    bool changed = false;
+    for (Stmt* c : {stmt->thenBranch.get(), stmt->elseBranch.get(), stmt->body.get()})
+        changed |= removeDeadStores(c, reads);
+    if (stmt->kind != Stmt::Kind::Block) return changed;
+
+    std::vector<std::unique_ptr<Stmt>>& list = stmt->blockStmts;
+    std::vector<std::unique_ptr<Stmt>> kept;
+    for (size_t i = 0; i < list.size(); i++) {
+        changed |= removeDeadStores(list[i].get(), reads);
+        Stmt* s = list[i].get();
+        Symbol name;
+        std::unique_ptr<Expr>* value = nullptr;
+        if (s->kind == Stmt::Kind::Assign && s->assignTarget->kind == Expr::Kind::Var) {
+            name = s->assignTarget->ident;
+            value = &s->assignValue;
+        } else if (s->kind == Stmt::Kind::VarDecl) {
+            name = s->varName;
+            value = &s->varInit;
+        }
+        if (name.empty() || !trackedType(name)) {
+            kept.push_back(std::move(list[i]));
+            continue;
+        }
+        auto r = reads.find(name);
+        bool unread = r == reads.end() || r->second == 0;
+        // A declaration stays unless the local is never read at all.
+        bool dead = unread || (s->kind == Stmt::Kind::Assign && overwrittenBeforeRead(list, i, name));
+        if (!dead) {
+            kept.push_back(std::move(list[i]));
+            continue;
+        }
+        // A value that calls or may fail still runs, as a statement of its
+        // own: the local it was stored to may be gone with its declaration.
+        if (*value && (hasSideEffects(value->get()) || mayFail(value->get()))) {
+            auto eval = std::make_unique<Stmt>();
+            eval->kind = Stmt::Kind::ExprStmt;
+            eval->loc = s->loc;
+            eval->expr = std::move(*value);
+            kept.push_back(std::move(eval));
+        }
+        changed = true;
+    }
+    list = std::move(kept);
+    return changed;
+}
+
+void Optimizer::eliminateDeadStores(Stmt* body) {
+    for (bool changed = true; changed;) {
+        std::unordered_map<Symbol, int> reads;
+        bool hasAsm = false;
+        countReads(body, reads, hasAsm);
+        if (hasAsm) return;
+        changed = removeDeadStores(body, reads);
+    }
+}
+
+Symbol Optimizer::newTemp(const Type* type) {
+    // The analyzer hands out its function symbols read-only, as it does
+    // their declarations.
+    return semantic_->addTemp(const_cast<FuncSymbol&>(*current_), type);
+}
+
+void Optimizer::scanLoop(const Stmt* s, LoopFacts& f) const {
+    if (!s) return;
+    if (s->kind == Stmt::Kind::Asm) f.hasAsm = true;
+    const Expr* target = nullptr;
+    if (s->kind == Stmt::Kind::Assign) target = s->assignTarget.get();
+    if (target && (target->kind != Expr::Kind::Var || !trackedType(target->ident))) {
+        const Type* t = target->exprType;
+        if (!scalar(t)) f.clobbersAll = true;
+        else f.storedKinds.insert((int)t->kind);
+    }
+    if (s->kind == Stmt::Kind::VarDecl && !trackedType(s->varName)) {
+        if (!scalar(s->varType)) f.clobbersAll = true;
+        else f.storedKinds.insert((int)s->varType->kind);
+    }
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        if (hasSideEffects(e)) f.clobbersAll = true;
+    for (const auto& b : s->blockStmts) scanLoop(b.get(), f);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        scanLoop(c, f);
+}
+
+bool Optimizer::invariant(const Expr* e, const LoopFacts& f) const {
+    auto unchangedMemory = [&](const Type* t) {
+        return !f.clobbersAll && scalar(t) && !f.storedKinds.count((int)t->kind);
+    };
+    switch (e->kind) {
+        case Expr::Kind::IntLit:
+        case Expr::Kind::FloatLit:
+        case Expr::Kind::BoolLit:
+            return true;
+        case Expr::Kind::Var:
+            return trackedType(e->ident) && !f.assigned.count(e->ident);
+        case Expr::Kind::Binary:
+            if (e->op == Expr::Op::And || e->op == Expr::Op::Or || !scalar(e->exprType)) return false;
+            return invariant(e->left.get(), f) && invariant(e->right.get(), f);
+        case Expr::Kind::Unary:
+            return invariant(e->right.get(), f);
+        case Expr::Kind::Member: {
+            // Through a pointer, or a struct member of what a pointer reaches.
+            // A struct local whose address is never taken changes only
+            // through stores naming it, which the loop facts record.
+            const Expr* base = e->left.get();
+            bool viaPointer = base->exprType->kind == Type::Kind::Pointer ||
+                              (base->kind == Expr::Kind::Member && base->exprType->kind == Type::Kind::StructRef);
+            bool local = base->kind == Expr::Kind::Var && base->exprType->kind == Type::Kind::StructRef &&
+                         !addressTaken_.count(base->ident) && !f.assigned.count(base->ident);
+            if (local) return unchangedMemory(e->exprType);
+            if (!viaPointer) return false;
+            if (e->exprType->kind == Type::Kind::StructRef) return invariant(base, f);
+            return unchangedMemory(e->exprType) && invariant(base, f);
+        }
+        case Expr::Kind::Deref:
+            return unchangedMemory(e->exprType) && invariant(e->right.get(), f);
+        case Expr::Kind::Index:
+            return unchangedMemory(e->exprType) && invariant(e->left.get(), f) && invariant(e->right.get(), f);
+        default:
+            return false;
+    }
+}
+
+// Moves the largest invariant expressions under slot into temporaries set
+// before the loop. Only the left operand of and/or is sure to be evaluated.
+void Optimizer::hoist(std::unique_ptr<Expr>& slot, LoopFacts& f) {
+    Expr* e = slot.get();
+    if (!e) return;
+    bool leaf = e->kind == Expr::Kind::IntLit || e->kind == Expr::Kind::FloatLit ||
+                e->kind == Expr::Kind::BoolLit || e->kind == Expr::Kind::Var;
+    if (!leaf && scalar(e->exprType) && invariant(e, f)) {
+        Symbol temp;
+        for (const auto& h : f.hoisted)
+            if (sameExpr(h.first, e)) temp = h.second;
+        const Type* type = e->exprType;
+        SourceLoc loc = e->loc;
+        if (temp.empty()) {
+            temp = newTemp(type);
+            f.preheader.push_back(makeDecl(temp, std::move(slot)));
+            f.hoisted.push_back({f.preheader.back()->varInit.get(), temp});
+        }
+        slot = makeLocal(temp, type, loc);
+        f.fromBody |= f.inBody;
+        return;
+    }
+    switch (e->kind) {
+        case Expr::Kind::Binary:
+            hoist(e->left, f);
+            if (e->op != Expr::Op::And && e->op != Expr::Op::Or) hoist(e->right, f);
+            break;
+        case Expr::Kind::AddressOf:
+            hoistFromLvalue(e->right.get(), f);
+            break;
+        default:
+            hoist(e->left, f);
+            hoist(e->right, f);
+            for (auto& a : e->args) hoist(a, f);
+            break;
+    }
+}
+
+// The address an lvalue names may be invariant in part; the lvalue itself
+// stays.
+void Optimizer::hoistFromLvalue(Expr* e, LoopFacts& f) {
+    switch (e->kind) {
+        case Expr::Kind::Deref:
+            hoist(e->right, f);
+            break;
+        case Expr::Kind::Index:
+            hoist(e->left, f);
+            hoist(e->right, f);
+            break;
+        case Expr::Kind::Member:
+            if (e->left->exprType->kind == Type::Kind::Pointer) hoist(e->left, f);
+            else hoistFromLvalue(e->left.get(), f);
+            break;
+        default:
+            break;
+    }
+}
+
+void Optimizer::hoistFromStmt(Stmt* s, LoopFacts& f) {
+    switch (s->kind) {
+        case Stmt::Kind::VarDecl:
+            hoist(s->varInit, f);
+            break;
+        case Stmt::Kind::Assign:
+            hoist(s->assignValue, f);
+            hoistFromLvalue(s->assignTarget.get(), f);
+            break;
+        case Stmt::Kind::ExprStmt:
+            hoist(s->expr, f);
+            break;
+        case Stmt::Kind::Return:
+            hoist(s->returnExpr, f);
+            break;
+        case Stmt::Kind::If:
+        case Stmt::Kind::While:
+            hoist(s->condition, f);
+            break;
+        case Stmt::Kind::For:
+            if (s->initStmt) hoistFromStmt(s->initStmt.get(), f);
+            hoist(s->condition, f);
+            break;
+        default:
+            break;
+    }
+}
+
+// For an induction variable i stepped once per iteration by i = i + c, every
+// p + i and p[i] with p invariant becomes a pointer q set to p + i before the
+// loop and stepped by c next to i. Loops the code generator vectorizes keep
+// their indexing.
+void Optimizer::reduceStrength(Stmt* loop, LoopFacts& f) {
+    VectorLoop plan;
+    std::string whyNot;
+    if (analyzeVectorLoop(loop, *current_, plan, whyNot)) return;
+
+    std::vector<Stmt*> steps;  // candidate i = i + c statements
+    if (loop->kind == Stmt::Kind::For) {
+        steps.push_back(loop->stepStmt.get());
+    } else if (loop->body && loop->body->kind == Stmt::Kind::Block) {
+        for (auto& s : loop->body->blockStmts) steps.push_back(s.get());
+    }
+    for (Stmt* step : steps) {
+        Symbol iv;
+        int64_t delta;
+        if (!isStep(step, iv, delta) || !trackedType(iv) || trackedType(iv)->kind != Type::Kind::Int ||
+            countStores(loop->body.get(), iv) + countStores(loop->stepStmt.get(), iv) != 1)
+            continue;
+
+        // Pointer temporaries by base, created on first use.
+        std::vector<std::pair<Symbol, Symbol>> pointers;
+        auto pointerFor = [&](const Expr* base) {
+            for (const auto& p : pointers)
+                if (p.first == base->ident) return p.second;
+            Symbol q = newTemp(base->exprType);
+            auto start = Expr::makeBinary(makeLocal(base->ident, base->exprType, base->loc), Expr::Op::Add,
+                                          makeLocal(iv, trackedType(iv), base->loc), base->loc);
+            start->exprType = base->exprType;
+            f.preheader.push_back(makeDecl(q, std::move(start)));
+            pointers.push_back({base->ident, q});
+            return q;
+        };
+        auto isBase = [&](const Expr* e) {
+            return e->kind == Expr::Kind::Var && e->exprType->kind == Type::Kind::Pointer && invariant(e, f);
+        };
+        auto isIv = [&](const Expr* e) { return e->kind == Expr::Kind::Var && e->ident == iv; };
+        std::function<void(std::unique_ptr<Expr>&, bool)> rewrite = [&](std::unique_ptr<Expr>& slot, bool lvalue) {
+            Expr* e = slot.get();
+            if (!e) return;
+            if (e->kind == Expr::Kind::Binary && e->op == Expr::Op::Add && isBase(e->left.get()) &&
+                isIv(e->right.get())) {
+                slot = makeLocal(pointerFor(e->left.get()), e->exprType, e->loc);
+                return;
+            }
+            if (e->kind == Expr::Kind::Index && !lvalue && scalar(e->exprType) && isBase(e->left.get()) &&
+                isIv(e->right.get())) {
+                auto deref = std::make_unique<Expr>();
+                deref->kind = Expr::Kind::Deref;
+                deref->loc = e->loc;
+                deref->exprType = e->exprType;
+                deref->right = makeLocal(pointerFor(e->left.get()), e->left->exprType, e->loc);
+                slot = std::move(deref);
+                return;
+            }
+            rewrite(e->left, e->kind == Expr::Kind::AddressOf);
+            rewrite(e->right, e->kind == Expr::Kind::AddressOf);
+            for (auto& a : e->args) rewrite(a, false);
+        };
+        std::function<void(Stmt*)> rewriteStmt = [&](Stmt* s) {
+            if (!s) return;
+            rewrite(s->varInit, false);
+            rewrite(s->assignValue, false);
+            rewrite(s->condition, false);
+            rewrite(s->returnExpr, false);
+            rewrite(s->expr, false);
+            if (s->assignTarget && s->assignTarget->kind == Expr::Kind::Index && scalar(s->assignTarget->exprType))
+                rewrite(s->assignTarget, false);  // p[i] = x stores through *q
+            else if (s->assignTarget)
+                rewrite(s->assignTarget->kind == Expr::Kind::Var ? s->assignTarget : s->assignTarget->left, false);
+            if (s->assignTarget && s->assignTarget->kind != Expr::Kind::Var)
+                rewrite(s->assignTarget->right, false);
+            for (auto& b : s->blockStmts) rewriteStmt(b.get());
+            for (Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->stepStmt.get()})
+                rewriteStmt(c);
+        };
+        rewrite(loop->condition, false);
+        rewriteStmt(loop->body.get());
+        if (loop->kind == Stmt::Kind::For) rewriteStmt(loop->stepStmt.get());
+        if (pointers.empty()) continue;
+        loop->asmCode = whyNot;  // the bumps below would hide the reason
+
+        // q = q + c right after i = i + c.
+        std::vector<std::unique_ptr<Stmt>> bumps;
+        for (const auto& p : pointers) {
+            const Type* type = trackedType(p.second);
+            auto bump = std::make_unique<Stmt>();
+            bump->kind = Stmt::Kind::Assign;
+            bump->loc = step->loc;
+            bump->assignTarget = makeLocal(p.second, type, step->loc);
+            bump->assignValue = Expr::makeBinary(makeLocal(p.second, type, step->loc), Expr::Op::Add,
+                                                 Expr::makeIntLit(delta, step->loc), step->loc);
+            bump->assignValue->exprType = type;
+            bumps.push_back(std::move(bump));
+        }
+        if (loop->kind == Stmt::Kind::For) {
+            auto block = std::make_unique<Stmt>();
+            block->kind = Stmt::Kind::Block;
+            block->loc = step->loc;
+            block->blockStmts.push_back(std::move(loop->stepStmt));
+            for (auto& b : bumps) block->blockStmts.push_back(std::move(b));
+            loop->stepStmt = std::move(block);
+        } else {
+            auto& list = loop->body->blockStmts;
+            size_t at = 0;
+            while (list[at].get() != step) at++;
+            list.insert(list.begin() + at + 1, std::make_move_iterator(bumps.begin()),
+                        std::make_move_iterator(bumps.end()));
+        }
+        return;  // one induction variable per loop
+    }
+}
+
+bool Optimizer::isSlice(const Type* t) const {
+    if (t->kind != Type::Kind::StructRef) return false;
+    const StructDef* sd = semantic_->getStruct(t->structName, t->ns);
+    return sd && sd->slice;
+}
+
+// s[i] becomes s.ptr[i], which the code generator does not check.
+void Optimizer::uncheck(Expr* index) const {
+    const Type* t = index->left->exprType;
+    auto ptr = Expr::makeMember(std::move(index->left), Symbol("ptr"), index->loc);
+    ptr->exprType = semantic_->getStruct(t->structName, t->ns)->members[0].second;
+    index->left = std::move(ptr);
+}
+
+// For a counter i stepped up by a constant, at the end of the body or as the
+// for step, and a condition i < hi or i <= hi with hi invariant, every
+// s[i] in the body indexes within [i0, hi]. The loop becomes
+//
+//   if (i >= hi or (i >= 0 and hi <= s.len and ...)) { the loop, s[i] as s.ptr[i] }
+//   else { the loop }
+//
+// so the checks are made once, and the checked loop still fails at the
+// element a plain run would.
+bool Optimizer::versionLoop(std::unique_ptr<Stmt>& loop, std::vector<std::unique_ptr<Stmt>>& out) {
+    if (keepChecks_) return false;
+    Stmt* step = loop->stepStmt.get();
+    if (loop->kind == Stmt::Kind::While) {
+        if (!loop->body || loop->body->kind != Stmt::Kind::Block || loop->body->blockStmts.empty()) return false;
+        step = loop->body->blockStmts.back().get();
+    }
+    Symbol iv;
+    int64_t delta;
+    if (!isStep(step, iv, delta) || delta <= 0 || !trackedType(iv) ||
+        trackedType(iv)->kind != Type::Kind::Int ||
+        countStores(loop->body.get(), iv) + countStores(loop->stepStmt.get(), iv) != 1)
+        return false;
+    const Expr* cond = loop->condition.get();
+    if (!cond || cond->kind != Expr::Kind::Binary || (cond->op != Expr::Op::Lt && cond->op != Expr::Op::Le) ||
+        cond->left->kind != Expr::Kind::Var || cond->left->ident != iv)
+        return false;
+    bool inclusive = cond->op == Expr::Op::Le;
+
+    LoopFacts f;
+    bool hasAsm = false;
+    collectAssigned(loop.get(), f.assigned, hasAsm);
+    scanLoop(loop.get(), f);
+    if (hasAsm || f.hasAsm || !invariant(cond->right.get(), f)) return false;
+
+    std::vector<const Expr*> slices;  // one Var of each slice indexed by i
+    auto indexed = [&](const Expr* e) {
+        return e->kind == Expr::Kind::Index && e->left->kind == Expr::Kind::Var && isSlice(e->left->exprType) &&
+               e->right->kind == Expr::Kind::Var && e->right->ident == iv && !f.assigned.count(e->left->ident) &&
+               !addressTaken_.count(e->left->ident) && !storesInto(loop.get(), e->left->ident);
+    };
+    std::function<void(const Expr*)> find = [&](const Expr* e) {
+        if (!e) return;
+        if (indexed(e) && std::none_of(slices.begin(), slices.end(),
+                                       [&](const Expr* s) { return s->ident == e->left->ident; }))
+            slices.push_back(e->left.get());
+        find(e->left.get());
+        find(e->right.get());
+        for (const auto& a : e->args) find(a.get());
+    };
+    forEachExpr(loop->body.get(), [&](std::unique_ptr<Expr>& e) { find(e.get()); });
+    if (slices.empty()) return false;
+
+    // The guard, from i as it is on entry.
+    SourceLoc loc = loop->loc;
+    const Type* boolTy = TypeTable::instance().get(Type::Kind::Bool);
+    auto binary = [&](std::unique_ptr<Expr> l, Expr::Op op, std::unique_ptr<Expr> r) {
+        auto e = Expr::makeBinary(std::move(l), op, std::move(r), loc);
+        e->exprType = boolTy;
+        return e;
+    };
+    auto counter = [&] { return makeLocal(iv, trackedType(iv), loc); };
+    auto bound = [&] { return cloneExpr(cond->right.get()); };
+    std::unique_ptr<Expr> inRange = binary(counter(), Expr::Op::Ge, Expr::makeIntLit(0, loc));
+    for (const Expr* s : slices) {
+        auto len = Expr::makeMember(cloneExpr(s), Symbol("len"), loc);
+        len->exprType = TypeTable::instance().get(Type::Kind::Int);
+        inRange = binary(std::move(inRange), Expr::Op::And,
+                         binary(bound(), inclusive ? Expr::Op::Lt : Expr::Op::Le, std::move(len)));
+    }
+    auto guard = binary(binary(counter(), inclusive ? Expr::Op::Gt : Expr::Op::Ge, bound()), Expr::Op::Or,
+                        std::move(inRange));
+
+    // The copy reads through the pointers.
+    std::unique_ptr<Stmt> fast = cloneStmt(loop.get());
+    std::function<void(std::unique_ptr<Expr>&)> unchecked = [&](std::unique_ptr<Expr>& e) {
+        if (!e) return;
+        if (indexed(e.get())) uncheck(e.get());
+        unchecked(e->left);
+        unchecked(e->right);
+        for (auto& a : e->args) unchecked(a);
+    };
+    forEachExpr(fast->body.get(), unchecked);
+
+    if (loop->kind == Stmt::Kind::For && loop->initStmt) {
+        out.push_back(std::move(loop->initStmt));
+        fast->initStmt.reset();
+    }
+    auto branch = [&](std::unique_ptr<Stmt> l) {
+        auto block = std::make_unique<Stmt>();
+        block->kind = Stmt::Kind::Block;
+        block->loc = loc;
+        optimizeLoop(std::move(l), block->blockStmts);
+        return block;
+    };
+    auto check = std::make_unique<Stmt>();
+    check->kind = Stmt::Kind::If;
+    check->loc = loc;
+    check->condition = std::move(guard);
+    check->thenBranch = branch(std::move(fast));
+    check->elseBranch = branch(std::move(loop));
+    out.push_back(std::move(check));
+    return true;
+}
+
+// What range analysis knows at a point of a function: bounds on int locals,
+// the lengths of slice locals, int locals holding a slice's length, and
+// pairs (i, s) with 0 <= i < s.len. Only locals whose address is never
+// taken are tracked, so only stores naming them change them.
+struct Optimizer::Ranges {
+    std::unordered_map<Symbol, Range> value;
+    std::unordered_map<Symbol, int64_t> length;
+    std::unordered_map<Symbol, Symbol> lengthOf;
+    std::vector<std::pair<Symbol, Symbol>> inBounds;
+
+    void forget(Symbol name) {
+        value.erase(name);
+        length.erase(name);
+        lengthOf.erase(name);
+        for (auto it = lengthOf.begin(); it != lengthOf.end();)
+            it = it->second == name ? lengthOf.erase(it) : std::next(it);
+        inBounds.erase(std::remove_if(inBounds.begin(), inBounds.end(),
+                                      [&](const std::pair<Symbol, Symbol>& p) {
+                                          return p.first == name || p.second == name;
+                                      }),
+                       inBounds.end());
+    }
+
+    // Where two paths join: the hull of the bounds, and what both agree on.
+    void keepCommon(const Ranges& o) {
+        for (auto it = value.begin(); it != value.end();) {
+            auto other = o.value.find(it->first);
+            if (other == o.value.end()) {
+                it = value.erase(it);
+                continue;
+            }
+            it->second.lo = std::min(it->second.lo, other->second.lo);
+            it->second.hi = std::max(it->second.hi, other->second.hi);
+            ++it;
+        }
+        for (auto it = length.begin(); it != length.end();) {
+            auto other = o.length.find(it->first);
+            it = other == o.length.end() || other->second != it->second ? length.erase(it) : std::next(it);
+        }
+        for (auto it = lengthOf.begin(); it != lengthOf.end();) {
+            auto other = o.lengthOf.find(it->first);
+            it = other == o.lengthOf.end() || other->second != it->second ? lengthOf.erase(it) : std::next(it);
+        }
+        inBounds.erase(std::remove_if(inBounds.begin(), inBounds.end(),
+                                      [&](const std::pair<Symbol, Symbol>& p) {
+                                          return std::find(o.inBounds.begin(), o.inBounds.end(), p) ==
+                                                 o.inBounds.end();
+                                      }),
+                       inBounds.end());
+    }
+};
+
+bool Optimizer::isSliceLocal(const Expr* e) const {
+    return e->kind == Expr::Kind::Var && isSlice(e->exprType) && !addressTaken_.count(e->ident) &&
+           current_->locals.count(e->ident);
+}
+
+// Bounds on the value of int expression e; an operation that may wrap
+// leaves them unknown.
+Optimizer::Range Optimizer::rangeOf(const Expr* e, const Ranges& r) const {
+    auto negate = [](Range a) {
+        if (a.lo == INT64_MIN) return Range{a.hi == INT64_MAX ? INT64_MIN : -a.hi, INT64_MAX};
+        return Range{a.hi == INT64_MAX ? INT64_MIN : -a.hi, -a.lo};
+    };
+    auto add = [](Range a, Range b) {
+        Range c;
+        if (a.lo != INT64_MIN && b.lo != INT64_MIN && __builtin_add_overflow(a.lo, b.lo, &c.lo)) c.lo = INT64_MIN;
+        if (a.hi != INT64_MAX && b.hi != INT64_MAX && __builtin_add_overflow(a.hi, b.hi, &c.hi)) c.hi = INT64_MAX;
+        return c;
+    };
+    auto multiply = [](Range a, Range b) {
+        if (a.lo == INT64_MIN || a.hi == INT64_MAX || b.lo == INT64_MIN || b.hi == INT64_MAX) return Range();
+        int64_t p[4];
+        if (__builtin_mul_overflow(a.lo, b.lo, &p[0]) || __builtin_mul_overflow(a.lo, b.hi, &p[1]) ||
+            __builtin_mul_overflow(a.hi, b.lo, &p[2]) || __builtin_mul_overflow(a.hi, b.hi, &p[3]))
+            return Range();
+        return Range{*std::min_element(p, p + 4), *std::max_element(p, p + 4)};
+    };
+    switch (e->kind) {
+        case Expr::Kind::IntLit:
+            return {e->intVal, e->intVal};
+        case Expr::Kind::Var: {
+            auto it = r.value.find(e->ident);
+            return it == r.value.end() ? Range() : it->second;
+        }
+        case Expr::Kind::Member: {
+            if (e->member != Symbol("len") || !isSliceLocal(e->left.get())) return {};
+            auto it = r.length.find(e->left->ident);
+            return it == r.length.end() ? Range() : Range{it->second, it->second};
+        }
+        case Expr::Kind::Unary:
+            if (e->op != Expr::Op::Neg) return {};
+            return negate(rangeOf(e->right.get(), r));
+        case Expr::Kind::Binary: {
+            if (e->exprType->kind != Type::Kind::Int) return {};
+            Range a = rangeOf(e->left.get(), r), b = rangeOf(e->right.get(), r);
+            switch (e->op) {
+                case Expr::Op::Add: return add(a, b);
+                case Expr::Op::Sub: return add(a, negate(b));
+                case Expr::Op::Mul: return multiply(a, b);
+                case Expr::Op::Div:
+                    if (a.lo < 0 || b.lo != b.hi || b.lo <= 0) return {};
+                    return {a.lo / b.lo, a.hi / b.lo};
+                case Expr::Op::Mod:
+                    if (a.lo < 0 || b.lo != b.hi || b.lo <= 0) return {};
+                    return {0, std::min(a.hi, b.lo - 1)};
+                default:
+                    return {};
+            }
+        }
+        default:
+            return {};
+    }
+}
+
+// The slice whose length e is, if range analysis knows one.
+Symbol Optimizer::lengthIn(const Expr* e, const Ranges& r) const {
+    if (e->kind == Expr::Kind::Member && e->member == Symbol("len") && isSliceLocal(e->left.get()))
+        return e->left->ident;
+    if (e->kind != Expr::Kind::Var) return Symbol();
+    auto it = r.lengthOf.find(e->ident);
+    return it == r.lengthOf.end() ? Symbol() : it->second;
+}
+
+// Narrows r by cond being true: the comparisons of locals it and-s together.
+void Optimizer::assume(const Expr* cond, Ranges& r) const {
+    std::vector<const Expr*> terms;
+    std::function<void(const Expr*)> split = [&](const Expr* e) {
+        if (e->kind == Expr::Kind::Binary && e->op == Expr::Op::And) {
+            split(e->left.get());
+            split(e->right.get());
+        } else if (e->kind == Expr::Kind::Binary) {
+            terms.push_back(e);
+        }
+    };
+    split(cond);
+    // x op y with x a tracked int local, mirrored when only y is one.
+    auto normal = [&](const Expr* t, const Expr*& x, const Expr*& y, Expr::Op& op) {
+        x = t->left.get(), y = t->right.get(), op = t->op;
+        auto local = [&](const Expr* e) {
+            return e->kind == Expr::Kind::Var && trackedType(e->ident) &&
+                   trackedType(e->ident)->kind == Type::Kind::Int;
+        };
+        if (!local(x) && local(y)) {
+            std::swap(x, y);
+            if (op == Expr::Op::Lt) op = Expr::Op::Gt;
+            else if (op == Expr::Op::Gt) op = Expr::Op::Lt;
+            else if (op == Expr::Op::Le) op = Expr::Op::Ge;
+            else if (op == Expr::Op::Ge) op = Expr::Op::Le;
+        }
+        return local(x);
+    };
+    for (const Expr* t : terms) {
+        const Expr *x, *y;
+        Expr::Op op;
+        if (!normal(t, x, y, op)) continue;
+        Range b = rangeOf(y, r);
+        Range& v = r.value[x->ident];
+        if (op == Expr::Op::Le || (op == Expr::Op::Lt && b.hi != INT64_MAX && b.hi != INT64_MIN))
+            v.hi = std::min(v.hi, op == Expr::Op::Lt ? b.hi - 1 : b.hi);
+        if (op == Expr::Op::Ge || (op == Expr::Op::Gt && b.lo != INT64_MIN && b.lo != INT64_MAX))
+            v.lo = std::max(v.lo, op == Expr::Op::Gt ? b.lo + 1 : b.lo);
+        if (op == Expr::Op::Eq) v = {std::max(v.lo, b.lo), std::min(v.hi, b.hi)};
+    }
+    for (const Expr* t : terms) {
+        const Expr *x, *y;
+        Expr::Op op;
+        if (!normal(t, x, y, op) || op != Expr::Op::Lt || r.value[x->ident].lo < 0) continue;
+        Symbol s = lengthIn(y, r);
+        if (!s.empty()) r.inBounds.push_back({x->ident, s});
+    }
+}
+
+// name = value: what is known of name afterwards.
+void Optimizer::assign(Symbol name, const Expr* value, Ranges& r) const {
+    if (!value) {
+        r.forget(name);
+        return;
+    }
+    const Type* t = trackedType(name);
+    if (t && t->kind == Type::Kind::Int) {
+        Range v = rangeOf(value, r);
+        Symbol s = value->kind == Expr::Kind::Member ? lengthIn(value, r) : Symbol();
+        r.forget(name);
+        if (v.lo != INT64_MIN || v.hi != INT64_MAX) r.value[name] = v;
+        if (!s.empty()) r.lengthOf[name] = s;
+        return;
+    }
+    int64_t length = -1;
+    auto exact = [&](const Expr* e, int64_t& n) {
+        Range v = rangeOf(e, r);
+        n = v.lo;
+        return v.lo == v.hi;
+    };
+    int64_t lo, hi;
+    if (value->kind == Expr::Kind::NewArray && exact(value->left.get(), hi) && hi >= 0) length = hi;
+    if (value->kind == Expr::Kind::Slice && exact(value->args[0].get(), lo) && exact(value->args[1].get(), hi) &&
+        lo >= 0 && hi >= lo)
+        length = hi - lo;
+    if (value->kind == Expr::Kind::Var && value->ident != name && r.length.count(value->ident))
+        length = r.length.at(value->ident);
+    r.forget(name);
+    if (length >= 0 && current_->locals.count(name) && !addressTaken_.count(name)) r.length[name] = length;
+}
+
+// Rewrites the checked s[i] under e that range analysis shows in range.
+// Those that run whenever e does (sure) show their index in range for
+// what follows, as the program stops otherwise.
+void Optimizer::checkIndexes(Expr* e, Ranges& r, std::vector<std::pair<Symbol, Symbol>>& learned,
+                             bool sure) const {
+    if (!e) return;
+    bool shortCircuit = e->kind == Expr::Kind::Binary && (e->op == Expr::Op::And || e->op == Expr::Op::Or);
+    checkIndexes(e->left.get(), r, learned, sure);
+    checkIndexes(e->right.get(), r, learned, sure && !shortCircuit);
+    for (const auto& a : e->args) checkIndexes(a.get(), r, learned, sure);
+    if (e->kind != Expr::Kind::Index || !isSliceLocal(e->left.get())) return;
+    Symbol s = e->left->ident;
+    const Expr* i = e->right.get();
+    Range v = rangeOf(i, r);
+    auto len = r.length.find(s);
+    bool inRange = (v.lo >= 0 && len != r.length.end() && v.hi < len->second) ||
+                   (i->kind == Expr::Kind::Var &&
+                    std::find(r.inBounds.begin(), r.inBounds.end(), std::make_pair(i->ident, s)) !=
+                        r.inBounds.end());
+    if (inRange) uncheck(e);
+    else if (sure && i->kind == Expr::Kind::Var && trackedType(i->ident)) learned.push_back({i->ident, s});
+}
+
+void Optimizer::removeBoundsChecks(Stmt* s, Ranges& r) {
+    if (!s) return;
+    std::vector<std::pair<Symbol, Symbol>> learned;
+    auto settle = [&] {
+        for (const auto& p : learned)
+            if (std::find(r.inBounds.begin(), r.inBounds.end(), p) == r.inBounds.end()) r.inBounds.push_back(p);
+        learned.clear();
+    };
+    switch (s->kind) {
+        case Stmt::Kind::Block:
+        case Stmt::Kind::Unsafe:
+            for (auto& b : s->blockStmts) removeBoundsChecks(b.get(), r);
+            removeBoundsChecks(s->body.get(), r);
+            break;
+        case Stmt::Kind::VarDecl:
+            checkIndexes(s->varInit.get(), r, learned, true);
+            settle();
+            assign(s->varName, s->varInit.get(), r);
+            break;
+        case Stmt::Kind::Assign: {
+            Expr* target = s->assignTarget.get();
+            checkIndexes(target, r, learned, true);
+            // s[i] = x finds the element's address before evaluating x.
+            if (target->kind == Expr::Kind::Index) settle();
+            checkIndexes(s->assignValue.get(), r, learned, true);
+            settle();
+            if (target->kind == Expr::Kind::Var) {
+                assign(target->ident, s->assignValue.get(), r);
+                break;
+            }
+            const Expr* root = target;
+            while (root->kind == Expr::Kind::Member) root = root->left.get();
+            if (root != target && root->kind == Expr::Kind::Var) r.forget(root->ident);
+            break;
+        }
+        case Stmt::Kind::If: {
+            checkIndexes(s->condition.get(), r, learned, true);
+            settle();
+            Ranges other = r;
+            assume(s->condition.get(), r);
+            removeBoundsChecks(s->thenBranch.get(), r);
+            removeBoundsChecks(s->elseBranch.get(), other);
+            r.keepCommon(other);
+            break;
+        }
+        case Stmt::Kind::While:
+        case Stmt::Kind::For: {
+            removeBoundsChecks(s->initStmt.get(), r);
+            // Only what the loop leaves alone holds on every iteration.
+            Ranges entry = r;
+            std::unordered_set<Symbol> assigned;
+            bool hasAsm = false;
+            collectAssigned(s, assigned, hasAsm);
+            for (Symbol name : assigned) r.forget(name);
+            std::vector<Symbol> stored;
+            for (const auto& l : r.length) stored.push_back(l.first);
+            for (const auto& p : r.inBounds) stored.push_back(p.second);
+            for (const auto& p : r.lengthOf) stored.push_back(p.second);
+            for (Symbol name : stored)
+                if (storesInto(s, name)) r.forget(name);
+            Ranges body = r;
+            checkIndexes(s->condition.get(), body, learned, true);
+            for (const auto& p : learned) body.inBounds.push_back(p);
+            learned.clear();
+            // A counter stepped up once per iteration stays within its
+            // value on entry and the bound of the condition.
+            Stmt* step = s->stepStmt.get();
+            if (s->kind == Stmt::Kind::While && s->body && s->body->kind == Stmt::Kind::Block &&
+                !s->body->blockStmts.empty())
+                step = s->body->blockStmts.back().get();
+            Symbol iv;
+            int64_t delta;
+            const Expr* cond = s->condition.get();
+            if (isStep(step, iv, delta) && delta > 0 && trackedType(iv) &&
+                trackedType(iv)->kind == Type::Kind::Int &&
+                countStores(s->body.get(), iv) + countStores(s->stepStmt.get(), iv) == 1 && cond &&
+                cond->kind == Expr::Kind::Binary && (cond->op == Expr::Op::Lt || cond->op == Expr::Op::Le) &&
+                cond->left->kind == Expr::Kind::Var && cond->left->ident == iv && entry.value.count(iv)) {
+                const Expr* hi = cond->right.get();
+                Symbol len = cond->op == Expr::Op::Lt ? lengthIn(hi, r) : Symbol();
+                if (hi->kind == Expr::Kind::Member && (assigned.count(len) || storesInto(s, len))) len = Symbol();
+                // Past a bound this close to the largest int the counter
+                // could wrap; a slice's length is never that large.
+                Range bound = rangeOf(hi, r);
+                bool noWrap = !len.empty() || bound.hi <= INT64_MAX - delta;
+                Range& v = body.value[iv];
+                v = {noWrap ? entry.value[iv].lo : INT64_MIN, INT64_MAX};
+                if (noWrap && bound.hi != INT64_MAX && bound.hi != INT64_MIN)
+                    v.hi = cond->op == Expr::Op::Lt ? bound.hi - 1 : bound.hi;
+                if (len.empty() || v.lo < 0) len = Symbol();
+                if (!len.empty()) body.inBounds.push_back({iv, len});
+            }
+            removeBoundsChecks(s->body.get(), body);
+            removeBoundsChecks(s->stepStmt.get(), body);
+            break;
+        }
+        case Stmt::Kind::Return:
+            checkIndexes(s->returnExpr.get(), r, learned, true);
+            break;
+        case Stmt::Kind::ExprStmt:
+            checkIndexes(s->expr.get(), r, learned, true);
+            settle();
+            break;
+        default:
+            break;
+    }
+}
+
+void Optimizer::optimizeLoop(std::unique_ptr<Stmt> loop, std::vector<std::unique_ptr<Stmt>>& out) {
+    LoopFacts f;
+    bool hasAsm = false;
+    collectAssigned(loop.get(), f.assigned, hasAsm);
+    scanLoop(loop.get(), f);
+    if (hasAsm || f.hasAsm) {
+        out.push_back(std::move(loop));
+        return;
+    }
+
+    // The condition runs before anything else in the loop. The body's
+    // statements up to the first that may return run on every iteration,
+    // but only when there is one: hoisting from them needs a guard.
+    std::unique_ptr<Expr> guard = hasSideEffects(loop->condition.get()) ? nullptr : cloneExpr(loop->condition.get());
+    hoist(loop->condition, f);
+    if (guard && loop->body) {
+        f.inBody = true;
+        Stmt* body = loop->body.get();
+        if (body->kind == Stmt::Kind::Block) {
+            for (auto& s : body->blockStmts) {
+                hoistFromStmt(s.get(), f);
+                if (containsReturn(s.get())) break;
+            }
+        } else {
+            hoistFromStmt(body, f);
+        }
+    }
+    reduceStrength(loop.get(), f);
+    if (f.preheader.empty()) {
+        out.push_back(std::move(loop));
+        return;
+    }
+
+    // A for loop's initializer runs before the preheader and the guard.
+    if (loop->kind == Stmt::Kind::For && loop->initStmt) out.push_back(std::move(loop->initStmt));
+    std::vector<std::unique_ptr<Stmt>>* dest = &out;
+    if (f.fromBody) {
+        auto then = std::make_unique<Stmt>();
+        then->kind = Stmt::Kind::Block;
+        then->loc = loop->loc;
+        auto check = std::make_unique<Stmt>();
+        check->kind = Stmt::Kind::If;
+        check->loc = loop->loc;
+        check->condition = std::move(guard);
+        check->thenBranch = std::move(then);
+        out.push_back(std::move(check));
+        dest = &out.back()->thenBranch->blockStmts;
+    }
+    for (auto& s : f.preheader) dest->push_back(std::move(s));
+    dest->push_back(std::move(loop));
+}
+
 void Optimizer::optimizeExpr(Expr* expr) {
     if (!expr) return;
     switch (expr->kind) {
         case Expr::Kind::Binary: {
             optimizeExpr(expr->left.get());
             optimizeExpr(expr->right.get());
-
-            // Constant folding
-            if (expr->left->kind == Expr::Kind::IntLit && expr->right->kind == Expr::Kind::IntLit) {
-                int64_t l = expr->left->intVal;
-                int64_t r = expr->right->intVal;
-                if (expr->op == "+") { expr->kind = Expr::Kind::IntLit; expr->intVal = l + r; expr->left.reset(); expr->right.reset(); }
-                else if (expr->op == "-") { expr->kind = Expr::Kind::IntLit; expr->intVal = l - r; expr->left.reset(); expr->right.reset(); }
-                else if (expr->op == "*") { expr->kind = Expr::Kind::IntLit; expr->intVal = l * r; expr->left.reset(); expr->right.reset(); }
-                else if (expr->op == "/" && r != 0) { expr->kind = Expr::Kind::IntLit; expr->intVal = l / r; expr->left.reset(); expr->right.reset(); }
-            }
+            foldBinary(expr);
             break;
         }
         case Expr::Kind::Unary:
             optimizeExpr(expr->right.get());
+            foldUnary(expr);
+            break;
+        case Expr::Kind::Var: {
+            auto it = known_.find(expr->ident);
+            if (it == known_.end()) break;
+            const Known& k = it->second;
+            expr->kind = k.kind;
+            expr->intVal = k.intVal;
+            expr->floatVal = k.floatVal;
+            expr->boolVal = k.boolVal;
+            if (k.kind == Expr::Kind::Var) expr->ident = k.var;
             break;
+        }
         case Expr::Kind::Call:
             for (auto& a : expr->args) optimizeExpr(a.get());
+            if (inlineCall(expr)) {
+                // Fold the substituted arguments into the callee's expression
+                // and inline the calls it makes.
+                optimizeExpr(expr);
+                inlining_.pop_back();
+            }
             break;
         case Expr::Kind::Member:
             optimizeExpr(expr->left.get());
             break;
         default:
+            optimizeExpr(expr->left.get());
+            optimizeExpr(expr->right.get());
+            for (auto& a : expr->args) optimizeExpr(a.get());
             break;
     }
 }
 
+bool Optimizer::notInlined(const Expr* call, const std::string& why) {
+    // Calls inside inlined code are reported where the callee is optimized.
+    if (remarkMissed_ && inlining_.empty())
+        remarks_.push_back(SourceManager::instance().formatRemark(
+            call->loc, "'" + call->ident.str() + "' not inlined into '" + current_->name.str() + "': " + why));
+    return false;
+}
+
+bool Optimizer::inlineCall(Expr* call) {
+    if (!semantic_ || !current_) return false;
+    FuncSymbol* fs = semantic_->getFunc(call->ident, call->ns);
+    if (!fs && call->ns.empty()) fs = semantic_->getFunc(call->ident, current_->ns);
+    if (!fs || (fs->decl && fs->decl->isExtern) || (!fs->decl && fs->unit.empty())) return false;  // runtime and C
+    if (fs->precompiled || !fs->decl || !fs->decl->body) return notInlined(call, "its module was loaded from the cache");
+    const FuncDecl* callee = fs->decl;
+    if (callee->noInline) return notInlined(call, "it is marked @noinline");
+    if (fs == current_ || std::find(inlining_.begin(), inlining_.end(), fs) != inlining_.end())
+        return notInlined(call, "it is recursive");
+    if (inlining_.size() >= kMaxInlineDepth)
+        return notInlined(call, "calls are inlined at most " + std::to_string(kMaxInlineDepth) + " levels deep");
+
+    // Without statement expressions only a body of one return statement can
+    // take the call's place.
+    const Stmt* body = callee->body.get();
+    if (body->kind == Stmt::Kind::Block && body->blockStmts.size() == 1) body = body->blockStmts[0].get();
+    if (body->kind != Stmt::Kind::Return || !body->returnExpr)
+        return notInlined(call, "its body is not a single return statement");
+    const Expr* e = body->returnExpr.get();
+    int cost = countNodes(e);
+    if (cost > kInlineCost && !callee->forceInline)
+        return notInlined(call, "cost " + std::to_string(cost) + " exceeds the threshold of " +
+                                    std::to_string(kInlineCost) + " (mark it @inline to override)");
+    if (e->exprType != fs->returnType) return notInlined(call, "its return value is converted");
+    if (fs->returnType->kind == Type::Kind::StructRef) return notInlined(call, "it returns a struct");
+    if (call->args.size() != fs->paramTypes.size() || callee->params.size() != fs->paramTypes.size()) return false;
+
+    ParamUses uses(callee->params);
+    uses.scan(e);
+    if (uses.foreign) return notInlined(call, "it reads a name other than its parameters");
+    if (uses.escapes) return notInlined(call, "it takes the address of a parameter");
+    // The call's own node keeps the caller's view of the result type.
+    if (fs->ns != current_->ns) {
+        bool local = unqualifiedStruct(e->targetType) || needsCalleeNamespace(e->left.get(), uses) ||
+                     needsCalleeNamespace(e->right.get(), uses);
+        for (const auto& a : e->args) local |= needsCalleeNamespace(a.get(), uses);
+        if (local) return notInlined(call, "its body uses a struct of its module by its unqualified name");
+        uses.ns = fs->ns;
+        collectModuleCalls(e, *semantic_, uses);
+    }
+    // An argument that may stop the program must still be evaluated, and
+    // before every later argument's check and the body's own. Where its
+    // parameter is used once, first, that is where the use is; otherwise
+    // such arguments go to temporaries ahead of the statement whose value
+    // the call is, so nothing else in it runs first.
+    bool toTemps = false;
+    int failAt = -1;
+    size_t firstFailing = call->args.size();
+    for (size_t i = 0; i < call->args.size(); i++) {
+        if (!mayFail(call->args[i].get())) continue;
+        firstFailing = std::min(firstFailing, i);
+        int at = (int)(std::find(uses.order.begin(), uses.order.end(), (int)i) - uses.order.begin());
+        toTemps |= uses.count[i] != 1 || uses.late[i] || at < failAt;
+        failAt = at;
+    }
+    if (toTemps && call != stmtValue_)
+        return notInlined(call, "argument " + std::to_string(firstFailing + 1) + " may fail");
+    // Arguments are evaluated where their parameter is used rather than
+    // before the call: once per use, and after the calls the body makes.
+    bool calls = hasSideEffects(e);
+    for (size_t i = 0; i < call->args.size(); i++) {
+        const Expr* a = call->args[i].get();
+        std::string arg = "argument " + std::to_string(i + 1);
+        if (!sameType(a->exprType, fs->paramTypes[i], fs->ns)) return notInlined(call, arg + " is converted to its parameter type");
+        if (hasSideEffects(a)) return notInlined(call, arg + " has side effects");
+        if (toTemps && mayFail(a)) {
+            if (!scalar(a->exprType)) return notInlined(call, arg + " may fail");
+            continue;
+        }
+        if (uses.count[i] > 1 && !trivialArg(a)) return notInlined(call, arg + " would be evaluated more than once");
+        bool stable = a->kind == Expr::Kind::IntLit || a->kind == Expr::Kind::FloatLit ||
+                      a->kind == Expr::Kind::BoolLit || a->kind == Expr::Kind::StringLit ||
+                      (a->kind == Expr::Kind::Var && !addressTaken_.count(a->ident)) ||
+                      (a->kind == Expr::Kind::AddressOf && a->right->kind == Expr::Kind::Var);
+        if (calls && uses.count[i] > 0 && !stable)
+            return notInlined(call, arg + " could change during the calls in its body");
+    }
+    for (size_t i = 0; toTemps && i < call->args.size(); i++) {
+        std::unique_ptr<Expr>& a = call->args[i];
+        if (!mayFail(a.get())) continue;
+        const Type* type = a->exprType;
+        SourceLoc loc = a->loc;
+        Symbol temp = newTemp(type);
+        stmtTemps_.push_back(makeDecl(temp, std::move(a)));
+        a = makeLocal(temp, type, loc);
+    }
+
+    auto inlined = cloneExpr(e, &uses, &call->args);
+    inlined->loc = call->loc;
+    inlined->exprType = call->exprType;
+    if (remarkInlined_)
+        remarks_.push_back(SourceManager::instance().formatRemark(
+            call->loc, "'" + call->ident.str() + "' inlined into '" + current_->name.str() + "' (cost " +
+                           std::to_string(cost) + ")"));
+    *call = std::move(*inlined);
+    inlining_.push_back(fs);
+    return true;
+}
+
+// The expression s evaluates first and as a whole, if any: calls in it
+// may put arguments in temporaries set just before s.
+Expr* Optimizer::valueOf(Stmt* s) {
+    switch (s->kind) {
+        case Stmt::Kind::VarDecl:
+            return s->varInit.get();
+        case Stmt::Kind::Assign:
+            return s->assignTarget->kind == Expr::Kind::Var ? s->assignValue.get() : nullptr;
+        case Stmt::Kind::Return:
+            return s->returnExpr.get();
+        case Stmt::Kind::ExprStmt:
+            return s->expr.get();
+        default:
+            return nullptr;
+    }
+}
+
 void Optimizer::optimizeStmt(Stmt* stmt) {
     if (!stmt) return;
     switch (stmt->kind) {
@@ -42,7 +1604,11 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
             bool returned = false;
             for (auto& s : stmt->blockStmts) {
                 if (returned) continue; // Dead code elimination
+                stmtValue_ = valueOf(s.get());
                 optimizeStmt(s.get());
+                stmtValue_ = nullptr;
+                for (auto& t : stmtTemps_) optimized.push_back(std::move(t));
+                stmtTemps_.clear();
 
                 // Simplify If statements in blocks
                 if (s->kind == Stmt::Kind::If && s->condition->kind == Expr::Kind::BoolLit) {
@@ -64,7 +1630,14 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
                     continue;
                 }
 
+                if (s->kind == Stmt::Kind::While && s->condition->kind == Expr::Kind::BoolLit &&
+                    !s->condition->boolVal)
+                    continue;
                 if (s->kind == Stmt::Kind::Return) returned = true;
+                if ((s->kind == Stmt::Kind::While || s->kind == Stmt::Kind::For) && current_) {
+                    if (!versionLoop(s, optimized)) optimizeLoop(std::move(s), optimized);
+                    continue;
+                }
                 optimized.push_back(std::move(s));
             }
             stmt->blockStmts = std::move(optimized);
@@ -72,10 +1645,15 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
         }
         case Stmt::Kind::VarDecl:
             optimizeExpr(stmt->varInit.get());
+            learn(stmt->varName, stmt->varInit.get());
             break;
         case Stmt::Kind::Assign:
-            optimizeExpr(stmt->assignTarget.get());
             optimizeExpr(stmt->assignValue.get());
+            if (stmt->assignTarget->kind == Expr::Kind::Var) {
+                learn(stmt->assignTarget->ident, stmt->assignValue.get());
+            } else {
+                optimizeExpr(stmt->assignTarget.get());
+            }
             break;
         case Stmt::Kind::If: {
             optimizeExpr(stmt->condition.get());
@@ -89,21 +1667,34 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
                     if (stmt->elseBranch) optimizeStmt(stmt->elseBranch.get());
                 }
             } else {
+                std::unordered_map<Symbol, Known> before = known_;
                 optimizeStmt(stmt->thenBranch.get());
+                std::unordered_map<Symbol, Known> afterThen = std::move(known_);
+                known_ = std::move(before);
                 if (stmt->elseBranch) optimizeStmt(stmt->elseBranch.get());
+                keepAgreeing(afterThen);
             }
             break;
         }
-        case Stmt::Kind::While:
+        case Stmt::Kind::While: {
+            forgetAssignedIn(stmt);
+            std::unordered_map<Symbol, Known> head = known_;
             optimizeExpr(stmt->condition.get());
             optimizeStmt(stmt->body.get());
+            known_ = std::move(head);
             break;
-        case Stmt::Kind::For:
+        }
+        case Stmt::Kind::For: {
             optimizeStmt(stmt->initStmt.get());
+            forgetAssignedIn(stmt->body.get());
+            forgetAssignedIn(stmt->stepStmt.get());
+            std::unordered_map<Symbol, Known> head = known_;
             optimizeExpr(stmt->condition.get());
-            optimizeStmt(stmt->stepStmt.get());
             optimizeStmt(stmt->body.get());
+            optimizeStmt(stmt->stepStmt.get());
+            known_ = std::move(head);
             break;
+        }
         case Stmt::Kind::Return:
             optimizeExpr(stmt->returnExpr.get());
             break;
@@ -114,17 +1705,163 @@ void Optimizer::optimizeStmt(Stmt* stmt) {
             optimizeStmt(stmt->body.get());
             break;
         case Stmt::Kind::Asm:
+            known_.clear();
             break;
     }
 }
 
+// The return statements under s that end the function when s does and
+// return a call of the function itself, with arguments that can be
+// assigned to its parameters.
+void Optimizer::findTailCalls(Stmt* s, bool last, std::vector<Stmt*>& out) const {
+    if (!s || !last) return;
+    switch (s->kind) {
+        case Stmt::Kind::Block:
+            if (!s->blockStmts.empty()) findTailCalls(s->blockStmts.back().get(), true, out);
+            break;
+        case Stmt::Kind::Unsafe:
+            findTailCalls(s->body.get(), true, out);
+            break;
+        case Stmt::Kind::If:
+            findTailCalls(s->thenBranch.get(), true, out);
+            findTailCalls(s->elseBranch.get(), true, out);
+            break;
+        case Stmt::Kind::Return: {
+            const Expr* call = s->returnExpr.get();
+            if (!call || call->kind != Expr::Kind::Call) return;
+            FuncSymbol* fs = semantic_->getFunc(call->ident, call->ns);
+            if (!fs && call->ns.empty()) fs = semantic_->getFunc(call->ident, current_->ns);
+            const FuncDecl* f = current_->decl;
+            if (fs != current_ || call->args.size() != f->params.size()) return;
+            for (size_t i = 0; i < call->args.size(); i++) {
+                const Expr* a = call->args[i].get();
+                if (a->kind == Expr::Kind::Var && a->ident == f->params[i].name) continue;
+                if (!scalar(current_->paramTypes[i]) || a->exprType != current_->paramTypes[i]) return;
+            }
+            out.push_back(s);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Self tail calls become a loop around the body. Each return f(x) found
+// above turns into the assignment of x to the parameters and another
+// iteration of
+//
+//   let .again = true;
+//   while (.again) { .again = false; body }
+//
+// with .again set by the calls; when the body ends in such a call nothing
+// else reaches its end and the loop is while (true) without the flag.
+void Optimizer::loopTailCalls(FuncDecl& f) {
+    Stmt* body = f.body.get();
+    std::unordered_set<Symbol> assigned;
+    bool hasAsm = false;
+    collectAssigned(body, assigned, hasAsm);
+    // An address taken in one call would see the locals of the next.
+    if (hasAsm || !addressTaken_.empty() || body->kind != Stmt::Kind::Block) return;
+    std::vector<Stmt*> calls;
+    findTailCalls(body, true, calls);
+    if (calls.empty()) return;
+
+    const Type* boolTy = TypeTable::instance().get(Type::Kind::Bool);
+    bool always = std::find(calls.begin(), calls.end(), body->blockStmts.back().get()) != calls.end();
+    Symbol again = always ? Symbol() : newTemp(boolTy);
+    auto store = [&](Symbol name, const Type* type, std::unique_ptr<Expr> value, SourceLoc loc) {
+        auto s = std::make_unique<Stmt>();
+        s->kind = Stmt::Kind::Assign;
+        s->loc = loc;
+        s->assignTarget = makeLocal(name, type, loc);
+        s->assignValue = std::move(value);
+        return s;
+    };
+    auto flag = [&](bool v, SourceLoc loc) {
+        auto lit = Expr::makeBoolLit(v, loc);
+        lit->exprType = boolTy;
+        return lit;
+    };
+    for (Stmt* s : calls) {
+        std::unique_ptr<Expr> call = std::move(s->returnExpr);
+        std::vector<size_t> changed;
+        for (size_t i = 0; i < call->args.size(); i++)
+            if (call->args[i]->kind != Expr::Kind::Var || call->args[i]->ident != f.params[i].name)
+                changed.push_back(i);
+        s->kind = Stmt::Kind::Block;
+        // Every argument is evaluated before any parameter changes.
+        std::vector<std::unique_ptr<Stmt>> stores;
+        for (size_t i : changed) {
+            const Type* t = current_->paramTypes[i];
+            std::unique_ptr<Expr> value = std::move(call->args[i]);
+            if (changed.size() > 1) {
+                Symbol temp = newTemp(t);
+                s->blockStmts.push_back(makeDecl(temp, std::move(value)));
+                value = makeLocal(temp, t, s->loc);
+            }
+            stores.push_back(store(f.params[i].name, t, std::move(value), s->loc));
+        }
+        for (auto& st : stores) s->blockStmts.push_back(std::move(st));
+        if (!always) s->blockStmts.push_back(store(again, boolTy, flag(true, s->loc), s->loc));
+    }
+
+    auto loop = std::make_unique<Stmt>();
+    loop->kind = Stmt::Kind::While;
+    loop->loc = body->loc;
+    loop->condition = always ? flag(true, body->loc) : makeLocal(again, boolTy, body->loc);
+    loop->body = std::move(f.body);
+    if (!always) loop->body->blockStmts.insert(loop->body->blockStmts.begin(),
+                                               store(again, boolTy, flag(false, body->loc), body->loc));
+    f.body = std::make_unique<Stmt>();
+    f.body->kind = Stmt::Kind::Block;
+    f.body->loc = loop->loc;
+    if (!always) f.body->blockStmts.push_back(makeDecl(again, flag(true, loop->loc)));
+    f.body->blockStmts.push_back(std::move(loop));
+}
+
 void Optimizer::optimizeFunc(FuncDecl& f) {
-    if (f.body) optimizeStmt(f.body.get());
+    if (!f.body) return;
+    known_.clear();
+    if (current_) loopTailCalls(f);
+    if (current_ && !keepChecks_) {
+        // Inline assembly could change any local.
+        std::unordered_set<Symbol> assigned;
+        bool hasAsm = false;
+        collectAssigned(f.body.get(), assigned, hasAsm);
+        Ranges ranges;
+        if (!hasAsm) removeBoundsChecks(f.body.get(), ranges);
+    }
+    optimizeStmt(f.body.get());
+    if (current_) eliminateDeadStores(f.body.get());
 }
 
 void Optimizer::optimize() {
-    for (auto& f : program_->functions)
-        optimizeFunc(f);
+    if (!semantic_) {
+        for (auto& f : program_->functions)
+            optimizeFunc(f);
+        return;
+    }
+    // Every function this run generates code for: the program's, those of
+    // modules not loaded from the cache, and generic instances. A fixed order
+    // keeps the output independent of hash order.
+    std::vector<const FuncSymbol*> funcs;
+    auto add = [&funcs](const FuncSymbol& fs) {
+        if (fs.decl && fs.decl->body && !fs.precompiled) funcs.push_back(&fs);
+    };
+    for (const auto& f : semantic_->functions()) add(f.second);
+    for (const auto& m : semantic_->moduleFunctions())
+        for (const auto& f : m.second) add(f.second);
+    std::sort(funcs.begin(), funcs.end(),
+              [](const FuncSymbol* a, const FuncSymbol* b) { return a->mangledName < b->mangledName; });
+    for (const FuncSymbol* fs : funcs) {
+        current_ = fs;
+        addressTaken_.clear();
+        collectAddressTaken(fs->decl->body.get(), addressTaken_);
+        // The analyzer hands out its declarations read-only; they are owned
+        // by the program, a module or the instance list, all mutable.
+        optimizeFunc(const_cast<FuncDecl&>(*fs->decl));
+    }
+    current_ = nullptr;
 }
 
 } // namespace gspp
@@ -2,20 +2,111 @@
 #define GSPP_OPTIMIZER_H
 
 #include "ast.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace gspp {
 
+class SemanticAnalyzer;
+struct FuncSymbol;
+
+// Constant folding, dead-code removal and inlining of small functions. With
+// a SemanticAnalyzer it covers module functions and generic instances too,
+// and the passes that need to know a function's locals run: inlining,
+// constant and copy propagation, and dead-store elimination.
 class Optimizer {
 public:
-    explicit Optimizer(Program* program) : program_(program) {}
+    explicit Optimizer(Program* program, SemanticAnalyzer* semantic = nullptr)
+        : program_(program), semantic_(semantic) {}
     void optimize();
+    void setRemarks(bool inlined, bool missed) { remarkInlined_ = inlined; remarkMissed_ = missed; }
+    // -g: every slice index stays checked.
+    void setKeepChecks(bool keep) { keepChecks_ = keep; }
+    const std::vector<std::string>& remarks() const { return remarks_; }
 
 private:
     void optimizeExpr(Expr* expr);
     void optimizeStmt(Stmt* stmt);
     void optimizeFunc(FuncDecl& f);
 
+    // Replaces call by the callee's returned expression when the cost model
+    // and the arguments allow it.
+    bool inlineCall(Expr* call);
+    bool notInlined(const Expr* call, const std::string& why);
+    static Expr* valueOf(Stmt* s);
+
+    // What a local is known to hold at the current point: a literal, or
+    // (kind Var) the value of another local.
+    struct Known {
+        Expr::Kind kind = Expr::Kind::IntLit;
+        int64_t intVal = 0;
+        double floatVal = 0.0;
+        bool boolVal = false;
+        Symbol var;
+        bool operator==(const Known& o) const;
+    };
+    const Type* trackedType(Symbol name) const;
+    void learn(Symbol name, const Expr* value);
+    void forget(Symbol name);
+    void forgetAssignedIn(const Stmt* loop);
+    void keepAgreeing(const std::unordered_map<Symbol, Known>& other);
+
+    // Loop-invariant code motion and strength reduction of p + i for a loop
+    // directly inside a block; the statements they need before the loop go
+    // to out ahead of it.
+    struct LoopFacts;
+    void optimizeLoop(std::unique_ptr<Stmt> loop, std::vector<std::unique_ptr<Stmt>>& out);
+    void scanLoop(const Stmt* s, LoopFacts& f) const;
+    bool invariant(const Expr* e, const LoopFacts& f) const;
+    void hoist(std::unique_ptr<Expr>& slot, LoopFacts& f);
+    void hoistFromLvalue(Expr* e, LoopFacts& f);
+    void hoistFromStmt(Stmt* s, LoopFacts& f);
+    void reduceStrength(Stmt* loop, LoopFacts& f);
+    Symbol newTemp(const Type* type);
+    // Bounds-check hoisting: a counted loop that indexes slices with its
+    // counter runs as a copy indexing their raw pointers when one test
+    // before it shows every index in range, and as is otherwise.
+    bool versionLoop(std::unique_ptr<Stmt>& loop, std::vector<std::unique_ptr<Stmt>>& out);
+    bool isSlice(const Type* t) const;
+    void uncheck(Expr* index) const;
+
+    // Bounds-check elimination: s[i] on a slice local reads through s.ptr
+    // where range analysis shows 0 <= i < s.len.
+    struct Range {
+        int64_t lo = INT64_MIN, hi = INT64_MAX;
+    };
+    struct Ranges;
+    void removeBoundsChecks(Stmt* s, Ranges& r);
+    void checkIndexes(Expr* e, Ranges& r, std::vector<std::pair<Symbol, Symbol>>& learned, bool sure) const;
+    void assume(const Expr* cond, Ranges& r) const;
+    void assign(Symbol name, const Expr* value, Ranges& r) const;
+    Range rangeOf(const Expr* e, const Ranges& r) const;
+    Symbol lengthIn(const Expr* e, const Ranges& r) const;
+    bool isSliceLocal(const Expr* e) const;
+
+    // Self recursion in tail position becomes a loop.
+    void loopTailCalls(FuncDecl& f);
+    void findTailCalls(Stmt* s, bool last, std::vector<Stmt*>& out) const;
+
+    // Removes stores to locals that are never read, or overwritten before
+    // they are.
+    void eliminateDeadStores(Stmt* body);
+    bool removeDeadStores(Stmt* stmt, const std::unordered_map<Symbol, int>& reads);
+
     Program* program_;
+    SemanticAnalyzer* semantic_;
+    const FuncSymbol* current_ = nullptr;
+    std::vector<const FuncSymbol*> inlining_;  // callees being inlined, innermost last
+    std::unordered_set<Symbol> addressTaken_;  // the caller's locals a call may change
+    std::unordered_map<Symbol, Known> known_;
+    Expr* stmtValue_ = nullptr;                     // valueOf the statement being optimized
+    std::vector<std::unique_ptr<Stmt>> stmtTemps_;  // arguments to set before it
+    bool remarkInlined_ = false;
+    bool remarkMissed_ = false;
+    bool keepChecks_ = false;
+    std::vector<std::string> remarks_;
 };
 
 } // namespace gspp
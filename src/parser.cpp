@@ -1,4 +1,5 @@
 #include "parser.h"
+#include <algorithm>
 #include <sstream>
 
 namespace gspp {
@@ -52,46 +53,42 @@ void Parser::sync() {
     }
 }
 
-std::unique_ptr<Type> Parser::parseType() {
-    SourceLoc l = loc();
-    if (match(TokenKind::Star)) {
-        auto ty = std::make_unique<Type>();
-        ty->kind = Type::Kind::Pointer;
-        ty->ptrTo = parseType();
-        ty->loc = l;
-        return ty;
-    }
-    auto ty = std::make_unique<Type>();
-    ty->loc = l;
-    if (match(TokenKind::Int)) { ty->kind = Type::Kind::Int; return ty; }
-    if (match(TokenKind::Float)) { ty->kind = Type::Kind::Float; return ty; }
-    if (match(TokenKind::Bool)) { ty->kind = Type::Kind::Bool; return ty; }
-    if (match(TokenKind::String)) { ty->kind = Type::Kind::String; return ty; }
-    if (match(TokenKind::Char)) { ty->kind = Type::Kind::Char; return ty; }
+const Type* Parser::parseType() {
+    TypeTable& types = TypeTable::instance();
+    if (match(TokenKind::Star)) return types.pointerTo(parseType());
+    if (match(TokenKind::LBracket)) {
+        // []T is the built-in slice<T>.
+        expect(TokenKind::RBracket, "expected ']' in slice type");
+        return types.structRef(Symbol("slice"), Symbol(), {parseType()});
+    }
+    if (match(TokenKind::Int)) return types.get(Type::Kind::Int);
+    if (match(TokenKind::Float)) return types.get(Type::Kind::Float);
+    if (match(TokenKind::Bool)) return types.get(Type::Kind::Bool);
+    if (match(TokenKind::String)) return types.get(Type::Kind::String);
+    if (match(TokenKind::Char)) return types.get(Type::Kind::Char);
+    if (match(TokenKind::F64x4)) return types.get(Type::Kind::F64x4);
+    if (match(TokenKind::I32x8)) return types.get(Type::Kind::I32x8);
     if (check(TokenKind::Ident)) {
-        std::string id = current_.text;
+        Symbol name = current_.sym;
+        Symbol ns;
         advance();
         if (match(TokenKind::Dot)) {
             if (!check(TokenKind::Ident)) { error("expected type name after '.'"); }
-            ty->kind = Type::Kind::StructRef;
-            ty->ns = id;
-            ty->structName = current_.text;
+            ns = name;
+            name = current_.sym;
             advance();
-        } else {
-            ty->kind = Type::Kind::StructRef;
-            ty->structName = id;
         }
+        std::vector<const Type*> typeArgs;
         if (match(TokenKind::Lt)) {
             do {
-                ty->typeArgs.push_back(*parseType());
+                typeArgs.push_back(parseType());
             } while (match(TokenKind::Comma));
             expect(TokenKind::Gt, "expected '>' after type arguments");
         }
-        return ty;
+        return types.structRef(name, ns, typeArgs);
     }
     error("expected type");
-    ty->kind = Type::Kind::Int;
-    return ty;
+    return types.get(Type::Kind::Int);
 }
 
 std::unique_ptr<Expr> Parser::parsePrimary() {
@@ -108,9 +105,12 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
     }
     if (match(TokenKind::True)) return Expr::makeBoolLit(true, l);
     if (match(TokenKind::False)) return Expr::makeBoolLit(false, l);
-    if (check(TokenKind::Ident)) {
-        std::string id = current_.text;
+    if (check(TokenKind::Ident) || check(TokenKind::F64x4) || check(TokenKind::I32x8)) {
+        // f64x4(...) and i32x8(...) build vectors; the analyzer treats them as builtins.
+        Symbol id = check(TokenKind::Ident) ? current_.sym : Symbol(current_.text);
+        bool vectorType = !check(TokenKind::Ident);
         advance();
+        if (vectorType && !check(TokenKind::LParen)) error("expected '(' after vector type");
         if (check(TokenKind::LParen)) {
             advance();
             std::vector<std::unique_ptr<Expr>> args;
@@ -130,21 +130,31 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
         return e;
     }
     if (match(TokenKind::New)) {
-        auto ty = parseType();
         auto e = std::make_unique<Expr>();
         e->kind = Expr::Kind::New;
+        if (check(TokenKind::LBracket) && lexer_.peek().kind != TokenKind::RBracket) {
+            // new [n]T: an array that knows its length.
+            advance();
+            e->kind = Expr::Kind::NewArray;
+            e->left = parseExpr();
+            expect(TokenKind::RBracket, "expected ']' after array size");
+            e->targetType = parseType();
+            e->loc = l;
+            return e;
+        }
+        const Type* ty = parseType();
         if (match(TokenKind::LBracket)) {
             e->left = parseExpr();
             expect(TokenKind::RBracket, "expected ']' after array size");
         }
-        e->targetType = std::move(ty);
+        e->targetType = ty;
         e->loc = l;
         return e;
     }
     if (check(TokenKind::StringLit)) {
         auto e = std::make_unique<Expr>();
         e->kind = Expr::Kind::StringLit;
-        e->ident = current_.text;
+        e->strVal = current_.text;
         e->loc = l;
         advance();
         return e;
@@ -158,7 +168,7 @@ std::unique_ptr<Expr> Parser::parsePostfix(std::unique_ptr<Expr> base) {
         SourceLoc l = loc();
         if (match(TokenKind::Dot)) {
             if (!check(TokenKind::Ident)) { error("expected member name"); break; }
-            std::string mem = current_.text;
+            Symbol mem = current_.sym;
             advance();
             auto m = std::make_unique<Expr>();
             m->kind = Expr::Kind::Member;
@@ -166,11 +176,24 @@ std::unique_ptr<Expr> Parser::parsePostfix(std::unique_ptr<Expr> base) {
             m->member = mem;
             m->loc = l;
             base = std::move(m);
+        } else if (match(TokenKind::LBracket)) {
+            auto e = std::make_unique<Expr>();
+            e->kind = Expr::Kind::Index;
+            e->left = std::move(base);
+            e->right = parseExpr();
+            e->loc = l;
+            if (match(TokenKind::DotDot)) {
+                e->kind = Expr::Kind::Slice;
+                e->args.push_back(std::move(e->right));
+                e->args.push_back(parseExpr());
+            }
+            expect(TokenKind::RBracket, "expected ']' after index");
+            base = std::move(e);
         } else if ((check(TokenKind::Lt) && lexer_.peekForGenericEnd()) || check(TokenKind::LParen)) {
-            std::vector<Type> typeArgs;
+            std::vector<const Type*> typeArgs;
             if (match(TokenKind::Lt)) {
                 do {
-                    typeArgs.push_back(*parseType());
+                    typeArgs.push_back(parseType());
                 } while (match(TokenKind::Comma));
                 expect(TokenKind::Gt, "expected '>' after type arguments");
             }
@@ -191,16 +214,16 @@ std::unique_ptr<Expr> Parser::parsePostfix(std::unique_ptr<Expr> base) {
             expect(TokenKind::RParen, "expected ')' after arguments");
 
             if (base->kind == Expr::Kind::Member && base->left->kind == Expr::Kind::Var) {
-                std::string ns = base->left->ident;
-                std::string func = base->member;
+                Symbol ns = base->left->ident;
+                Symbol func = base->member;
                 auto c = Expr::makeCall(func, std::move(args), l);
                 c->ns = ns;
-                c->exprType.typeArgs = typeArgs;
+                c->typeArgs = typeArgs;
                 base = std::move(c);
             } else if (base->kind == Expr::Kind::Var) {
-                std::string func = base->ident;
+                Symbol func = base->ident;
                 auto c = Expr::makeCall(func, std::move(args), l);
-                c->exprType.typeArgs = typeArgs;
+                c->typeArgs = typeArgs;
                 base = std::move(c);
             } else {
                 error("expression is not callable");
@@ -212,25 +235,27 @@ std::unique_ptr<Expr> Parser::parsePostfix(std::unique_ptr<Expr> base) {
     return base;
 }
 
-int Parser::binPrec(const std::string& op) {
-    if (op == "or") return 1;
-    if (op == "and") return 2;
-    if (op == "==" || op == "!=") return 3;
-    if (op == "<" || op == ">" || op == "<=" || op == ">=") return 4;
-    if (op == "+" || op == "-") return 5;
-    if (op == "*" || op == "/" || op == "%") return 6;
-    return 0;
+int Parser::binPrec(Expr::Op op) {
+    switch (op) {
+        case Expr::Op::Or: return 1;
+        case Expr::Op::And: return 2;
+        case Expr::Op::Eq: case Expr::Op::Ne: return 3;
+        case Expr::Op::Lt: case Expr::Op::Gt: case Expr::Op::Le: case Expr::Op::Ge: return 4;
+        case Expr::Op::Add: case Expr::Op::Sub: return 5;
+        case Expr::Op::Mul: case Expr::Op::Div: case Expr::Op::Mod: return 6;
+        default: return 0;
+    }
 }
 
 std::unique_ptr<Expr> Parser::parseUnary() {
     SourceLoc l = loc();
     if (match(TokenKind::Minus)) {
         auto operand = parseUnary();
-        return Expr::makeUnary("-", std::move(operand), l);
+        return Expr::makeUnary(Expr::Op::Neg, std::move(operand), l);
     }
     if (match(TokenKind::Not)) {
         auto operand = parseUnary();
-        return Expr::makeUnary("not", std::move(operand), l);
+        return Expr::makeUnary(Expr::Op::Not, std::move(operand), l);
     }
     if (match(TokenKind::Star)) {
         auto operand = parseUnary();
@@ -254,20 +279,20 @@ std::unique_ptr<Expr> Parser::parseUnary() {
 std::unique_ptr<Expr> Parser::parseBinary(int minPrec) {
     auto left = parseUnary();
     for (;;) {
-        std::string op;
-        if (check(TokenKind::Plus)) op = "+";
-        else if (check(TokenKind::Minus)) op = "-";
-        else if (check(TokenKind::Star)) op = "*";
-        else if (check(TokenKind::Slash)) op = "/";
-        else if (check(TokenKind::Percent)) op = "%";
-        else if (check(TokenKind::Eq)) op = "==";
-        else if (check(TokenKind::Ne)) op = "!=";
-        else if (check(TokenKind::Lt)) op = "<";
-        else if (check(TokenKind::Gt)) op = ">";
-        else if (check(TokenKind::Le)) op = "<=";
-        else if (check(TokenKind::Ge)) op = ">=";
-        else if (check(TokenKind::And)) op = "and";
-        else if (check(TokenKind::Or)) op = "or";
+        Expr::Op op;
+        if (check(TokenKind::Plus)) op = Expr::Op::Add;
+        else if (check(TokenKind::Minus)) op = Expr::Op::Sub;
+        else if (check(TokenKind::Star)) op = Expr::Op::Mul;
+        else if (check(TokenKind::Slash)) op = Expr::Op::Div;
+        else if (check(TokenKind::Percent)) op = Expr::Op::Mod;
+        else if (check(TokenKind::Eq)) op = Expr::Op::Eq;
+        else if (check(TokenKind::Ne)) op = Expr::Op::Ne;
+        else if (check(TokenKind::Lt)) op = Expr::Op::Lt;
+        else if (check(TokenKind::Gt)) op = Expr::Op::Gt;
+        else if (check(TokenKind::Le)) op = Expr::Op::Le;
+        else if (check(TokenKind::Ge)) op = Expr::Op::Ge;
+        else if (check(TokenKind::And)) op = Expr::Op::And;
+        else if (check(TokenKind::Or)) op = Expr::Op::Or;
         else break;
         int prec = binPrec(op);
         if (prec < minPrec) break;
@@ -300,11 +325,10 @@ std::unique_ptr<Stmt> Parser::parseVarDecl() {
     stmt->loc = loc();
     advance(); // var
     if (!check(TokenKind::Ident)) { error("expected variable name"); sync(); return stmt; }
-    stmt->varName = current_.text;
+    stmt->varName = current_.sym;
     advance();
     if (match(TokenKind::Colon)) {
-        auto ty = parseType();
-        stmt->varType = *ty;
+        stmt->varType = parseType();
     }
     if (match(TokenKind::Assign)) {
         stmt->varInit = parseExpr();
@@ -349,6 +373,7 @@ std::unique_ptr<Stmt> Parser::parseFor() {
     stmt->kind = Stmt::Kind::For;
     stmt->loc = loc();
     advance();
+    if (check(TokenKind::Ident)) return parseForIn(std::move(stmt));
     expect(TokenKind::LParen, "expected '(' after 'for'");
     stmt->initStmt = parseStmt();
     stmt->condition = parseExpr();
@@ -359,6 +384,77 @@ std::unique_ptr<Stmt> Parser::parseFor() {
     return stmt;
 }
 
+// for x in lo..hi and for x in slice become counted loops over hidden
+// locals, whose names cannot clash with identifiers:
+//
+//   { let .endN = hi; for (let x = lo; x < .endN; x = x + 1;) body }
+//   { let .ptrN = s.ptr; let .lenN = s.len;
+//     for (let .iN = 0; .iN < .lenN; .iN = .iN + 1;) { let x = .ptrN[.iN]; body } }
+//
+// A slice that is not a plain variable is first copied to .sN. Its
+// elements are read through the raw pointer: the counter never leaves
+// 0 .. len - 1, so no element needs a bounds check.
+std::unique_ptr<Stmt> Parser::parseForIn(std::unique_ptr<Stmt> loop) {
+    SourceLoc l = loop->loc;
+    Symbol var = current_.sym;
+    advance();
+    expect(TokenKind::In, "expected 'in' after loop variable");
+    std::string n = std::to_string(hiddenLoops_++);
+    auto hidden = [&](const char* prefix) { return Symbol(std::string(".") + prefix + n); };
+    auto local = [&](Symbol name) { return Expr::makeVar(name, l); };
+    auto decl = [&](Symbol name, std::unique_ptr<Expr> init) {
+        auto s = std::make_unique<Stmt>();
+        s->kind = Stmt::Kind::VarDecl;
+        s->loc = l;
+        s->varName = name;
+        s->varInit = std::move(init);
+        return s;
+    };
+    auto step = [&](Symbol name) {
+        auto s = std::make_unique<Stmt>();
+        s->kind = Stmt::Kind::Assign;
+        s->loc = l;
+        s->assignTarget = local(name);
+        s->assignValue = Expr::makeBinary(local(name), Expr::Op::Add, Expr::makeIntLit(1, l), l);
+        return s;
+    };
+
+    auto outer = std::make_unique<Stmt>();
+    outer->kind = Stmt::Kind::Block;
+    outer->loc = l;
+    auto source = parseExpr();
+    if (match(TokenKind::DotDot)) {
+        Symbol end = hidden("end");
+        outer->blockStmts.push_back(decl(end, parseExpr()));
+        loop->initStmt = decl(var, std::move(source));
+        loop->condition = Expr::makeBinary(local(var), Expr::Op::Lt, local(end), l);
+        loop->stepStmt = step(var);
+        loop->body = parseBlock();
+    } else {
+        if (source->kind != Expr::Kind::Var) {
+            Symbol copy = hidden("s");
+            outer->blockStmts.push_back(decl(copy, std::move(source)));
+            source = local(copy);
+        }
+        Symbol ptr = hidden("ptr"), len = hidden("len"), i = hidden("i");
+        outer->blockStmts.push_back(decl(ptr, Expr::makeMember(Expr::makeVar(source->ident, l), Symbol("ptr"), l)));
+        outer->blockStmts.push_back(decl(len, Expr::makeMember(std::move(source), Symbol("len"), l)));
+        loop->initStmt = decl(i, Expr::makeIntLit(0, l));
+        loop->condition = Expr::makeBinary(local(i), Expr::Op::Lt, local(len), l);
+        loop->stepStmt = step(i);
+        auto element = std::make_unique<Expr>();
+        element->kind = Expr::Kind::Index;
+        element->loc = l;
+        element->left = local(ptr);
+        element->right = local(i);
+        auto body = parseBlock();
+        body->blockStmts.insert(body->blockStmts.begin(), decl(var, std::move(element)));
+        loop->body = std::move(body);
+    }
+    outer->blockStmts.push_back(std::move(loop));
+    return outer;
+}
+
 std::unique_ptr<Stmt> Parser::parseReturn() {
     auto stmt = std::make_unique<Stmt>();
     stmt->kind = Stmt::Kind::Return;
@@ -430,17 +526,45 @@ std::unique_ptr<Stmt> Parser::parseStmt() {
     return stmt;
 }
 
-StructDecl Parser::parseStructDecl() {
+// @packed, @reorder and @soa go on structs, @inline and @noinline on
+// functions; the declaration that follows checks which apply.
+std::vector<Symbol> Parser::parseAttributes() {
+    static const Symbol known[] = {Symbol("packed"), Symbol("reorder"), Symbol("soa"), Symbol("inline"),
+                                   Symbol("noinline")};
+    std::vector<Symbol> attrs;
+    while (match(TokenKind::At)) {
+        if (check(TokenKind::Ident) && std::find(std::begin(known), std::end(known), current_.sym) != std::end(known))
+            attrs.push_back(current_.sym);
+        else
+            error("unknown attribute '@" + std::string(current_.text) + "'");
+        if (check(TokenKind::Ident)) advance();
+    }
+    return attrs;
+}
+
+StructDecl Parser::parseStructDecl(const std::vector<Symbol>& attrs) {
+    static const Symbol packedSym("packed"), reorderSym("reorder"), soaSym("soa");
     StructDecl s;
     s.loc = loc();
+    for (Symbol a : attrs) {
+        if (a == packedSym) s.packed = true;
+        else if (a == reorderSym) s.reorder = true;
+        else if (a == soaSym) s.soa = true;
+        else error("attribute '@" + a.str() + "' does not apply to a struct");
+    }
+    if (!check(TokenKind::Struct) && !check(TokenKind::Class)) {
+        error("expected 'struct' or 'class' after attributes");
+        sync();
+        return s;
+    }
     advance(); // struct or class
     if (!check(TokenKind::Ident)) { error("expected struct/class name"); sync(); return s; }
-    s.name = current_.text;
+    s.name = current_.sym;
     advance();
     if (match(TokenKind::Lt)) {
         do {
             if (!check(TokenKind::Ident)) { error("expected type parameter name"); }
-            s.typeParams.push_back(current_.text);
+            s.typeParams.push_back(current_.sym);
             advance();
         } while (match(TokenKind::Comma));
         expect(TokenKind::Gt, "expected '>' after type parameters");
@@ -449,12 +573,11 @@ StructDecl Parser::parseStructDecl() {
     while (!check(TokenKind::RBrace) && !check(TokenKind::Eof)) {
         if (!check(TokenKind::Ident)) { error("expected member name"); sync(); break; }
         StructMember m;
-        m.name = current_.text;
+        m.name = current_.sym;
         m.loc = loc();
         advance();
         expect(TokenKind::Colon, "expected ':'");
-        auto ty = parseType();
-        m.type = *ty;
+        m.type = parseType();
         s.members.push_back(std::move(m));
         expect(TokenKind::Semicolon, "expected ';'");
     }
@@ -462,17 +585,24 @@ StructDecl Parser::parseStructDecl() {
     return s;
 }
 
-FuncDecl Parser::parseFuncDecl(bool isExtern) {
+FuncDecl Parser::parseFuncDecl(bool isExtern, const std::vector<Symbol>& attrs) {
+    static const Symbol inlineSym("inline"), noinlineSym("noinline");
     FuncDecl f;
     f.loc = loc();
+    for (Symbol a : attrs) {
+        if (a == inlineSym) f.forceInline = true;
+        else if (a == noinlineSym) f.noInline = true;
+        else error("attribute '@" + a.str() + "' does not apply to a function");
+    }
+    if (f.forceInline && f.noInline) error("a function cannot be both @inline and @noinline");
     advance(); // func
     if (!check(TokenKind::Ident)) { error("expected function name"); sync(); return f; }
-    f.name = current_.text;
+    f.name = current_.sym;
     advance();
     if (match(TokenKind::Lt)) {
         do {
             if (!check(TokenKind::Ident)) { error("expected type parameter name"); }
-            f.typeParams.push_back(current_.text);
+            f.typeParams.push_back(current_.sym);
             advance();
         } while (match(TokenKind::Comma));
         expect(TokenKind::Gt, "expected '>' after type parameters");
@@ -482,22 +612,17 @@ FuncDecl Parser::parseFuncDecl(bool isExtern) {
         do {
             if (!check(TokenKind::Ident)) { error("expected parameter name"); break; }
             FuncParam p;
-            p.name = current_.text;
+            p.name = current_.sym;
             p.loc = loc();
             advance();
             expect(TokenKind::Colon, "expected ':'");
-            auto ty = parseType();
-            p.type = *ty;
+            p.type = parseType();
             f.params.push_back(std::move(p));
         } while (match(TokenKind::Comma));
     }
     expect(TokenKind::RParen, "expected ')'");
-    if (match(TokenKind::Arrow)) {
-        auto ty = parseType();
-        f.returnType = *ty;
-    } else {
-        f.returnType.kind = Type::Kind::Int;
-    }
+    if (match(TokenKind::Arrow))
+        f.returnType = parseType();
     if (isExtern && check(TokenKind::Semicolon)) {
         advance();
     } else {
@@ -510,8 +635,10 @@ std::unique_ptr<Program> Parser::parseProgram() {
     auto prog = std::make_unique<Program>();
     prog->loc = loc();
     while (!check(TokenKind::Eof)) {
-        if (check(TokenKind::Struct) || check(TokenKind::Class)) {
-            prog->structs.push_back(parseStructDecl());
+        if (check(TokenKind::Struct) || check(TokenKind::Class) || check(TokenKind::At)) {
+            std::vector<Symbol> attrs = parseAttributes();
+            if (check(TokenKind::Func)) prog->functions.push_back(parseFuncDecl(false, attrs));
+            else prog->structs.push_back(parseStructDecl(attrs));
         } else if (check(TokenKind::Func)) {
             prog->functions.push_back(parseFuncDecl(false));
         } else if (match(TokenKind::Extern)) {
@@ -538,10 +665,10 @@ std::unique_ptr<Program> Parser::parseProgram() {
                 size_t slash = imp.path.find_last_of("/\\");
                 std::string filename = (slash == std::string::npos) ? imp.path : imp.path.substr(slash + 1);
                 size_t dot = filename.find_last_of('.');
-                imp.name = (dot == std::string::npos) ? filename : filename.substr(0, dot);
+                imp.name = Symbol(dot == std::string::npos ? filename : filename.substr(0, dot));
                 advance();
             } else if (check(TokenKind::Ident)) {
-                imp.name = current_.text;
+                imp.name = current_.sym;
                 imp.path = imp.name + ".gs";
                 advance();
             } else {
@@ -23,13 +23,13 @@ private:
     bool expect(TokenKind k, const char* msg);
     SourceLoc loc() const;
 
-    std::unique_ptr<Type> parseType();
+    const Type* parseType();
     std::unique_ptr<Expr> parseExpr();
     std::unique_ptr<Expr> parsePrimary();
     std::unique_ptr<Expr> parseUnary();
     std::unique_ptr<Expr> parseBinary(int minPrec);
     std::unique_ptr<Expr> parsePostfix(std::unique_ptr<Expr> base);
-    int binPrec(const std::string& op);
+    int binPrec(Expr::Op op);
 
     std::unique_ptr<Stmt> parseStmt();
     std::unique_ptr<Stmt> parseBlock();
@@ -37,10 +37,12 @@ private:
     std::unique_ptr<Stmt> parseIf();
     std::unique_ptr<Stmt> parseWhile();
     std::unique_ptr<Stmt> parseFor();
+    std::unique_ptr<Stmt> parseForIn(std::unique_ptr<Stmt> loop);
     std::unique_ptr<Stmt> parseReturn();
 
-    StructDecl parseStructDecl();
-    FuncDecl parseFuncDecl(bool isExtern = false);
+    std::vector<Symbol> parseAttributes();
+    StructDecl parseStructDecl(const std::vector<Symbol>& attrs = {});
+    FuncDecl parseFuncDecl(bool isExtern = false, const std::vector<Symbol>& attrs = {});
 
     void error(const std::string& msg);
     void sync();
@@ -48,6 +50,7 @@ private:
     Lexer& lexer_;
     Token current_;
     std::vector<std::string> errors_;
+    int hiddenLoops_ = 0;  // numbers the hidden locals of for-in loops
 };
 
 } // namespace gspp
@@ -0,0 +1,180 @@
+#include "regalloc.h"
+#include <algorithm>
+
+namespace gspp {
+
+static const char* const kGprPool[] = {"%rbx", "%r12", "%r13", "%r14", "%r15"};
+static const char* const kXmmPool[] = {"%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15"};
+
+RegisterAllocator::RegisterAllocator(const FuncSymbol& fs, bool allowXmm)
+    : fs_(fs), allowXmm_(allowXmm) {}
+
+void RegisterAllocator::touch(Symbol name) {
+    auto it = intervals_.find(name);
+    if (it == intervals_.end()) return;  // not a local of this function
+    LiveInterval& li = it->second;
+    if (li.start == 0 && li.end == 0 && !fs_.locals.at(name).isParam) li.start = pos_;
+    li.end = std::max(li.end, pos_);
+    pos_++;
+}
+
+void RegisterAllocator::visitExpr(const Expr* expr) {
+    if (!expr) return;
+    switch (expr->kind) {
+        case Expr::Kind::Var:
+            touch(expr->ident);
+            return;
+        case Expr::Kind::AddressOf:
+            if (expr->right && expr->right->kind == Expr::Kind::Var)
+                addressTaken_.insert(expr->right->ident);
+            break;
+        default:
+            break;
+    }
+    visitExpr(expr->left.get());
+    visitExpr(expr->right.get());
+    for (const auto& a : expr->args) visitExpr(a.get());
+    bool isCall = expr->kind == Expr::Kind::Call || expr->kind == Expr::Kind::New ||
+                  expr->kind == Expr::Kind::NewArray || expr->kind == Expr::Kind::Delete ||
+                  (expr->kind == Expr::Kind::Binary && expr->op == Expr::Op::Add && expr->left &&
+                   expr->left->exprType->kind == Type::Kind::String);
+    if (isCall) callPositions_.push_back(pos_++);
+}
+
+void RegisterAllocator::visitStmt(const Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->kind) {
+        case Stmt::Kind::Block:
+            for (const auto& s : stmt->blockStmts) visitStmt(s.get());
+            break;
+        case Stmt::Kind::VarDecl:
+            visitExpr(stmt->varInit.get());
+            touch(stmt->varName);
+            break;
+        case Stmt::Kind::Assign:
+            visitExpr(stmt->assignValue.get());
+            visitExpr(stmt->assignTarget.get());
+            break;
+        case Stmt::Kind::If:
+            visitExpr(stmt->condition.get());
+            visitStmt(stmt->thenBranch.get());
+            visitStmt(stmt->elseBranch.get());
+            break;
+        case Stmt::Kind::While: {
+            int loopStart = pos_++;
+            visitExpr(stmt->condition.get());
+            visitStmt(stmt->body.get());
+            loops_.push_back({loopStart, pos_++});
+            break;
+        }
+        case Stmt::Kind::For: {
+            visitStmt(stmt->initStmt.get());
+            int loopStart = pos_++;
+            visitExpr(stmt->condition.get());
+            visitStmt(stmt->body.get());
+            visitStmt(stmt->stepStmt.get());
+            loops_.push_back({loopStart, pos_++});
+            break;
+        }
+        case Stmt::Kind::Return:
+            visitExpr(stmt->returnExpr.get());
+            if (fs_.returnType->kind == Type::Kind::StructRef) touch(resultSlot());  // copied to
+            break;
+        case Stmt::Kind::ExprStmt:
+            visitExpr(stmt->expr.get());
+            break;
+        case Stmt::Kind::Unsafe:
+            visitStmt(stmt->body.get());
+            break;
+        case Stmt::Kind::Asm:
+            hasAsm_ = true;
+            break;
+    }
+}
+
+void RegisterAllocator::extendOverLoops() {
+    // A local referenced inside a loop must stay live for the whole loop,
+    // since the back edge can carry its value into the next iteration.
+    // Loops are recorded innermost first, so one pass composes correctly.
+    for (const auto& loop : loops_) {
+        for (auto& p : intervals_) {
+            LiveInterval& li = p.second;
+            if (li.end < loop.first || li.start > loop.second) continue;
+            if (li.end == 0 && li.start == 0) continue;
+            li.start = std::min(li.start, loop.first);
+            li.end = std::max(li.end, loop.second);
+        }
+    }
+}
+
+void RegisterAllocator::run() {
+    if (!fs_.decl || !fs_.decl->body) return;
+    for (const auto& p : fs_.locals) {
+        LiveInterval li;
+        li.name = p.first;
+        li.isFloat = p.second.type->kind == Type::Kind::Float;
+        intervals_[p.first] = li;
+    }
+    visitStmt(fs_.decl->body.get());
+    // Inline asm may address locals by their frame slots; leave such functions alone.
+    if (hasAsm_) return;
+    extendOverLoops();
+
+    std::vector<LiveInterval*> order;
+    for (auto& p : intervals_) {
+        LiveInterval& li = p.second;
+        if (addressTaken_.count(li.name)) continue;
+        const Type* t = fs_.locals.at(li.name).type;
+        if (t->kind == Type::Kind::StructRef || isVector(t)) continue;  // lives in the frame
+        for (int c : callPositions_)
+            if (li.start < c && c < li.end) { li.crossesCall = true; break; }
+        if (li.isFloat && (!allowXmm_ || li.crossesCall)) continue;
+        order.push_back(&li);
+    }
+    std::sort(order.begin(), order.end(), [](const LiveInterval* a, const LiveInterval* b) {
+        if (a->start != b->start) return a->start < b->start;
+        return a->name.str() < b->name.str();
+    });
+
+    std::vector<std::string> freeGpr(std::rbegin(kGprPool), std::rend(kGprPool));
+    std::vector<std::string> freeXmm(std::rbegin(kXmmPool), std::rend(kXmmPool));
+    std::vector<LiveInterval*> active;  // sorted by increasing end
+
+    for (LiveInterval* cur : order) {
+        // Expire intervals that ended before this one starts.
+        for (auto it = active.begin(); it != active.end();) {
+            if ((*it)->end >= cur->start) break;
+            ((*it)->isFloat ? freeXmm : freeGpr).push_back((*it)->reg);
+            it = active.erase(it);
+        }
+        std::vector<std::string>& pool = cur->isFloat ? freeXmm : freeGpr;
+        if (pool.empty()) {
+            // Spill whichever interval of the same class ends last.
+            LiveInterval* victim = nullptr;
+            for (auto it = active.rbegin(); it != active.rend(); ++it)
+                if ((*it)->isFloat == cur->isFloat) { victim = *it; break; }
+            if (!victim || victim->end <= cur->end) continue;  // spill cur itself
+            cur->reg = victim->reg;
+            victim->reg.clear();
+            active.erase(std::find(active.begin(), active.end(), victim));
+        } else {
+            cur->reg = pool.back();
+            pool.pop_back();
+        }
+        active.insert(std::upper_bound(active.begin(), active.end(), cur,
+                                       [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; }),
+                      cur);
+    }
+
+    for (const auto& p : intervals_) {
+        if (p.second.reg.empty()) continue;
+        assignment_[p.first] = p.second.reg;
+    }
+    for (const char* r : kGprPool) {
+        for (const auto& p : assignment_) {
+            if (p.second == r) { usedCalleeSaved_.push_back(r); break; }
+        }
+    }
+}
+
+} // namespace gspp
@@ -0,0 +1,56 @@
+#ifndef GSPP_REGALLOC_H
+#define GSPP_REGALLOC_H
+
+#include "ast.h"
+#include "semantic.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gspp {
+
+// Live range of a local over the linearized statement order of a function.
+struct LiveInterval {
+    Symbol name;
+    int start = 0;
+    int end = 0;
+    bool isFloat = false;
+    bool crossesCall = false;
+    std::string reg;  // empty when spilled to its stack slot
+};
+
+// Linear-scan register allocator (Poletto & Sarkar) for the x86-64 backend.
+// Integer-like locals are placed in callee-saved GPRs so they survive calls;
+// float locals use XMM8-XMM15, which are caller-saved and therefore only
+// considered for intervals that do not cross a call.
+class RegisterAllocator {
+public:
+    RegisterAllocator(const FuncSymbol& fs, bool allowXmm);
+    void run();
+    // name -> register (e.g. "%rbx"), only for locals that got one
+    const std::unordered_map<Symbol, std::string>& assignment() const { return assignment_; }
+    // callee-saved GPRs the function must preserve, in allocation order
+    const std::vector<std::string>& usedCalleeSaved() const { return usedCalleeSaved_; }
+
+private:
+    void visitStmt(const Stmt* stmt);
+    void visitExpr(const Expr* expr);
+    void touch(Symbol name);
+    void extendOverLoops();
+
+    const FuncSymbol& fs_;
+    bool allowXmm_ = false;
+    int pos_ = 1;
+    std::unordered_map<Symbol, LiveInterval> intervals_;
+    std::unordered_set<Symbol> addressTaken_;
+    std::vector<int> callPositions_;
+    std::vector<std::pair<int, int>> loops_;
+    bool hasAsm_ = false;
+    std::unordered_map<Symbol, std::string> assignment_;
+    std::vector<std::string> usedCalleeSaved_;
+};
+
+} // namespace gspp
+
+#endif
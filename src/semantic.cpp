@@ -1,25 +1,61 @@
 #include "semantic.h"
+#include "gsi.h"
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <iostream>
 
 namespace gspp {
 
-SemanticAnalyzer::SemanticAnalyzer(Program* program) : program_(program) {}
+namespace {
 
-void SemanticAnalyzer::addModule(const std::string& name, Program* prog) {
+// Charges the outermost instantiation's wall time to the stats; instances
+// created while analyzing another one are already inside that interval.
+class InstanceTimer {
+public:
+    InstanceTimer(int& depth, double& seconds) : depth_(depth), seconds_(seconds) {
+        if (depth_++ == 0) start_ = std::chrono::steady_clock::now();
+    }
+    ~InstanceTimer() {
+        if (--depth_ == 0)
+            seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    int& depth_;
+    double& seconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace
+
+SemanticAnalyzer::SemanticAnalyzer(Program* program, int wordBytes) : program_(program), wordBytes_(wordBytes) {
+    TypeTable& types = TypeTable::instance();
+    Symbol t("T");
+    sliceTemplate_.name = Symbol("slice");
+    sliceTemplate_.typeParams.push_back(t);
+    sliceTemplate_.members.push_back({Symbol("ptr"), types.pointerTo(types.typeParam(t)), SourceLoc()});
+    sliceTemplate_.members.push_back({Symbol("len"), types.get(Type::Kind::Int), SourceLoc()});
+    structTemplates_[sliceTemplate_.name] = &sliceTemplate_;
+}
+
+void SemanticAnalyzer::addModule(Symbol name, Program* prog) {
     modules_[name] = prog;
 
     // Save current state
     auto oldStructs = std::move(structs_);
     auto oldFunctions = std::move(functions_);
     auto oldNs = currentNamespace_;
+    auto oldUnit = currentUnit_;
     structs_.clear();
     functions_.clear();
     currentNamespace_ = name;
+    currentUnit_ = name;
 
     // Store templates
     for (const auto& s : prog->structs) {
-        if (s.typeParams.empty()) analyzeStruct(s);
+        if (s.name == sliceTemplate_.name) error("'slice' is a built-in type", s.loc);
+        else if (s.typeParams.empty()) analyzeStruct(s);
         else moduleStructTemplates_[name][s.name] = &s;
     }
     for (const auto& f : prog->functions) {
@@ -34,6 +70,41 @@ void SemanticAnalyzer::addModule(const std::string& name, Program* prog) {
     structs_ = std::move(oldStructs);
     functions_ = std::move(oldFunctions);
     currentNamespace_ = oldNs;
+    currentUnit_ = oldUnit;
+}
+
+void SemanticAnalyzer::addCachedModule(Symbol name, const GsiModule* image) {
+    images_[name] = image;
+    moduleStructs_[name];
+    moduleFunctions_[name];
+    std::vector<GenericInstance> instances = image->instances();
+    for (const GenericInstance& gi : instances) {
+        if (gi.isFunc) instantiateFunc(gi.name, gi.ns, gi.args);
+        else instantiateStruct(gi.name, gi.ns, gi.args);
+    }
+    moduleInstances_[name] = std::move(instances);
+}
+
+ModuleInterface SemanticAnalyzer::moduleInterface(Symbol name) {
+    ModuleInterface iface;
+    const Program* prog = modules_.at(name);
+    iface.imports = prog->imports;
+    for (const auto& s : prog->structs) {
+        if (!s.typeParams.empty()) iface.structTemplates.push_back(&s);
+        else iface.structs.push_back(moduleStructs_[name].at(s.name));
+    }
+    for (const auto& f : prog->functions) {
+        if (!f.typeParams.empty()) {
+            iface.funcTemplates.push_back(&f);
+            continue;
+        }
+        FuncSymbol fs = moduleFunctions_[name].at(f.name);
+        fs.decl = nullptr;
+        fs.locals.clear();
+        iface.functions.push_back(std::move(fs));
+    }
+    iface.instances = moduleInstances_[name];
+    return iface;
 }
 
 void SemanticAnalyzer::pushScope() {
@@ -44,15 +115,23 @@ void SemanticAnalyzer::popScope() {
     scopes_.pop_back();
 }
 
-void SemanticAnalyzer::addVar(const std::string& name, const Type& type, bool isParam) {
+void SemanticAnalyzer::addVar(Symbol name, const Type* type, bool isParam) {
     VarSymbol sym;
     sym.name = name;
     sym.type = type;
     sym.isParam = isParam;
     if (!scopes_.empty()) {
-        if (isParam)
+        if (isParam && type->kind != Type::Kind::StructRef) {
             sym.frameOffset = 0;  // set later from param index
-        else {
+        } else if (type->kind == Type::Kind::StructRef || isVector(type)) {
+            // A struct lives in the frame; a struct parameter arrives as an
+            // address and is copied here on entry. Offsets are in x64 units,
+            // which 32-bit code halves, so reserve for that scale.
+            size_t size, align;
+            typeLayout(type, size, align);
+            nextFrameOffset_ += (int)((size * (8 / wordBytes_) + 7) & ~(size_t)7);
+            sym.frameOffset = -nextFrameOffset_;
+        } else {
             nextFrameOffset_ += 8;  // 8 bytes per local on x64
             sym.frameOffset = -nextFrameOffset_;
         }
@@ -62,7 +141,23 @@ void SemanticAnalyzer::addVar(const std::string& name, const Type& type, bool is
     }
 }
 
-VarSymbol* SemanticAnalyzer::lookupVar(const std::string& name) {
+Symbol SemanticAnalyzer::addTemp(FuncSymbol& fs, const Type* type) {
+    int used = 0;
+    for (const auto& l : fs.locals) used = std::max(used, -l.second.frameOffset);
+    Symbol name;
+    for (size_t n = fs.locals.size();; n++) {
+        name = Symbol(".t" + std::to_string(n));
+        if (!fs.locals.count(name)) break;
+    }
+    VarSymbol sym;
+    sym.name = name;
+    sym.type = type;
+    sym.frameOffset = -(used + 8);
+    fs.locals[name] = sym;
+    return name;
+}
+
+VarSymbol* SemanticAnalyzer::lookupVar(Symbol name) {
     for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
         auto i = it->find(name);
         if (i != it->end()) return &i->second;
@@ -70,45 +165,27 @@ VarSymbol* SemanticAnalyzer::lookupVar(const std::string& name) {
     return nullptr;
 }
 
-std::string SemanticAnalyzer::typeName(const Type& t) {
-    switch (t.kind) {
-        case Type::Kind::Int: return "int";
-        case Type::Kind::Float: return "float";
-        case Type::Kind::Bool: return "bool";
-        case Type::Kind::String: return "string";
-        case Type::Kind::Char: return "char";
-        case Type::Kind::Void: return "void";
-        case Type::Kind::TypeParam: return t.structName;
-        case Type::Kind::Pointer: return "ptr_" + typeName(*t.ptrTo);
-        case Type::Kind::StructRef: {
-            std::string n = t.ns.empty() ? t.structName : t.ns + "_" + t.structName;
-            for (const auto& arg : t.typeArgs) n += "_" + typeName(arg);
-            return n;
-        }
-    }
-    return "unknown";
-}
-
-std::string SemanticAnalyzer::mangleGenericName(const std::string& name, const std::vector<Type>& args) {
+Symbol SemanticAnalyzer::mangleGenericName(Symbol name, const std::vector<const Type*>& args) {
     std::string m = name + "_";
-    for (const auto& arg : args) m += typeName(arg) + "_";
-    return m;
+    for (const Type* arg : args) m += arg->mangledName + "_";
+    return Symbol(m);
 }
 
-Type SemanticAnalyzer::substitute(const Type& t, const std::unordered_map<std::string, Type>& subs) {
-    if (t.kind == Type::Kind::TypeParam || (t.kind == Type::Kind::StructRef && t.ns.empty())) {
-        auto it = subs.find(t.structName);
+const Type* SemanticAnalyzer::substitute(const Type* t, const std::unordered_map<Symbol, const Type*>& subs) {
+    if (t->kind == Type::Kind::TypeParam || (t->kind == Type::Kind::StructRef && t->ns.empty())) {
+        auto it = subs.find(t->structName);
         if (it != subs.end()) return it->second;
-        if (t.kind == Type::Kind::TypeParam) return t;
+        if (t->kind == Type::Kind::TypeParam) return t;
     }
-    Type res = t;
-    if (t.ptrTo) res.ptrTo = std::make_unique<Type>(substitute(*t.ptrTo, subs));
-    res.typeArgs.clear();
-    for (const auto& arg : t.typeArgs) res.typeArgs.push_back(substitute(arg, subs));
-    return res;
+    TypeTable& types = TypeTable::instance();
+    if (t->kind == Type::Kind::Pointer) return types.pointerTo(substitute(t->ptrTo, subs));
+    if (t->kind != Type::Kind::StructRef || t->typeArgs.empty()) return t;
+    std::vector<const Type*> args;
+    for (const Type* arg : t->typeArgs) args.push_back(substitute(arg, subs));
+    return types.structRef(t->structName, t->ns, args);
 }
 
-std::unique_ptr<Expr> SemanticAnalyzer::substituteExpr(const Expr* e, const std::unordered_map<std::string, Type>& subs) {
+std::unique_ptr<Expr> SemanticAnalyzer::substituteExpr(const Expr* e, const std::unordered_map<Symbol, const Type*>& subs) {
     if (!e) return nullptr;
     auto res = std::make_unique<Expr>();
     res->kind = e->kind;
@@ -116,19 +193,21 @@ std::unique_ptr<Expr> SemanticAnalyzer::substituteExpr(const Expr* e, const std:
     res->intVal = e->intVal;
     res->floatVal = e->floatVal;
     res->boolVal = e->boolVal;
+    res->strVal = e->strVal;
     res->ident = e->ident;
     res->ns = e->ns;
     res->member = e->member;
     res->op = e->op;
     res->exprType = substitute(e->exprType, subs);
-    if (e->targetType) res->targetType = std::make_unique<Type>(substitute(*e->targetType, subs));
+    if (e->targetType) res->targetType = substitute(e->targetType, subs);
+    for (const Type* arg : e->typeArgs) res->typeArgs.push_back(substitute(arg, subs));
     if (e->left) res->left = substituteExpr(e->left.get(), subs);
     if (e->right) res->right = substituteExpr(e->right.get(), subs);
     for (const auto& arg : e->args) res->args.push_back(substituteExpr(arg.get(), subs));
     return res;
 }
 
-std::unique_ptr<Stmt> SemanticAnalyzer::substituteStmt(const Stmt* s, const std::unordered_map<std::string, Type>& subs) {
+std::unique_ptr<Stmt> SemanticAnalyzer::substituteStmt(const Stmt* s, const std::unordered_map<Symbol, const Type*>& subs) {
     if (!s) return nullptr;
     auto res = std::make_unique<Stmt>();
     res->kind = s->kind;
@@ -151,65 +230,87 @@ std::unique_ptr<Stmt> SemanticAnalyzer::substituteStmt(const Stmt* s, const std:
     return res;
 }
 
-void SemanticAnalyzer::instantiateStruct(const std::string& name, const std::string& ns, const std::vector<Type>& args) {
+void SemanticAnalyzer::instantiateStruct(Symbol name, Symbol ns, const std::vector<const Type*>& args) {
     if (args.empty()) return;
-    std::string mangled = mangleGenericName(name, args);
-    if (getStruct(mangled, ns)) return;
-
-    const StructDecl* tmpl = nullptr;
-    if (ns.empty()) {
-        if (structTemplates_.count(name)) tmpl = structTemplates_[name];
-    } else {
-        if (moduleStructTemplates_.count(ns) && moduleStructTemplates_[ns].count(name))
-            tmpl = moduleStructTemplates_[ns][name];
+    GenericInstance key{false, name, ns, args};
+    if (!currentUnit_.empty()) recordInstance(key);
+    stats_.requests++;
+    Symbol mangled = mangleGenericName(name, args);
+    if (instances_.count(key) || getStruct(mangled, ns)) {
+        stats_.reused++;
+        return;
     }
+
+    const StructDecl* tmpl = findStructTemplate(name, ns);
     if (!tmpl) return;
+    // Registered before the members are resolved, so a template that refers
+    // to its own instance (a *Node<T> member) does not recurse forever.
+    instances_.insert(std::move(key));
+    stats_.structs++;
+    InstanceTimer timer(instanceDepth_, stats_.seconds);
 
-    std::unordered_map<std::string, Type> subs;
+    std::unordered_map<Symbol, const Type*> subs;
     for (size_t i = 0; i < tmpl->typeParams.size() && i < args.size(); i++)
         subs[tmpl->typeParams[i]] = args[i];
 
     auto spec = std::make_unique<StructDecl>();
     spec->name = mangled;
     spec->loc = tmpl->loc;
+    spec->packed = tmpl->packed;
+    spec->reorder = tmpl->reorder;
+    spec->soa = tmpl->soa;
     for (const auto& m : tmpl->members) {
         StructMember sm = m;
         sm.type = substitute(m.type, subs);
         spec->members.push_back(std::move(sm));
     }
 
+    // Instances are compiled with the main program, whichever module asked.
     auto oldNs = currentNamespace_;
+    auto oldUnit = currentUnit_;
     currentNamespace_ = ns;
+    currentUnit_ = Symbol();
     analyzeStruct(*spec);
     instantiatedStructDecls_.push_back(std::move(spec));
-    if (!ns.empty()) {
+    if (tmpl == &sliceTemplate_) {
+        // Kept apart so a module analyzed with structs_ swapped out still sees them.
+        StructDef& def = slices_[mangled] = std::move(structs_[mangled]);
+        def.slice = true;
+        structs_.erase(mangled);
+    } else if (!ns.empty()) {
         moduleStructs_[ns][mangled] = std::move(structs_[mangled]);
         structs_.erase(mangled);
     }
     currentNamespace_ = oldNs;
+    currentUnit_ = oldUnit;
 }
 
-void SemanticAnalyzer::instantiateFunc(const std::string& name, const std::string& ns, const std::vector<Type>& args) {
+void SemanticAnalyzer::instantiateFunc(Symbol name, Symbol ns, const std::vector<const Type*>& args) {
     if (args.empty()) return;
-    std::string mangled = mangleGenericName(name, args);
-    if (getFunc(mangled, ns)) return;
-
-    const FuncDecl* tmpl = nullptr;
-    if (ns.empty()) {
-        if (funcTemplates_.count(name)) tmpl = funcTemplates_[name];
-    } else {
-        if (moduleFuncTemplates_.count(ns) && moduleFuncTemplates_[ns].count(name))
-            tmpl = moduleFuncTemplates_[ns][name];
+    GenericInstance key{true, name, ns, args};
+    if (!currentUnit_.empty()) recordInstance(key);
+    stats_.requests++;
+    Symbol mangled = mangleGenericName(name, args);
+    if (instances_.count(key) || getFunc(mangled, ns)) {
+        stats_.reused++;
+        return;
     }
+
+    const FuncDecl* tmpl = findFuncTemplate(name, ns);
     if (!tmpl) return;
+    instances_.insert(std::move(key));
+    stats_.funcs++;
+    InstanceTimer timer(instanceDepth_, stats_.seconds);
 
-    std::unordered_map<std::string, Type> subs;
+    std::unordered_map<Symbol, const Type*> subs;
     for (size_t i = 0; i < tmpl->typeParams.size() && i < args.size(); i++)
         subs[tmpl->typeParams[i]] = args[i];
 
     auto spec = std::make_unique<FuncDecl>();
     spec->name = mangled;
     spec->loc = tmpl->loc;
+    spec->forceInline = tmpl->forceInline;
+    spec->noInline = tmpl->noInline;
     spec->returnType = substitute(tmpl->returnType, subs);
     for (const auto& p : tmpl->params) {
         FuncParam fp = p;
@@ -219,32 +320,78 @@ void SemanticAnalyzer::instantiateFunc(const std::string& name, const std::strin
     spec->body = substituteStmt(tmpl->body.get(), subs);
 
     auto oldNs = currentNamespace_;
+    auto oldUnit = currentUnit_;
     currentNamespace_ = ns;
+    currentUnit_ = Symbol();
     analyzeFunc(*spec);
+    functions_[mangled].instance = true;
     instantiatedFuncDecls_.push_back(std::move(spec));
     if (!ns.empty()) {
         moduleFunctions_[ns][mangled] = std::move(functions_[mangled]);
         functions_.erase(mangled);
     }
     currentNamespace_ = oldNs;
+    currentUnit_ = oldUnit;
+}
+
+const StructDecl* SemanticAnalyzer::findStructTemplate(Symbol name, Symbol ns) {
+    if (ns.empty()) {
+        auto i = structTemplates_.find(name);
+        return i == structTemplates_.end() ? nullptr : i->second;
+    }
+    auto& templates = moduleStructTemplates_[ns];
+    auto i = templates.find(name);
+    if (i != templates.end()) return i->second;
+    auto img = images_.find(ns);
+    if (img == images_.end()) return nullptr;
+    std::unique_ptr<StructDecl> decl = img->second->structTemplate(name);
+    if (!decl) return nullptr;
+    loadedStructDecls_.push_back(std::move(decl));
+    return templates[name] = loadedStructDecls_.back().get();
+}
+
+const FuncDecl* SemanticAnalyzer::findFuncTemplate(Symbol name, Symbol ns) {
+    if (ns.empty()) {
+        auto i = funcTemplates_.find(name);
+        return i == funcTemplates_.end() ? nullptr : i->second;
+    }
+    auto& templates = moduleFuncTemplates_[ns];
+    auto i = templates.find(name);
+    if (i != templates.end()) return i->second;
+    auto img = images_.find(ns);
+    if (img == images_.end()) return nullptr;
+    std::unique_ptr<FuncDecl> decl = img->second->funcTemplate(name);
+    if (!decl) return nullptr;
+    loadedFuncDecls_.push_back(std::move(decl));
+    return templates[name] = loadedFuncDecls_.back().get();
+}
+
+void SemanticAnalyzer::recordInstance(const GenericInstance& gi) {
+    if (recorded_[currentUnit_].insert(gi).second) moduleInstances_[currentUnit_].push_back(gi);
 }
 
 void SemanticAnalyzer::error(const std::string& msg, SourceLoc loc) {
     errors_.push_back(SourceManager::instance().formatError(loc, msg));
 }
 
-StructDef* SemanticAnalyzer::getStruct(const std::string& name, const std::string& ns) {
+StructDef* SemanticAnalyzer::getStruct(Symbol name, Symbol ns) {
     if (ns.empty()) {
         auto i = structs_.find(name);
-        return i == structs_.end() ? nullptr : &i->second;
+        if (i != structs_.end()) return &i->second;
+        i = slices_.find(name);
+        return i == slices_.end() ? nullptr : &i->second;
     }
     auto mi = moduleStructs_.find(ns);
     if (mi == moduleStructs_.end()) return nullptr;
     auto i = mi->second.find(name);
-    return i == mi->second.end() ? nullptr : &i->second;
+    if (i != mi->second.end()) return &i->second;
+    auto img = images_.find(ns);
+    StructDef sd;
+    if (img == images_.end() || !img->second->findStruct(name, sd)) return nullptr;
+    return &(mi->second[name] = std::move(sd));
 }
 
-FuncSymbol* SemanticAnalyzer::getFunc(const std::string& name, const std::string& ns) {
+FuncSymbol* SemanticAnalyzer::getFunc(Symbol name, Symbol ns) {
     if (ns.empty()) {
         auto i = functions_.find(name);
         return i == functions_.end() ? nullptr : &i->second;
@@ -252,86 +399,145 @@ FuncSymbol* SemanticAnalyzer::getFunc(const std::string& name, const std::string
     auto mi = moduleFunctions_.find(ns);
     if (mi == moduleFunctions_.end()) return nullptr;
     auto i = mi->second.find(name);
-    return i == mi->second.end() ? nullptr : &i->second;
+    if (i != mi->second.end()) return &i->second;
+    auto img = images_.find(ns);
+    FuncSymbol fs;
+    if (img == images_.end() || !img->second->findFunc(name, fs)) return nullptr;
+    fs.ns = ns;
+    fs.unit = ns;
+    fs.precompiled = true;
+    return &(mi->second[name] = std::move(fs));
 }
 
-Type SemanticAnalyzer::resolveType(const Type& t) {
-    if (t.kind == Type::Kind::Pointer) {
-        Type r = t;
-        r.ptrTo = std::make_unique<Type>(resolveType(*t.ptrTo));
-        return r;
-    }
-    if (t.kind != Type::Kind::StructRef) return t;
+const Type* SemanticAnalyzer::resolveType(const Type* t) {
+    TypeTable& types = TypeTable::instance();
+    if (t->kind == Type::Kind::Pointer) return types.pointerTo(resolveType(t->ptrTo));
+    if (t->kind != Type::Kind::StructRef) return t;
 
-    if (!t.typeArgs.empty()) {
-        std::vector<Type> resolvedArgs;
-        for (const auto& arg : t.typeArgs) resolvedArgs.push_back(resolveType(arg));
+    if (!t->typeArgs.empty()) {
+        std::vector<const Type*> resolvedArgs;
+        for (const Type* arg : t->typeArgs) resolvedArgs.push_back(resolveType(arg));
 
-        std::string targetNs = t.ns;
+        Symbol targetNs = t->ns;
         if (targetNs.empty() && !currentNamespace_.empty()) {
             // Check if template exists in current namespace
-            if (moduleStructTemplates_.count(currentNamespace_) && moduleStructTemplates_[currentNamespace_].count(t.structName))
+            if (findStructTemplate(t->structName, currentNamespace_))
                 targetNs = currentNamespace_;
         }
 
-        instantiateStruct(t.structName, targetNs, resolvedArgs);
-        Type r = t;
-        r.ns = targetNs;
-        r.structName = mangleGenericName(t.structName, resolvedArgs);
-        r.typeArgs.clear();
-        return resolveType(r);
-    }
-
-    StructDef* sd = getStruct(t.structName, t.ns);
-    if (!sd && t.ns.empty() && !currentNamespace_.empty()) {
-        sd = getStruct(t.structName, currentNamespace_);
-        if (sd) {
-            Type r = t;
-            r.ns = currentNamespace_;
-            return r;
-        }
+        instantiateStruct(t->structName, targetNs, resolvedArgs);
+        return resolveType(types.structRef(mangleGenericName(t->structName, resolvedArgs), targetNs));
+    }
+
+    StructDef* sd = getStruct(t->structName, t->ns);
+    if (!sd && t->ns.empty() && !currentNamespace_.empty()) {
+        sd = getStruct(t->structName, currentNamespace_);
+        if (sd) return types.structRef(t->structName, currentNamespace_);
     }
-    if (!sd) return t;
-    Type r = t;
-    r.kind = Type::Kind::StructRef;
-    r.structName = t.structName;
-    r.ns = t.ns;
-    return r;
+    return t;
 }
 
 void SemanticAnalyzer::analyzeStruct(const StructDecl& s) {
     StructDef def;
     def.name = s.name;
-    def.mangledName = currentNamespace_.empty() ? s.name : currentNamespace_ + "_" + s.name;
-    size_t offset = 0;
+    def.mangledName = currentNamespace_.empty() ? s.name.str() : currentNamespace_ + "_" + s.name;
+    std::vector<size_t> sizes, aligns, order;
     for (size_t i = 0; i < s.members.size(); i++) {
         const auto& m = s.members[i];
-        Type ty = resolveType(m.type);
+        const Type* ty = resolveType(m.type);
         def.members.push_back({m.name, ty});
         def.memberIndex[m.name] = i;
-        if (ty.kind == Type::Kind::Int || ty.kind == Type::Kind::Float || ty.kind == Type::Kind::Bool)
-            offset += 8;
-        else if (ty.kind == Type::Kind::StructRef) {
-            StructDef* sd = getStruct(ty.structName, ty.ns);
-            offset += sd ? sd->sizeBytes : 8;
-        }
+        size_t size, align;
+        typeLayout(ty, size, align);
+        sizes.push_back(size);
+        aligns.push_back(s.packed ? 1 : align);
+        order.push_back(i);
     }
-    def.sizeBytes = (offset + 7) & ~7;
+    // C layout: each member at the next multiple of its alignment, the whole
+    // padded to the largest one. @reorder places wider-aligned members first
+    // (keeping declaration order among equals), which leaves no interior
+    // padding; offsets stay indexed by declaration order either way.
+    if (s.reorder)
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return aligns[a] > aligns[b]; });
+    def.offsets.resize(s.members.size());
+    size_t offset = 0;
+    for (size_t i : order) {
+        offset = (offset + aligns[i] - 1) / aligns[i] * aligns[i];
+        def.offsets[i] = offset;
+        offset += sizes[i];
+        def.alignBytes = std::max(def.alignBytes, aligns[i]);
+    }
+    def.sizeBytes = (offset + def.alignBytes - 1) / def.alignBytes * def.alignBytes;
+    def.soa = s.soa;
     structs_[s.name] = std::move(def);
 }
 
+bool SemanticAnalyzer::isSoa(const Type* t) {
+    if (t->kind != Type::Kind::StructRef) return false;
+    StructDef* sd = getStruct(t->structName, t->ns);
+    return sd && sd->soa;
+}
+
+bool SemanticAnalyzer::isSlice(const Type* t) {
+    if (t->kind != Type::Kind::StructRef) return false;
+    StructDef* sd = getStruct(t->structName, t->ns);
+    return sd && sd->slice;
+}
+
+const Type* SemanticAnalyzer::sliceOf(const Type* element) {
+    instantiateStruct(sliceTemplate_.name, Symbol(), {element});
+    return TypeTable::instance().structRef(mangleGenericName(sliceTemplate_.name, {element}), Symbol());
+}
+
+// Slices built by an expression, and struct results of calls, live in a
+// hidden local of their own.
+Symbol SemanticAnalyzer::addFrameSlot(const Type* type) {
+    Symbol name;
+    int n = 0;
+    do name = Symbol(".slot" + std::to_string(n++));
+    while (currentFuncSymbol_ && currentFuncSymbol_->locals.count(name));
+    addVar(name, type);
+    return name;
+}
+
+void SemanticAnalyzer::typeLayout(const Type* t, size_t& size, size_t& align) {
+    if (t->kind == Type::Kind::Bool || t->kind == Type::Kind::Char) {
+        size = align = 1;
+        return;
+    }
+    if (t->kind == Type::Kind::StructRef) {
+        if (StructDef* sd = getStruct(t->structName, t->ns)) {
+            size = sd->sizeBytes;
+            align = sd->alignBytes;
+            return;
+        }
+    }
+    if (isVector(t)) {
+        size = 32;
+        align = 16;
+        return;
+    }
+    size = align = (size_t)wordBytes_;
+}
+
 void SemanticAnalyzer::analyzeFunc(const FuncDecl& f) {
     FuncSymbol sym;
     sym.name = f.name;
     sym.ns = currentNamespace_;
-    if (f.isExtern) sym.mangledName = f.name;
-    else sym.mangledName = currentNamespace_.empty() ? f.name : currentNamespace_ + "_" + f.name;
+    if (f.isExtern) sym.mangledName = f.name.str();
+    else sym.mangledName = currentNamespace_.empty() ? f.name.str() : currentNamespace_ + "_" + f.name;
     sym.returnType = resolveType(f.returnType);
     sym.decl = &f;
-    for (const auto& p : f.params)
+    sym.unit = currentUnit_;
+    sym.precompiled = f.isExtern;
+    for (const auto& p : f.params) {
         sym.paramTypes.push_back(resolveType(p.type));
+        if (isVector(sym.paramTypes.back()))
+            error("parameter '" + p.name + "' of '" + f.name + "' is a vector; pass a pointer (*" +
+                  sym.paramTypes.back()->mangledName + ") instead", p.loc);
+    }
 
-    std::string key = f.name; // Use a unique key if possible
+    Symbol key = f.name; // Use a unique key if possible
     functions_[key] = std::move(sym);
     FuncSymbol& fs = functions_[key];
 
@@ -343,18 +549,28 @@ void SemanticAnalyzer::analyzeFunc(const FuncDecl& f) {
     currentFunc_ = const_cast<FuncDecl*>(&f);
     currentFuncSymbol_ = &fs;
     nextFrameOffset_ = 0;
-    // Windows x64: first 4 args in RCX, RDX, R8, R9. We spill to [RBP+16], [RBP+24], ...
+    // Parameters start in the caller's argument slots at [RBP+16], [RBP+24], ...
+    // (cdecl, and the Windows x64 home area). System V passes no slots for
+    // register arguments, so the code generator moves those into the frame.
     int paramOffset = 16;
     for (size_t i = 0; i < f.params.size(); i++) {
-        Type pt = resolveType(f.params[i].type);
+        const Type* pt = resolveType(f.params[i].type);
         addVar(f.params[i].name, pt, true);
         VarSymbol* vs = lookupVar(f.params[i].name);
-        if (vs) {
+        if (vs && pt->kind != Type::Kind::StructRef) {
             vs->frameOffset = paramOffset;
             fs.locals[f.params[i].name] = *vs;
         }
         paramOffset += 8;
     }
+    if (fs.returnType->kind == Type::Kind::StructRef && f.body) {
+        // The caller passes the address the result is copied to. It is
+        // live from entry, like a parameter.
+        addVar(resultSlot(), TypeTable::instance().pointerTo(fs.returnType));
+        VarSymbol* vs = lookupVar(resultSlot());
+        vs->isParam = true;
+        fs.locals[resultSlot()] = *vs;
+    }
     if (f.body) analyzeStmt(f.body.get());
     popScope();
 
@@ -363,87 +579,85 @@ void SemanticAnalyzer::analyzeFunc(const FuncDecl& f) {
     nextFrameOffset_ = oldOffset;
 }
 
-Type SemanticAnalyzer::analyzeExpr(Expr* expr) {
-    if (!expr) return Type{};
+const Type* SemanticAnalyzer::analyzeExpr(Expr* expr) {
+    TypeTable& types = TypeTable::instance();
+    const Type* intTy = types.get(Type::Kind::Int);
+    if (!expr) return intTy;
     switch (expr->kind) {
         case Expr::Kind::IntLit:
-            expr->exprType.kind = Type::Kind::Int;
-            return expr->exprType;
+            return expr->exprType = intTy;
         case Expr::Kind::FloatLit:
-            expr->exprType.kind = Type::Kind::Float;
-            return expr->exprType;
+            return expr->exprType = types.get(Type::Kind::Float);
         case Expr::Kind::BoolLit:
-            expr->exprType.kind = Type::Kind::Bool;
-            return expr->exprType;
+            return expr->exprType = types.get(Type::Kind::Bool);
         case Expr::Kind::StringLit:
-            expr->exprType.kind = Type::Kind::String;
-            return expr->exprType;
+            return expr->exprType = types.get(Type::Kind::String);
         case Expr::Kind::Var: {
             VarSymbol* vs = lookupVar(expr->ident);
             if (!vs) {
                 error("undefined variable '" + expr->ident + "'", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                return expr->exprType = intTy;
             }
-            expr->exprType = vs->type;
-            return expr->exprType;
+            return expr->exprType = vs->type;
         }
         case Expr::Kind::Binary: {
-            Type l = analyzeExpr(expr->left.get());
-            Type r = analyzeExpr(expr->right.get());
-            if (expr->op == "and" || expr->op == "or" || expr->op == "==" || expr->op == "!=" ||
-                expr->op == "<" || expr->op == ">" || expr->op == "<=" || expr->op == ">=") {
-                expr->exprType.kind = Type::Kind::Bool;
-                return expr->exprType;
+            const Type* l = analyzeExpr(expr->left.get());
+            const Type* r = analyzeExpr(expr->right.get());
+            if (isVector(l) || isVector(r)) {
+                const Type* v = isVector(l) ? l : r;
+                if (l != r)
+                    error("vector arithmetic needs two " + v->mangledName + " operands", expr->loc);
+                else if (expr->op != Expr::Op::Add && expr->op != Expr::Op::Sub && expr->op != Expr::Op::Mul &&
+                         !(expr->op == Expr::Op::Div && v->kind == Type::Kind::F64x4))
+                    error("operator not defined on " + v->mangledName, expr->loc);
+                return expr->exprType = v;
             }
-            if (expr->op == "+" || expr->op == "-" || expr->op == "*" || expr->op == "/" || expr->op == "%") {
-                if (l.kind == Type::Kind::String && expr->op == "+") {
-                    expr->exprType.kind = Type::Kind::String;
-                    return expr->exprType;
-                }
-                if (l.kind == Type::Kind::Pointer && (expr->op == "+" || expr->op == "-")) {
-                    expr->exprType = l;
-                    return expr->exprType;
-                }
-                expr->exprType = l;
-                return expr->exprType;
+            if (l->kind == Type::Kind::Pointer && isSoa(l->ptrTo) &&
+                (expr->op == Expr::Op::Add || expr->op == Expr::Op::Sub))
+                error("pointer arithmetic on @soa struct '" + l->ptrTo->structName + "'; index it with [] instead",
+                      expr->loc);
+            switch (expr->op) {
+                case Expr::Op::And: case Expr::Op::Or:
+                case Expr::Op::Eq: case Expr::Op::Ne: case Expr::Op::Lt:
+                case Expr::Op::Gt: case Expr::Op::Le: case Expr::Op::Ge:
+                    return expr->exprType = types.get(Type::Kind::Bool);
+                case Expr::Op::Add: case Expr::Op::Sub: case Expr::Op::Mul:
+                case Expr::Op::Div: case Expr::Op::Mod:
+                    return expr->exprType = l;  // string concat and pointer arithmetic keep the left type
+                default:
+                    return expr->exprType = intTy;
             }
-            expr->exprType.kind = Type::Kind::Int;
-            return expr->exprType;
         }
         case Expr::Kind::Unary: {
-            Type o = analyzeExpr(expr->right.get());
-            if (expr->op == "not") {
-                expr->exprType.kind = Type::Kind::Bool;
-                return expr->exprType;
-            }
-            expr->exprType = o;
-            return expr->exprType;
+            const Type* o = analyzeExpr(expr->right.get());
+            if (isVector(o)) error("operator not defined on " + o->mangledName, expr->loc);
+            if (expr->op == Expr::Op::Not) return expr->exprType = types.get(Type::Kind::Bool);
+            return expr->exprType = o;
         }
         case Expr::Kind::Call: {
-            std::string targetNs = expr->ns;
+            static const Symbol printSym("print"), printlnSym("println");
+            Symbol targetNs = expr->ns;
             if (targetNs.empty() && !currentNamespace_.empty()) {
-                if (moduleFuncTemplates_.count(currentNamespace_) && moduleFuncTemplates_[currentNamespace_].count(expr->ident))
+                if (findFuncTemplate(expr->ident, currentNamespace_))
                     targetNs = currentNamespace_;
                 else if (functions_.count(expr->ident))
-                    targetNs = "";
+                    targetNs = Symbol();
             }
 
-            if (!expr->exprType.typeArgs.empty()) {
-                std::vector<Type> resolvedArgs;
-                for (const auto& arg : expr->exprType.typeArgs) resolvedArgs.push_back(resolveType(arg));
+            if (!expr->typeArgs.empty()) {
+                std::vector<const Type*> resolvedArgs;
+                for (const Type* arg : expr->typeArgs) resolvedArgs.push_back(resolveType(arg));
                 instantiateFunc(expr->ident, targetNs, resolvedArgs);
                 expr->ident = mangleGenericName(expr->ident, resolvedArgs);
                 expr->ns = targetNs;
-                expr->exprType.typeArgs.clear();
+                expr->typeArgs.clear();
             }
 
-            if (expr->ns.empty() && (expr->ident == "print" || expr->ident == "println")) {
+            if (expr->ns.empty() && (expr->ident == printSym || expr->ident == printlnSym)) {
                 for (size_t i = 0; i < expr->args.size(); i++) {
                     analyzeExpr(expr->args[i].get());
                 }
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                return expr->exprType = intTy;
             }
             FuncSymbol* fs = getFunc(expr->ident, expr->ns);
             if (!fs && expr->ns.empty() && !currentNamespace_.empty()) {
@@ -451,10 +665,10 @@ Type SemanticAnalyzer::analyzeExpr(Expr* expr) {
                 if (fs) expr->ns = currentNamespace_;
             }
 
+            if (!fs && expr->ns.empty() && isVectorBuiltin(expr->ident)) return expr->exprType = analyzeVectorBuiltin(expr);
             if (!fs) {
                 error("undefined function '" + expr->ident + "' (ns=" + expr->ns + ")", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                return expr->exprType = intTy;
             }
             if (expr->args.size() != fs->paramTypes.size()) {
                 error("argument count mismatch for '" + expr->ident + "'", expr->loc);
@@ -462,8 +676,8 @@ Type SemanticAnalyzer::analyzeExpr(Expr* expr) {
             for (size_t i = 0; i < expr->args.size(); i++) {
                 analyzeExpr(expr->args[i].get());
             }
-            expr->exprType = fs->returnType;
-            return expr->exprType;
+            if (fs->returnType->kind == Type::Kind::StructRef) expr->member = addFrameSlot(fs->returnType);
+            return expr->exprType = fs->returnType;
         }
         case Expr::Kind::Member: {
             // Check if it's a module access
@@ -477,64 +691,160 @@ Type SemanticAnalyzer::analyzeExpr(Expr* expr) {
                 }
             }
 
-            Type base = analyzeExpr(expr->left.get());
-            if (base.kind == Type::Kind::Pointer) {
+            soaMemberBase_ = expr->left->kind == Expr::Kind::Index;
+            const Type* base = analyzeExpr(expr->left.get());
+            if (base->kind == Type::Kind::Pointer) {
                 // Auto-dereference for pointer to struct
-                base = *base.ptrTo;
+                base = base->ptrTo;
             }
-            if (base.kind != Type::Kind::StructRef) {
+            if (base->kind != Type::Kind::StructRef) {
                 error("member access on non-struct type", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                return expr->exprType = intTy;
             }
-            StructDef* sd = getStruct(base.structName, base.ns);
+            StructDef* sd = getStruct(base->structName, base->ns);
             if (!sd) {
-                error("unknown struct '" + base.structName + "'", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                error("unknown struct '" + base->structName + "'", expr->loc);
+                return expr->exprType = intTy;
             }
             auto it = sd->memberIndex.find(expr->member);
             if (it == sd->memberIndex.end()) {
-                error("no member '" + expr->member + "' in struct '" + base.structName + "'", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                error("no member '" + expr->member + "' in struct '" + base->structName + "'", expr->loc);
+                return expr->exprType = intTy;
             }
-            expr->exprType = sd->members[it->second].second;
-            return expr->exprType;
+            return expr->exprType = sd->members[it->second].second;
         }
         case Expr::Kind::Deref: {
-            Type base = analyzeExpr(expr->right.get());
-            if (base.kind != Type::Kind::Pointer) {
+            const Type* base = analyzeExpr(expr->right.get());
+            if (base->kind != Type::Kind::Pointer) {
                 error("dereferencing non-pointer type", expr->loc);
-                expr->exprType.kind = Type::Kind::Int;
-                return expr->exprType;
+                return expr->exprType = intTy;
             }
-            expr->exprType = *base.ptrTo;
-            return expr->exprType;
+            return expr->exprType = base->ptrTo;
         }
-        case Expr::Kind::AddressOf: {
-            Type base = analyzeExpr(expr->right.get());
-            expr->exprType.kind = Type::Kind::Pointer;
-            expr->exprType.ptrTo = std::make_unique<Type>(base);
-            return expr->exprType;
+        case Expr::Kind::Index: {
+            bool memberBase = soaMemberBase_;
+            soaMemberBase_ = false;
+            const Type* base = analyzeExpr(expr->left.get());
+            analyzeExpr(expr->right.get());
+            if (isSlice(base)) base = getStruct(base->structName)->members[0].second;  // checked at run time
+            if (base->kind != Type::Kind::Pointer) {
+                error("indexing non-pointer type", expr->loc);
+                return expr->exprType = intTy;
+            }
+            // Members of an @soa element live in separate arrays.
+            if (isSoa(base->ptrTo) && !memberBase)
+                error("an element of @soa struct '" + base->ptrTo->structName +
+                      "' has no address of its own; access one of its members", expr->loc);
+            return expr->exprType = base->ptrTo;
         }
-        case Expr::Kind::New: {
-            if (expr->left) analyzeExpr(expr->left.get());
-            expr->exprType.kind = Type::Kind::Pointer;
-            expr->exprType.ptrTo = std::make_unique<Type>(resolveType(*expr->targetType));
-            return expr->exprType;
+        case Expr::Kind::Slice: {
+            // p[lo..hi] views hi - lo elements from p + lo; s[lo..hi] does the
+            // same within slice s, checking lo <= hi <= s.len at run time.
+            const Type* base = analyzeExpr(expr->left.get());
+            for (auto& bound : expr->args)
+                if (analyzeExpr(bound.get())->kind != Type::Kind::Int) error("slice bounds must be int", bound->loc);
+            const Type* element = nullptr;
+            if (base->kind == Type::Kind::Pointer && !isSoa(base->ptrTo)) element = base->ptrTo;
+            else if (isSlice(base)) element = getStruct(base->structName)->members[0].second->ptrTo;
+            if (!element) {
+                error("only pointers and slices can be sliced", expr->loc);
+                return expr->exprType = intTy;
+            }
+            const Type* slice = sliceOf(element);
+            expr->ident = addFrameSlot(slice);
+            return expr->exprType = slice;
         }
-        case Expr::Kind::Delete: {
-            analyzeExpr(expr->right.get());
-            expr->exprType.kind = Type::Kind::Void;
-            return expr->exprType;
+        case Expr::Kind::NewArray: {
+            if (analyzeExpr(expr->left.get())->kind != Type::Kind::Int)
+                error("array size must be int", expr->left->loc);
+            const Type* element = resolveType(expr->targetType);
+            if (isSoa(element)) {
+                error("@soa struct '" + element->structName + "' cannot be an array element", expr->loc);
+                return expr->exprType = intTy;
+            }
+            const Type* slice = sliceOf(element);
+            expr->ident = addFrameSlot(slice);
+            return expr->exprType = slice;
         }
+        case Expr::Kind::AddressOf:
+            return expr->exprType = types.pointerTo(analyzeExpr(expr->right.get()));
+        case Expr::Kind::New:
+            if (expr->left) analyzeExpr(expr->left.get());
+            return expr->exprType = types.pointerTo(resolveType(expr->targetType));
+        case Expr::Kind::Delete:
+            analyzeExpr(expr->right.get());
+            return expr->exprType = types.get(Type::Kind::Void);
         default:
-            expr->exprType.kind = Type::Kind::Int;
-            return expr->exprType;
+            return expr->exprType = intTy;
     }
 }
 
+bool isVectorBuiltin(Symbol name) {
+    static const Symbol names[] = {Symbol("f64x4"), Symbol("i32x8"), Symbol("vload"), Symbol("vstore"),
+                                   Symbol("extract"), Symbol("insert"), Symbol("reduce_add"),
+                                   Symbol("reduce_min"), Symbol("reduce_max")};
+    return std::find(std::begin(names), std::end(names), name) != std::end(names);
+}
+
+Symbol resultSlot() {
+    static const Symbol name(".result");
+    return name;
+}
+
+// f64x4(x) and i32x8(x) fill every lane with x; f64x4(a, b, c, d) and
+// i32x8 with eight values give each lane. vload(p) reads a vector from an
+// *float (four floats) or an *int (eight ints, keeping their low 32 bits)
+// and vstore(p, v) writes one back. The lane of extract(v, k) and
+// insert(v, k, x) must be a literal.
+const Type* SemanticAnalyzer::analyzeVectorBuiltin(Expr* call) {
+    TypeTable& types = TypeTable::instance();
+    const std::string& name = call->ident.str();
+    std::vector<const Type*> args;
+    for (auto& a : call->args) args.push_back(analyzeExpr(a.get()));
+    auto vectorOf = [&](const Type* p) -> const Type* {
+        if (p->kind == Type::Kind::Pointer && p->ptrTo->kind == Type::Kind::Float) return types.get(Type::Kind::F64x4);
+        if (p->kind == Type::Kind::Pointer && p->ptrTo->kind == Type::Kind::Int) return types.get(Type::Kind::I32x8);
+        return nullptr;
+    };
+    auto laneOf = [&](const Type* v) {
+        return types.get(v->kind == Type::Kind::F64x4 ? Type::Kind::Float : Type::Kind::Int);
+    };
+    auto fail = [&](const std::string& msg) {
+        error(msg, call->loc);
+        return types.get(Type::Kind::Int);
+    };
+
+    if (name == "f64x4" || name == "i32x8") {
+        const Type* v = types.get(name == "f64x4" ? Type::Kind::F64x4 : Type::Kind::I32x8);
+        if (args.size() != 1 && (int)args.size() != vectorLanes(v))
+            return fail(name + " takes 1 or " + std::to_string(vectorLanes(v)) + " arguments");
+        for (const Type* a : args)
+            if (a != laneOf(v)) return fail(name + " lanes are " + laneOf(v)->mangledName);
+        return v;
+    }
+    if (name == "vload" || name == "vstore") {
+        size_t n = name == "vload" ? 1 : 2;
+        if (args.size() != n) return fail(name + " takes " + std::to_string(n) + " argument" + (n > 1 ? "s" : ""));
+        const Type* v = vectorOf(args[0]);
+        if (!v) return fail(name + " needs an *int or *float pointer");
+        if (n == 1) return v;
+        if (args[1] != v) return fail("vstore through " + args[0]->ptrTo->mangledName + " pointer needs an " +
+                                      v->mangledName);
+        return types.get(Type::Kind::Void);
+    }
+    size_t n = name == "extract" ? 2 : name == "insert" ? 3 : 1;
+    if (args.size() != n) return fail(name + " takes " + std::to_string(n) + " argument" + (n > 1 ? "s" : ""));
+    const Type* v = args[0];
+    if (!isVector(v)) return fail(name + " needs an f64x4 or i32x8");
+    if (n == 1) return laneOf(v);
+    const Expr* lane = call->args[1].get();
+    if (lane->kind != Expr::Kind::IntLit || lane->intVal < 0 || lane->intVal >= vectorLanes(v))
+        return fail("lane of " + v->mangledName + " must be a literal from 0 to " + std::to_string(vectorLanes(v) - 1));
+    if (n == 2) return laneOf(v);
+    if (args[2] != laneOf(v)) return fail(v->mangledName + " lanes are " + laneOf(v)->mangledName);
+    return v;
+}
+
 void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
     if (!stmt) return;
     switch (stmt->kind) {
@@ -544,10 +854,10 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
             popScope();
             break;
         case Stmt::Kind::VarDecl: {
-            Type ty = resolveType(stmt->varType);
+            const Type* ty = resolveType(stmt->varType);
             if (stmt->varInit) {
-                Type initTy = analyzeExpr(stmt->varInit.get());
-                if (ty.kind == Type::Kind::Int && stmt->varType.structName.empty())
+                const Type* initTy = analyzeExpr(stmt->varInit.get());
+                if (ty->kind == Type::Kind::Int)
                     ty = initTy;  // infer from initializer when no explicit type
                 stmt->varType = ty;
             }
@@ -592,50 +902,28 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
 
 void SemanticAnalyzer::analyzeProgram() {
     for (const auto& s : program_->structs) {
-        if (s.typeParams.empty()) analyzeStruct(s);
+        if (s.name == sliceTemplate_.name) error("'slice' is a built-in type", s.loc);
+        else if (s.typeParams.empty()) analyzeStruct(s);
         else structTemplates_[s.name] = &s;
     }
     // Register builtins so they are known during analysis
-    FuncSymbol printlnSym;
-    printlnSym.name = "println";
-    printlnSym.mangledName = "println";
-    printlnSym.returnType.kind = Type::Kind::Int;
-    printlnSym.paramTypes.push_back(Type{});
-    printlnSym.paramTypes.back().kind = Type::Kind::Int;
-    functions_["println"] = std::move(printlnSym);
-    FuncSymbol printSym;
-    printSym.name = "print";
-    printSym.mangledName = "print";
-    printSym.returnType.kind = Type::Kind::Int;
-    printSym.paramTypes.push_back(Type{});
-    printSym.paramTypes.back().kind = Type::Kind::Int;
-    functions_["print"] = std::move(printSym);
-    FuncSymbol pfSym;
-    pfSym.name = "print_float";
-    pfSym.mangledName = "print_float";
-    pfSym.returnType.kind = Type::Kind::Int;
-    pfSym.paramTypes.push_back(Type{});
-    pfSym.paramTypes.back().kind = Type::Kind::Float;
-    functions_["print_float"] = std::move(pfSym);
-    FuncSymbol pflSym;
-    pflSym.name = "println_float";
-    pflSym.mangledName = "println_float";
-    pflSym.returnType.kind = Type::Kind::Int;
-    pflSym.paramTypes.push_back(Type{});
-    pflSym.paramTypes.back().kind = Type::Kind::Float;
-    functions_["println_float"] = std::move(pflSym);
-    FuncSymbol psSym;
-    psSym.name = "print_string";
-    psSym.mangledName = "print_string";
-    psSym.returnType.kind = Type::Kind::Int;
-    psSym.paramTypes.push_back(Type{Type::Kind::String});
-    functions_["print_string"] = std::move(psSym);
-    FuncSymbol plsSym;
-    plsSym.name = "println_string";
-    plsSym.mangledName = "println_string";
-    plsSym.returnType.kind = Type::Kind::Int;
-    plsSym.paramTypes.push_back(Type{Type::Kind::String});
-    functions_["println_string"] = std::move(plsSym);
+    TypeTable& types = TypeTable::instance();
+    const Type* intTy = types.get(Type::Kind::Int);
+    const Type* floatTy = types.get(Type::Kind::Float);
+    const Type* stringTy = types.get(Type::Kind::String);
+    const std::pair<const char*, const Type*> builtins[] = {
+        {"println", intTy}, {"print", intTy},
+        {"print_float", floatTy}, {"println_float", floatTy},
+        {"print_string", stringTy}, {"println_string", stringTy},
+    };
+    for (const auto& b : builtins) {
+        FuncSymbol sym;
+        sym.name = Symbol(b.first);
+        sym.mangledName = b.first;
+        sym.returnType = intTy;
+        sym.paramTypes.push_back(b.second);
+        functions_[sym.name] = std::move(sym);
+    }
     for (const auto& f : program_->functions) {
         if (f.typeParams.empty()) analyzeFunc(f);
         else funcTemplates_[f.name] = &f;
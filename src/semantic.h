@@ -5,88 +5,176 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 
 namespace gspp {
 
 struct StructDef {
-    std::string name;
+    Symbol name;
     std::string mangledName;
-    std::vector<std::pair<std::string, Type>> members;
-    std::unordered_map<std::string, size_t> memberIndex;
-    size_t sizeBytes = 0;  // for codegen
+    std::vector<std::pair<Symbol, const Type*>> members;
+    std::unordered_map<Symbol, size_t> memberIndex;
+    std::vector<size_t> offsets;  // byte offset of each member, in declaration order
+    size_t sizeBytes = 0;         // including tail padding
+    size_t alignBytes = 1;
+    // @soa: an array from new T[n] holds member i's n values at n * offsets[i],
+    // after a word holding n. For n == 1 that is the ordinary layout.
+    bool soa = false;
+    // An instance of the built-in slice<T>, spelled []T: a pointer to the
+    // first element, then the number of elements.
+    bool slice = false;
 };
 
 struct VarSymbol {
-    std::string name;
-    Type type;
+    Symbol name;
+    const Type* type = nullptr;
     int frameOffset = 0;  // negative offset from RBP
     bool isParam = false;
 };
 
 struct FuncSymbol {
-    std::string name;
+    Symbol name;
     std::string mangledName;
-    std::string ns;
-    Type returnType;
-    std::vector<Type> paramTypes;
+    Symbol ns;
+    const Type* returnType = nullptr;
+    std::vector<const Type*> paramTypes;
     const FuncDecl* decl = nullptr;
-    std::unordered_map<std::string, VarSymbol> locals;  // name -> symbol (frame offset etc.)
+    std::unordered_map<Symbol, VarSymbol> locals;  // name -> symbol (frame offset etc.)
+    Symbol unit;               // module whose object holds the code; empty for the main program
+    bool precompiled = false;  // code already exists (extern, or loaded from the module cache)
+    bool instance = false;     // generic instance; other objects may define the same one
 };
 
+// The SIMD builtins f64x4(...), i32x8(...), vload, vstore, extract, insert
+// and reduce_add/min/max; a declared function of the same name wins.
+bool isVectorBuiltin(Symbol name);
+
+// The hidden local of a function returning a struct: the address the caller
+// wants the result copied to.
+Symbol resultSlot();
+
+// A generic struct or function instantiated with concrete type arguments.
+// Types are interned, so the argument pointers form a canonical key.
+struct GenericInstance {
+    bool isFunc = false;
+    Symbol name;
+    Symbol ns;
+    std::vector<const Type*> args;
+
+    bool operator==(const GenericInstance& o) const {
+        return isFunc == o.isFunc && name == o.name && ns == o.ns && args == o.args;
+    }
+};
+
+struct GenericInstanceHash {
+    size_t operator()(const GenericInstance& gi) const {
+        size_t h = (size_t)gi.name.id() * 31 + gi.ns.id() * 2 + gi.isFunc;
+        for (const Type* t : gi.args) h = h * 1000003 ^ std::hash<const Type*>()(t);
+        return h;
+    }
+};
+
+struct InstantiationStats {
+    size_t requests = 0;  // instantiations asked for, including repeats
+    size_t reused = 0;    // requests answered by an existing instance
+    size_t structs = 0;   // distinct struct instances created
+    size_t funcs = 0;     // distinct function instances created
+    double seconds = 0;   // spent instantiating (nested work counted once)
+};
+
+struct ModuleInterface;
+class GsiModule;
+
 class SemanticAnalyzer {
 public:
-    explicit SemanticAnalyzer(Program* program);
-    void addModule(const std::string& name, Program* prog);
+    // wordBytes is the size of int, float, pointer and string values on
+    // the target (4 for 32-bit code); it decides struct layout.
+    explicit SemanticAnalyzer(Program* program, int wordBytes = 8);
+    void addModule(Symbol name, Program* prog);
+    // Registers a module from its cached interface instead of analyzing it.
+    // Structs, functions and templates are read from the image when first
+    // looked up; instantiations the module made are replayed so their code is
+    // generated with the main program. The image must outlive the analyzer.
+    void addCachedModule(Symbol name, const GsiModule* image);
+    // Interface of a module added with addModule, for the module cache.
+    ModuleInterface moduleInterface(Symbol name);
     bool analyze();
     const std::vector<std::string>& errors() const { return errors_; }
-    StructDef* getStruct(const std::string& name, const std::string& ns = "");
-    FuncSymbol* getFunc(const std::string& name, const std::string& ns = "");
-    const std::unordered_map<std::string, StructDef>& structs() const { return structs_; }
-    const std::unordered_map<std::string, FuncSymbol>& functions() const { return functions_; }
-    const std::unordered_map<std::string, std::unordered_map<std::string, FuncSymbol>>& moduleFunctions() const { return moduleFunctions_; }
+    const InstantiationStats& instantiationStats() const { return stats_; }
+    StructDef* getStruct(Symbol name, Symbol ns = Symbol());
+    FuncSymbol* getFunc(Symbol name, Symbol ns = Symbol());
+    // A new local of fs for code the optimizer introduces, in a frame slot of
+    // its own; its name cannot clash with a source identifier.
+    Symbol addTemp(FuncSymbol& fs, const Type* type);
+    const std::unordered_map<Symbol, StructDef>& structs() const { return structs_; }
+    const std::unordered_map<Symbol, FuncSymbol>& functions() const { return functions_; }
+    const std::unordered_map<Symbol, std::unordered_map<Symbol, FuncSymbol>>& moduleFunctions() const { return moduleFunctions_; }
 
 private:
     void analyzeProgram();
     void analyzeStruct(const StructDecl& s);
+    void typeLayout(const Type* t, size_t& size, size_t& align);
+    bool isSoa(const Type* t);
+    bool isSlice(const Type* t);
+    const Type* sliceOf(const Type* element);
+    Symbol addFrameSlot(const Type* type);
     void analyzeFunc(const FuncDecl& f);
     void analyzeStmt(Stmt* stmt);
-    Type analyzeExpr(Expr* expr);
-    Type resolveType(const Type& t);
+    const Type* analyzeExpr(Expr* expr);
+    const Type* analyzeVectorBuiltin(Expr* call);
+    const Type* resolveType(const Type* t);
     void pushScope();
     void popScope();
-    void addVar(const std::string& name, const Type& type, bool isParam = false);
-    VarSymbol* lookupVar(const std::string& name);
-    std::string typeName(const Type& t);
-    std::string mangleGenericName(const std::string& name, const std::vector<Type>& args);
-    Type substitute(const Type& t, const std::unordered_map<std::string, Type>& subs);
-    std::unique_ptr<Expr> substituteExpr(const Expr* e, const std::unordered_map<std::string, Type>& subs);
-    std::unique_ptr<Stmt> substituteStmt(const Stmt* s, const std::unordered_map<std::string, Type>& subs);
-    void instantiateStruct(const std::string& name, const std::string& ns, const std::vector<Type>& args);
-    void instantiateFunc(const std::string& name, const std::string& ns, const std::vector<Type>& args);
+    void addVar(Symbol name, const Type* type, bool isParam = false);
+    VarSymbol* lookupVar(Symbol name);
+    Symbol mangleGenericName(Symbol name, const std::vector<const Type*>& args);
+    const Type* substitute(const Type* t, const std::unordered_map<Symbol, const Type*>& subs);
+    std::unique_ptr<Expr> substituteExpr(const Expr* e, const std::unordered_map<Symbol, const Type*>& subs);
+    std::unique_ptr<Stmt> substituteStmt(const Stmt* s, const std::unordered_map<Symbol, const Type*>& subs);
+    void instantiateStruct(Symbol name, Symbol ns, const std::vector<const Type*>& args);
+    void instantiateFunc(Symbol name, Symbol ns, const std::vector<const Type*>& args);
+    const StructDecl* findStructTemplate(Symbol name, Symbol ns);
+    const FuncDecl* findFuncTemplate(Symbol name, Symbol ns);
+    void recordInstance(const GenericInstance& gi);
     void error(const std::string& msg, SourceLoc loc);
 
     Program* program_;
-    std::unordered_map<std::string, Program*> modules_;
-    std::unordered_map<std::string, std::unordered_map<std::string, StructDef>> moduleStructs_;
-    std::unordered_map<std::string, std::unordered_map<std::string, FuncSymbol>> moduleFunctions_;
+    int wordBytes_;
+    std::unordered_map<Symbol, Program*> modules_;
+    std::unordered_map<Symbol, std::unordered_map<Symbol, StructDef>> moduleStructs_;
+    std::unordered_map<Symbol, std::unordered_map<Symbol, FuncSymbol>> moduleFunctions_;
+
+    std::unordered_map<Symbol, const StructDecl*> structTemplates_;
+    std::unordered_map<Symbol, const FuncDecl*> funcTemplates_;
+    std::unordered_map<Symbol, std::unordered_map<Symbol, const StructDecl*>> moduleStructTemplates_;
+    std::unordered_map<Symbol, std::unordered_map<Symbol, const FuncDecl*>> moduleFuncTemplates_;
 
-    std::unordered_map<std::string, const StructDecl*> structTemplates_;
-    std::unordered_map<std::string, const FuncDecl*> funcTemplates_;
-    std::unordered_map<std::string, std::unordered_map<std::string, const StructDecl*>> moduleStructTemplates_;
-    std::unordered_map<std::string, std::unordered_map<std::string, const FuncDecl*>> moduleFuncTemplates_;
+    std::unordered_map<Symbol, const GsiModule*> images_;  // cached modules, decoded lazily
+    std::vector<std::unique_ptr<StructDecl>> loadedStructDecls_;  // templates decoded from images
+    std::vector<std::unique_ptr<FuncDecl>> loadedFuncDecls_;
 
     std::vector<std::unique_ptr<StructDecl>> instantiatedStructDecls_;
     std::vector<std::unique_ptr<FuncDecl>> instantiatedFuncDecls_;
 
-    std::unordered_map<std::string, StructDef> structs_;
-    std::unordered_map<std::string, FuncSymbol> functions_;
-    std::vector<std::unordered_map<std::string, VarSymbol>> scopes_;
+    std::unordered_map<Symbol, StructDef> structs_;
+    StructDecl sliceTemplate_;  // struct slice<T> { ptr: *T; len: int; }
+    // Instances of slice<T>, shared by the program and every module.
+    std::unordered_map<Symbol, StructDef> slices_;
+    std::unordered_map<Symbol, FuncSymbol> functions_;
+    std::vector<std::unordered_map<Symbol, VarSymbol>> scopes_;
     std::vector<std::string> errors_;
     FuncDecl* currentFunc_ = nullptr;
     FuncSymbol* currentFuncSymbol_ = nullptr;
     int nextFrameOffset_ = 0;
-    std::string currentNamespace_;
+    bool soaMemberBase_ = false;  // the Index being analyzed is the base of a member access
+    Symbol currentNamespace_;
+    Symbol currentUnit_;  // module whose own declarations are being analyzed
+    std::unordered_map<Symbol, std::vector<GenericInstance>> moduleInstances_;  // requested per module
+    std::unordered_set<GenericInstance, GenericInstanceHash> instances_;  // every instance created
+    std::unordered_map<Symbol, std::unordered_set<GenericInstance, GenericInstanceHash>> recorded_;
+    InstantiationStats stats_;
+    int instanceDepth_ = 0;
 };
 
 } // namespace gspp
@@ -0,0 +1,41 @@
+#include "symbol.h"
+#include <stdexcept>
+
+namespace gspp {
+
+Symbol::Symbol(std::string_view s) : id_(SymbolTable::instance().intern(s)) {}
+
+const std::string& Symbol::str() const {
+    return SymbolTable::instance().spelling(id_);
+}
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable inst;
+    return inst;
+}
+
+SymbolTable::SymbolTable() {
+    intern("");
+}
+
+uint32_t SymbolTable::intern(std::string_view s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(s);
+    if (it != ids_.end()) return it->second;
+    uint32_t id = count_;
+    if ((id >> ChunkBits) >= MaxChunks) throw std::length_error("too many distinct identifiers");
+    std::unique_ptr<std::string[]>& chunk = chunks_[id >> ChunkBits];
+    if (!chunk) chunk.reset(new std::string[ChunkSize]);
+    std::string& name = chunk[id & (ChunkSize - 1)];
+    name.assign(s.data(), s.size());
+    ids_.emplace(name, id);
+    count_++;
+    return id;
+}
+
+size_t SymbolTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+} // namespace gspp
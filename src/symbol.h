@@ -0,0 +1,75 @@
+#ifndef GSPP_SYMBOL_H
+#define GSPP_SYMBOL_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gspp {
+
+// Interned identifier. Each distinct spelling is stored once in the
+// SymbolTable and named by a small integer, so symbols compare and hash as
+// integers. The default-constructed symbol is the empty string. Construction
+// from text hashes it, so hot paths should intern once and keep the Symbol.
+class Symbol {
+public:
+    Symbol() = default;
+    explicit Symbol(std::string_view s);
+
+    uint32_t id() const { return id_; }
+    const std::string& str() const;
+    bool empty() const { return id_ == 0; }
+    bool operator==(Symbol o) const { return id_ == o.id_; }
+    bool operator!=(Symbol o) const { return id_ != o.id_; }
+
+private:
+    uint32_t id_ = 0;
+};
+
+// Safe to use from several threads: interning takes a lock, and spellings
+// live in fixed-size chunks that never move, so reading the spelling of a
+// symbol the caller already holds needs none.
+class SymbolTable {
+public:
+    static SymbolTable& instance();
+
+    uint32_t intern(std::string_view s);
+    const std::string& spelling(uint32_t id) const {
+        return chunks_[id >> ChunkBits][id & (ChunkSize - 1)];
+    }
+    size_t size() const;
+
+private:
+    static constexpr uint32_t ChunkBits = 12;
+    static constexpr uint32_t ChunkSize = 1u << ChunkBits;
+    static constexpr uint32_t MaxChunks = 1u << 12;  // 16M symbols
+
+    SymbolTable();
+
+    std::unique_ptr<std::string[]> chunks_[MaxChunks];  // id -> spelling
+    uint32_t count_ = 0;
+    std::unordered_map<std::string_view, uint32_t> ids_;  // views into chunks_
+    mutable std::mutex mutex_;
+};
+
+inline std::string operator+(const std::string& a, Symbol b) { return a + b.str(); }
+inline std::string operator+(const char* a, Symbol b) { return a + b.str(); }
+inline std::string operator+(Symbol a, const std::string& b) { return a.str() + b; }
+inline std::string operator+(Symbol a, const char* b) { return a.str() + b; }
+inline std::ostream& operator<<(std::ostream& os, Symbol s) { return os << s.str(); }
+
+} // namespace gspp
+
+namespace std {
+template <>
+struct hash<gspp::Symbol> {
+    size_t operator()(gspp::Symbol s) const noexcept { return s.id(); }
+};
+} // namespace std
+
+#endif
@@ -0,0 +1,197 @@
+#include "vectorize.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace gspp {
+
+namespace {
+
+bool sameLeaf(const Expr* a, const Expr* b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case Expr::Kind::IntLit: return a->intVal == b->intVal;
+        case Expr::Kind::FloatLit: return std::memcmp(&a->floatVal, &b->floatVal, sizeof a->floatVal) == 0;
+        case Expr::Kind::Var: return a->ident == b->ident;
+        default: return false;
+    }
+}
+
+// i = i + 1
+bool isIncrement(const Stmt* s, Symbol counter) {
+    if (!s || s->kind != Stmt::Kind::Assign) return false;
+    const Expr* t = s->assignTarget.get();
+    const Expr* v = s->assignValue.get();
+    return t->kind == Expr::Kind::Var && t->ident == counter && v->kind == Expr::Kind::Binary &&
+           v->op == Expr::Op::Add && v->left->kind == Expr::Kind::Var && v->left->ident == counter &&
+           v->right->kind == Expr::Kind::IntLit && v->right->intVal == 1;
+}
+
+void collectAddressTaken(const Expr* e, std::unordered_set<Symbol>& out) {
+    if (!e) return;
+    if (e->kind == Expr::Kind::AddressOf && e->right && e->right->kind == Expr::Kind::Var)
+        out.insert(e->right->ident);
+    collectAddressTaken(e->left.get(), out);
+    collectAddressTaken(e->right.get(), out);
+    for (const auto& a : e->args) collectAddressTaken(a.get(), out);
+}
+
+void collectAddressTaken(const Stmt* s, std::unordered_set<Symbol>& out) {
+    if (!s) return;
+    for (const auto& b : s->blockStmts) collectAddressTaken(b.get(), out);
+    for (const Expr* e : {s->varInit.get(), s->assignTarget.get(), s->assignValue.get(), s->condition.get(),
+                          s->returnExpr.get(), s->expr.get()})
+        collectAddressTaken(e, out);
+    for (const Stmt* c : {s->thenBranch.get(), s->elseBranch.get(), s->body.get(), s->initStmt.get(),
+                          s->stepStmt.get()})
+        collectAddressTaken(c, out);
+}
+
+struct Checker {
+    const FuncSymbol& fs;
+    VectorLoop& plan;
+    std::string& whyNot;
+    std::vector<Symbol> used;  // every local the vector code reads
+
+    const Type* localType(Symbol name) const {
+        auto it = fs.locals.find(name);
+        return it == fs.locals.end() ? nullptr : it->second.type;
+    }
+
+    bool fail(const std::string& why) {
+        whyNot = why;
+        return false;
+    }
+
+    // A local *int or *float; the element kind goes to kind.
+    bool elementPointerOk(Symbol p, Type::Kind& kind) {
+        const Type* t = localType(p);
+        if (!t || t->kind != Type::Kind::Pointer ||
+            (t->ptrTo->kind != Type::Kind::Int && t->ptrTo->kind != Type::Kind::Float))
+            return fail("'" + p.str() + "' is not an *int or *float local");
+        kind = t->ptrTo->kind;
+        if (std::find(plan.pointers.begin(), plan.pointers.end(), p) == plan.pointers.end())
+            plan.pointers.push_back(p);
+        used.push_back(p);
+        return true;
+    }
+
+    void addInvariant(const Expr* e) {
+        if (plan.invariantIndex(e) < 0) plan.invariants.push_back(e);
+    }
+
+    bool value(const Expr* e, Type::Kind kind) {
+        if (e->exprType->kind != kind) return fail("the loop mixes int and float values");
+        Symbol p = elementPointer(e, plan.counter);
+        if (!p.empty()) {
+            Type::Kind k;
+            return elementPointerOk(p, k);
+        }
+        switch (e->kind) {
+            case Expr::Kind::IntLit:
+            case Expr::Kind::FloatLit:
+                addInvariant(e);
+                return true;
+            case Expr::Kind::Var: {
+                if (e->ident == plan.counter) {
+                    plan.usesCounter = true;
+                    return true;
+                }
+                const Type* t = localType(e->ident);
+                if (!t || t->kind != kind) return fail("'" + e->ident.str() + "' is not a scalar local");
+                used.push_back(e->ident);
+                addInvariant(e);
+                return true;
+            }
+            case Expr::Kind::Binary:
+                if (e->op != Expr::Op::Add && e->op != Expr::Op::Sub && e->op != Expr::Op::Mul &&
+                    !(e->op == Expr::Op::Div && kind == Type::Kind::Float))
+                    return fail("the loop uses an operator without a packed form");
+                return value(e->left.get(), kind) && value(e->right.get(), kind);
+            default:
+                return fail("the loop body reads something other than the current elements and invariants");
+        }
+    }
+};
+
+} // namespace
+
+int VectorLoop::invariantIndex(const Expr* e) const {
+    for (size_t i = 0; i < invariants.size(); i++)
+        if (sameLeaf(invariants[i], e)) return (int)i;
+    return -1;
+}
+
+Symbol elementPointer(const Expr* e, Symbol counter) {
+    const Expr* base = nullptr;
+    const Expr* index = nullptr;
+    if (e->kind == Expr::Kind::Index) {
+        base = e->left.get();
+        index = e->right.get();
+    } else if (e->kind == Expr::Kind::Deref && e->right->kind == Expr::Kind::Binary &&
+               e->right->op == Expr::Op::Add) {
+        base = e->right->left.get();
+        index = e->right->right.get();
+    }
+    if (!base || base->kind != Expr::Kind::Var || index->kind != Expr::Kind::Var || index->ident != counter)
+        return Symbol();
+    return base->ident;
+}
+
+bool analyzeVectorLoop(const Stmt* loop, const FuncSymbol& fs, VectorLoop& plan, std::string& whyNot) {
+    plan = VectorLoop();
+    Checker c{fs, plan, whyNot, {}};
+    const Expr* cond = loop->condition.get();
+    if (!cond || cond->kind != Expr::Kind::Binary || cond->op != Expr::Op::Lt || cond->left->kind != Expr::Kind::Var)
+        return c.fail("the loop condition is not 'i < n'");
+    plan.counter = cond->left->ident;
+    const Type* counterType = c.localType(plan.counter);
+    if (!counterType || counterType->kind != Type::Kind::Int) return c.fail("the loop counter is not an int local");
+    c.used.push_back(plan.counter);
+
+    const Expr* bound = cond->right.get();
+    if (bound->kind == Expr::Kind::Var && bound->ident != plan.counter) {
+        const Type* t = c.localType(bound->ident);
+        if (!t || t->kind != Type::Kind::Int) return c.fail("the loop bound is not an int local");
+        c.used.push_back(bound->ident);
+    } else if (bound->kind != Expr::Kind::IntLit) {
+        return c.fail("the loop bound is not a literal or a local");
+    }
+    plan.bound = bound;
+
+    std::vector<const Stmt*> body;
+    const Stmt* b = loop->body.get();
+    if (b && b->kind == Stmt::Kind::Block) {
+        for (const auto& s : b->blockStmts) body.push_back(s.get());
+    } else if (b) {
+        body.push_back(b);
+    }
+    if (loop->kind == Stmt::Kind::For) {
+        if (!isIncrement(loop->stepStmt.get(), plan.counter)) return c.fail("the loop does not step by 'i = i + 1'");
+    } else {
+        if (body.empty() || !isIncrement(body.back(), plan.counter))
+            return c.fail("the loop does not end with 'i = i + 1'");
+        body.pop_back();
+    }
+
+    for (const Stmt* s : body) {
+        if (s->kind != Stmt::Kind::Assign) return c.fail("the loop body has a statement other than an element store");
+        Symbol p = elementPointer(s->assignTarget.get(), plan.counter);
+        if (p.empty()) return c.fail("the loop body stores to something other than p[i]");
+        Type::Kind kind;
+        if (!c.elementPointerOk(p, kind) || !c.value(s->assignValue.get(), kind)) return false;
+        if (std::find(plan.written.begin(), plan.written.end(), p) == plan.written.end()) plan.written.push_back(p);
+        plan.stores.push_back(s);
+    }
+    if (plan.stores.empty()) return c.fail("the loop stores nothing");
+
+    // A store through a pointer to one of these locals would change it
+    // behind the vector code's back.
+    std::unordered_set<Symbol> addressTaken;
+    if (fs.decl) collectAddressTaken(fs.decl->body.get(), addressTaken);
+    for (Symbol s : c.used)
+        if (addressTaken.count(s)) return c.fail("the address of '" + s.str() + "' is taken");
+    return true;
+}
+
+} // namespace gspp
@@ -0,0 +1,41 @@
+#ifndef GSPP_VECTORIZE_H
+#define GSPP_VECTORIZE_H
+
+#include "ast.h"
+#include "semantic.h"
+#include <string>
+#include <vector>
+
+namespace gspp {
+
+// A counted loop
+//     while (i < n) { p[i] = e; ...; i = i + 1; }
+// (or the equivalent for loop) whose body only stores, through *int or
+// *float pointers, expressions built from the current elements q[i],
+// loop-invariant scalars, literals and i itself with + - * (and / on
+// floats). Such a loop has no dependence from one iteration to the next
+// unless two of its pointers overlap by less than a vector, which the
+// generated code checks at run time.
+struct VectorLoop {
+    Symbol counter;
+    const Expr* bound = nullptr;           // IntLit or invariant local
+    std::vector<const Stmt*> stores;       // element assignments, in order
+    std::vector<Symbol> pointers;          // every pointer stored or loaded through
+    std::vector<Symbol> written;           // the ones stored through
+    std::vector<const Expr*> invariants;   // distinct literal and scalar leaves
+    bool usesCounter = false;              // i appears as a value
+
+    // Index of leaf e in invariants, or -1.
+    int invariantIndex(const Expr* e) const;
+};
+
+// The pointer p when e is p[i] or *(p + i) for the counter i; else empty.
+Symbol elementPointer(const Expr* e, Symbol counter);
+
+// Fills plan when loop (a While or For statement of fs) has the shape above;
+// otherwise says why not.
+bool analyzeVectorLoop(const Stmt* loop, const FuncSymbol& fs, VectorLoop& plan, std::string& whyNot);
+
+} // namespace gspp
+
+#endif